@@ -0,0 +1,228 @@
+// alloc_test.c
+// Host check that the clients' send path does not touch the heap.
+//
+// Runs the shared client code (telemetry_record.c, sample_queue.c,
+// qos_window.c, backlog_ring.c, backlog_policy.c, mqtt_outbox.c) through the
+// same steps as cli_esp.c/cli_pico.c: build a reading, pass it through the
+// sample queue, send it through the QoS window as JSON, ACK it, queue it for
+// MQTT, log failures to the backlog ring (summarizing the oldest when it is
+// full) and drain summaries and readings. malloc/calloc/realloc are
+// wrapped at link time (-Wl,--wrap), so every allocation made by that code
+// is counted. Exits non-zero if any happen.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qos_window.h"
+#include "backlog_ring.h"
+#include "telemetry_record.h"
+#include "sample_queue.h"
+#include "mqtt_outbox.h"
+#include "backlog_policy.h"
+
+#define ITERATIONS 10000
+#define RING_CAPACITY 256
+#define SUMMARY_CAPACITY 16
+#define OUTAGE_EVERY 1024 // The first half of every such block gets no ACKs
+#define BATCH_MAX (QOS_PAYLOAD_MAX / TELEMETRY_RECORD_SIZE)
+
+static const char *device_id = "ESP32_Device_01";
+static const uint32_t boot_id = 3735928559u; // A 10-digit boot id, as the sketches send
+static unsigned long allocations;
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n)
+{
+    allocations++;
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    allocations++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n)
+{
+    allocations++;
+    return __real_realloc(p, n);
+}
+
+// In-memory ring files (io ctx: the ring's mem_files_t)
+typedef struct
+{
+    uint8_t *data;
+    size_t data_len;
+    uint8_t cursor[64];
+} mem_files_t;
+
+static uint8_t ring_data[RING_CAPACITY * TELEMETRY_RECORD_SIZE];
+static uint8_t summary_data[SUMMARY_CAPACITY * TELEMETRY_SUMMARY_SIZE];
+static mem_files_t ring_files = {ring_data, sizeof(ring_data)};
+static mem_files_t summary_files = {summary_data, sizeof(summary_data)};
+
+static uint8_t *ring_file(mem_files_t *m, int file, uint32_t off, size_t len)
+{
+    if (file == RING_FILE_DATA && off + len <= m->data_len)
+        return m->data + off;
+    if (file == RING_FILE_CURSOR && off + len <= sizeof(m->cursor))
+        return m->cursor + off;
+    return NULL;
+}
+
+static int mem_read(void *ctx, int file, uint32_t off, void *buf, size_t len)
+{
+    uint8_t *p = ring_file(ctx, file, off, len);
+    if (!p)
+        return -1;
+    memcpy(buf, p, len);
+    return 0;
+}
+
+static int mem_write(void *ctx, int file, uint32_t off, const void *buf, size_t len)
+{
+    uint8_t *p = ring_file(ctx, file, off, len);
+    if (!p)
+        return -1;
+    memcpy(p, buf, len);
+    return 0;
+}
+
+static backlog_ring_t ring;
+static backlog_ring_t summaries;
+static backlog_policy_t policy;
+static sample_queue_t samples;
+static mqtt_outbox_t outbox;
+static char wire[TELEMETRY_BATCH_JSON_MAX];
+static int wire_len;
+
+// Encodes the slot like udpSend() in the sketches; the "link" keeps the last datagram
+static int encode_send(void *ctx, const char *buf, size_t len)
+{
+    telemetry_record_t recs[BATCH_MAX];
+    telemetry_summary_t summary;
+    int count = (int)(len / TELEMETRY_RECORD_SIZE);
+    int used = 0;
+
+    if (telemetry_summary_unpack((const uint8_t *)buf, len, &summary) == 0)
+    {
+        wire_len = telemetry_summary_to_json(&summary, device_id, boot_id, wire, sizeof(wire));
+        return wire_len < 0 ? -1 : 0;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        if (telemetry_record_unpack((const uint8_t *)buf + i * TELEMETRY_RECORD_SIZE, &recs[i]) != 0)
+            return -1;
+    }
+    if (count == 1)
+        wire_len = telemetry_record_to_json(&recs[0], device_id, boot_id, wire, sizeof(wire));
+    else
+        wire_len = telemetry_batch_to_json(recs, count, device_id, boot_id, wire, sizeof(wire), &used);
+    return wire_len < 0 ? -1 : 0;
+}
+
+// Failed live readings go to the ring, as in onQoSDone() and logDataToFile()
+static void log_failed(void *ctx, uint32_t seq, int delivered, const char *buf, size_t len)
+{
+    if (!delivered && len == TELEMETRY_RECORD_SIZE && backlog_policy_make_room(&policy) >= 0)
+        ring_push(&ring, buf);
+}
+
+// Server side of the exchange: ACK the seq named in the last datagram
+static void ack_last(qos_window_t *w, uint32_t seq, uint32_t now)
+{
+    char ack[96];
+    uint32_t acked;
+    int n = snprintf(ack, sizeof(ack), "{\"type\":\"ACK\",\"id\":\"%s\",\"seq\":%lu}", device_id, (unsigned long)seq);
+    if (qos_parse_ack(ack, (size_t)n, device_id, &acked))
+        qos_window_on_ack(w, acked, now);
+}
+
+static void run(qos_window_t *w, uint32_t iterations, uint32_t *now)
+{
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        telemetry_record_t rec;
+        uint8_t packed[BATCH_MAX * TELEMETRY_RECORD_SIZE];
+
+        // Live reading: every fourth one (all of them during an outage) is
+        // never ACKed and ends up in the ring
+        int outage = i % OUTAGE_EVERY < OUTAGE_EVERY / 2;
+        telemetry_record_set(&rec, i, *now, 21.5f + (i % 7) * 0.3f, 45.0f, 1);
+        if (sample_queue_push(&samples, &rec) != 0 || sample_queue_pop(&samples, &rec) != 0)
+            continue;
+        telemetry_record_pack(&rec, packed);
+        qos_window_send(w, rec.seq, (const char *)packed, TELEMETRY_RECORD_SIZE, *now);
+        if (i % 4 != 0 && !outage)
+            ack_last(w, rec.seq, *now + 20);
+
+        // MQTT outbox: published (encoded) every other reading, so it fills and drops
+        mqtt_outbox_push(&outbox, &rec);
+        if (i % 2 == 0 && mqtt_outbox_peek(&outbox, &rec) == 0 &&
+            telemetry_record_to_json(&rec, device_id, 0, wire, sizeof(wire)) > 0)
+            mqtt_outbox_pop(&outbox);
+        *now += 1000;
+        qos_window_poll(w, *now);
+
+        if (outage)
+            continue;
+
+        // Summary drain: the oldest summary, ACKed and popped
+        telemetry_summary_t s;
+        if (ring_count(&summaries) > 0 && ring_read(&summaries, summaries.head, packed) == 0 &&
+            telemetry_summary_unpack(packed, TELEMETRY_SUMMARY_SIZE, &s) == 0 &&
+            qos_window_send(w, s.first_seq, (const char *)packed, TELEMETRY_SUMMARY_SIZE, *now) == 0)
+        {
+            ack_last(w, s.first_seq, *now + 20);
+            ring_pop(&summaries, 1);
+        }
+
+        // Backlog drain: one batch from the head, ACKed and popped
+        uint32_t n = ring_count(&ring) < BATCH_MAX ? ring_count(&ring) : BATCH_MAX;
+        telemetry_record_t first;
+        for (uint32_t k = 0; k < n; ++k)
+            ring_read(&ring, ring.head + k, packed + k * TELEMETRY_RECORD_SIZE);
+        if (n >= BATCH_MAX / 2 && telemetry_record_unpack(packed, &first) == 0 &&
+            qos_window_send(w, first.seq, (const char *)packed, n * TELEMETRY_RECORD_SIZE, *now) == 0)
+        {
+            ack_last(w, first.seq, *now + 20);
+            ring_pop(&ring, n);
+        }
+    }
+}
+
+int main(void)
+{
+    qos_window_t w;
+    ring_io_t io = {mem_read, mem_write, &ring_files};
+    ring_io_t summary_io = {mem_read, mem_write, &summary_files};
+    uint32_t now = 0;
+
+    if (ring_open(&ring, &io, RING_CAPACITY, TELEMETRY_RECORD_SIZE) != 0 ||
+        ring_open(&summaries, &summary_io, SUMMARY_CAPACITY, TELEMETRY_SUMMARY_SIZE) != 0)
+    {
+        fprintf(stderr, "ring_open failed\n");
+        return 1;
+    }
+    backlog_policy_init(&policy, &ring, &summaries, 16);
+    qos_window_init(&w, 8, 800, 1, encode_send, log_failed, NULL);
+    sample_queue_init(&samples);
+    mqtt_outbox_init(&outbox, 5000, 300000);
+
+    // Warm-up pass (the C library may allocate lazily on first use)
+    run(&w, 16, &now);
+    allocations = 0;
+    run(&w, ITERATIONS, &now);
+
+    printf("iterations=%d allocations=%lu sent=%u acked=%u failed=%u backlog=%u summarized=%u\n",
+           ITERATIONS, allocations, w.sent, w.acked, w.failed, ring_count(&ring), policy.summarized);
+    if (w.acked == 0 || w.failed == 0 || policy.summarized == 0)
+    {
+        fprintf(stderr, "send path not exercised\n");
+        return 1;
+    }
+    return allocations == 0 ? 0 : 1;
+}
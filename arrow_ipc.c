@@ -0,0 +1,431 @@
+// arrow_ipc.c
+// Minimal Arrow IPC stream writer. See arrow_ipc.h.
+//
+// Messages are encapsulated as: 0xFFFFFFFF, int32 metadata length, a
+// flatbuffer-encoded Message (padded to 8 bytes), then the message body.
+// The flatbuffers are built front to back by a tiny builder below: every
+// table is preceded by its vtable and followed by the objects it references,
+// so all uoffsets point forward as the format requires.
+#include <stdlib.h>
+#include <string.h>
+#include "arrow_ipc.h"
+
+// Message.fbs / Schema.fbs constants
+#define METADATA_V5 4
+#define HEADER_SCHEMA 1
+#define HEADER_DICTIONARY_BATCH 2
+#define HEADER_RECORD_BATCH 3
+#define TYPE_INT 2
+#define TYPE_FLOATING_POINT 3
+#define TYPE_UTF8 5
+#define TYPE_TIMESTAMP 10
+#define PRECISION_DOUBLE 2
+#define TIMEUNIT_SECOND 0
+
+#define MAX_FIELDS 16
+#define MAX_BUFFERS (3 * MAX_FIELDS)
+
+typedef struct
+{
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    int err;
+} fb_t;
+
+// A table field: size is 1, 2, 4 or 8 for scalars, 0 for an offset to
+// another object (patched with fb_link once the object is written).
+typedef struct
+{
+    int id;
+    int size;
+    uint64_t value;
+} fb_field_t;
+
+static void fb_put(fb_t *b, const void *p, size_t n)
+{
+    if (b->err)
+        return;
+    if (b->len + n > b->cap)
+    {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + n)
+            cap *= 2;
+        uint8_t *nb = realloc(b->buf, cap);
+        if (!nb)
+        {
+            b->err = 1;
+            return;
+        }
+        b->buf = nb;
+        b->cap = cap;
+    }
+    if (p)
+        memcpy(b->buf + b->len, p, n);
+    else
+        memset(b->buf + b->len, 0, n);
+    b->len += n;
+}
+
+static void fb_pad(fb_t *b, size_t align)
+{
+    while (!b->err && b->len % align)
+        fb_put(b, NULL, 1);
+}
+
+static void fb_u32(fb_t *b, uint32_t v)
+{
+    fb_put(b, &v, sizeof(v));
+}
+
+// Points the uoffset at field_pos to the object at target
+static void fb_link(fb_t *b, size_t field_pos, size_t target)
+{
+    if (b->err)
+        return;
+    uint32_t rel = (uint32_t)(target - field_pos);
+    memcpy(b->buf + field_pos, &rel, sizeof(rel));
+}
+
+// Writes a vtable followed by its table. pos[i] receives the absolute
+// position of fields[i] so offset fields can be linked later.
+static size_t fb_table(fb_t *b, const fb_field_t *fields, int n, size_t *pos)
+{
+    uint16_t voff[MAX_FIELDS] = {0};
+    size_t foff[MAX_FIELDS];
+    int nslots = 0;
+    size_t off = 4; // soffset to the vtable
+
+    for (int i = 0; i < n; ++i)
+    {
+        size_t size = fields[i].size ? (size_t)fields[i].size : 4;
+        off = (off + size - 1) / size * size;
+        foff[i] = off;
+        voff[fields[i].id] = (uint16_t)off;
+        off += size;
+        if (fields[i].id + 1 > nslots)
+            nslots = fields[i].id + 1;
+    }
+
+    fb_pad(b, 2);
+    size_t vt = b->len;
+    uint16_t hdr[2] = {(uint16_t)(4 + 2 * nslots), (uint16_t)off};
+    fb_put(b, hdr, sizeof(hdr));
+    fb_put(b, voff, 2 * (size_t)nslots);
+
+    // Tables start 8-aligned so every scalar is naturally aligned
+    fb_pad(b, 8);
+    size_t t = b->len;
+    fb_put(b, NULL, off);
+    if (b->err)
+        return 0;
+
+    int32_t soff = (int32_t)(t - vt);
+    memcpy(b->buf + t, &soff, sizeof(soff));
+    for (int i = 0; i < n; ++i)
+    {
+        if (fields[i].size)
+            memcpy(b->buf + t + foff[i], &fields[i].value, (size_t)fields[i].size); // Little-endian host
+        if (pos)
+            pos[i] = t + foff[i];
+    }
+    return t;
+}
+
+static size_t fb_string(fb_t *b, const char *s)
+{
+    size_t n = strlen(s);
+    fb_pad(b, 4);
+    size_t p = b->len;
+    fb_u32(b, (uint32_t)n);
+    fb_put(b, s, n);
+    fb_put(b, NULL, 1);
+    return p;
+}
+
+// Vector of n uoffsets; element i lives at returned position + 4 + 4 * i
+static size_t fb_offset_vector(fb_t *b, int n)
+{
+    fb_pad(b, 4);
+    size_t p = b->len;
+    fb_u32(b, (uint32_t)n);
+    fb_put(b, NULL, 4 * (size_t)n);
+    return p;
+}
+
+// Vector of 16-byte structs of two int64 (FieldNode, Buffer)
+static size_t fb_pair_vector(fb_t *b, const int64_t *pairs, int n)
+{
+    while (!b->err && b->len % 8 != 4)
+        fb_put(b, NULL, 1); // Struct data after the length must be 8-aligned
+    size_t p = b->len;
+    fb_u32(b, (uint32_t)n);
+    fb_put(b, pairs, 16 * (size_t)n);
+    return p;
+}
+
+// Message table wrapping a header; returns the position of the header offset
+static size_t fb_message(fb_t *b, int header_type, int64_t body_len)
+{
+    fb_u32(b, 0); // Root uoffset, patched below
+    fb_field_t f[] = {
+        {0, 2, METADATA_V5},
+        {1, 1, (uint64_t)header_type},
+        {2, 0, 0},
+        {3, 8, (uint64_t)body_len},
+    };
+    size_t pos[4];
+    size_t t = fb_table(b, f, 4, pos);
+    fb_link(b, 0, t);
+    return pos[2];
+}
+
+static size_t fb_int_type(fb_t *b, int bit_width)
+{
+    fb_field_t f[] = {{0, 4, (uint64_t)bit_width}, {1, 1, 1}};
+    return fb_table(b, f, 2, NULL);
+}
+
+static size_t fb_field(fb_t *b, const arrow_field_t *af)
+{
+    int type_type;
+    switch (af->type)
+    {
+    case ARROW_INT64:
+        type_type = TYPE_INT;
+        break;
+    case ARROW_FLOAT64:
+        type_type = TYPE_FLOATING_POINT;
+        break;
+    case ARROW_TIMESTAMP_SEC:
+        type_type = TYPE_TIMESTAMP;
+        break;
+    default:
+        type_type = TYPE_UTF8; // Dictionary fields carry the value type
+        break;
+    }
+
+    fb_field_t f[6] = {
+        {0, 0, 0},                   // name
+        {1, 1, 0},                   // nullable = false
+        {2, 1, (uint64_t)type_type}, // type_type
+        {3, 0, 0},                   // type
+        {5, 0, 0},                   // children
+        {4, 0, 0},                   // dictionary
+    };
+    int n = af->type == ARROW_DICT_UTF8 ? 6 : 5;
+    size_t pos[6];
+    size_t table = fb_table(b, f, n, pos);
+
+    fb_link(b, pos[0], fb_string(b, af->name));
+
+    size_t type_pos;
+    if (af->type == ARROW_INT64)
+    {
+        type_pos = fb_int_type(b, 64);
+    }
+    else if (af->type == ARROW_FLOAT64)
+    {
+        fb_field_t t[] = {{0, 2, PRECISION_DOUBLE}};
+        type_pos = fb_table(b, t, 1, NULL);
+    }
+    else if (af->type == ARROW_TIMESTAMP_SEC)
+    {
+        fb_field_t t[] = {{0, 2, TIMEUNIT_SECOND}, {1, 0, 0}};
+        size_t tpos[2];
+        type_pos = fb_table(b, t, 2, tpos);
+        fb_link(b, tpos[1], fb_string(b, "UTC"));
+    }
+    else
+    {
+        type_pos = fb_table(b, NULL, 0, NULL); // Utf8 {}
+    }
+    fb_link(b, pos[3], type_pos);
+
+    fb_link(b, pos[4], fb_offset_vector(b, 0));
+
+    if (af->type == ARROW_DICT_UTF8)
+    {
+        fb_field_t d[] = {{0, 8, (uint64_t)af->dict_id}, {1, 0, 0}};
+        size_t dpos[2];
+        size_t dt = fb_table(b, d, 2, dpos);
+        fb_link(b, dpos[1], fb_int_type(b, 32));
+        fb_link(b, pos[5], dt);
+    }
+    return table;
+}
+
+typedef struct
+{
+    const void *p;
+    int64_t len;
+} body_buf_t;
+
+// Writes one encapsulated message: prefix, metadata, body buffers
+static int write_message(FILE *f, fb_t *b, const body_buf_t *bufs, int nbufs)
+{
+    static const uint8_t zeros[8] = {0};
+
+    fb_pad(b, 8);
+    if (b->err)
+        return -1;
+
+    uint32_t prefix[2] = {0xFFFFFFFFu, (uint32_t)b->len};
+    if (fwrite(prefix, sizeof(prefix), 1, f) != 1 || fwrite(b->buf, b->len, 1, f) != 1)
+        return -1;
+
+    for (int i = 0; i < nbufs; ++i)
+    {
+        if (bufs[i].len && fwrite(bufs[i].p, (size_t)bufs[i].len, 1, f) != 1)
+            return -1;
+        size_t pad = (size_t)((8 - bufs[i].len % 8) % 8);
+        if (pad && fwrite(zeros, pad, 1, f) != 1)
+            return -1;
+    }
+    return 0;
+}
+
+// Lays out the body buffers of a record batch and writes the RecordBatch
+// table. Returns the table position.
+static size_t fb_record_batch(fb_t *b, int64_t nrows, const int64_t *nodes, int nnodes,
+                              const body_buf_t *bufs, int nbufs)
+{
+    int64_t layout[2 * MAX_BUFFERS];
+    int64_t off = 0;
+    for (int i = 0; i < nbufs; ++i)
+    {
+        layout[2 * i] = off;
+        layout[2 * i + 1] = bufs[i].len;
+        off += (bufs[i].len + 7) / 8 * 8;
+    }
+
+    fb_field_t f[] = {{0, 8, (uint64_t)nrows}, {1, 0, 0}, {2, 0, 0}};
+    size_t pos[3];
+    size_t t = fb_table(b, f, 3, pos);
+    fb_link(b, pos[1], fb_pair_vector(b, nodes, nnodes));
+    fb_link(b, pos[2], fb_pair_vector(b, layout, nbufs));
+    return t;
+}
+
+static int64_t body_length(const body_buf_t *bufs, int nbufs)
+{
+    int64_t total = 0;
+    for (int i = 0; i < nbufs; ++i)
+        total += (bufs[i].len + 7) / 8 * 8;
+    return total;
+}
+
+int arrow_write_schema(FILE *f, const arrow_field_t *fields, int nfields)
+{
+    if (nfields > MAX_FIELDS)
+        return -1;
+
+    fb_t b = {0};
+    size_t header = fb_message(&b, HEADER_SCHEMA, 0);
+
+    fb_field_t s[] = {{1, 0, 0}};
+    size_t spos[1];
+    fb_link(&b, header, fb_table(&b, s, 1, spos));
+
+    size_t vec = fb_offset_vector(&b, nfields);
+    fb_link(&b, spos[0], vec);
+    for (int i = 0; i < nfields; ++i)
+        fb_link(&b, vec + 4 + 4 * (size_t)i, fb_field(&b, &fields[i]));
+
+    int rc = write_message(f, &b, NULL, 0);
+    free(b.buf);
+    return rc;
+}
+
+int arrow_write_dictionary(FILE *f, int64_t dict_id, const char *const *values, int nvalues)
+{
+    int32_t *offsets = malloc(((size_t)nvalues + 1) * sizeof(*offsets));
+    if (!offsets)
+        return -1;
+
+    size_t total = 0;
+    for (int i = 0; i < nvalues; ++i)
+        total += strlen(values[i]);
+    char *data = malloc(total ? total : 1);
+    if (!data)
+    {
+        free(offsets);
+        return -1;
+    }
+
+    offsets[0] = 0;
+    for (int i = 0; i < nvalues; ++i)
+    {
+        size_t n = strlen(values[i]);
+        memcpy(data + offsets[i], values[i], n);
+        offsets[i + 1] = offsets[i] + (int32_t)n;
+    }
+
+    body_buf_t bufs[3] = {
+        {NULL, 0},
+        {offsets, ((int64_t)nvalues + 1) * 4},
+        {data, (int64_t)total},
+    };
+    int64_t nodes[2] = {nvalues, 0};
+
+    fb_t b = {0};
+    size_t header = fb_message(&b, HEADER_DICTIONARY_BATCH, body_length(bufs, 3));
+    fb_field_t d[] = {{0, 8, (uint64_t)dict_id}, {1, 0, 0}};
+    size_t dpos[2];
+    fb_link(&b, header, fb_table(&b, d, 2, dpos));
+    fb_link(&b, dpos[1], fb_record_batch(&b, nvalues, nodes, 1, bufs, 3));
+
+    int rc = write_message(f, &b, bufs, 3);
+    free(b.buf);
+    free(offsets);
+    free(data);
+    return rc;
+}
+
+int arrow_write_batch(FILE *f, const arrow_field_t *fields, const arrow_column_t *cols,
+                      int nfields, int64_t nrows)
+{
+    if (nfields > MAX_FIELDS)
+        return -1;
+
+    body_buf_t bufs[MAX_BUFFERS];
+    int64_t nodes[2 * MAX_FIELDS];
+    int nbufs = 0;
+
+    for (int i = 0; i < nfields; ++i)
+    {
+        nodes[2 * i] = nrows;
+        nodes[2 * i + 1] = 0; // null_count
+        bufs[nbufs++] = (body_buf_t){NULL, 0}; // No validity bitmap
+
+        switch (fields[i].type)
+        {
+        case ARROW_DICT_UTF8:
+            bufs[nbufs++] = (body_buf_t){cols[i].values, nrows * 4};
+            break;
+        case ARROW_UTF8:
+            bufs[nbufs++] = (body_buf_t){cols[i].offsets, (nrows + 1) * 4};
+            bufs[nbufs++] = (body_buf_t){cols[i].data, nrows ? cols[i].offsets[nrows] : 0};
+            break;
+        case ARROW_INT64:
+        case ARROW_FLOAT64:
+        case ARROW_TIMESTAMP_SEC:
+            bufs[nbufs++] = (body_buf_t){cols[i].values, nrows * 8};
+            break;
+        }
+    }
+
+    fb_t b = {0};
+    size_t header = fb_message(&b, HEADER_RECORD_BATCH, body_length(bufs, nbufs));
+    fb_link(&b, header, fb_record_batch(&b, nrows, nodes, nfields, bufs, nbufs));
+
+    int rc = write_message(f, &b, bufs, nbufs);
+    free(b.buf);
+    return rc;
+}
+
+int arrow_write_eos(FILE *f)
+{
+    uint32_t eos[2] = {0xFFFFFFFFu, 0};
+    return fwrite(eos, sizeof(eos), 1, f) == 1 ? 0 : -1;
+}
@@ -0,0 +1,53 @@
+// arrow_ipc.h
+// Minimal Apache Arrow IPC *stream* writer (no libarrow dependency).
+//
+// Supports the handful of column types the telemetry exports need:
+// dictionary-encoded strings (int32 indices), UTF-8 strings, 64-bit integers
+// and floats, and second-resolution timestamps. All columns are written as
+// non-nullable.
+// The output can be read with pyarrow.ipc.open_stream() or any Arrow reader.
+#ifndef ARROW_IPC_H
+#define ARROW_IPC_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum
+{
+    ARROW_DICT_UTF8,     // int32 indices into a string dictionary
+    ARROW_UTF8,          // int32 offsets + character data
+    ARROW_INT64,
+    ARROW_FLOAT64,
+    ARROW_TIMESTAMP_SEC, // int64 seconds since the epoch, UTC
+} arrow_type_t;
+
+typedef struct
+{
+    const char *name;
+    arrow_type_t type;
+    int64_t dict_id; // Only for ARROW_DICT_UTF8
+} arrow_field_t;
+
+// Column data for one record batch. Fixed-width types use values; ARROW_UTF8
+// uses offsets (nrows + 1 entries) and data.
+typedef struct
+{
+    const void *values;
+    const int32_t *offsets;
+    const char *data;
+} arrow_column_t;
+
+// Writes the schema message that must start every stream
+int arrow_write_schema(FILE *f, const arrow_field_t *fields, int nfields);
+
+// Writes the dictionary batch for a dictionary-encoded field. Must come after
+// the schema and before the first record batch that references it.
+int arrow_write_dictionary(FILE *f, int64_t dict_id, const char *const *values, int nvalues);
+
+int arrow_write_batch(FILE *f, const arrow_field_t *fields, const arrow_column_t *cols,
+                      int nfields, int64_t nrows);
+
+// Writes the end-of-stream marker
+int arrow_write_eos(FILE *f);
+
+#endif
@@ -0,0 +1,112 @@
+// backlog_policy.c
+// Backlog summarization. See backlog_policy.h.
+#include <string.h>
+#include "backlog_policy.h"
+#include "telemetry_record.h"
+
+void backlog_policy_init(backlog_policy_t *p, backlog_ring_t *readings, backlog_ring_t *summaries, uint32_t group)
+{
+    memset(p, 0, sizeof(*p));
+    p->readings = readings;
+    p->summaries = summaries;
+    p->group = group < 2 ? 2 : group;
+}
+
+static int read_summary(backlog_ring_t *r, uint32_t pos, telemetry_summary_t *s)
+{
+    uint8_t buf[TELEMETRY_SUMMARY_SIZE];
+    return ring_read(r, pos, buf) == 0 ? telemetry_summary_unpack(buf, sizeof(buf), s) : -1;
+}
+
+// Rewrites the summary ring as at most about half as many summaries of
+// similar reading counts, oldest first. Neighbours are merged while the
+// result stays within four times the average count: any two consecutive
+// outputs then hold more than that, so there are at most n/2 + 1 of them.
+// Each output is appended before its inputs are popped, so the ring needs
+// one free slot (make_room rebuilds it one short of full).
+static int halve_summaries(backlog_policy_t *p)
+{
+    backlog_ring_t *r = p->summaries;
+    uint32_t n = ring_count(r);
+    uint64_t total = 0;
+    telemetry_summary_t cur, next;
+    uint8_t buf[TELEMETRY_SUMMARY_SIZE];
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (read_summary(r, r->head + i, &next) == 0)
+            total += next.count;
+    }
+    uint64_t target = 4 * total / (n ? n : 1);
+
+    uint32_t taken = 0;
+    while (n > 0)
+    {
+        // Inputs of one output: [head, head + taken)
+        int have = 0;
+        for (taken = 0; taken < n; ++taken)
+        {
+            if (read_summary(r, r->head + taken, &next) != 0)
+            {
+                p->unreadable++;
+                continue;
+            }
+            if (have && cur.count + (uint64_t)next.count > target)
+                break;
+            if (have)
+                telemetry_summary_merge(&cur, &next);
+            else
+                cur = next;
+            have = 1;
+        }
+        if (have)
+        {
+            telemetry_summary_pack(&cur, buf);
+            if (ring_push(r, buf) != 0)
+                return -1;
+        }
+        if (ring_pop(r, taken) != 0)
+            return -1;
+        n -= taken;
+    }
+    p->halvings++;
+    return 0;
+}
+
+int backlog_policy_make_room(backlog_policy_t *p)
+{
+    backlog_ring_t *r = p->readings;
+    if (ring_count(r) < r->capacity)
+        return 0;
+
+    uint32_t n = p->group < ring_count(r) ? p->group : ring_count(r);
+    uint8_t buf[TELEMETRY_SUMMARY_SIZE];
+    telemetry_summary_t s;
+    telemetry_record_t rec;
+    int have = 0;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (ring_read(r, r->head + i, buf) != 0 || telemetry_record_unpack(buf, &rec) != 0)
+        {
+            p->unreadable++;
+            continue;
+        }
+        if (have)
+            telemetry_summary_add(&s, &rec);
+        else
+            telemetry_summary_init(&s, &rec);
+        have = 1;
+    }
+
+    if (have)
+    {
+        if (ring_count(p->summaries) + 1 >= p->summaries->capacity && halve_summaries(p) != 0)
+            return -1;
+        telemetry_summary_pack(&s, buf);
+        if (ring_push(p->summaries, buf) != 0)
+            return -1;
+        p->summarized += s.count;
+    }
+    return ring_pop(r, n) == 0 ? (int)n : -1;
+}
@@ -0,0 +1,49 @@
+// backlog_policy.h
+// Keeps the client backlog within its flash budget at reduced resolution.
+//
+// Readings are kept in one backlog ring (telemetry_record_t) and summaries
+// in a second, smaller one (telemetry_summary_t). When the reading ring is
+// full, its `group` oldest readings are folded into one min/max/mean/count
+// summary instead of overwriting the oldest one. When the summary ring is
+// full in turn, neighbouring summaries are merged into about half as many
+// of similar size, halving the resolution of everything summarized so far.
+// The two rings therefore always cover the whole outage: the newest
+// readings at full resolution, older ones in summaries that get coarser the
+// longer it lasts.
+//
+// Every step appends the new summary before popping what it replaces, so a
+// reset in between duplicates a few readings on the server instead of
+// losing them.
+#ifndef BACKLOG_POLICY_H
+#define BACKLOG_POLICY_H
+
+#include <stdint.h>
+#include "backlog_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    backlog_ring_t *readings;  // TELEMETRY_RECORD_SIZE records, oldest first
+    backlog_ring_t *summaries; // TELEMETRY_SUMMARY_SIZE records, oldest first
+    uint32_t group;            // Readings folded into one summary
+    uint32_t summarized;       // Readings folded into summaries so far
+    uint32_t halvings;         // Times the summary ring was rebuilt at half the resolution
+    uint32_t unreadable;       // Torn or worn records skipped while folding
+} backlog_policy_t;
+
+void backlog_policy_init(backlog_policy_t *p, backlog_ring_t *readings, backlog_ring_t *summaries, uint32_t group);
+
+// Makes room for one more reading. Does nothing unless the reading ring is
+// full. Returns the number of readings popped from it (0 if none), or -1 on
+// a storage error. Records popped are gone: a caller draining the reading
+// ring must restart from its head.
+int backlog_policy_make_room(backlog_policy_t *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
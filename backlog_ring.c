@@ -0,0 +1,132 @@
+// backlog_ring.c
+// Fixed-size circular backlog store. See backlog_ring.h.
+#include <string.h>
+#include "backlog_ring.h"
+
+#define RING_CURSOR_MAGIC 0x52435552u // "RCUR"
+#define RING_CURSOR_STRIDE 32         // Offset between the two cursor copies
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t gen;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t capacity;
+    uint32_t record_size;
+    uint32_t crc; // Over the fields above
+} ring_cursor_t;
+
+// Bitwise CRC-32 (IEEE): no table, the cursor is tiny
+static uint32_t crc32_small(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--)
+    {
+        crc ^= *p++;
+        for (int k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static int load_cursor(backlog_ring_t *r, int copy, ring_cursor_t *c)
+{
+    if (r->io.read(r->io.ctx, RING_FILE_CURSOR, (uint32_t)copy * RING_CURSOR_STRIDE, c, sizeof(*c)) != 0)
+        return -1;
+    if (c->magic != RING_CURSOR_MAGIC || c->crc != crc32_small(c, offsetof(ring_cursor_t, crc)))
+        return -1;
+    if (c->capacity != r->capacity || c->record_size != r->record_size || c->tail - c->head > c->capacity)
+        return -1;
+    return 0;
+}
+
+// Writes head/tail to the copy not holding the current generation
+static int store_cursor(backlog_ring_t *r, uint32_t head, uint32_t tail)
+{
+    ring_cursor_t c;
+    c.magic = RING_CURSOR_MAGIC;
+    c.gen = r->gen + 1;
+    c.head = head;
+    c.tail = tail;
+    c.capacity = r->capacity;
+    c.record_size = r->record_size;
+    c.crc = crc32_small(&c, offsetof(ring_cursor_t, crc));
+
+    if (r->io.write(r->io.ctx, RING_FILE_CURSOR, (c.gen & 1) * RING_CURSOR_STRIDE, &c, sizeof(c)) != 0)
+        return -1;
+    r->gen = c.gen;
+    r->head = head;
+    r->tail = tail;
+    return 0;
+}
+
+int ring_open(backlog_ring_t *r, const ring_io_t *io, uint32_t capacity, uint32_t record_size)
+{
+    ring_cursor_t a, b;
+    int va, vb;
+
+    memset(r, 0, sizeof(*r));
+    r->io = *io;
+    r->capacity = capacity;
+    r->record_size = record_size;
+    if (capacity == 0 || record_size == 0 || record_size > RING_RECORD_MAX)
+        return -1;
+
+    va = load_cursor(r, 0, &a) == 0;
+    vb = load_cursor(r, 1, &b) == 0;
+    if (va && (!vb || (int32_t)(a.gen - b.gen) > 0))
+    {
+        r->gen = a.gen;
+        r->head = a.head;
+        r->tail = a.tail;
+    }
+    else if (vb)
+    {
+        r->gen = b.gen;
+        r->head = b.head;
+        r->tail = b.tail;
+    }
+    return 0; // No valid cursor: start empty
+}
+
+uint32_t ring_count(const backlog_ring_t *r)
+{
+    return r->tail - r->head;
+}
+
+int ring_push(backlog_ring_t *r, const void *rec)
+{
+    uint32_t head = r->head;
+
+    // Record first, cursor second: a crash in between loses only this record
+    uint32_t off = (r->tail % r->capacity) * r->record_size;
+    if (r->io.write(r->io.ctx, RING_FILE_DATA, off, rec, r->record_size) != 0)
+        return -1;
+
+    if (r->tail - head == r->capacity)
+    {
+        head++;
+        r->dropped++;
+    }
+    return store_cursor(r, head, r->tail + 1);
+}
+
+int ring_read(backlog_ring_t *r, uint32_t pos, void *rec)
+{
+    if (pos - r->head >= ring_count(r))
+        return -1;
+
+    uint32_t off = (pos % r->capacity) * r->record_size;
+    return r->io.read(r->io.ctx, RING_FILE_DATA, off, rec, r->record_size);
+}
+
+int ring_pop(backlog_ring_t *r, uint32_t n)
+{
+    if (n == 0)
+        return 0;
+    if (n > ring_count(r))
+        n = ring_count(r);
+    return store_cursor(r, r->head + n, r->tail);
+}
@@ -0,0 +1,69 @@
+// backlog_ring.h
+// Fixed-size circular store for readings that could not be delivered.
+//
+// The data file holds `capacity` fixed-size records (each carrying its own
+// integrity check, see telemetry_record.h); a separate cursor file holds the
+// head (oldest record) and tail (next free slot) as free-running counters.
+// Appending writes the record first and then the cursor, popping only writes
+// the cursor, so nothing is ever rewritten or moved. The cursor is
+// stored twice with a generation number and a CRC, alternating between the
+// copies: a torn write leaves the other copy intact. When the store is full
+// the oldest record is overwritten.
+//
+// File access goes through ring_io_t, so the same code runs on LittleFS,
+// SPIFFS or a host file.
+#ifndef BACKLOG_RING_H
+#define BACKLOG_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RING_FILE_DATA 0
+#define RING_FILE_CURSOR 1
+
+#define RING_RECORD_MAX 64 // Largest record size
+
+typedef struct
+{
+    // Return 0 on success. Writes past the end of the file extend it.
+    int (*read)(void *ctx, int file, uint32_t off, void *buf, size_t len);
+    int (*write)(void *ctx, int file, uint32_t off, const void *buf, size_t len);
+    void *ctx;
+} ring_io_t;
+
+typedef struct
+{
+    ring_io_t io;
+    uint32_t capacity;    // Records
+    uint32_t record_size; // Bytes per record
+    uint32_t head;        // Counter of the oldest record
+    uint32_t tail;        // Counter of the next record to append
+    uint32_t gen;         // Generation of the last cursor write
+    uint32_t dropped;     // Records overwritten because the store was full
+} backlog_ring_t;
+
+// Loads the cursor (or starts empty if none is valid for this geometry).
+// Returns 0 or -1.
+int ring_open(backlog_ring_t *r, const ring_io_t *io, uint32_t capacity, uint32_t record_size);
+
+uint32_t ring_count(const backlog_ring_t *r);
+
+// Appends a record of record_size bytes, overwriting the oldest one if full.
+// Returns 0 or -1.
+int ring_push(backlog_ring_t *r, const void *rec);
+
+// Reads the record at counter pos (head <= pos < tail). Returns 0 or -1.
+int ring_read(backlog_ring_t *r, uint32_t pos, void *rec);
+
+// Drops the n oldest records. Returns 0 or -1.
+int ring_pop(backlog_ring_t *r, uint32_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+// bench_gorilla.c
+// Compression ratio and encode/decode throughput of the history chunks.
+// Build & run: make bench
+//
+// Generates DHT-like readings (0.1 resolution, slow drift, 5 s cadence with
+// occasional jitter), encodes them in sealed chunks, then decodes all chunks
+// and checks that every sample round-trips exactly.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gorilla.h"
+
+#define SAMPLES 5000000 // About 290 days of one device at 5 s cadence
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    int64_t *ts = malloc(SAMPLES * sizeof(*ts));
+    double *temp = malloc(SAMPLES * sizeof(*temp));
+    double *hum = malloc(SAMPLES * sizeof(*hum));
+    if (!ts || !temp || !hum)
+    {
+        perror("malloc");
+        return 1;
+    }
+
+    // Synthetic series: values come from a float sensor reading, like the clients
+    srand(42);
+    int64_t t = 1700000000;
+    int t10 = 235, h10 = 550;
+    for (int i = 0; i < SAMPLES; ++i)
+    {
+        t += 5 + (rand() % 20 == 0 ? (rand() % 3) - 1 : 0);
+        if (rand() % 8 == 0)
+            t10 += (rand() % 3) - 1;
+        if (rand() % 6 == 0)
+            h10 += (rand() % 3) - 1;
+        ts[i] = t;
+        temp[i] = (double)(float)(t10 / 10.0f);
+        hum[i] = (double)(float)(h10 / 10.0f);
+    }
+
+    // --- Encode ---
+    int nchunks = SAMPLES / GORILLA_CHUNK_MAX_SAMPLES + 2;
+    gorilla_chunk_t *chunks = calloc((size_t)nchunks, sizeof(*chunks));
+    int used = 0;
+
+    double start = now_sec();
+    gorilla_chunk_init(&chunks[0]);
+    for (int i = 0; i < SAMPLES; ++i)
+    {
+        if (gorilla_chunk_full(&chunks[used], ts[i]))
+        {
+            gorilla_chunk_seal(&chunks[used]);
+            gorilla_chunk_init(&chunks[++used]);
+        }
+        gorilla_chunk_append(&chunks[used], ts[i], temp[i], hum[i]);
+    }
+    gorilla_chunk_seal(&chunks[used]);
+    used++;
+    double encode_sec = now_sec() - start;
+
+    size_t bytes = 0;
+    for (int i = 0; i < used; ++i)
+        bytes += gorilla_chunk_bytes(&chunks[i]);
+
+    // --- Decode ---
+    long decoded = 0, mismatches = 0;
+    start = now_sec();
+    for (int c = 0; c < used; ++c)
+    {
+        gorilla_iter_t it;
+        int64_t dts;
+        double dt, dh;
+        gorilla_iter_init(&it, &chunks[c]);
+        while (gorilla_iter_next(&it, &dts, &dt, &dh) == 1)
+        {
+            if (dts != ts[decoded] || dt != temp[decoded] || dh != hum[decoded])
+                mismatches++;
+            decoded++;
+        }
+    }
+    double decode_sec = now_sec() - start;
+
+    size_t raw = (size_t)SAMPLES * 24;
+    printf("samples:          %d in %d chunks\n", SAMPLES, used);
+    printf("raw size:         %zu bytes (24 B/sample)\n", raw);
+    printf("compressed size:  %zu bytes (%.2f B/sample, %.1fx)\n",
+           bytes, (double)bytes / SAMPLES, (double)raw / bytes);
+    printf("encode:           %.1f Msamples/s\n", SAMPLES / encode_sec / 1e6);
+    printf("decode:           %.1f Msamples/s (%.0f MB/s of raw samples)\n",
+           decoded / decode_sec / 1e6, decoded * 24.0 / decode_sec / 1e6);
+    printf("round-trip:       %ld decoded, %ld mismatches\n", decoded, mismatches);
+
+    for (int i = 0; i < used; ++i)
+        gorilla_chunk_free(&chunks[i]);
+    free(chunks);
+    free(ts);
+    free(temp);
+    free(hum);
+    return (decoded == SAMPLES && mismatches == 0) ? 0 : 1;
+}
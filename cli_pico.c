@@ -7,9 +7,12 @@
 #include <DHT.h>         // DHT by Adafruit
 #include <ArduinoJson.h> // ArduinoJson by Benoit
 #include <LittleFS.h>    // Replaces SPIFFS for Pico W
-#include <vector>
 #include <PubSubClient.h> // MQTT client library
 #include <WiFiClientSecure.h>
+#include "client_core.h" // QoS, backlog, throttling and heartbeats (shared with fleet_sim.c)
+#include "telemetry_record.h" // Compact binary readings, encoded to JSON when sent
+#include "sample_queue.h" // Lock-free handoff from the sampler core to the network core
+#include "mqtt_outbox.h" // Bounded MQTT outbox and reconnect backoff
 
 // ---------------- CONFIG ----------------
 const char *ssid = "Pixel_Alf";
@@ -24,14 +27,37 @@ const char *mqtt_server = "4979254f05ea480283d67c6f0d9f7525.s1.eu.hivemq.cloud";
 const char *mqtt_username = "web_client";
 const char *mqtt_password = "Password1";
 const int mqtt_port = 8883; // Secure MQTT port
+#define MQTT_RECONNECT_MIN_MS 5000   // Backoff after the first failed connection attempt...
+#define MQTT_RECONNECT_MAX_MS 300000 // ...doubling up to 5 minutes
+#define MQTT_CONNECT_TIMEOUT_S 5     // Bounds one (TLS) connection attempt
+#define MQTT_PUBLISH_INTERVAL_MS 200 // At most one publish per interval
+#define MQTT_KEEPALIVE_S 60          // Broker keeps the connection through Wi-Fi blips shorter than 1.5x this
+#define MQTT_COMMAND_QOS 1           // Commands are queued by the broker while the device is offline
 
 #define DHTPIN 4
 #define DHTTYPE DHT11
 
 // --- CONFIG FOR RETRY & LOGGING ---
-#define MAX_RETRIES 5
-#define INITIAL_BACKOFF_MS 200
-const char *log_filepath = "/telemetry_log.txt";
+#define MAX_RETRIES 5     // Transmissions per seq before it is logged to file
+#define ACK_TIMEOUT_MS 800 // ACK wait until the round trip has been measured (RTO then adapts)
+#define QOS_WINDOW_SIZE 8 // Unacknowledged seqs kept in flight (one is reserved for live readings)
+#if QOS_WINDOW_SIZE < 2
+#error "QOS_WINDOW_SIZE must leave room for the backlog drain"
+#endif
+const char *log_filepath = "/telemetry_log.txt"; // Line-based log of older firmware (migrated on boot)
+const char *ring_data_path = "/backlog.dat";      // Backlog ring slots
+const char *ring_cursor_path = "/backlog.cur";    // Backlog ring head/tail cursor
+#define BACKLOG_CAPACITY 2048                     // Stored readings (16 bytes each) before the oldest are summarized
+const char *summary_data_path = "/summary.dat";   // Summaries of the readings folded out of the backlog
+const char *summary_cursor_path = "/summary.cur";
+#define SUMMARY_CAPACITY 128 // Summaries kept (36 bytes each); rebuilt at half the resolution when full
+#define SUMMARY_GROUP 16     // Oldest readings folded into one summary when the backlog is full
+#define DRAIN_RECENT_FIRST 0 // 1 = replay the full-resolution readings before the older summaries
+#define DRAIN_TIME_BUDGET_MS 20 // Max time spent handing stored records to the window per step
+#define DRAIN_BYTE_BUDGET 4096  // Max wire bytes handed to the window per step (about three full batches)
+#define DRAIN_RETRY_MS 5000     // Shortest pause after a stored record runs out of retries...
+#define DRAIN_RETRY_MAX_MS 60000 // ...growing with decorrelated jitter up to this
+#define DRAIN_START_SPREAD_MS 10000 // Random delay before draining after boot or a Wi-Fi reconnect
 const char *DEVICE_ID = "PICO_Device_01";
 
 // --- WIFI CONFIG ---
@@ -42,6 +68,14 @@ const char *DEVICE_ID = "PICO_Device_01";
 #define MAX_DELAY_MS 60000      // Cap generation delay at 60 seconds
 #define THROTTLING_THRESHOLD 10 // Start throttling if backlog exceeds 10 packets
 #define THROTTLING_FACTOR 2000  // Increase delay by 2 seconds per packet over threshold
+// --- DEADBAND (REPORT BY EXCEPTION) CONFIG ---
+#define DEADBAND_ENABLED 1          // 0 = send every reading
+#define DEADBAND_TEMP_C 0.5f        // Send when the temperature moves by more than this...
+#define DEADBAND_HUM_PCT 2.0f       // ...or the humidity by more than this...
+#define REFRESH_INTERVAL_MS 900000  // ...or no reading was sent for this long (15 minutes)
+// --- HEARTBEAT CONFIG ---
+#define HEARTBEAT_INTERVAL_MS 60000 // Heartbeat datagram after this long without sending (advertised to the server)
+#define HEARTBEAT_MIN_GAP_MS 5000   // Backlog depth changes are reported at most this often
 // ----------------------------
 
 DHT dht(DHTPIN, DHTTYPE);
@@ -49,314 +83,280 @@ WiFiUDP udp;
 
 WiFiClientSecure espClient;
 PubSubClient client(espClient); // MQTT Client using secure WiFiClient
+Session tls_session;            // BearSSL session cache: reconnects resume instead of a full handshake
 
-unsigned long seq = 0; // Sequence number for guaranteed delivery
+char mqtt_client_id[24] = ""; // Stable, so the broker keeps the session (at most 23 chars in MQTT 3.1)
 int qos = 1;           // 0 = best effort, 1 = guaranteed delivery
 
-// Global variable for dynamic loop delay
-unsigned long current_delay = BASE_DELAY_MS;
+client_core_t core;         // QoS window, backlog and drain, throttling, heartbeats
+File ring_files[2];         // RING_FILE_DATA, RING_FILE_CURSOR
+File summary_files[2];
+
+sample_queue_t samples;              // Readings from the sampler to the network side
+volatile uint32_t sensor_errors = 0; // Failed sensor reads, counted by the sampler
+mqtt_outbox_t mqtt_outbox;           // Readings waiting for MQTT (network side)
+unsigned long next_sample = 0;       // Sampler deadline (core 1)
 bool fs_is_ready = false; // Global flag to track successful LittleFS mount state
 
 // Forward declaration
-bool sendWithQoS(const String &payload, unsigned long current_seq);
-void logDataToFile(const String &payload);
-void transmitStoredData();
 void reconnectMqtt();
+bool sampleSensor();
+void publishReading(const telemetry_record_t &rec);
+void networkStep();
+void serviceMqtt();
+void startCore();
 
-void publishMessage(const char *topic, const String &payload, boolean retained);
+bool publishMessage(const char *topic, const char *payload, boolean retained);
 
-// Function to wait for an acknowledgement from the UDP server
-bool waitForAck(unsigned long mySeq, const char *myId)
+// --- Client core HAL: WiFiUDP, the clock, the DHT and Serial ---
+int halUdpSend(void *ctx, const void *buf, size_t len)
 {
-    unsigned long start = millis();
-    char incoming[512];
+    udp.beginPacket(udp_server_ip, udp_port);
+    udp.write((const uint8_t *)buf, len);
+    return udp.endPacket() ? 0 : -1;
+}
 
-    // Check for ACK for a brief timeout (800ms)
-    while (millis() - start < 800)
+int halUdpRecv(void *ctx, char *buf, size_t len)
+{
+    while (udp.parsePacket() > 0)
     {
-        int packetSize = udp.parsePacket();
-        if (packetSize)
-        {
-            int len = udp.read(incoming, sizeof(incoming) - 1);
-            incoming[len] = 0;
-
-            // Use JsonDocument (best practice, though original used StaticJsonDocument)
-            // Note: Since this block was not causing the error, I'm keeping the original type for minimal change.
-            StaticJsonDocument<128> doc;
-            DeserializationError error = deserializeJson(doc, incoming);
-
-            if (error)
-            {
-                continue;
-            }
-
-            const char *type = doc["type"] | "";
-            const char *id = doc["id"] | "";
-            unsigned long seq = doc["seq"] | 0;
-
-            if (strcmp(type, "ACK") == 0 &&
-                strcmp(id, myId) == 0 &&
-                seq == mySeq)
-            {
-                Serial.println("ACK received!");
-                return true;
-            }
-        }
+        int n = udp.read(buf, len);
+        if (n > 0)
+            return n;
     }
-    return false;
+    return 0;
 }
 
-// Function to handle the actual sending and QoS (ACK/Retry) logic.
-// Returns true on successful delivery (ACK received or QoS 0).
-bool sendWithQoS(const String &payload, unsigned long current_seq)
+int halLinkUp(void *ctx)
 {
-    bool delivered = false;
-    int retry_count = 0;
-    unsigned long backoff_ms = INITIAL_BACKOFF_MS;
-    int qos_level = 1;
+    return WiFi.status() == WL_CONNECTED;
+}
 
-    // Check for communications failure (Error Handling)
-    if (WiFi.status() != WL_CONNECTED)
-    {
-        Serial.println("ERROR: WiFi disconnected. Cannot send live data.");
-        return false; // Communication failure
-    }
+uint32_t halMillis(void *ctx)
+{
+    return millis();
+}
 
-    do
-    {
-        // 1. Send UDP packet (using const char* IP)
-        udp.beginPacket(udp_server_ip, udp_port);
-        udp.print(payload);
-        udp.endPacket();
-
-        Serial.print("Sent UDP (Seq ");
-        Serial.print(current_seq);
-        Serial.print("): ");
-        Serial.println(payload.substring(0, min((int)payload.length(), 60)) + "...");
-
-        // 2. Wait for ACK (Error Handling)
-        if (qos_level == 1)
-        {
-            delivered = waitForAck(current_seq, DEVICE_ID);
+uint32_t halRandom(void *ctx, uint32_t max)
+{
+    return (uint32_t)random(max);
+}
 
-            if (!delivered)
-            {
-                retry_count++;
-                Serial.print("No ACK -> retrying (Retry #");
-                Serial.print(retry_count);
-                Serial.print(", Wait ");
-                Serial.print(backoff_ms);
-                Serial.println("ms)...");
-
-                if (retry_count >= MAX_RETRIES)
-                {
-                    Serial.println("ERROR: Max retries reached! Will log to file.");
-                    return false; // Indicate failure to deliver/log
-                }
-
-                // 3. Implement Exponential Backoff (Error Handling)
-                delay(backoff_ms);
-                backoff_ms *= 2;
-                if (backoff_ms > 5000)
-                    backoff_ms = 5000;
-            }
-        }
-        else
-        {
-            delivered = true;
-        }
+int halReadSensor(void *ctx, float *temp_c, float *hum_pct)
+{
+    *temp_c = dht.readTemperature();
+    *hum_pct = dht.readHumidity();
+    return isnan(*temp_c) || isnan(*hum_pct) ? -1 : 0;
+}
 
-    } while (!delivered);
+void halWait(void *ctx, uint32_t ms)
+{
+    delay(ms);
+}
 
-    return delivered; // True if ACK received
+void halLog(void *ctx, const char *line)
+{
+    Serial.println(line);
 }
 
-// Function to store a payload string into the LittleFS log file
-void logDataToFile(const String &payload)
+// Storage hooks for the backlog rings (ctx: the ring's data and cursor files)
+int ringRead(void *ctx, int file, uint32_t off, void *buf, size_t len)
 {
-    // Check global flag
-    if (!fs_is_ready)
-    {
-        return;
-    }
+    File &f = ((File *)ctx)[file];
+    if (!f || !f.seek(off))
+        return -1;
+    return f.read((uint8_t *)buf, len) == (int)len ? 0 : -1;
+}
 
-    // Use "a" (append) mode
-    File file = LittleFS.open(log_filepath, "a");
-    if (!file)
-    {
-        Serial.println("Failed to open file for appending.");
-        return;
-    }
+int ringWrite(void *ctx, int file, uint32_t off, const void *buf, size_t len)
+{
+    File &f = ((File *)ctx)[file];
+    if (!f)
+        return -1;
 
-    // Write payload followed by a newline character
-    if (file.println(payload) > 0)
-    {
-        Serial.println("Telemetry successfully logged to file.");
-    }
-    else
+    // Grow the file up to off first: seeking past the end is not portable
+    uint32_t size = f.size();
+    if (off > size)
     {
-        Serial.println("File write failed!");
+        uint8_t zero[32] = {0};
+        f.seek(size);
+        while (size < off)
+        {
+            size_t n = min((size_t)(off - size), sizeof(zero));
+            if (f.write(zero, n) != n)
+                return -1;
+            size += n;
+        }
     }
-    file.close();
+
+    if (!f.seek(off) || f.write((const uint8_t *)buf, len) != len)
+        return -1;
+    f.flush();
+    return 0;
 }
 
-// Function to transmit stored data on restart/reconnection
-void transmitStoredData()
+// Opens a ring file for in-place updates, creating it if needed
+File openRingFile(const char *path)
 {
-    Serial.println("--- Checking for stored telemetry---");
-
-    // Check global flag
-    if (!fs_is_ready)
+    File f = LittleFS.open(path, "r+");
+    if (!f)
     {
-        Serial.println("LittleFS mount failed! Cannot check log.");
-        return;
+        f = LittleFS.open(path, "w");
+        f.close();
+        f = LittleFS.open(path, "r+");
     }
+    return f;
+}
 
-    // Use "r" (read) mode
+// Moves readings left in the line-based log of older firmware into the
+// backlog, summarizing the oldest ones if it fills up
+void migrateLegacyLog()
+{
     File file = LittleFS.open(log_filepath, "r");
     if (!file)
-    {
-        Serial.println("No existing telemetry log file found.");
-        // If file doesn't exist, backlog is zero, reset delay
-        current_delay = BASE_DELAY_MS;
         return;
-    }
-
-    std::vector<String> failed_messages;
-    int count = 0;
 
-    // Read stored data line by line
+    static char line[256]; // Longer lines are split and fail to parse
+    JsonDocument doc;
+    int migrated = 0;
     while (file.available())
     {
-        String line = file.readStringUntil('\n');
-        line.trim();
-
-        if (line.length() == 0)
+        size_t n = file.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[n] = '\0';
+        if (n == 0 || deserializeJson(doc, line, n))
             continue;
 
-        // Using JsonDocument
-        JsonDocument doc;
-        DeserializationError error = deserializeJson(doc, line);
-
-        if (error)
-        {
-            Serial.println("Error parsing stored JSON. Skipping line.");
-            continue;
-        }
+        telemetry_record_t rec;
+        telemetry_record_set(&rec, doc["seq"] | 0UL, doc["dateObserved"] | 0UL,
+                             doc["temperature"] | 0.0f, doc["relativeHumidity"] | 0.0f, doc["qos"] | 1);
+        client_core_store(&core, &rec);
+        migrated++;
+    }
+    file.close();
+    LittleFS.remove(log_filepath);
 
-        unsigned long stored_seq = doc["seq"] | 0;
+    Serial.print("Migrated ");
+    Serial.print(migrated);
+    Serial.println(" readings from the old log file.");
+}
 
-        // Attempt to send the stored message with QoS/Retries
-        if (sendWithQoS(line, stored_seq))
-        {
-            Serial.println("Stored message successfully re-sent and acknowledged.");
-        }
-        else
-        {
-            // Failed to send after max retries -> keep it in the buffer
-            failed_messages.push_back(line);
-            Serial.println("Failed to re-send. Keeping in log.");
-        }
-        count++;
+// Opens (or creates) the backlog and summary rings on the mounted file system
+bool openBacklog()
+{
+    ring_files[RING_FILE_DATA] = openRingFile(ring_data_path);
+    ring_files[RING_FILE_CURSOR] = openRingFile(ring_cursor_path);
+    summary_files[RING_FILE_DATA] = openRingFile(summary_data_path);
+    summary_files[RING_FILE_CURSOR] = openRingFile(summary_cursor_path);
+    if (!ring_files[RING_FILE_DATA] || !ring_files[RING_FILE_CURSOR] ||
+        !summary_files[RING_FILE_DATA] || !summary_files[RING_FILE_CURSOR])
+    {
+        Serial.println("Failed to open the backlog files.");
+        return false;
     }
 
-    file.close();
+    if (client_core_open_backlog(&core) != 0)
+        return false;
+
+    // Migrated readings keep their seqs; new ones continue after them
+    migrateLegacyLog();
+    client_core_resume_seq(&core);
+    Serial.print("Backlog ready: ");
+    Serial.print(ring_count(&core.backlog));
+    Serial.print(" stored readings, ");
+    Serial.print(ring_count(&core.summaries));
+    Serial.println(" summaries.");
+    return true;
+}
 
-    // --- ADAPTIVE THROTTLING LOGIC ---
-    int backlog_count = failed_messages.size();
+// Sets up the client core from the configuration above and the HAL hooks
+void startCore()
+{
+    client_config_t config;
+    client_config_defaults(&config, DEVICE_ID);
+    config.qos = qos;
+    config.window_size = QOS_WINDOW_SIZE;
+    config.ack_timeout_ms = ACK_TIMEOUT_MS;
+    config.max_retries = MAX_RETRIES;
+    config.backlog_capacity = BACKLOG_CAPACITY;
+    config.summary_capacity = SUMMARY_CAPACITY;
+    config.summary_group = SUMMARY_GROUP;
+    config.drain_recent_first = DRAIN_RECENT_FIRST;
+    config.drain_time_budget_ms = DRAIN_TIME_BUDGET_MS;
+    config.drain_byte_budget = DRAIN_BYTE_BUDGET;
+    config.drain_retry_ms = DRAIN_RETRY_MS;
+    config.drain_retry_max_ms = DRAIN_RETRY_MAX_MS;
+    config.drain_start_spread_ms = DRAIN_START_SPREAD_MS;
+    config.base_delay_ms = BASE_DELAY_MS;
+    config.max_delay_ms = MAX_DELAY_MS;
+    config.throttling_threshold = THROTTLING_THRESHOLD;
+    config.throttling_factor_ms = THROTTLING_FACTOR;
+    config.deadband_enabled = DEADBAND_ENABLED;
+    config.deadband_temp_c = DEADBAND_TEMP_C;
+    config.deadband_hum_pct = DEADBAND_HUM_PCT;
+    config.refresh_interval_ms = REFRESH_INTERVAL_MS;
+    config.heartbeat_interval_ms = HEARTBEAT_INTERVAL_MS;
+    config.heartbeat_min_gap_ms = HEARTBEAT_MIN_GAP_MS;
+    config.boot_id = rp2040.hwrand32(); // Hardware RNG: random() repeats after a reset
+
+    client_hal_t hal = {halUdpSend, halUdpRecv, halLinkUp, halMillis, halRandom, halReadSensor, halWait, halLog,
+                        {ringRead, ringWrite, ring_files}, {ringRead, ringWrite, summary_files}, NULL};
+    client_core_init(&core, &config, &hal);
+}
 
-    if (backlog_count > THROTTLING_THRESHOLD)
-    {
-        // Calculate new delay based on backlog size
-        unsigned long throttle_increase = (backlog_count - THROTTLING_THRESHOLD) * THROTTLING_FACTOR;
-        current_delay = BASE_DELAY_MS + throttle_increase;
+//------------------------------
+// Makes one connection attempt when the backoff schedule allows it. Never
+// loops or waits; the attempt itself is bounded by MQTT_CONNECT_TIMEOUT_S.
+void reconnectMqtt()
+{
+    if (WiFi.status() != WL_CONNECTED || !mqtt_outbox_reconnect_due(&mqtt_outbox, millis()))
+        return;
 
-        // Cap the delay
-        if (current_delay > MAX_DELAY_MS)
-        {
-            current_delay = MAX_DELAY_MS;
-        }
+    Serial.print("Attempting MQTT connection... ");
+
+    if (mqtt_client_id[0] == '\0')
+        snprintf(mqtt_client_id, sizeof(mqtt_client_id), "g04-%s", DEVICE_ID);
 
-        Serial.print("CONGESTION DETECTED: Backlog=");
-        Serial.print(backlog_count);
-        Serial.print(". New generation delay: ");
-        Serial.print(current_delay / 1000);
-        Serial.println("s.");
+    // Persistent session (cleanSession = false, no will): the broker keeps the
+    // subscription and queues QoS 1 commands across reconnects
+    if (client.connect(mqtt_client_id, mqtt_username, mqtt_password, NULL, 0, false, NULL, false))
+    {
+        Serial.println("connected");
+        client.subscribe("/comcs/g04/commands", MQTT_COMMAND_QOS);
+        mqtt_outbox_connected(&mqtt_outbox);
     }
     else
     {
-        // If backlog is low, reset to base delay
-        current_delay = BASE_DELAY_MS;
-        if (backlog_count > 0)
-        {
-            Serial.print("Backlog clearing: ");
-            Serial.print(backlog_count);
-            Serial.println(" remaining. Resetting delay.");
-        }
+        mqtt_outbox_connect_failed(&mqtt_outbox, millis(), (uint32_t)random(0x7fffffff));
+        Serial.print("failed, rc=");
+        Serial.print(client.state());
+        Serial.print(", next attempt in ");
+        Serial.print((mqtt_outbox.next_attempt_ms - millis()) / 1000);
+        Serial.println(" s");
     }
-    // --- END ADAPTIVE THROTTLING ---
+}
 
-    // ----------------------------------------------------------------------
-    // Rolling Window Logic: Rewrite the log file with only the failed messages
-    // ----------------------------------------------------------------------
+// Background MQTT: keeps the connection, processes incoming commands and
+// publishes the oldest outbox reading, at most one per
+// MQTT_PUBLISH_INTERVAL_MS. A reading whose publish fails stays queued.
+void serviceMqtt()
+{
+    static unsigned long last_publish = 0;
+    static char payload[TELEMETRY_JSON_MAX];
+    telemetry_record_t rec;
 
-    if (count > 0)
+    if (!client.connected())
     {
-        // Only rewrite if there were items to process
-        if (failed_messages.empty())
-        {
-            // All messages sent successfully, delete the file.
-            LittleFS.remove(log_filepath);
-            Serial.println("All stored messages sent successfully. Log file deleted.");
-        }
-        else
-        {
-            // Rewrite the file with only the failed messages
-            // Use "w" (write/overwrite) mode
-            File new_file = LittleFS.open(log_filepath, "w");
-            if (!new_file)
-            {
-                Serial.println("FATAL: Failed to open file for rewriting!");
-                return;
-            }
-
-            Serial.print("Rewriting log with ");
-            Serial.print(failed_messages.size());
-            Serial.println(" messages that failed to re-send.");
-
-            for (const String &msg : failed_messages)
-            {
-                new_file.println(msg);
-            }
-            new_file.close();
-            Serial.println("Log file rewritten.");
-        }
+        reconnectMqtt();
+        return;
     }
-}
-//------------------------------
-void reconnectMqtt()
-{
-    while (!client.connected())
-    {
-        Serial.print("Attempting MQTT connection... ");
-
-        String clientId = "ESP32-G04-";
-        clientId += String(random(0xffff), HEX);
+    client.loop();
 
-        // Connect with client ID, username, and password
-        if (client.connect(clientId.c_str(), mqtt_username, mqtt_password))
-        {
-            Serial.println("connected");
-            client.subscribe("/comcs/g04/commands");
-        }
-        else
-        {
-            Serial.print("failed, rc=");
-            Serial.print(client.state());
-            Serial.println(" retrying in 5 seconds");
-            delay(5000);
-        }
-    }
+    if (millis() - last_publish < MQTT_PUBLISH_INTERVAL_MS || mqtt_outbox_peek(&mqtt_outbox, &rec) != 0)
+        return;
+    last_publish = millis();
+    telemetry_record_to_json(&rec, DEVICE_ID, 0, payload, sizeof(payload));
+    if (publishMessage("/comcs/g04/sensor", payload, true))
+        mqtt_outbox_pop(&mqtt_outbox);
 }
 
 //------------------------------
@@ -369,21 +369,85 @@ void callback(char *topic, byte *payload, unsigned int length)
 }
 
 //------------------------------
-void publishMessage(const char *topic, const String &payload, boolean retained)
+bool publishMessage(const char *topic, const char *payload, boolean retained)
 {
-    if (client.publish(topic, payload.c_str(), retained))
+    if (client.publish(topic, payload, retained))
     {
-        Serial.println("JSON published to " + String(topic));
+        Serial.print("JSON published to ");
+        Serial.println(topic);
+        return true;
     }
-    else
+    Serial.print("MQTT publish failed for topic: ");
+    Serial.println(topic);
+    return false;
+}
+
+// Reads the sensor and queues the reading for the network side. Never
+// touches the network or flash. Returns false if the read failed.
+bool sampleSensor()
+{
+    telemetry_record_t rec;
+    int r = client_core_sample(&core, &rec);
+    if (r < 0)
     {
-        Serial.print("MQTT publish failed for topic: ");
-        Serial.println(topic);
+        sensor_errors++; // Reported by the network side
+        return false;
     }
+
+    // Within the deadband: nothing to send. Otherwise hand it over; a seq is
+    // only used up by a queued reading.
+    if (r > 0 && sample_queue_push(&samples, &rec) == 0)
+        client_core_sample_queued(&core, &rec);
+    return true;
+}
+
+// Sends one reading taken by the sampler: UDP with QoS (stored in the
+// backlog if that fails), and MQTT later from the outbox
+void publishReading(const telemetry_record_t &rec)
+{
+    client_core_publish(&core, &rec);
+    mqtt_outbox_push(&mqtt_outbox, &rec);
 }
+
+// One pass of the network side: sends the queued readings, then services
+// ACKs, retransmissions and the backlog drain
+void networkStep()
+{
+    static uint32_t reported_errors = 0;
+    static uint32_t reported_overflows = 0;
+    static uint32_t reported_mqtt_drops = 0;
+
+    telemetry_record_t rec;
+    while (sample_queue_pop(&samples, &rec) == 0)
+        publishReading(rec);
+
+    if (sensor_errors != reported_errors)
+    {
+        reported_errors = sensor_errors;
+        Serial.println("Failed to read from DHT11!");
+    }
+    if (sample_queue_overflows(&samples) != reported_overflows)
+    {
+        reported_overflows = sample_queue_overflows(&samples);
+        Serial.println("WARNING: Sample queue full, readings dropped.");
+    }
+    if (mqtt_outbox.dropped != reported_mqtt_drops)
+    {
+        reported_mqtt_drops = mqtt_outbox.dropped;
+        Serial.println("WARNING: MQTT outbox full, oldest readings dropped.");
+    }
+
+    client_core_poll(&core);
+
+    // MQTT last: a slow broker never delays UDP delivery
+    serviceMqtt();
+}
+
 void setup()
 {
     Serial.begin(9600);
+    randomSeed(micros());
+    startCore(); // Per-device retry jitter; the drain starts a random delay after Wi-Fi comes up
 
     // 1. Initialise LittleFS (REVISED LOGIC: Attempt mount, if fails, format and retry)
     // This process is equivalent to calling lfs_mount and lfs_format.
@@ -417,6 +481,9 @@ void setup()
         fs_is_ready = true; // Set flag on success
     }
 
+    if (fs_is_ready)
+        openBacklog();
+
     // --- Connection Timeout Logic ---
 
     // Explicitly disconnect before starting a new connection attempt for clean radio state.
@@ -434,7 +501,8 @@ void setup()
 
     if (WiFi.status() == WL_CONNECTED)
     {
-        Serial.println("\nConnected! IP: " + WiFi.localIP().toString());
+        Serial.print("\nConnected! IP: ");
+        Serial.println(WiFi.localIP());
     }
     else
     {
@@ -445,11 +513,17 @@ void setup()
 
     espClient.setInsecure();
 
+    espClient.setTimeout(MQTT_CONNECT_TIMEOUT_S * 1000);
+    espClient.setSession(&tls_session);
+    client.setKeepAlive(MQTT_KEEPALIVE_S);
     client.setServer(mqtt_server, mqtt_port);
     client.setCallback(callback);
+    client.setSocketTimeout(MQTT_CONNECT_TIMEOUT_S);
+    mqtt_outbox_init(&mqtt_outbox, MQTT_RECONNECT_MIN_MS, MQTT_RECONNECT_MAX_MS);
 
     udp.begin(udp_port);
-    dht.begin();
+    // The sensor is read by core 1 (setup1/loop1); samples queued meanwhile
+    // are sent once loop() starts
 
     // 2. Transmit stored data on restart (Req. c)
     // This function now uses the fs_is_ready flag.
@@ -457,62 +531,36 @@ void setup()
     // transmitStoredData();
 }
 
+// Network side (core 0, where the CYW43 driver runs): owns UDP, MQTT and
+// the backlog files
 void loop()
 {
-    // Maintain MQTT connection
-    if (!client.connected())
-        reconnectMqtt();
-
-    // Required for the MQTT client to process incoming and outgoing messages
-    client.loop();
+    networkStep();
+    delay(5);
+}
 
-    // 1. Read sensor data
-    float temp = dht.readTemperature();
-    float hum = dht.readHumidity();
+// Sampler (core 1): reads the sensor on a fixed schedule set by the adaptive
+// delay, whatever the network is doing
+void setup1()
+{
+    dht.begin();
+    next_sample = millis();
+}
 
-    if (isnan(temp) || isnan(hum))
+void loop1()
+{
+    if (!sampleSensor())
     {
-        Serial.println("Failed to read from DHT11!");
         delay(1000);
+        next_sample = millis();
         return;
     }
 
-    // 2. Build JSON payload
-    // Using JsonDocument
-    JsonDocument doc;
-    doc["id"] = DEVICE_ID;
-    doc["type"] = "WeatherObserved";
-    doc["temperature"] = temp;
-    doc["relativeHumidity"] = hum;
-    doc["dateObserved"] = millis(); // Using internal time for simplicity
-    doc["status"] = "OPERATIONAL";  // Simple QoS Flag
-    doc["qos"] = qos;
-    doc["seq"] = seq;
-
-    String payload;
-    serializeJson(doc, payload);
-
-    // 3. Attempt to send with QoS
-    bool delivered = sendWithQoS(payload, seq);
-    publishMessage("/comcs/g04/sensor", payload.c_str(), true);
-
-    // 4. Handle failure by logging to file
-    if (!delivered)
-    {
-        // This only happens if max retries failed inside sendWithQoS()
-        logDataToFile(payload);
-    }
+    // Deadlines advance by the period, so the read time does not add up
+    next_sample += core.current_delay_ms;
+    long wait = (long)(next_sample - millis());
+    if (wait > 0)
+        delay(wait);
     else
-    {
-        // Attempt to send stored data, since it is expected that the
-        // server can now receive and reply
-        transmitStoredData();
-    }
-
-    // 5. Update sequence number for the next live packet
-    // Sequence number increments regardless of logging status, as the logged
-    // packet retains its sequence number and will be resent later.
-    seq++;
-
-    delay(current_delay); // Use adaptive delay
-}
\ No newline at end of file
+        next_sample = millis(); // Fell behind: restart the schedule
+}
@@ -0,0 +1,568 @@
+// client_core.c
+// Platform-independent engine of the telemetry clients. See client_core.h.
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "client_core.h"
+#include "heartbeat.h"
+
+static void core_log(client_core_t *c, const char *fmt, ...)
+{
+    char line[CLIENT_LOG_MAX];
+    va_list ap;
+
+    if (!c->hal.log)
+        return;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    c->hal.log(c->hal.ctx, line);
+}
+
+static uint32_t now_ms(client_core_t *c)
+{
+    return c->hal.millis(c->hal.ctx);
+}
+
+static uint32_t random_below(const client_hal_t *hal, uint32_t max)
+{
+    return max > 0 ? hal->random(hal->ctx, max) : 0;
+}
+
+void client_config_defaults(client_config_t *cfg, const char *device_id)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->device_id = device_id;
+    cfg->qos = 1;
+    cfg->window_size = 8;
+    cfg->ack_timeout_ms = 800;
+    cfg->max_retries = 5;
+    cfg->backlog_capacity = 2048;
+    cfg->summary_capacity = 128;
+    cfg->summary_group = 16;
+    cfg->drain_recent_first = 0;
+    cfg->drain_time_budget_ms = 20;
+    cfg->drain_byte_budget = 4096;
+    cfg->drain_retry_ms = 5000;
+    cfg->drain_retry_max_ms = 60000;
+    cfg->drain_start_spread_ms = 10000;
+    cfg->base_delay_ms = 5000;
+    cfg->max_delay_ms = 60000;
+    cfg->throttling_threshold = 10;
+    cfg->throttling_factor_ms = 2000;
+    cfg->deadband_enabled = 1;
+    cfg->deadband_temp_c = 0.5f;
+    cfg->deadband_hum_pct = 2.0f;
+    cfg->refresh_interval_ms = 900000;
+    cfg->heartbeat_interval_ms = 60000;
+    cfg->heartbeat_min_gap_ms = 5000;
+}
+
+// Transmit hook for the QoS window. The window holds packed records; they
+// are encoded to the JSON wire format here, on every (re)transmission. A
+// single record goes out as a WeatherObserved reading, several (a backlog
+// batch) as one WeatherObservedBatch datagram, a stored summary as a
+// WeatherObservedSummary. The buffers are shared by all cores: the network
+// side is single-threaded.
+static int udp_send(void *ctx, const char *buf, size_t len)
+{
+    static telemetry_record_t recs[CLIENT_DRAIN_BATCH_MAX];
+    static telemetry_summary_t summary;
+    static char payload[TELEMETRY_BATCH_JSON_MAX];
+    client_core_t *c = ctx;
+    int count = (int)(len / TELEMETRY_RECORD_SIZE);
+    int used = 0;
+    int n;
+
+    if (telemetry_summary_unpack((const uint8_t *)buf, len, &summary) == 0)
+        n = telemetry_summary_to_json(&summary, c->cfg.device_id, c->boot, payload, sizeof(payload));
+    else
+    {
+        if (count < 1 || count > CLIENT_DRAIN_BATCH_MAX || len % TELEMETRY_RECORD_SIZE != 0)
+            return -1;
+        for (int i = 0; i < count; ++i)
+        {
+            if (telemetry_record_unpack((const uint8_t *)buf + i * TELEMETRY_RECORD_SIZE, &recs[i]) != 0)
+                return -1;
+        }
+
+        if (count == 1)
+            n = telemetry_record_to_json(&recs[0], c->cfg.device_id, c->boot, payload, sizeof(payload));
+        else
+            n = telemetry_batch_to_json(recs, count, c->cfg.device_id, c->boot, payload, sizeof(payload), &used);
+    }
+    if (n < 0)
+        return -1;
+
+    if (c->hal.udp_send(c->hal.ctx, payload, (size_t)n) != 0)
+        return -1;
+    c->last_udp_tx = now_ms(c);
+    return 0;
+}
+
+void client_core_pause_drain(client_core_t *c, uint32_t ms)
+{
+    c->drain_failed = 1;
+    c->drain_failed_at = now_ms(c);
+    c->drain_pause_ms = ms;
+}
+
+// Marks a backlog batch or the summary in flight as delivered or failed.
+// Returns 0 if seq does not name one of them (a live reading).
+static int mark_drained(client_core_t *c, uint32_t done_seq, int delivered)
+{
+    int found = 0;
+    if (c->summary_inflight && c->summary_seq == done_seq)
+    {
+        c->summary_inflight = 0;
+        if (delivered)
+            ring_pop(&c->summaries, 1);
+        found = 1;
+    }
+    for (int k = 0; k < c->drain_count && !found; ++k)
+    {
+        client_drain_batch_t *b = &c->drain_batches[(c->drain_first + k) % QOS_WINDOW_MAX];
+        if (b->pending && b->seq == done_seq)
+        {
+            b->pending = 0;
+            b->acked = (uint8_t)delivered;
+            c->drain_inflight--;
+            found = 1;
+        }
+    }
+    if (!found)
+        return 0;
+
+    if (delivered)
+        c->drain_backoff_ms = c->cfg.drain_retry_ms;
+    else if (c->nack_retry_after)
+        client_core_pause_drain(c, c->nack_retry_after);
+    else
+    {
+        // Jittered, so devices that lost the same server come back apart
+        c->drain_backoff_ms = qos_window_backoff(&c->tx, c->cfg.drain_retry_ms, c->drain_backoff_ms,
+                                                 c->cfg.drain_retry_max_ms);
+        client_core_pause_drain(c, c->drain_backoff_ms);
+    }
+    return 1;
+}
+
+// Called by the QoS window once a seq is ACKed or out of retries
+static void on_done(void *ctx, uint32_t done_seq, int delivered, const char *buf, size_t len)
+{
+    client_core_t *c = ctx;
+
+    if (delivered)
+    {
+        mark_drained(c, done_seq, 1);
+        if (len == TELEMETRY_SUMMARY_SIZE)
+            core_log(c, "ACK received for seq %lu (summary) (SRTT %lu ms, RTO %lu ms)", (unsigned long)done_seq,
+                     (unsigned long)c->tx.srtt_ms, (unsigned long)c->tx.rto_ms);
+        else if (len > TELEMETRY_RECORD_SIZE)
+            core_log(c, "ACK received for seq %lu (batch of %u) (SRTT %lu ms, RTO %lu ms)", (unsigned long)done_seq,
+                     (unsigned)(len / TELEMETRY_RECORD_SIZE), (unsigned long)c->tx.srtt_ms, (unsigned long)c->tx.rto_ms);
+        else
+            core_log(c, "ACK received for seq %lu (SRTT %lu ms, RTO %lu ms)", (unsigned long)done_seq,
+                     (unsigned long)c->tx.srtt_ms, (unsigned long)c->tx.rto_ms);
+        return;
+    }
+
+    if (c->nack_retry_after)
+        core_log(c, "Server deferred seq %lu, retrying in %lu ms", (unsigned long)done_seq, (unsigned long)c->nack_retry_after);
+    else
+        core_log(c, "ERROR: Max retries reached for seq %lu!", (unsigned long)done_seq);
+
+    // Stored readings stay in the ring; live ones are appended to it
+    telemetry_record_t rec;
+    if (!mark_drained(c, done_seq, 0) && len == TELEMETRY_RECORD_SIZE &&
+        telemetry_record_unpack((const uint8_t *)buf, &rec) == 0)
+        client_core_store(c, &rec);
+}
+
+// Matches incoming ACKs to the outstanding seqs and retransmits timed-out ones
+static void service_qos(client_core_t *c)
+{
+    char incoming[512];
+    int len;
+
+    while ((len = c->hal.udp_recv(c->hal.ctx, incoming, sizeof(incoming) - 1)) > 0)
+    {
+        uint32_t acked_seq, retry_after;
+        if (qos_parse_ack(incoming, (size_t)len, c->cfg.device_id, &acked_seq))
+            qos_window_on_ack(&c->tx, acked_seq, now_ms(c));
+        else if (qos_parse_nack(incoming, (size_t)len, c->cfg.device_id, &acked_seq, &retry_after))
+        {
+            // Server over its replay budget: drop the batch and come back in
+            // the slot it reserved (see mark_drained)
+            c->nack_retry_after = retry_after > 0 ? retry_after : 1;
+            qos_window_on_nack(&c->tx, acked_seq);
+            c->nack_retry_after = 0;
+        }
+    }
+    qos_window_poll(&c->tx, now_ms(c));
+}
+
+// Hands a datagram to the QoS window. While the window is full it waits
+// (servicing ACKs) if the platform can, otherwise it gives up.
+static int queue_datagram(client_core_t *c, const void *payload, size_t len, uint32_t seq)
+{
+    while (!qos_window_can_send(&c->tx))
+    {
+        if (!c->hal.wait)
+            return 0;
+        service_qos(c);
+        c->hal.wait(c->hal.ctx, 1);
+    }
+
+    if (qos_window_send(&c->tx, seq, payload, len, now_ms(c)) != 0)
+    {
+        core_log(c, "ERROR: Payload too large for the QoS window.");
+        return 0;
+    }
+    return 1;
+}
+
+void client_core_init(client_core_t *c, const client_config_t *cfg, const client_hal_t *hal)
+{
+    memset(c, 0, sizeof(*c));
+    c->cfg = *cfg;
+    c->hal = *hal;
+    c->handle = heartbeat_handle(cfg->device_id);
+    c->boot = cfg->boot_id ? cfg->boot_id : 1 + random_below(hal, 0x7fffffff);
+    c->current_delay_ms = cfg->base_delay_ms;
+    c->drain_backoff_ms = cfg->drain_retry_ms;
+    c->link_was_up = 0; // The drain also waits a random delay once the link first comes up
+    deadband_init(&c->deadband, cfg->deadband_temp_c, cfg->deadband_hum_pct, cfg->refresh_interval_ms);
+    qos_window_init(&c->tx, cfg->window_size, cfg->ack_timeout_ms, cfg->max_retries, udp_send, on_done, c);
+    qos_window_seed(&c->tx, c->handle ^ random_below(hal, 0x7fffffff)); // Per-device retry jitter
+    client_core_pause_drain(c, random_below(hal, cfg->drain_start_spread_ms)); // Devices rebooted by the same power cut start apart
+}
+
+// Stored readings keep the seqs of the run that sampled them. New ones go on
+// after the newest, so the server does not take the two for each other.
+void client_core_resume_seq(client_core_t *c)
+{
+    uint8_t buf[TELEMETRY_SUMMARY_SIZE];
+    telemetry_record_t rec;
+    telemetry_summary_t summary;
+
+    if (ring_count(&c->backlog) > 0 && ring_read(&c->backlog, c->backlog.tail - 1, buf) == 0 &&
+        telemetry_record_unpack(buf, &rec) == 0 && rec.seq + 1 > c->seq)
+        c->seq = rec.seq + 1;
+    if (ring_count(&c->summaries) > 0 && ring_read(&c->summaries, c->summaries.tail - 1, buf) == 0 &&
+        telemetry_summary_unpack(buf, TELEMETRY_SUMMARY_SIZE, &summary) == 0 && summary.last_seq + 1 > c->seq)
+        c->seq = summary.last_seq + 1;
+}
+
+int client_core_open_backlog(client_core_t *c)
+{
+    if (ring_open(&c->backlog, &c->hal.backlog_io, c->cfg.backlog_capacity, TELEMETRY_RECORD_SIZE) != 0 ||
+        ring_open(&c->summaries, &c->hal.summary_io, c->cfg.summary_capacity, TELEMETRY_SUMMARY_SIZE) != 0)
+        return -1;
+    backlog_policy_init(&c->policy, &c->backlog, &c->summaries, c->cfg.summary_group);
+    c->drain_next = c->backlog.head;
+    c->backlog_ready = 1;
+    return 0;
+}
+
+uint32_t client_core_backlog_depth(const client_core_t *c)
+{
+    return c->backlog_ready ? ring_count(&c->backlog) + ring_count(&c->summaries) : 0;
+}
+
+void client_core_store(client_core_t *c, const telemetry_record_t *rec)
+{
+    if (!c->backlog_ready)
+        return;
+
+    uint8_t packed[TELEMETRY_RECORD_SIZE];
+    telemetry_record_pack(rec, packed);
+
+    // When full, fold the oldest readings into a summary instead of
+    // overwriting one. Not while stored records are in flight: the folded
+    // ones would be popped under them.
+    if (c->drain_inflight == 0 && !c->summary_inflight)
+    {
+        int folded = backlog_policy_make_room(&c->policy);
+        if (folded > 0)
+        {
+            c->drain_count = 0;
+            c->drain_next = c->backlog.head;
+            core_log(c, "Backlog full: %d oldest readings summarized.", folded);
+        }
+        else if (folded < 0)
+            core_log(c, "Backlog summary write failed!");
+    }
+
+    uint32_t dropped = c->backlog.dropped;
+    if (ring_push(&c->backlog, packed) != 0)
+    {
+        core_log(c, "Backlog write failed!");
+        return;
+    }
+    c->stored++;
+
+    core_log(c, "Telemetry successfully logged to file.");
+    if (c->backlog.dropped != dropped)
+        core_log(c, "WARNING: Backlog full, oldest reading overwritten.");
+}
+
+// Updates the sampling period from the backlog size
+static void update_throttling(client_core_t *c, uint32_t backlog_count)
+{
+    // --- ADAPTIVE THROTTLING LOGIC ---
+    if (backlog_count > c->cfg.throttling_threshold)
+    {
+        // Calculate new delay based on backlog size, capped
+        uint32_t delay = c->cfg.base_delay_ms + (backlog_count - c->cfg.throttling_threshold) * c->cfg.throttling_factor_ms;
+        if (delay > c->cfg.max_delay_ms)
+            delay = c->cfg.max_delay_ms;
+        c->current_delay_ms = delay;
+
+        core_log(c, "CONGESTION DETECTED: Backlog=%lu. New generation delay: %lus.",
+                 (unsigned long)backlog_count, (unsigned long)(delay / 1000));
+    }
+    else
+    {
+        // If backlog is low, reset to base delay
+        c->current_delay_ms = c->cfg.base_delay_ms;
+        if (backlog_count > 0)
+            core_log(c, "Backlog clearing: %lu remaining. Resetting delay.", (unsigned long)backlog_count);
+    }
+    // --- END ADAPTIVE THROTTLING ---
+}
+
+int client_core_sample(client_core_t *c, telemetry_record_t *rec)
+{
+    float temp, hum;
+
+    if (c->hal.read_sensor(c->hal.ctx, &temp, &hum) != 0 || temp != temp || hum != hum)
+        return -1;
+
+    // Report by exception: drop readings within the deadband
+    uint32_t now = now_ms(c);
+    if (c->cfg.deadband_enabled && deadband_check(&c->deadband, temp, hum, now) == DEADBAND_SKIP)
+        return 0;
+
+    // Build the reading; it is encoded to JSON only when sent
+    telemetry_record_set(rec, c->seq, now, temp, hum, (uint8_t)c->cfg.qos); // dateObserved: internal time for simplicity
+    rec->heartbeat_s = (uint16_t)(c->cfg.heartbeat_interval_ms / 1000); // The network side sends heartbeats meanwhile
+    return 1;
+}
+
+void client_core_sample_queued(client_core_t *c, const telemetry_record_t *rec)
+{
+    c->seq++;
+    deadband_sent(&c->deadband, rec->temp_c100 / 100.0f, rec->hum_c100 / 100.0f, rec->observed);
+}
+
+int client_core_publish(client_core_t *c, const telemetry_record_t *rec)
+{
+    int sent = 0;
+    c->readings++;
+
+    if (!c->hal.link_up(c->hal.ctx))
+        core_log(c, "ERROR: WiFi disconnected. Cannot send live data.");
+    else
+    {
+        uint8_t packed[TELEMETRY_RECORD_SIZE];
+        telemetry_record_pack(rec, packed);
+        sent = queue_datagram(c, packed, sizeof(packed), rec->seq);
+        if (sent)
+            core_log(c, "Sent UDP (Seq %lu)", (unsigned long)rec->seq);
+    }
+
+    // Only when it could not be queued; readings that run out of retries
+    // later are stored by on_done()
+    if (!sent)
+        client_core_store(c, rec);
+    update_throttling(c, c->backlog_ready ? ring_count(&c->backlog) : 0);
+    return sent;
+}
+
+// Pops the delivered batches at the head of the ring
+static void advance_backlog(client_core_t *c)
+{
+    while (c->drain_count > 0 && c->drain_batches[c->drain_first].acked)
+    {
+        // Records may have been overwritten while in flight
+        const client_drain_batch_t *b = &c->drain_batches[c->drain_first];
+        if ((int32_t)(b->pos + b->count - c->backlog.head) > 0)
+            ring_pop(&c->backlog, b->pos + b->count - c->backlog.head);
+        c->drain_first = (c->drain_first + 1) % QOS_WINDOW_MAX;
+        c->drain_count--;
+    }
+    if ((int32_t)(c->drain_next - c->backlog.head) < 0)
+        c->drain_next = c->backlog.head;
+}
+
+// Lists records [pos, pos + count) as a batch in flight (or, with no
+// readable record among them, as already done)
+static void add_drain_batch(client_core_t *c, uint32_t pos, uint32_t count, uint32_t first_seq, int pending)
+{
+    client_drain_batch_t *b = &c->drain_batches[(c->drain_first + c->drain_count) % QOS_WINDOW_MAX];
+    b->pos = pos;
+    b->count = count;
+    b->seq = first_seq;
+    b->pending = (uint8_t)pending;
+    b->acked = (uint8_t)!pending;
+    c->drain_count++;
+    if (pending)
+        c->drain_inflight++;
+}
+
+// Hands the oldest stored summary to the QoS window
+static void send_stored_summary(client_core_t *c)
+{
+    uint8_t packed[TELEMETRY_SUMMARY_SIZE];
+    telemetry_summary_t s;
+
+    if (ring_read(&c->summaries, c->summaries.head, packed) != 0 ||
+        telemetry_summary_unpack(packed, sizeof(packed), &s) != 0)
+    {
+        core_log(c, "Unreadable summary record. Skipping it.");
+        ring_pop(&c->summaries, 1);
+        return;
+    }
+    if (c->tx.inflight >= c->cfg.window_size - 1)
+        return;
+    if (!queue_datagram(c, packed, sizeof(packed), s.first_seq))
+    {
+        client_core_pause_drain(c, c->cfg.drain_retry_ms);
+        return;
+    }
+    c->summary_inflight = 1;
+    c->summary_seq = s.first_seq;
+    core_log(c, "--- Replaying a summary of %lu readings ---", (unsigned long)s.count);
+}
+
+// Incremental backlog drain, called on every poll. Packs consecutive stored
+// records into batches of up to CLIENT_DRAIN_BATCH_MAX (as many as fit in
+// one datagram), hands them to the QoS window from a persistent read cursor
+// within a time and byte budget, and never waits for ACKs: one ACK confirms
+// a whole batch, and batches are popped by advance_backlog() once they and
+// all older ones are ACKed. One window slot is always left for live
+// readings. After a batch runs out of retries the drain pauses for a
+// jittered drain_retry_ms..drain_retry_max_ms, or for the server's
+// retryAfter after a NACK, and restarts from the head.
+static void transmit_stored_data(client_core_t *c)
+{
+    if (!c->backlog_ready)
+        return;
+
+    advance_backlog(c);
+    if (ring_count(&c->backlog) == 0 && ring_count(&c->summaries) == 0)
+        return;
+
+    if (c->drain_failed)
+    {
+        if (c->drain_inflight > 0 || c->summary_inflight || now_ms(c) - c->drain_failed_at < c->drain_pause_ms)
+            return;
+        c->drain_failed = 0;
+        c->drain_next = c->backlog.head;
+        c->drain_count = 0;
+    }
+
+    // Summaries hold the oldest readings and go first, one at a time, unless
+    // drain_recent_first replays the full-resolution readings before them
+    if (ring_count(&c->summaries) > 0 && (!c->cfg.drain_recent_first || ring_count(&c->backlog) == 0))
+    {
+        if (!c->summary_inflight)
+            send_stored_summary(c);
+        return;
+    }
+
+    if (c->drain_next == c->backlog.head && c->drain_count == 0)
+        core_log(c, "--- Replaying %lu stored readings ---", (unsigned long)ring_count(&c->backlog));
+
+    static telemetry_record_t recs[CLIENT_DRAIN_BATCH_MAX];
+    static uint8_t packed[CLIENT_DRAIN_BATCH_MAX * TELEMETRY_RECORD_SIZE];
+    static char probe[TELEMETRY_BATCH_JSON_MAX];
+    uint32_t start = now_ms(c);
+    size_t bytes = 0;
+
+    while (c->drain_next != c->backlog.tail && c->drain_count < QOS_WINDOW_MAX &&
+           c->tx.inflight < c->cfg.window_size - 1 &&
+           bytes < c->cfg.drain_byte_budget && now_ms(c) - start < c->cfg.drain_time_budget_ms)
+    {
+        uint32_t pos = c->drain_next;
+        uint32_t end[CLIENT_DRAIN_BATCH_MAX]; // Ring counter just past each record read
+        int n = 0;
+
+        // The CRC catches records torn by a reset or worn flash
+        while (n < CLIENT_DRAIN_BATCH_MAX && pos != c->backlog.tail)
+        {
+            uint8_t *p = packed + n * TELEMETRY_RECORD_SIZE;
+            if (ring_read(&c->backlog, pos++, p) != 0 || telemetry_record_unpack(p, &recs[n]) != 0)
+            {
+                core_log(c, "Unreadable backlog record. Skipping it.");
+                continue;
+            }
+            end[n++] = pos;
+        }
+        if (n == 0)
+        {
+            add_drain_batch(c, c->drain_next, pos - c->drain_next, 0, 0);
+            c->drain_next = pos;
+            continue;
+        }
+
+        // Keep only what fits in one datagram
+        int used = 1;
+        int wire = n > 1 ? telemetry_batch_to_json(recs, n, c->cfg.device_id, c->boot, probe, sizeof(probe), &used)
+                         : telemetry_record_to_json(recs, c->cfg.device_id, c->boot, probe, sizeof(probe));
+        if (wire < 0)
+        {
+            core_log(c, "ERROR: Stored reading does not fit in a datagram.");
+            break;
+        }
+        pos = end[used - 1];
+
+        if (!queue_datagram(c, packed, (size_t)used * TELEMETRY_RECORD_SIZE, recs[0].seq))
+        {
+            // Link is down, retry later
+            client_core_pause_drain(c, c->cfg.drain_retry_ms);
+            break;
+        }
+        add_drain_batch(c, c->drain_next, pos - c->drain_next, recs[0].seq, 1);
+        c->drain_next = pos;
+        bytes += (size_t)wire;
+    }
+}
+
+// Sends an 8-byte heartbeat when nothing went to the server for
+// heartbeat_interval_ms, so report-by-exception silence is not taken for a
+// failure, and when the backlog depth changed (at most every
+// heartbeat_min_gap_ms) so the server sees devices catching up. Not ACKed.
+static void send_heartbeat(client_core_t *c, int link_up)
+{
+    uint32_t now = now_ms(c);
+    uint32_t depth = client_core_backlog_depth(c);
+
+    int idle = now - c->last_udp_tx >= c->cfg.heartbeat_interval_ms;
+    int changed = depth != c->reported_backlog && now - c->last_heartbeat >= c->cfg.heartbeat_min_gap_ms;
+    if ((!idle && !changed) || !link_up)
+        return;
+
+    uint8_t packet[HEARTBEAT_SIZE];
+    heartbeat_pack(c->handle, depth, packet);
+    if (c->hal.udp_send(c->hal.ctx, packet, HEARTBEAT_SIZE) != 0)
+        return;
+    c->last_udp_tx = now;
+    c->last_heartbeat = now;
+    c->reported_backlog = depth;
+    c->heartbeats++;
+}
+
+void client_core_poll(client_core_t *c)
+{
+    // The whole fleet sees an access point come back at once: spread the drains
+    int link_up = c->hal.link_up(c->hal.ctx) != 0;
+    if (link_up && !c->link_was_up)
+        client_core_pause_drain(c, random_below(&c->hal, c->cfg.drain_start_spread_ms));
+    c->link_was_up = link_up;
+
+    service_qos(c);
+    transmit_stored_data(c);
+    send_heartbeat(c, link_up);
+}
@@ -0,0 +1,190 @@
+// client_core.h
+// Platform-independent engine of the telemetry clients.
+//
+// Holds the QoS 1 protocol, the backlog and its drain, the adaptive
+// throttling, report-by-exception and heartbeats that cli_esp.c and
+// cli_pico.c used to carry as two copies. The platform supplies a small HAL:
+// UDP send/receive, the clock, a random source, the sensor, the backlog
+// storage (ring_io_t, one per ring) and an optional log line sink. The
+// sketches wrap WiFiUDP, millis(), the DHT and LittleFS/SPIFFS; fleet_sim.c
+// runs thousands of cores in one Linux process against srv.c.
+//
+// Two sides, which may run on different cores:
+//  - the sampler calls client_core_sample() and hands the reading over (the
+//    sketches pass it through a sample_queue_t), then
+//    client_core_sample_queued() once it was accepted;
+//  - the network side calls client_core_publish() for each reading and
+//    client_core_poll() frequently. It owns everything else.
+// The sampler only reads current_delay_ms from the network side.
+//
+// Copy client_core.h/.c next to the sketch with the other shared modules.
+#ifndef CLIENT_CORE_H
+#define CLIENT_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "qos_window.h"
+#include "backlog_ring.h"
+#include "backlog_policy.h"
+#include "telemetry_record.h"
+#include "deadband.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLIENT_DRAIN_BATCH_MAX (QOS_PAYLOAD_MAX / TELEMETRY_RECORD_SIZE) // Stored readings per datagram
+#define CLIENT_LOG_MAX 128 // Longest log line
+
+typedef struct
+{
+    // Sends one datagram to the server. Returns 0 on success.
+    int (*udp_send)(void *ctx, const void *buf, size_t len);
+    // Copies one received datagram into buf. Returns its length, 0 if none
+    // is waiting. Never blocks.
+    int (*udp_recv)(void *ctx, char *buf, size_t len);
+    // Non-zero while the network is up (Wi-Fi associated)
+    int (*link_up)(void *ctx);
+    uint32_t (*millis)(void *ctx);
+    uint32_t (*random)(void *ctx, uint32_t max); // 0..max-1
+    // Reads the sensor. Returns 0 on success.
+    int (*read_sensor)(void *ctx, float *temp_c, float *hum_pct);
+    // Waits about ms while a live reading waits for a window slot. NULL: the
+    // reading is stored in the backlog instead of waiting.
+    void (*wait)(void *ctx, uint32_t ms);
+    // Receives one log line (no newline). NULL: silent.
+    void (*log)(void *ctx, const char *line);
+    ring_io_t backlog_io; // Reading ring files
+    ring_io_t summary_io; // Summary ring files
+    void *ctx;            // Passed to the hooks above
+} client_hal_t;
+
+typedef struct
+{
+    const char *device_id;
+    int qos;                     // 0 = best effort, 1 = guaranteed delivery
+    int window_size;             // Unacknowledged seqs in flight (one is kept for live readings)
+    uint32_t ack_timeout_ms;     // ACK wait until the round trip is measured
+    int max_retries;             // Transmissions per seq before it is stored
+    uint32_t backlog_capacity;   // Stored readings
+    uint32_t summary_capacity;   // Stored summaries
+    uint32_t summary_group;      // Readings folded into one summary when the backlog is full
+    int drain_recent_first;      // Replay the readings before the older summaries
+    uint32_t drain_time_budget_ms; // Per poll
+    uint32_t drain_byte_budget;    // Wire bytes per poll
+    uint32_t drain_retry_ms;       // Pause after a stored record runs out of retries...
+    uint32_t drain_retry_max_ms;   // ...growing with jitter up to this
+    uint32_t drain_start_spread_ms; // Random drain delay after boot or a link coming back
+    uint32_t base_delay_ms;        // Sampling period
+    uint32_t max_delay_ms;         // Throttled period cap
+    uint32_t throttling_threshold; // Backlog size where throttling starts
+    uint32_t throttling_factor_ms; // Added period per stored reading over the threshold
+    int deadband_enabled;
+    float deadband_temp_c;
+    float deadband_hum_pct;
+    uint32_t refresh_interval_ms;  // Longest time between readings with the deadband on
+    uint32_t heartbeat_interval_ms; // Heartbeat after this long without sending
+    uint32_t heartbeat_min_gap_ms;  // Backlog depth changes reported at most this often
+    uint32_t boot_id;               // Sent as "boot" with every reading (0 = drawn from the HAL's random source)
+} client_config_t;
+
+// Backlog replay: records [backlog.head, drain_next) have been handed to the
+// window as batches of consecutive records, listed oldest first
+typedef struct
+{
+    uint32_t pos;   // Ring counter of the first record
+    uint32_t count; // Records covered, unreadable ones included
+    uint32_t seq;   // Seq of the first reading (names the batch in the window)
+    uint8_t pending; // Waiting for ACK
+    uint8_t acked;   // Delivered, waiting for older batches
+} client_drain_batch_t;
+
+typedef struct
+{
+    client_config_t cfg;
+    client_hal_t hal;
+    qos_window_t tx;        // Outstanding QoS 1 datagrams
+    uint32_t handle;        // Names the device in heartbeat datagrams
+    uint32_t boot;          // New on every boot: seqs restart, and the server must know
+
+    // Sampler side
+    uint32_t seq;           // Next sequence number
+    deadband_t deadband;    // Last reading sent
+    volatile uint32_t current_delay_ms; // Sampling period, set by the network side
+
+    // Backlog (network side)
+    backlog_ring_t backlog;   // Undelivered readings, oldest first
+    backlog_ring_t summaries; // Summaries of older readings, oldest first
+    backlog_policy_t policy;  // Folds readings into summaries when the backlog is full
+    int backlog_ready;        // Set once both rings are open
+    int summary_inflight;     // The oldest summary is in the window...
+    uint32_t summary_seq;     // ...under its first seq
+    client_drain_batch_t drain_batches[QOS_WINDOW_MAX];
+    uint32_t drain_next;
+    int drain_first;          // Oldest batch
+    int drain_count;          // Batches listed
+    int drain_inflight;
+    int drain_failed;         // A stored record ran out of retries (or the drain is held off)
+    uint32_t drain_failed_at;
+    uint32_t drain_pause_ms;  // How long the drain waits after drain_failed_at
+    uint32_t drain_backoff_ms; // Last jittered pause after a failure
+    uint32_t nack_retry_after; // retryAfter of the NACK being handled (0 = none)
+
+    // Heartbeats and link state (network side)
+    uint32_t last_udp_tx;     // Last datagram sent to the server
+    uint32_t last_heartbeat;
+    uint32_t reported_backlog;
+    int link_was_up;
+
+    // Counters for logs and the simulator
+    uint32_t readings;        // Readings published
+    uint32_t stored;          // Readings written to the backlog
+    uint32_t heartbeats;      // Heartbeat datagrams sent
+} client_core_t;
+
+// Fills cfg with the sketches' defaults for device_id
+void client_config_defaults(client_config_t *cfg, const char *device_id);
+
+// Sets up the core; the QoS window's jitter is seeded from the HAL's random
+// source, and the drain starts after a random delay. Does not touch the
+// backlog (client_core_open_backlog).
+void client_core_init(client_core_t *c, const client_config_t *cfg, const client_hal_t *hal);
+
+// Opens (or creates) the backlog and summary rings. Returns 0 on success.
+int client_core_open_backlog(client_core_t *c);
+
+// Continues the seqs after the newest stored reading or summary. Call once
+// the backlog is open and anything to import (an older firmware's log) has
+// been stored, before the first reading is taken.
+void client_core_resume_seq(client_core_t *c);
+
+// Sampler side. Reads the sensor and applies the deadband. Returns 1 with
+// *rec filled if the reading should be sent, 0 if it is within the deadband,
+// -1 if the sensor read failed. The seq is used up (and the deadband moved)
+// only by client_core_sample_queued(), once the reading was handed over.
+int client_core_sample(client_core_t *c, telemetry_record_t *rec);
+void client_core_sample_queued(client_core_t *c, const telemetry_record_t *rec);
+
+// Network side. Sends one reading through the QoS window, or stores it when
+// the link is down; readings that run out of retries are stored later.
+// Returns 1 if it was handed to the window.
+int client_core_publish(client_core_t *c, const telemetry_record_t *rec);
+
+// Network side, called frequently: ACKs/NACKs, retransmissions, the backlog
+// drain and heartbeats
+void client_core_poll(client_core_t *c);
+
+// Stores a reading in the backlog (summarizing the oldest when it is full)
+void client_core_store(client_core_t *c, const telemetry_record_t *rec);
+
+// Holds the backlog drain for ms; it then restarts from the head
+void client_core_pause_drain(client_core_t *c, uint32_t ms);
+
+// Readings and summaries waiting in the backlog
+uint32_t client_core_backlog_depth(const client_core_t *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
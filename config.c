@@ -0,0 +1,447 @@
+// config.c
+// Server configuration file, overrides and validation. See config.h.
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+
+// Global keys: numbers are checked against [min, max] by config_check()
+static const struct
+{
+    const char *key;
+    size_t offset;
+    size_t size;  // 0 for a uint32_t, else the string buffer size
+    uint32_t min, max;
+    int reload;   // Applied again on SIGHUP
+} config_keys[] = {
+#define NUM(k, lo, hi, r) {#k, offsetof(server_config_t, k), 0, lo, hi, r}
+#define STR(k) {#k, offsetof(server_config_t, k), sizeof(((server_config_t *)0)->k), 0, 0, 0}
+    NUM(port, 1, 65535, 0),
+    NUM(metrics_port, 1, 65535, 0),
+    NUM(max_devices, 1, 1000000, 0),
+    STR(alert_log),
+    STR(mqtt_address),
+    STR(mqtt_tls),
+    STR(mqtt_truststore),
+    STR(mqtt_client_id),
+    STR(mqtt_username),
+    STR(mqtt_password),
+    NUM(buffer_size, 512, 65536, 1),
+    NUM(ingest_batch, 1, 1024, 1),
+    NUM(socket_rcvbuf, 0, 1u << 30, 1),
+    NUM(mqtt_publish_timeout_ms, 1, 60000, 1),
+    NUM(monitor_interval_sec, 1, 3600, 1),
+    NUM(dedup_window, 0, DEDUP_WINDOW_MAX, 1),
+    NUM(gap_grace_sec, 1, 30 * 86400, 1),
+    NUM(gap_alerts, 0, 1, 1),
+    NUM(replay_admission, 0, 1, 1),
+    NUM(replay_burst_ms, 0, 60000, 1),
+    NUM(compaction_interval_sec, 1, 7 * 86400, 1),
+    NUM(compaction_io_bytes_per_sec, 1024, 1u << 30, 1),
+#undef NUM
+#undef STR
+};
+
+#define CONFIG_KEY_COUNT (sizeof(config_keys) / sizeof(config_keys[0]))
+
+static uint32_t *key_u32(const server_config_t *c, size_t k)
+{
+    return (uint32_t *)((char *)c + config_keys[k].offset);
+}
+
+static char *key_str(const server_config_t *c, size_t k)
+{
+    return (char *)c + config_keys[k].offset;
+}
+
+// Sets a global key. Returns 0, -1 for a bad value, -2 for an unknown key.
+static int set_global(server_config_t *c, const char *key, const char *value)
+{
+    for (size_t k = 0; k < CONFIG_KEY_COUNT; ++k)
+    {
+        if (strcmp(config_keys[k].key, key) != 0)
+            continue;
+        if (config_keys[k].size)
+        {
+            if (strlen(value) >= config_keys[k].size)
+                return -1;
+            strcpy(key_str(c, k), value);
+            return 0;
+        }
+
+        char *end;
+        errno = 0;
+        unsigned long v = strtoul(value, &end, 10);
+        if (end == value || *end || errno || v > UINT32_MAX || *value == '-')
+            return -1;
+        *key_u32(c, k) = (uint32_t)v;
+        return 0;
+    }
+    return -2;
+}
+
+// Strips a comment and surrounding whitespace in place
+static char *trim(char *s)
+{
+    char *hash = strchr(s, '#');
+    if (hash)
+        *hash = '\0';
+    while (isspace((unsigned char)*s))
+        s++;
+    size_t n = strlen(s);
+    while (n > 0 && isspace((unsigned char)s[n - 1]))
+        s[--n] = '\0';
+    return s;
+}
+
+int config_load(const char *path, server_config_t *c, char *err, size_t errlen)
+{
+    FILE *f = fopen(path, "r");
+    char line[512];
+    int lineno = 0;
+    tenant_config_t *cur = NULL;
+    char msg[192];
+
+    if (!f)
+    {
+        snprintf(err, errlen, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        lineno++;
+        char *s = trim(line);
+        if (!*s)
+            continue;
+
+        if (*s == '[')
+        {
+            char *close = strchr(s, ']');
+            if (!close || close[1] || strncmp(s, "[tenant ", 8) != 0)
+            {
+                snprintf(msg, sizeof(msg), "expected [tenant NAME]");
+                goto fail;
+            }
+            *close = '\0';
+            char *name = trim(s + 8);
+            if (strlen(name) >= TENANT_NAME_LEN)
+            {
+                snprintf(msg, sizeof(msg), "tenant name longer than %d characters", TENANT_NAME_LEN - 1);
+                goto fail;
+            }
+            if (c->tenant_count == TENANT_MAX)
+            {
+                snprintf(msg, sizeof(msg), "more than %d tenants", TENANT_MAX);
+                goto fail;
+            }
+            for (int i = 0; i < c->tenant_count; ++i)
+            {
+                if (strcmp(c->tenants[i].name, name) == 0)
+                {
+                    snprintf(msg, sizeof(msg), "tenant %s defined twice", name);
+                    goto fail;
+                }
+            }
+            cur = &c->tenants[c->tenant_count++];
+            *cur = c->tenant_defaults;
+            strcpy(cur->name, name);
+            continue;
+        }
+
+        char *eq = strchr(s, '=');
+        if (!eq)
+        {
+            snprintf(msg, sizeof(msg), "expected key = value");
+            goto fail;
+        }
+        *eq = '\0';
+        char *key = trim(s), *value = trim(eq + 1);
+
+        // Global keys, then tenant keys as defaults, before the first section
+        int rc = cur ? tenant_config_set(cur, key, value) : set_global(c, key, value);
+        if (rc == -2)
+            rc = tenant_config_set(&c->tenant_defaults, key, value);
+        if (rc < 0)
+        {
+            snprintf(msg, sizeof(msg), "bad value or unknown key%s: %s = %s",
+                     cur ? " in a [tenant] section" : "", key, value);
+            goto fail;
+        }
+    }
+    fclose(f);
+    return 0;
+
+fail:
+    fclose(f);
+    snprintf(err, errlen, "%s:%d: %s", path, lineno, msg);
+    return -1;
+}
+
+void config_finish(server_config_t *c)
+{
+    if (c->tenant_count == 0)
+        c->tenants[c->tenant_count++] = c->tenant_defaults;
+}
+
+int config_override(server_config_t *c, const char *assignment, char *err, size_t errlen)
+{
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", assignment);
+
+    char *eq = strchr(buf, '=');
+    if (!eq)
+    {
+        snprintf(err, errlen, "%s: expected key=value", assignment);
+        return -1;
+    }
+    *eq = '\0';
+    char *key = trim(buf), *value = trim(eq + 1);
+
+    // NAME.key: one tenant
+    char *dot = strchr(key, '.');
+    if (dot)
+    {
+        *dot = '\0';
+        for (int i = 0; i < c->tenant_count; ++i)
+        {
+            if (strcmp(c->tenants[i].name, key) != 0)
+                continue;
+            if (tenant_config_set(&c->tenants[i], dot + 1, value) < 0)
+            {
+                snprintf(err, errlen, "%s: bad value or unknown tenant key", assignment);
+                return -1;
+            }
+            return 0;
+        }
+        snprintf(err, errlen, "%s: no tenant %s", assignment, key);
+        return -1;
+    }
+
+    int rc = set_global(c, key, value);
+    if (rc == -2)
+    {
+        // A tenant key without a tenant: every tenant
+        rc = tenant_config_set(&c->tenant_defaults, key, value);
+        for (int i = 0; rc == 0 && i < c->tenant_count; ++i)
+            rc = tenant_config_set(&c->tenants[i], key, value);
+    }
+    if (rc < 0)
+    {
+        snprintf(err, errlen, "%s: bad value or unknown key", assignment);
+        return -1;
+    }
+    return 0;
+}
+
+void config_share_devices(server_config_t *c)
+{
+    uint32_t used = 0;
+    int unset = 0;
+
+    for (int i = 0; i < c->tenant_count; ++i)
+    {
+        used += c->tenants[i].max_devices;
+        unset += c->tenants[i].max_devices == 0;
+    }
+    for (int i = 0; unset && i < c->tenant_count; ++i)
+    {
+        if (c->tenants[i].max_devices == 0)
+            c->tenants[i].max_devices = used < c->max_devices ? (c->max_devices - used) / (uint32_t)unset : 0;
+    }
+}
+
+int config_check(const server_config_t *c, char *err, size_t errlen)
+{
+    uint64_t reserved = 0;
+    char msg[192];
+
+    for (size_t k = 0; k < CONFIG_KEY_COUNT; ++k)
+    {
+        uint32_t v;
+        if (config_keys[k].size)
+            continue;
+        v = *key_u32(c, k);
+        if (v < config_keys[k].min || v > config_keys[k].max)
+        {
+            snprintf(err, errlen, "%s = %u is outside %u..%u", config_keys[k].key, v, config_keys[k].min,
+                     config_keys[k].max);
+            return -1;
+        }
+    }
+
+    int tls_off = strcmp(c->mqtt_tls, "off") == 0;
+    if (!tls_off && strcmp(c->mqtt_tls, "verify") != 0 && strcmp(c->mqtt_tls, "insecure") != 0)
+    {
+        snprintf(err, errlen, "mqtt_tls must be verify, insecure or off (got %s)", c->mqtt_tls);
+        return -1;
+    }
+    int tls_scheme = strncmp(c->mqtt_address, "ssl://", 6) == 0 || strncmp(c->mqtt_address, "mqtts://", 8) == 0;
+    if (tls_off == tls_scheme)
+    {
+        snprintf(err, errlen, "mqtt_address %s does not match mqtt_tls %s (ssl:// and mqtts:// need TLS, tcp:// needs off)",
+                 c->mqtt_address, c->mqtt_tls);
+        return -1;
+    }
+    if (!c->mqtt_client_id[0] || !c->alert_log[0])
+    {
+        snprintf(err, errlen, "mqtt_client_id and alert_log may not be empty");
+        return -1;
+    }
+    if (c->port == c->metrics_port)
+    {
+        snprintf(err, errlen, "port and metrics_port are both %u", c->port);
+        return -1;
+    }
+
+    if (c->tenant_count == 0)
+    {
+        snprintf(err, errlen, "no tenants");
+        return -1;
+    }
+    for (int i = 0; i < c->tenant_count; ++i)
+    {
+        const tenant_config_t *t = &c->tenants[i];
+        if (tenant_config_check(t, msg, sizeof(msg)) < 0)
+        {
+            snprintf(err, errlen, "%s", msg);
+            return -1;
+        }
+        reserved += t->max_devices;
+        if (t->port && ((uint32_t)t->port == c->port || (uint32_t)t->port == c->metrics_port))
+        {
+            snprintf(err, errlen, "tenant %s: port %d is the shared or the metrics port (leave port out)", t->name,
+                     t->port);
+            return -1;
+        }
+        for (int j = 0; j < i; ++j)
+        {
+            if (t->port && t->port == c->tenants[j].port)
+            {
+                snprintf(err, errlen, "tenants %s and %s both use port %d", c->tenants[j].name, t->name, t->port);
+                return -1;
+            }
+        }
+    }
+    if (reserved > c->max_devices)
+    {
+        snprintf(err, errlen, "the tenants' max_devices add up to %llu, over max_devices = %u",
+                 (unsigned long long)reserved, c->max_devices);
+        return -1;
+    }
+    return 0;
+}
+
+// Appends a name to a ", "-separated list
+static void list_add(char *out, size_t outlen, const char *name)
+{
+    size_t n = strlen(out);
+    snprintf(out + n, outlen - n, "%s%s", n ? ", " : "", name);
+}
+
+int config_startup_changes(const server_config_t *a, const server_config_t *b, char *out, size_t outlen)
+{
+    int changes = 0;
+    char name[TENANT_NAME_LEN + 32];
+
+    out[0] = '\0';
+    for (size_t k = 0; k < CONFIG_KEY_COUNT; ++k)
+    {
+        if (config_keys[k].reload)
+            continue;
+        int differ = config_keys[k].size ? strcmp(key_str(a, k), key_str(b, k)) != 0
+                                         : *key_u32(a, k) != *key_u32(b, k);
+        if (differ)
+        {
+            list_add(out, outlen, config_keys[k].key);
+            changes++;
+        }
+    }
+
+    int same_tenants = a->tenant_count == b->tenant_count;
+    for (int i = 0; same_tenants && i < a->tenant_count; ++i)
+        same_tenants = strcmp(a->tenants[i].name, b->tenants[i].name) == 0;
+    if (!same_tenants)
+    {
+        list_add(out, outlen, "the set of tenants");
+        return changes + 1;
+    }
+
+    for (int i = 0; i < a->tenant_count; ++i)
+    {
+        const tenant_config_t *ta = &a->tenants[i], *tb = &b->tenants[i];
+        const struct
+        {
+            const char *key;
+            int differ;
+        } fields[] = {
+            {"match", strcmp(ta->match, tb->match) != 0},
+            {"network", ta->net != tb->net || ta->netmask != tb->netmask},
+            {"port", ta->port != tb->port},
+            {"topic_prefix", strcmp(ta->topic_prefix, tb->topic_prefix) != 0},
+            {"data_dir", strcmp(ta->data_dir, tb->data_dir) != 0},
+            {"max_devices", ta->max_devices != tb->max_devices},
+        };
+        for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); ++f)
+        {
+            if (fields[f].differ)
+            {
+                snprintf(name, sizeof(name), "%s.%s", ta->name, fields[f].key);
+                list_add(out, outlen, name);
+                changes++;
+            }
+        }
+    }
+    return changes;
+}
+
+void config_apply_reloadable(server_config_t *running, const server_config_t *next)
+{
+    for (size_t k = 0; k < CONFIG_KEY_COUNT; ++k)
+    {
+        if (config_keys[k].reload)
+            *key_u32(running, k) = *key_u32(next, k);
+    }
+
+    for (int i = 0; i < running->tenant_count; ++i)
+    {
+        tenant_config_t *dst = &running->tenants[i];
+        for (int j = 0; j < next->tenant_count; ++j)
+        {
+            const tenant_config_t *src = &next->tenants[j];
+            if (strcmp(dst->name, src->name) != 0)
+                continue;
+            dst->temp_min = src->temp_min;
+            dst->temp_max = src->temp_max;
+            dst->hum_min = src->hum_min;
+            dst->hum_max = src->hum_max;
+            dst->temp_diff = src->temp_diff;
+            dst->hum_diff = src->hum_diff;
+            dst->inactivity_timeout_sec = src->inactivity_timeout_sec;
+            dst->readings_per_sec = src->readings_per_sec;
+            dst->burst_ms = src->burst_ms;
+            dst->alerts_per_sec = src->alerts_per_sec;
+            dst->replay_readings_per_sec = src->replay_readings_per_sec;
+        }
+    }
+}
+
+void config_write(FILE *f, const server_config_t *c)
+{
+    for (size_t k = 0; k < CONFIG_KEY_COUNT; ++k)
+    {
+        if (!config_keys[k].size)
+            fprintf(f, "%s = %u\n", config_keys[k].key, *key_u32(c, k));
+        else if (strcmp(config_keys[k].key, "mqtt_password") == 0)
+            fprintf(f, "%s = %s\n", config_keys[k].key, key_str(c, k)[0] ? "********" : "");
+        else
+            fprintf(f, "%s = %s\n", config_keys[k].key, key_str(c, k));
+    }
+    for (int i = 0; i < c->tenant_count; ++i)
+    {
+        fputc('\n', f);
+        tenant_config_write(f, &c->tenants[i]);
+    }
+}
@@ -0,0 +1,89 @@
+// config.h
+// Runtime configuration of the server: a key = value file, overrides from
+// the environment and the command line, and validation.
+//
+// Global keys come first, then optional [tenant NAME] sections (see
+// tenant.h). A tenant key given before the first section (temp_max = 45)
+// is the default of every section, and of the single tenant used when the
+// file has no sections. On the command line, "key=value" sets a global key
+// (a tenant key is set for every tenant) and "NAME.key=value" a key of
+// tenant NAME.
+//
+// Keys marked "reloadable" are applied again on SIGHUP; the others only
+// take effect at startup (the server reports them if they change).
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tenant.h"
+
+#define DEDUP_WINDOW_MAX 4096 // Largest dedup_window: the per-device bitmap of received seqs
+
+typedef struct
+{
+    // Startup only
+    uint32_t port;             // Shared UDP port
+    uint32_t metrics_port;     // /metrics, /devices and /tenants
+    uint32_t max_devices;      // Devices across all tenants
+    char alert_log[256];       // Alert log file
+    char mqtt_address[256];
+    char mqtt_tls[16];         // verify, insecure or off
+    char mqtt_truststore[256]; // CA file ("" = system CAs)
+    char mqtt_client_id[64];
+    char mqtt_username[64];
+    char mqtt_password[128];
+
+    // Reloadable
+    uint32_t buffer_size;             // Largest datagram accepted
+    uint32_t ingest_batch;            // Datagrams read from a socket before the next one's turn
+    uint32_t socket_rcvbuf;           // SO_RCVBUF of the UDP sockets in bytes (0 = system default)
+    uint32_t mqtt_publish_timeout_ms; // PUBACK wait of an alert
+    uint32_t monitor_interval_sec;    // Inactivity and gap expiry checks
+    uint32_t dedup_window;            // Seqs below the highest one checked for duplicates (up to DEDUP_WINDOW_MAX)
+    uint32_t gap_grace_sec;           // Time a gap may still be filled by replay
+    uint32_t gap_alerts;              // DATA_LOSS alerts (0/1)
+    uint32_t replay_admission;        // NACK replay over the budget (0/1)
+    uint32_t replay_burst_ms;         // Idle replay capacity that may be used at once
+    uint32_t compaction_interval_sec;
+    uint32_t compaction_io_bytes_per_sec;
+
+    // Tenants. Reloadable: thresholds, inactivity_timeout_sec and the
+    // quotas; the rest, and the set of tenants, only at startup.
+    tenant_config_t tenant_defaults;
+    tenant_config_t tenants[TENANT_MAX];
+    int tenant_count; // 0 until config_finish()
+} server_config_t;
+
+// Reads a file on top of c. Returns 0, or -1 with "file:line: message" in err.
+int config_load(const char *path, server_config_t *c, char *err, size_t errlen);
+
+// Adds the implicit tenant if the file had no sections. Call after
+// config_load() and before config_override().
+void config_finish(server_config_t *c);
+
+// Applies "key=value" or "NAME.key=value". Returns 0, or -1 with a message.
+int config_override(server_config_t *c, const char *assignment, char *err, size_t errlen);
+
+// Gives the tenants that set no max_devices equal shares of the device
+// table the others leave. Call after the overrides.
+void config_share_devices(server_config_t *c);
+
+// Checks every value, and the tenants against each other (their max_devices
+// must fit in the shared table, so no tenant can use up another's slots).
+// Returns 0, or -1 with a message in err.
+int config_check(const server_config_t *c, char *err, size_t errlen);
+
+// Lists the startup-only settings that differ between a and b, separated
+// by ", ", in out. Returns how many differ.
+int config_startup_changes(const server_config_t *a, const server_config_t *b, char *out, size_t outlen);
+
+// Copies the reloadable settings of next into running, field by field, as
+// other threads read running. Tenants are matched by name.
+void config_apply_reloadable(server_config_t *running, const server_config_t *next);
+
+// Writes c in the file format (the MQTT password masked)
+void config_write(FILE *f, const server_config_t *c);
+
+#endif
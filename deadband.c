@@ -0,0 +1,36 @@
+// deadband.c
+// Report-by-exception filter. See deadband.h.
+#include <string.h>
+#include "deadband.h"
+
+static float absf(float v)
+{
+    return v < 0 ? -v : v;
+}
+
+void deadband_init(deadband_t *d, float temp_delta, float hum_delta, uint32_t refresh_ms)
+{
+    memset(d, 0, sizeof(*d));
+    d->temp_delta = temp_delta;
+    d->hum_delta = hum_delta;
+    d->refresh_ms = refresh_ms;
+}
+
+int deadband_check(deadband_t *d, float temp, float hum, uint32_t now_ms)
+{
+    if (!d->has_last || now_ms - d->last_sent_ms >= d->refresh_ms)
+        return DEADBAND_REFRESH;
+    if (absf(temp - d->last_temp) > d->temp_delta || absf(hum - d->last_hum) > d->hum_delta)
+        return DEADBAND_CHANGE;
+
+    d->skipped++;
+    return DEADBAND_SKIP;
+}
+
+void deadband_sent(deadband_t *d, float temp, float hum, uint32_t now_ms)
+{
+    d->has_last = 1;
+    d->last_temp = temp;
+    d->last_hum = hum;
+    d->last_sent_ms = now_ms;
+}
@@ -0,0 +1,44 @@
+// deadband.h
+// Report-by-exception filter for the clients. A reading is sent only when
+// temperature or humidity moved by more than a delta since the last reading
+// sent, or when no reading was sent for the refresh interval. Liveness in
+// between is covered by heartbeat datagrams (heartbeat.h).
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEADBAND_SKIP 0      // Within the deadband: do not send
+#define DEADBAND_CHANGE 1    // Moved by more than a delta
+#define DEADBAND_REFRESH 2   // First reading, or the refresh interval expired
+
+typedef struct
+{
+    float temp_delta;      // degC
+    float hum_delta;       // %RH
+    uint32_t refresh_ms;   // Max time between readings sent
+    int has_last;
+    float last_temp;       // Last reading sent
+    float last_hum;
+    uint32_t last_sent_ms;
+    uint32_t skipped;      // Readings suppressed so far
+} deadband_t;
+
+void deadband_init(deadband_t *d, float temp_delta, float hum_delta, uint32_t refresh_ms);
+
+// Decides whether a reading is sent. Counts suppressed ones; does not
+// change the reference values (see deadband_sent).
+int deadband_check(deadband_t *d, float temp, float hum, uint32_t now_ms);
+
+// Makes a reading that was actually sent the new reference
+void deadband_sent(deadband_t *d, float temp, float hum, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
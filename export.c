@@ -0,0 +1,808 @@
+// export.c
+// Columnar export of stored telemetry and alerts to Arrow IPC streams.
+// Build: make telemetry_export
+// Run:   ./telemetry_export [options]
+//
+//   -d DIR      segment directory written by the server (default: data)
+//   -a FILE     alert log to export (default: alerts.log, "-" to skip)
+//   -o FILE     telemetry output (default: telemetry.arrows)
+//   -A FILE     alerts output (default: alerts.arrows)
+//   -f TIME     only rows at or after TIME (epoch seconds or YYYY-MM-DD[THH:MM:SS], UTC)
+//   -t TIME     only rows before TIME
+//   -D ID       only this device (repeatable)
+//   -j N        decoder threads (default: number of online CPUs)
+//   -r RES      raw (default), 1m, 1h or auto: export rollups written by the
+//               server's compaction job; auto picks the finest resolution
+//               still retained for the start of the range (see rollup.h)
+//
+// Device ids (and alert types) are dictionary-encoded. Segment files are
+// mapped with mmap and their chunks are decoded by a pool of threads. Each
+// thread fills its own fixed-size record batch and appends it to the output
+// under a lock, so memory stays bounded by threads * EXPORT_BATCH_ROWS rows
+// regardless of the export size. Rows are grouped by chunk, not globally
+// sorted by time.
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "arrow_ipc.h"
+#include "gorilla.h"
+#include "rollup.h"
+#include "segment.h"
+
+#define EXPORT_BATCH_ROWS 65536
+#define MAX_FILTER_DEVICES 256
+#define MAX_DICT 65536
+
+// --- Options ---
+static const char *data_dir = "data";
+static const char *alerts_path = "alerts.log";
+static const char *telemetry_out = "telemetry.arrows";
+static const char *alerts_out = "alerts.arrows";
+static int64_t time_from = INT64_MIN;
+static int64_t time_to = INT64_MAX;
+static const char *filter_devices[MAX_FILTER_DEVICES];
+static int filter_count = 0;
+static int thread_count = 0;
+static int resolution = ROLLUP_RAW;
+static int resolution_auto = 0;
+
+// --- String dictionary (open addressing, read-only once built) ---
+typedef struct
+{
+    char **values;
+    int count;
+    int *slots; // Index + 1, 0 = empty
+    int nslots;
+} dict_t;
+
+static uint32_t hash_bytes(const char *s, size_t n)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < n; ++i)
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+static int dict_init(dict_t *d)
+{
+    d->count = 0;
+    d->nslots = 2 * MAX_DICT;
+    d->values = calloc(MAX_DICT, sizeof(*d->values));
+    d->slots = calloc((size_t)d->nslots, sizeof(*d->slots));
+    return (d->values && d->slots) ? 0 : -1;
+}
+
+static void dict_free(dict_t *d)
+{
+    for (int i = 0; i < d->count; ++i)
+        free(d->values[i]);
+    free(d->values);
+    free(d->slots);
+}
+
+// Returns the index of s, or -1 if absent and insert is 0 (or the dictionary is full)
+static int dict_find(dict_t *d, const char *s, size_t n, int insert)
+{
+    uint32_t i = hash_bytes(s, n) % (uint32_t)d->nslots;
+    while (d->slots[i])
+    {
+        const char *v = d->values[d->slots[i] - 1];
+        if (strlen(v) == n && memcmp(v, s, n) == 0)
+            return d->slots[i] - 1;
+        i = (i + 1) % (uint32_t)d->nslots;
+    }
+    if (!insert || d->count >= MAX_DICT)
+        return -1;
+
+    char *copy = strndup(s, n);
+    if (!copy)
+        return -1;
+    d->values[d->count] = copy;
+    d->slots[i] = ++d->count;
+    return d->count - 1;
+}
+
+static int device_selected(const char *id, size_t n)
+{
+    if (filter_count == 0)
+        return 1;
+    for (int i = 0; i < filter_count; ++i)
+    {
+        if (strlen(filter_devices[i]) == n && memcmp(filter_devices[i], id, n) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int parse_time(const char *s, int64_t *out)
+{
+    char *end;
+    long long v = strtoll(s, &end, 10);
+    if (*end == '\0')
+    {
+        *out = v;
+        return 0;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(s, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (!end || *end)
+    {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(s, "%Y-%m-%d", &tm);
+        if (!end || *end)
+            return -1;
+    }
+    *out = timegm(&tm);
+    return 0;
+}
+
+// --- Telemetry export ---
+
+typedef struct
+{
+    char path[512];
+} seg_file_t;
+
+static seg_file_t *files = NULL;
+static int file_count = 0;
+static dict_t devices;
+
+// Work shared by the decoder threads: one mapped file at a time
+static segment_map_t cur_map;
+static size_t *cur_offsets = NULL; // Record offsets within cur_map
+static int cur_records = 0;
+static int next_record = 0;
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *out = NULL;
+static int write_failed = 0;
+static long long rows_written = 0;
+static long long rows_dropped = 0; // Rows of devices that did not fit the dictionary (MAX_DICT)
+
+static const arrow_field_t telemetry_fields[] = {
+    {"device", ARROW_DICT_UTF8, 0},
+    {"timestamp", ARROW_TIMESTAMP_SEC, 0},
+    {"temperature", ARROW_FLOAT64, 0},
+    {"relativeHumidity", ARROW_FLOAT64, 0},
+};
+
+typedef struct
+{
+    int32_t device[EXPORT_BATCH_ROWS];
+    int64_t ts[EXPORT_BATCH_ROWS];
+    double temp[EXPORT_BATCH_ROWS];
+    double hum[EXPORT_BATCH_ROWS];
+    int rows;
+} batch_t;
+
+static void flush_batch(batch_t *b)
+{
+    if (b->rows == 0)
+        return;
+
+    arrow_column_t cols[] = {{b->device, NULL, NULL}, {b->ts, NULL, NULL},
+                             {b->temp, NULL, NULL}, {b->hum, NULL, NULL}};
+    pthread_mutex_lock(&out_lock);
+    if (arrow_write_batch(out, telemetry_fields, cols, 4, b->rows) < 0)
+        write_failed = 1;
+    rows_written += b->rows;
+    pthread_mutex_unlock(&out_lock);
+    b->rows = 0;
+}
+
+static int segment_day_in_range(const char *name)
+{
+    // <prefix>-YYYYMMDD.seg: skip whole days outside the requested range
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *p = strptime(strchr(name, '-') + 1, "%Y%m%d", &tm);
+    if (!p)
+        return 1;
+    int64_t day = timegm(&tm);
+    // Include the previous day: its chunks may run past midnight
+    return day + 2 * 86400 > time_from && day < time_to;
+}
+
+static int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const seg_file_t *)a)->path, ((const seg_file_t *)b)->path);
+}
+
+// Appends the <prefix>-YYYYMMDD.seg files of data_dir to files[]
+static int list_segments(const char *prefix)
+{
+    size_t plen = strlen(prefix);
+    DIR *dir = opendir(data_dir);
+    if (!dir)
+    {
+        perror(data_dir);
+        return -1;
+    }
+
+    struct dirent *e;
+    int cap = 0;
+    while ((e = readdir(dir)) != NULL)
+    {
+        size_t n = strlen(e->d_name);
+        if (strncmp(e->d_name, prefix, plen) != 0 || e->d_name[plen] != '-' ||
+            n < plen + 5 || strcmp(e->d_name + n - 4, ".seg") != 0)
+            continue;
+        if (!segment_day_in_range(e->d_name))
+            continue;
+
+        if (file_count == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            seg_file_t *nf = realloc(files, (size_t)cap * sizeof(*files));
+            if (!nf)
+            {
+                closedir(dir);
+                return -1;
+            }
+            files = nf;
+        }
+        snprintf(files[file_count++].path, sizeof(files->path), "%s/%s", data_dir, e->d_name);
+    }
+    closedir(dir);
+    qsort(files, (size_t)file_count, sizeof(*files), compare_files);
+    return 0;
+}
+
+static int record_selected(const segment_record_t *r)
+{
+    // Rollup exports may also aggregate raw days that were not compacted yet
+    return (r->hdr->kind == SEGMENT_KIND_RAW || resolution != ROLLUP_RAW) &&
+           r->hdr->t_end >= time_from && r->hdr->t_start < time_to &&
+           device_selected(r->id, r->hdr->id_len);
+}
+
+// Pass 1: collect the device dictionary from record headers only
+static int build_device_dictionary(void)
+{
+    for (int i = 0; i < file_count; ++i)
+    {
+        segment_map_t m;
+        if (segment_map(files[i].path, &m) < 0)
+        {
+            perror(files[i].path);
+            continue;
+        }
+        size_t off = 0;
+        segment_record_t r;
+        while (segment_next(&m, &off, &r) == 1)
+        {
+            if (record_selected(&r) && dict_find(&devices, r.id, r.hdr->id_len, 1) < 0)
+            {
+                fprintf(stderr, "Device dictionary full\n");
+                segment_unmap(&m);
+                return -1;
+            }
+        }
+        segment_unmap(&m);
+    }
+    return 0;
+}
+
+static void *decode_worker(void *arg)
+{
+    batch_t *b = arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&work_lock);
+        int idx = next_record < cur_records ? next_record++ : -1;
+        pthread_mutex_unlock(&work_lock);
+        if (idx < 0)
+            break;
+
+        size_t off = cur_offsets[idx];
+        segment_record_t r;
+        if (segment_next(&cur_map, &off, &r) != 1)
+            continue;
+
+        // Not in the dictionary (full, or the file changed since pass 1):
+        // a negative index would make the Arrow file unreadable
+        int32_t dev = dict_find(&devices, r.id, r.hdr->id_len, 0);
+        if (dev < 0)
+        {
+            pthread_mutex_lock(&out_lock);
+            rows_dropped += r.hdr->count;
+            pthread_mutex_unlock(&out_lock);
+            continue;
+        }
+        gorilla_iter_t it;
+        int64_t ts;
+        double temp, hum;
+        gorilla_iter_init_raw(&it, r.payload, r.hdr->nbits, r.hdr->count, r.hdr->t_start);
+        while (gorilla_iter_next(&it, &ts, &temp, &hum) == 1)
+        {
+            if (ts < time_from || ts >= time_to)
+                continue;
+            b->device[b->rows] = dev;
+            b->ts[b->rows] = ts;
+            b->temp[b->rows] = temp;
+            b->hum[b->rows] = hum;
+            if (++b->rows == EXPORT_BATCH_ROWS)
+                flush_batch(b);
+        }
+    }
+    return NULL;
+}
+
+static int export_rollups(void);
+
+static int export_telemetry(void)
+{
+    if (resolution != ROLLUP_RAW)
+        return export_rollups();
+
+    if (list_segments("raw") < 0 || dict_init(&devices) < 0 || build_device_dictionary() < 0)
+        return -1;
+
+    out = fopen(telemetry_out, "wb");
+    if (!out)
+    {
+        perror(telemetry_out);
+        return -1;
+    }
+
+    arrow_write_schema(out, telemetry_fields, 4);
+    arrow_write_dictionary(out, 0, (const char *const *)devices.values, devices.count);
+
+    batch_t *batches = malloc((size_t)thread_count * sizeof(*batches));
+    pthread_t *threads = malloc((size_t)thread_count * sizeof(*threads));
+    if (!batches || !threads)
+    {
+        fclose(out);
+        return -1;
+    }
+
+    for (int i = 0; i < file_count; ++i)
+    {
+        if (segment_map(files[i].path, &cur_map) < 0)
+            continue;
+
+        // Index the selected records of this file, then decode them in parallel
+        int cap = 0;
+        size_t off = 0, at = 0;
+        segment_record_t r;
+        cur_records = 0;
+        next_record = 0;
+        while (segment_next(&cur_map, &off, &r) == 1)
+        {
+            if (record_selected(&r))
+            {
+                if (cur_records == cap)
+                {
+                    cap = cap ? cap * 2 : 1024;
+                    size_t *no = realloc(cur_offsets, (size_t)cap * sizeof(*cur_offsets));
+                    if (!no)
+                        break;
+                    cur_offsets = no;
+                }
+                cur_offsets[cur_records++] = at;
+            }
+            at = off;
+        }
+
+        for (int t = 0; t < thread_count; ++t)
+        {
+            batches[t].rows = 0;
+            pthread_create(&threads[t], NULL, decode_worker, &batches[t]);
+        }
+        for (int t = 0; t < thread_count; ++t)
+        {
+            pthread_join(threads[t], NULL);
+            flush_batch(&batches[t]);
+        }
+        segment_unmap(&cur_map);
+    }
+
+    arrow_write_eos(out);
+    if (fclose(out) != 0)
+        write_failed = 1;
+
+    printf("Telemetry: %lld rows from %d segment files, %d devices -> %s\n",
+           rows_written, file_count, devices.count, telemetry_out);
+    if (rows_dropped)
+        fprintf(stderr, "Telemetry: %lld rows dropped, their devices are not in the dictionary\n", rows_dropped);
+
+    free(batches);
+    free(threads);
+    free(cur_offsets);
+    free(files);
+    dict_free(&devices);
+    return write_failed ? -1 : 0;
+}
+
+// --- Rollup export ---
+//
+// Rollups are small (one row per device and minute or hour), so they are
+// streamed from rollup_query() on a single thread.
+
+static const arrow_field_t rollup_fields[] = {
+    {"device", ARROW_DICT_UTF8, 0},
+    {"timestamp", ARROW_TIMESTAMP_SEC, 0},
+    {"count", ARROW_INT64, 0},
+    {"temperatureMin", ARROW_FLOAT64, 0},
+    {"temperatureMax", ARROW_FLOAT64, 0},
+    {"temperatureMean", ARROW_FLOAT64, 0},
+    {"relativeHumidityMin", ARROW_FLOAT64, 0},
+    {"relativeHumidityMax", ARROW_FLOAT64, 0},
+    {"relativeHumidityMean", ARROW_FLOAT64, 0},
+};
+#define ROLLUP_COLUMNS 9
+
+typedef struct
+{
+    int32_t *device;
+    int64_t *ts;
+    int64_t *count;
+    double *v[6];
+    int rows;
+} rollup_batch_t;
+
+static void flush_rollups(rollup_batch_t *b)
+{
+    if (b->rows == 0)
+        return;
+    arrow_column_t cols[ROLLUP_COLUMNS] = {{b->device, NULL, NULL}, {b->ts, NULL, NULL},
+                                           {b->count, NULL, NULL}};
+    for (int i = 0; i < 6; ++i)
+        cols[3 + i].values = b->v[i];
+    if (arrow_write_batch(out, rollup_fields, cols, ROLLUP_COLUMNS, b->rows) < 0)
+        write_failed = 1;
+    rows_written += b->rows;
+    b->rows = 0;
+}
+
+// First pass: devices whose raw files are gone only appear in the rollups,
+// and the dictionary is written before the first batch
+static int collect_rollup_device(const char *id, size_t id_len, const rollup_point_t *p, void *ctx)
+{
+    if (device_selected(id, id_len))
+        dict_find(&devices, id, id_len, 1);
+    return 0;
+}
+
+static int export_rollup_point(const char *id, size_t id_len, const rollup_point_t *p, void *ctx)
+{
+    rollup_batch_t *b = ctx;
+    if (!device_selected(id, id_len))
+        return 0;
+
+    int32_t dev = dict_find(&devices, id, id_len, 0);
+    if (dev < 0)
+    {
+        rows_dropped++; // Dictionary full
+        return 0;
+    }
+    int i = b->rows;
+    b->device[i] = dev;
+    b->ts[i] = p->t;
+    b->count[i] = p->count;
+    b->v[0][i] = p->temp_min;
+    b->v[1][i] = p->temp_max;
+    b->v[2][i] = p->temp_mean;
+    b->v[3][i] = p->hum_min;
+    b->v[4][i] = p->hum_max;
+    b->v[5][i] = p->hum_mean;
+    if (++b->rows == EXPORT_BATCH_ROWS)
+        flush_rollups(b);
+    return write_failed;
+}
+
+static int export_rollups(void)
+{
+    const char *prefix = resolution == ROLLUP_HOUR ? "1h" : "1m";
+    if (list_segments("raw") < 0 || list_segments(prefix) < 0 ||
+        dict_init(&devices) < 0 || build_device_dictionary() < 0)
+        return -1;
+
+    rollup_batch_t b = {0};
+    b.device = malloc(EXPORT_BATCH_ROWS * sizeof(*b.device));
+    b.ts = malloc(EXPORT_BATCH_ROWS * sizeof(*b.ts));
+    b.count = malloc(EXPORT_BATCH_ROWS * sizeof(*b.count));
+    int ok = b.device && b.ts && b.count;
+    for (int i = 0; i < 6; ++i)
+    {
+        b.v[i] = malloc(EXPORT_BATCH_ROWS * sizeof(double));
+        ok = ok && b.v[i];
+    }
+
+    const char *only = filter_count == 1 ? filter_devices[0] : NULL;
+    if (ok)
+        rollup_query(data_dir, only, time_from, time_to, resolution, collect_rollup_device, NULL); // Errors show in the second pass
+    out = ok ? fopen(telemetry_out, "wb") : NULL;
+    if (!out)
+    {
+        perror(telemetry_out);
+        write_failed = 1;
+    }
+    else
+    {
+        arrow_write_schema(out, rollup_fields, ROLLUP_COLUMNS);
+        arrow_write_dictionary(out, 0, (const char *const *)devices.values, devices.count);
+        if (rollup_query(data_dir, only, time_from, time_to, resolution, export_rollup_point, &b) < 0)
+            write_failed = 1;
+        flush_rollups(&b);
+        arrow_write_eos(out);
+        if (fclose(out) != 0)
+            write_failed = 1;
+
+        printf("Telemetry: %lld %s rollups, %d devices -> %s\n",
+               rows_written, prefix, devices.count, telemetry_out);
+        if (rows_dropped)
+            fprintf(stderr, "Telemetry: %lld rollups dropped, their devices are not in the dictionary\n", rows_dropped);
+    }
+
+    free(b.device);
+    free(b.ts);
+    free(b.count);
+    for (int i = 0; i < 6; ++i)
+        free(b.v[i]);
+    free(files);
+    dict_free(&devices);
+    return write_failed ? -1 : 0;
+}
+
+// --- Alert export ---
+//
+// alerts.log lines written by log_alert_dual() look like
+//   [YYYY-mm-dd HH:MM:SS] ALERT_TYPE: device=ID: message
+// (local time). Other log lines (duplicates, invalid JSON...) are skipped.
+
+typedef struct
+{
+    int64_t ts;
+    const char *type;
+    size_t type_len;
+    const char *device;
+    size_t device_len;
+    const char *message;
+} alert_line_t;
+
+static int parse_alert_line(char *line, alert_line_t *a)
+{
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] != '[')
+        return -1;
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    char *p = strptime(line + 1, "%Y-%m-%d %H:%M:%S", &tm);
+    if (!p || strncmp(p, "] ", 2) != 0)
+        return -1;
+    tm.tm_isdst = -1;
+    a->ts = mktime(&tm);
+    p += 2;
+
+    char *sep = strstr(p, ": device=");
+    if (!sep)
+        return -1;
+    a->type = p;
+    a->type_len = (size_t)(sep - p);
+
+    a->device = sep + strlen(": device=");
+    char *msg = strstr(a->device, ": ");
+    if (!msg)
+        return -1;
+    a->device_len = (size_t)(msg - a->device);
+    a->message = msg + 2;
+    return 0;
+}
+
+static int alert_selected(const alert_line_t *a)
+{
+    return a->ts >= time_from && a->ts < time_to && device_selected(a->device, a->device_len);
+}
+
+static int export_alerts(void)
+{
+    static const arrow_field_t fields[] = {
+        {"timestamp", ARROW_TIMESTAMP_SEC, 0},
+        {"device", ARROW_DICT_UTF8, 1},
+        {"alertType", ARROW_DICT_UTF8, 2},
+        {"message", ARROW_UTF8, 0},
+    };
+
+    FILE *in = fopen(alerts_path, "r");
+    if (!in)
+    {
+        perror(alerts_path);
+        return -1;
+    }
+
+    dict_t adevices, types;
+    if (dict_init(&adevices) < 0 || dict_init(&types) < 0)
+    {
+        fclose(in);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    alert_line_t a;
+
+    // Pass 1: dictionaries
+    while (getline(&line, &cap, in) > 0)
+    {
+        if (parse_alert_line(line, &a) == 0 && alert_selected(&a))
+        {
+            dict_find(&adevices, a.device, a.device_len, 1);
+            dict_find(&types, a.type, a.type_len, 1);
+        }
+    }
+
+    FILE *o = fopen(alerts_out, "wb");
+    if (!o)
+    {
+        perror(alerts_out);
+        fclose(in);
+        return -1;
+    }
+    arrow_write_schema(o, fields, 4);
+    arrow_write_dictionary(o, 1, (const char *const *)adevices.values, adevices.count);
+    arrow_write_dictionary(o, 2, (const char *const *)types.values, types.count);
+
+    // Pass 2: stream fixed-size batches
+    int64_t *ts = malloc(EXPORT_BATCH_ROWS * sizeof(*ts));
+    int32_t *dev = malloc(EXPORT_BATCH_ROWS * sizeof(*dev));
+    int32_t *type = malloc(EXPORT_BATCH_ROWS * sizeof(*type));
+    int32_t *offsets = malloc((EXPORT_BATCH_ROWS + 1) * sizeof(*offsets));
+    size_t text_cap = 1 << 20;
+    char *text = malloc(text_cap);
+    int rows = 0, failed = 0;
+    long long total = 0, dropped = 0;
+    if (!ts || !dev || !type || !offsets || !text)
+        failed = 1;
+
+    rewind(in);
+    offsets[0] = 0;
+    while (!failed)
+    {
+        int more = getline(&line, &cap, in) > 0;
+        int ok = more && parse_alert_line(line, &a) == 0 && alert_selected(&a);
+        size_t mlen = ok ? strlen(a.message) : 0;
+
+        // Flush when the batch is full, the text buffer would overflow, or at EOF
+        if (rows > 0 && (!more || rows == EXPORT_BATCH_ROWS || (size_t)offsets[rows] + mlen > text_cap))
+        {
+            arrow_column_t cols[] = {{ts, NULL, NULL}, {dev, NULL, NULL},
+                                     {type, NULL, NULL}, {NULL, offsets, text}};
+            if (arrow_write_batch(o, fields, cols, 4, rows) < 0)
+                failed = 1;
+            total += rows;
+            rows = 0;
+        }
+        if (!more)
+            break;
+        if (!ok || mlen > text_cap)
+            continue;
+
+        // Alerts past MAX_DICT devices or types have no dictionary index
+        dev[rows] = dict_find(&adevices, a.device, a.device_len, 0);
+        type[rows] = dict_find(&types, a.type, a.type_len, 0);
+        if (dev[rows] < 0 || type[rows] < 0)
+        {
+            dropped++;
+            continue;
+        }
+        ts[rows] = a.ts;
+        memcpy(text + offsets[rows], a.message, mlen);
+        offsets[rows + 1] = offsets[rows] + (int32_t)mlen;
+        rows++;
+    }
+
+    arrow_write_eos(o);
+    if (fclose(o) != 0)
+        failed = 1;
+    fclose(in);
+
+    printf("Alerts: %lld rows, %d devices, %d alert types -> %s\n",
+           total, adevices.count, types.count, alerts_out);
+    if (dropped)
+        fprintf(stderr, "Alerts: %lld rows dropped, their device or type is not in the dictionary\n", dropped);
+
+    free(line);
+    free(ts);
+    free(dev);
+    free(type);
+    free(offsets);
+    free(text);
+    dict_free(&adevices);
+    dict_free(&types);
+    return failed ? -1 : 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-d data_dir] [-a alerts.log|-] [-o telemetry.arrows] [-A alerts.arrows]\n"
+            "          [-f from] [-t to] [-D device]... [-j threads] [-r raw|1m|1h|auto]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "d:a:o:A:f:t:D:j:r:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            data_dir = optarg;
+            break;
+        case 'a':
+            alerts_path = optarg;
+            break;
+        case 'o':
+            telemetry_out = optarg;
+            break;
+        case 'A':
+            alerts_out = optarg;
+            break;
+        case 'f':
+        case 't':
+            if (parse_time(optarg, opt == 'f' ? &time_from : &time_to) < 0)
+            {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'D':
+            if (filter_count < MAX_FILTER_DEVICES)
+                filter_devices[filter_count++] = optarg;
+            break;
+        case 'j':
+            thread_count = atoi(optarg);
+            break;
+        case 'r':
+            if (strcmp(optarg, "raw") == 0)
+                resolution = ROLLUP_RAW;
+            else if (strcmp(optarg, "1m") == 0)
+                resolution = ROLLUP_MINUTE;
+            else if (strcmp(optarg, "1h") == 0)
+                resolution = ROLLUP_HOUR;
+            else if (strcmp(optarg, "auto") == 0)
+                resolution_auto = 1;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (thread_count <= 0)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = n > 0 ? (int)n : 1;
+    }
+
+    if (resolution_auto)
+    {
+        rollup_policy_t policy = {ROLLUP_RAW_RETENTION_DAYS, ROLLUP_MINUTE_RETENTION_DAYS,
+                                  ROLLUP_HOUR_RETENTION_DAYS};
+        resolution = rollup_resolution(&policy, time(NULL), time_from);
+    }
+
+    int rc = 0;
+    if (export_telemetry() < 0)
+        rc = 1;
+    if (strcmp(alerts_path, "-") != 0 && export_alerts() < 0)
+        rc = 1;
+    return rc;
+}
@@ -0,0 +1,589 @@
+// fleet_sim.c
+// Runs a fleet of simulated clients against a live srv.c.
+//
+// Each of the -d devices is the clients' own engine (client_core.c), with
+// the same configuration as cli_esp.c/cli_pico.c, on a host HAL: its own UDP
+// socket, the monotonic clock, a synthetic DHT11 and in-memory backlog
+// rings. All devices run in one thread of one process. Between them and the
+// server the link is impaired in both directions: -l percent of the
+// datagrams are lost, and each one is delayed by -L ms plus up to -J ms of
+// jitter (so datagrams also reorder). -o START,LENGTH takes the link down
+// for the whole fleet, as if the site lost its uplink; devices store their
+// readings and drain them once it is back. Runs in real time, since the
+// server uses its own clock. Prints the fleet totals at the end; -v adds a
+// line per second. Devices are named PREFIX0000, PREFIX0001... (-P,
+// default Fleet_Device_); runs that must not share server state use
+// different prefixes.
+//
+// The server accepts up to max_devices (1024) devices.
+//
+//   ./fleet_sim -d 1000 -t 60
+//   ./fleet_sim -d 500 -t 180 -l 5 -L 40 -J 20 -o 30,60 -v
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "client_core.h"
+
+#define TICK_MS 5           // Poll interval of every device (the sketches' loop delay)
+#define INBOX_SIZE 8        // Received datagrams waiting for the device's next poll
+#define INBOX_DATAGRAM 256  // ACKs and NACKs are well below this
+#define RECV_MAX 2048
+
+typedef struct
+{
+    uint8_t *data;
+    size_t data_len;
+    uint8_t cursor[64];
+} mem_files_t;
+
+typedef struct
+{
+    client_core_t core;
+    int fd;
+    char id[32];
+    mem_files_t backlog_files;
+    mem_files_t summary_files;
+    float base_temp, base_hum;
+    float temp, hum;          // Random walk around the base values
+    uint32_t next_sample;
+    uint32_t backlog_peak;
+    char inbox[INBOX_SIZE][INBOX_DATAGRAM];
+    uint16_t inbox_len[INBOX_SIZE];
+    int inbox_head, inbox_count;
+} sim_client_t;
+
+// A datagram held back by the link delay
+typedef struct
+{
+    uint32_t due;
+    uint32_t order;  // Ties keep their send order
+    int client;
+    int inbound;     // Towards the device
+    size_t len;
+    char data[];
+} delayed_t;
+
+static sim_client_t *clients;
+static int client_count;
+
+// Link impairment
+static double loss_pct;
+static uint32_t latency_ms, jitter_ms;
+static uint32_t outage_start_ms, outage_len_ms;
+static uint32_t rng = 2463534242u;
+
+static delayed_t **heap;
+static int heap_count, heap_size;
+static uint32_t heap_order;
+
+static struct timespec start_time;
+
+// Fleet counters
+static uint64_t out_datagrams, out_dropped, out_failed, in_datagrams, in_dropped, inbox_overflows;
+
+static uint32_t xorshift(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static double uniform(void)
+{
+    return xorshift() / 4294967296.0;
+}
+
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((ts.tv_sec - start_time.tv_sec) * 1000 + (ts.tv_nsec - start_time.tv_nsec) / 1000000);
+}
+
+static int link_down(uint32_t now)
+{
+    return outage_len_ms > 0 && now >= outage_start_ms && now - outage_start_ms < outage_len_ms;
+}
+
+static uint32_t link_delay(void)
+{
+    return latency_ms + (jitter_ms ? xorshift() % (jitter_ms + 1) : 0);
+}
+
+// --- Delay queue: binary min-heap on (due, order) ---
+static int heap_less(const delayed_t *a, const delayed_t *b)
+{
+    if (a->due != b->due)
+        return (int32_t)(a->due - b->due) < 0;
+    return (int32_t)(a->order - b->order) < 0;
+}
+
+static void heap_push(delayed_t *d)
+{
+    if (heap_count == heap_size)
+    {
+        int size = heap_size ? heap_size * 2 : 1024;
+        delayed_t **grown = realloc(heap, (size_t)size * sizeof(*heap));
+        if (!grown)
+        {
+            free(d);
+            return;
+        }
+        heap = grown;
+        heap_size = size;
+    }
+    int i = heap_count++;
+    while (i > 0 && heap_less(d, heap[(i - 1) / 2]))
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = d;
+}
+
+static delayed_t *heap_pop(void)
+{
+    delayed_t *top = heap[0];
+    delayed_t *last = heap[--heap_count];
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= heap_count)
+            break;
+        if (child + 1 < heap_count && heap_less(heap[child + 1], heap[child]))
+            child++;
+        if (!heap_less(heap[child], last))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heap_count > 0)
+        heap[i] = last;
+    return top;
+}
+
+static void delay_datagram(int client, int inbound, const void *buf, size_t len, uint32_t delay)
+{
+    delayed_t *d = malloc(sizeof(*d) + len);
+    if (!d)
+        return;
+    d->due = now_ms() + delay;
+    d->order = heap_order++;
+    d->client = client;
+    d->inbound = inbound;
+    d->len = len;
+    memcpy(d->data, buf, len);
+    heap_push(d);
+}
+
+static void inbox_push(sim_client_t *c, const void *buf, size_t len)
+{
+    if (c->inbox_count == INBOX_SIZE || len > INBOX_DATAGRAM)
+    {
+        inbox_overflows++;
+        return;
+    }
+    int slot = (c->inbox_head + c->inbox_count++) % INBOX_SIZE;
+    memcpy(c->inbox[slot], buf, len);
+    c->inbox_len[slot] = (uint16_t)len;
+}
+
+static void transmit(sim_client_t *c, const void *buf, size_t len)
+{
+    if (send(c->fd, buf, len, 0) < 0)
+        out_failed++; // Local socket buffer full: lost like on the air
+}
+
+// --- Client core HAL ---
+static int hal_udp_send(void *ctx, const void *buf, size_t len)
+{
+    sim_client_t *c = ctx;
+    uint32_t now = now_ms();
+
+    if (link_down(now))
+        return -1;
+    out_datagrams++;
+    if (loss_pct > 0 && uniform() * 100.0 < loss_pct)
+    {
+        out_dropped++;
+        return 0;
+    }
+    uint32_t delay = link_delay();
+    if (delay == 0)
+        transmit(c, buf, len);
+    else
+        delay_datagram((int)(c - clients), 0, buf, len, delay);
+    return 0;
+}
+
+static int hal_udp_recv(void *ctx, char *buf, size_t len)
+{
+    sim_client_t *c = ctx;
+    if (c->inbox_count == 0)
+        return 0;
+
+    size_t n = c->inbox_len[c->inbox_head];
+    if (n > len)
+        n = len;
+    memcpy(buf, c->inbox[c->inbox_head], n);
+    c->inbox_head = (c->inbox_head + 1) % INBOX_SIZE;
+    c->inbox_count--;
+    return (int)n;
+}
+
+static int hal_link_up(void *ctx)
+{
+    return !link_down(now_ms());
+}
+
+static uint32_t hal_millis(void *ctx)
+{
+    return now_ms();
+}
+
+static uint32_t hal_random(void *ctx, uint32_t max)
+{
+    return xorshift() % max;
+}
+
+// DHT11-like: a slow random walk around the device's base values,
+// quantised to 0.1 degC and 1 %RH
+static int hal_read_sensor(void *ctx, float *temp_c, float *hum_pct)
+{
+    sim_client_t *c = ctx;
+    c->temp += (float)((uniform() - 0.5) * 0.2 + (c->base_temp - c->temp) * 0.01);
+    c->hum += (float)((uniform() - 0.5) * 1.0 + (c->base_hum - c->hum) * 0.01);
+    *temp_c = (float)((int)(c->temp * 10.0f + 0.5f)) / 10.0f;
+    *hum_pct = (float)((int)(c->hum + 0.5f));
+    return 0;
+}
+
+static uint8_t *mem_file(mem_files_t *m, int file, uint32_t off, size_t len)
+{
+    if (file == RING_FILE_DATA && off + len <= m->data_len)
+        return m->data + off;
+    if (file == RING_FILE_CURSOR && off + len <= sizeof(m->cursor))
+        return m->cursor + off;
+    return NULL;
+}
+
+static int mem_read(void *ctx, int file, uint32_t off, void *buf, size_t len)
+{
+    uint8_t *p = mem_file(ctx, file, off, len);
+    if (!p)
+        return -1;
+    memcpy(buf, p, len);
+    return 0;
+}
+
+static int mem_write(void *ctx, int file, uint32_t off, const void *buf, size_t len)
+{
+    uint8_t *p = mem_file(ctx, file, off, len);
+    if (!p)
+        return -1;
+    memcpy(p, buf, len);
+    return 0;
+}
+
+// Receives everything waiting on one device's socket
+static void receive(int client)
+{
+    sim_client_t *c = &clients[client];
+    char buf[RECV_MAX];
+    ssize_t n;
+
+    while ((n = recv(c->fd, buf, sizeof(buf), 0)) > 0)
+    {
+        in_datagrams++;
+        if (link_down(now_ms()) || (loss_pct > 0 && uniform() * 100.0 < loss_pct))
+        {
+            in_dropped++;
+            continue;
+        }
+        uint32_t delay = link_delay();
+        if (delay == 0)
+            inbox_push(c, buf, (size_t)n);
+        else
+            delay_datagram(client, 1, buf, (size_t)n, delay);
+    }
+}
+
+static void release_due(void)
+{
+    uint32_t now = now_ms();
+    while (heap_count > 0 && (int32_t)(heap[0]->due - now) <= 0)
+    {
+        delayed_t *d = heap_pop();
+        if (d->inbound)
+            inbox_push(&clients[d->client], d->data, d->len);
+        else
+            transmit(&clients[d->client], d->data, d->len);
+        free(d);
+    }
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-d devices] [-t seconds] [-s server_ip] [-p port] [-l loss_pct]\n"
+            "          [-L latency_ms] [-J jitter_ms] [-o start_s,length_s] [-I interval_ms]\n"
+            "          [-b backlog_capacity] [-D] [-S seed] [-P id_prefix] [-v]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    int device_count = 100;
+    double seconds = 60;
+    const char *server_ip = "127.0.0.1";
+    int port = 5005;
+    uint32_t interval_ms = 5000;
+    uint32_t backlog_capacity = 256;
+    int deadband = 1;
+    int verbose = 0;
+    const char *prefix = "Fleet_Device_";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:t:s:p:l:L:J:o:I:b:DS:P:vh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': device_count = atoi(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        case 's': server_ip = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'l': loss_pct = atof(optarg); break;
+        case 'L': latency_ms = (uint32_t)atoi(optarg); break;
+        case 'J': jitter_ms = (uint32_t)atoi(optarg); break;
+        case 'o':
+        {
+            double start_s, len_s;
+            if (sscanf(optarg, "%lf,%lf", &start_s, &len_s) != 2)
+            {
+                usage(argv[0]);
+                return 2;
+            }
+            outage_start_ms = (uint32_t)(start_s * 1000);
+            outage_len_ms = (uint32_t)(len_s * 1000);
+            break;
+        }
+        case 'I': interval_ms = (uint32_t)atoi(optarg); break;
+        case 'b': backlog_capacity = (uint32_t)atoi(optarg); break;
+        case 'D': deadband = 0; break;
+        case 'S': rng = (uint32_t)strtoul(optarg, NULL, 0) | 1; break;
+        case 'P': prefix = optarg; break;
+        case 'v': verbose = 1; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (device_count < 1 || seconds <= 0 || interval_ms == 0 || backlog_capacity < 16 ||
+        loss_pct < 0 || loss_pct > 100 || strlen(prefix) > 20)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    struct sockaddr_in server = {0};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &server.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid server address: %s\n", server_ip);
+        return 2;
+    }
+
+    // One socket per device, so the server sees distinct source ports
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < (rlim_t)device_count + 64)
+    {
+        lim.rlim_cur = lim.rlim_max < (rlim_t)device_count + 64 ? lim.rlim_max : (rlim_t)device_count + 64;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    int ep = epoll_create1(0);
+    clients = calloc((size_t)device_count, sizeof(*clients));
+    if (ep < 0 || !clients)
+    {
+        perror("fleet_sim");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    client_config_t config;
+    // Every run reboots the fleet: new boot ids, as on the devices. They are
+    // not derived from -S, which only fixes the link and the sensors.
+    uint32_t run_boot = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    for (int i = 0; i < device_count; ++i)
+    {
+        sim_client_t *c = &clients[i];
+        snprintf(c->id, sizeof(c->id), "%s%04d", prefix, i);
+        c->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&server, sizeof(server)) < 0)
+        {
+            fprintf(stderr, "Socket for device %d: %s (raise the open file limit)\n", i, strerror(errno));
+            return 1;
+        }
+        struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (uint32_t)i};
+        epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev);
+
+        c->backlog_files.data_len = backlog_capacity * TELEMETRY_RECORD_SIZE;
+        c->backlog_files.data = calloc(1, c->backlog_files.data_len);
+        c->summary_files.data_len = (backlog_capacity / 16) * TELEMETRY_SUMMARY_SIZE;
+        c->summary_files.data = calloc(1, c->summary_files.data_len);
+        c->base_temp = c->temp = 22.0f + (float)(uniform() - 0.5) * 2.0f;
+        c->base_hum = c->hum = 50.0f + (float)(uniform() - 0.5) * 10.0f;
+
+        client_config_defaults(&config, c->id);
+        config.backlog_capacity = backlog_capacity;
+        config.summary_capacity = backlog_capacity / 16;
+        config.base_delay_ms = interval_ms;
+        config.deadband_enabled = deadband;
+        config.boot_id = (run_boot + (uint32_t)i * 2654435761u) | 1;
+
+        client_hal_t hal = {hal_udp_send, hal_udp_recv, hal_link_up, hal_millis, hal_random, hal_read_sensor,
+                            NULL, NULL, {mem_read, mem_write, &c->backlog_files},
+                            {mem_read, mem_write, &c->summary_files}, c};
+        client_core_init(&c->core, &config, &hal);
+        if (!c->backlog_files.data || !c->summary_files.data || client_core_open_backlog(&c->core) != 0)
+        {
+            fprintf(stderr, "Backlog for device %d failed\n", i);
+            return 1;
+        }
+        client_core_resume_seq(&c->core);
+        c->next_sample = xorshift() % interval_ms; // Devices were not switched on together
+    }
+    client_count = device_count;
+
+    printf("fleet: devices=%d seconds=%.0f server=%s:%d interval=%ums deadband=%s loss=%.1f%% latency=%u+%ums",
+           device_count, seconds, server_ip, port, interval_ms, deadband ? "on" : "off", loss_pct, latency_ms, jitter_ms);
+    if (outage_len_ms)
+        printf(" outage=%us@%us", outage_len_ms / 1000, outage_start_ms / 1000);
+    printf("\n");
+
+    uint32_t end = (uint32_t)(seconds * 1000);
+    uint32_t next_tick = 0, next_report = 1000;
+    uint64_t last_sent = 0, last_acked = 0;
+    struct epoll_event events[256];
+
+    for (;;)
+    {
+        uint32_t now = now_ms();
+        if (now >= end)
+            break;
+
+        int n = epoll_wait(ep, events, 256, 1);
+        for (int k = 0; k < n; ++k)
+            receive((int)events[k].data.u32);
+        release_due();
+
+        now = now_ms();
+        if ((int32_t)(now - next_tick) < 0)
+            continue;
+        next_tick = now + TICK_MS;
+
+        for (int i = 0; i < client_count; ++i)
+        {
+            sim_client_t *c = &clients[i];
+            if ((int32_t)(now - c->next_sample) >= 0)
+            {
+                telemetry_record_t rec;
+                if (client_core_sample(&c->core, &rec) > 0)
+                {
+                    client_core_sample_queued(&c->core, &rec);
+                    client_core_publish(&c->core, &rec);
+                }
+                c->next_sample += c->core.current_delay_ms;
+            }
+            client_core_poll(&c->core);
+            uint32_t depth = client_core_backlog_depth(&c->core);
+            if (depth > c->backlog_peak)
+                c->backlog_peak = depth;
+        }
+
+        if (verbose && now >= next_report)
+        {
+            uint64_t sent = 0, acked = 0, depth = 0;
+            for (int i = 0; i < client_count; ++i)
+            {
+                sent += clients[i].core.tx.sent;
+                acked += clients[i].core.tx.acked;
+                depth += client_core_backlog_depth(&clients[i].core);
+            }
+            printf("t=%us sent/s=%llu acked/s=%llu backlog=%llu%s\n", now / 1000,
+                   (unsigned long long)(sent - last_sent), (unsigned long long)(acked - last_acked),
+                   (unsigned long long)depth, link_down(now) ? " (outage)" : "");
+            last_sent = sent;
+            last_acked = acked;
+            next_report += 1000;
+        }
+    }
+
+    // Fleet totals
+    uint64_t readings = 0, sent = 0, retransmits = 0, acked = 0, failed = 0, nacked = 0;
+    uint64_t stored = 0, heartbeats = 0, backlog = 0, peak = 0;
+    uint32_t *srtt = calloc((size_t)client_count, sizeof(*srtt));
+    int measured = 0;
+    for (int i = 0; i < client_count; ++i)
+    {
+        const client_core_t *core = &clients[i].core;
+        readings += core->readings;
+        sent += core->tx.sent;
+        retransmits += core->tx.retransmits;
+        acked += core->tx.acked;
+        failed += core->tx.failed;
+        nacked += core->tx.nacked;
+        stored += core->stored;
+        heartbeats += core->heartbeats;
+        backlog += client_core_backlog_depth(core);
+        peak += clients[i].backlog_peak;
+        if (core->tx.has_rtt && srtt)
+            srtt[measured++] = core->tx.srtt_ms;
+    }
+
+    printf("readings=%llu transmissions=%llu (retransmits=%llu, %.1f%%) acked=%llu failed=%llu (nacked=%llu) heartbeats=%llu\n",
+           (unsigned long long)readings, (unsigned long long)sent, (unsigned long long)retransmits,
+           sent ? 100.0 * retransmits / sent : 0.0, (unsigned long long)acked, (unsigned long long)failed,
+           (unsigned long long)nacked, (unsigned long long)heartbeats);
+    printf("backlog: stored=%llu peak=%llu left=%llu\n",
+           (unsigned long long)stored, (unsigned long long)peak, (unsigned long long)backlog);
+    printf("link: out=%llu dropped=%llu send_failed=%llu in=%llu dropped=%llu inbox_overflows=%llu\n",
+           (unsigned long long)out_datagrams, (unsigned long long)out_dropped, (unsigned long long)out_failed,
+           (unsigned long long)in_datagrams, (unsigned long long)in_dropped, (unsigned long long)inbox_overflows);
+    if (measured > 0)
+    {
+        qsort(srtt, (size_t)measured, sizeof(*srtt), cmp_u32);
+        printf("srtt_ms: p50=%u p99=%u max=%u (devices=%d)\n", srtt[measured / 2],
+               srtt[(measured * 99) / 100], srtt[measured - 1], measured);
+    }
+
+    free(srtt);
+    for (int i = 0; i < client_count; ++i)
+    {
+        close(clients[i].fd);
+        free(clients[i].backlog_files.data);
+        free(clients[i].summary_files.data);
+    }
+    while (heap_count > 0)
+        free(heap_pop());
+    free(heap);
+    free(clients);
+    close(ep);
+    return 0;
+}
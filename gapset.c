@@ -0,0 +1,177 @@
+// gapset.c
+// Bounded set of missing sequence-number ranges. See gapset.h.
+#include <string.h>
+#include "gapset.h"
+
+static long range_len(const gap_range_t *r)
+{
+    return r->hi - r->lo + 1;
+}
+
+static void remove_at(gapset_t *g, int i)
+{
+    g->ranges[i] = g->ranges[--g->count];
+}
+
+// Frees one slot by dropping the oldest range. Returns the seqs lost.
+static long evict_oldest(gapset_t *g, gapset_lost_cb cb, void *ctx)
+{
+    int oldest = 0;
+    for (int i = 1; i < g->count; ++i)
+    {
+        if (g->ranges[i].opened < g->ranges[oldest].opened ||
+            (g->ranges[i].opened == g->ranges[oldest].opened && g->ranges[i].lo < g->ranges[oldest].lo))
+            oldest = i;
+    }
+
+    long lost = range_len(&g->ranges[oldest]);
+    if (cb)
+        cb(&g->ranges[oldest], ctx);
+    remove_at(g, oldest);
+    return lost;
+}
+
+void gapset_init(gapset_t *g)
+{
+    memset(g, 0, sizeof(*g));
+}
+
+long gapset_open(gapset_t *g, long lo, long hi, time_t now, gapset_lost_cb cb, void *ctx)
+{
+    if (hi < lo)
+        return 0;
+
+    long evicted = 0;
+    if (g->count == GAPSET_MAX_RANGES)
+        evicted = evict_oldest(g, cb, ctx);
+
+    g->ranges[g->count].lo = lo;
+    g->ranges[g->count].hi = hi;
+    g->ranges[g->count].opened = now;
+    g->count++;
+    return evicted;
+}
+
+int gapset_fill(gapset_t *g, long seq, long *evicted, gapset_lost_cb cb, void *ctx)
+{
+    if (evicted)
+        *evicted = 0;
+
+    for (int i = 0; i < g->count; ++i)
+    {
+        gap_range_t *r = &g->ranges[i];
+        if (seq < r->lo || seq > r->hi)
+            continue;
+
+        if (r->lo == r->hi)
+        {
+            remove_at(g, i);
+        }
+        else if (seq == r->lo)
+        {
+            r->lo++;
+        }
+        else if (seq == r->hi)
+        {
+            r->hi--;
+        }
+        else
+        {
+            // Split: the upper half needs its own slot
+            gap_range_t upper = {seq + 1, r->hi, r->opened};
+            r->hi = seq - 1;
+            if (g->count == GAPSET_MAX_RANGES)
+            {
+                long lost = evict_oldest(g, cb, ctx);
+                if (evicted)
+                    *evicted = lost;
+            }
+            g->ranges[g->count++] = upper;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+long gapset_fill_range(gapset_t *g, long lo, long hi, long *evicted, gapset_lost_cb cb, void *ctx)
+{
+    long filled = 0;
+    if (evicted)
+        *evicted = 0;
+
+    for (int i = 0; i < g->count;)
+    {
+        gap_range_t *r = &g->ranges[i];
+        if (hi < r->lo || lo > r->hi)
+        {
+            i++;
+            continue;
+        }
+
+        long from = lo > r->lo ? lo : r->lo;
+        long to = hi < r->hi ? hi : r->hi;
+        filled += to - from + 1;
+        if (from == r->lo && to == r->hi)
+        {
+            remove_at(g, i); // Slot i now holds another range: look at it again
+            continue;
+        }
+        if (from == r->lo)
+            r->lo = to + 1;
+        else if (to == r->hi)
+            r->hi = from - 1;
+        else
+        {
+            // Split: the upper part needs its own slot
+            gap_range_t upper = {to + 1, r->hi, r->opened};
+            r->hi = from - 1;
+            if (g->count == GAPSET_MAX_RANGES)
+            {
+                long lost = evict_oldest(g, cb, ctx);
+                if (evicted)
+                    *evicted += lost;
+            }
+            g->ranges[g->count++] = upper;
+        }
+        i++;
+    }
+    return filled;
+}
+
+long gapset_expire(gapset_t *g, time_t cutoff, gapset_lost_cb cb, void *ctx)
+{
+    long lost = 0;
+    for (int i = 0; i < g->count;)
+    {
+        if (g->ranges[i].opened < cutoff)
+        {
+            lost += range_len(&g->ranges[i]);
+            if (cb)
+                cb(&g->ranges[i], ctx);
+            remove_at(g, i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return lost;
+}
+
+int gapset_contains(const gapset_t *g, long seq)
+{
+    for (int i = 0; i < g->count; ++i)
+    {
+        if (seq >= g->ranges[i].lo && seq <= g->ranges[i].hi)
+            return 1;
+    }
+    return 0;
+}
+
+long gapset_pending(const gapset_t *g)
+{
+    long n = 0;
+    for (int i = 0; i < g->count; ++i)
+        n += range_len(&g->ranges[i]);
+    return n;
+}
@@ -0,0 +1,55 @@
+// gapset.h
+// Bounded set of missing sequence-number ranges for one device.
+//
+// A forward jump in seq opens a range of missing seqs; late retransmissions
+// (backlog replay) fill it in, splitting ranges as needed. Ranges still open
+// after a grace period are reported as lost. When the set is full, the oldest
+// range is evicted and counted as lost, so memory per device is fixed.
+#ifndef GAPSET_H
+#define GAPSET_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define GAPSET_MAX_RANGES 16
+
+typedef struct
+{
+    long lo;       // First missing seq
+    long hi;       // Last missing seq (inclusive)
+    time_t opened; // When the gap was detected
+} gap_range_t;
+
+typedef struct
+{
+    gap_range_t ranges[GAPSET_MAX_RANGES]; // Unordered
+    int count;
+} gapset_t;
+
+// Receives each range removed as lost (expired or evicted)
+typedef void (*gapset_lost_cb)(const gap_range_t *r, void *ctx);
+
+void gapset_init(gapset_t *g);
+
+// Records [lo, hi] as missing. Returns the number of seqs evicted to make room.
+long gapset_open(gapset_t *g, long lo, long hi, time_t now, gapset_lost_cb cb, void *ctx);
+
+// Removes seq from the set. Returns 1 if it was missing (a recovery), 0
+// otherwise. Splitting a range may evict the oldest one; *evicted receives
+// the number of seqs lost that way.
+int gapset_fill(gapset_t *g, long seq, long *evicted, gapset_lost_cb cb, void *ctx);
+
+// Removes [lo, hi] from the set (a summary standing in for those seqs).
+// Returns the number of seqs that were missing. *evicted as for gapset_fill.
+long gapset_fill_range(gapset_t *g, long lo, long hi, long *evicted, gapset_lost_cb cb, void *ctx);
+
+// Removes ranges opened before cutoff. Returns the number of seqs lost.
+long gapset_expire(gapset_t *g, time_t cutoff, gapset_lost_cb cb, void *ctx);
+
+// Non-zero if seq is currently missing
+int gapset_contains(const gapset_t *g, long seq);
+
+// Number of seqs currently missing
+long gapset_pending(const gapset_t *g);
+
+#endif
@@ -0,0 +1,371 @@
+// gorilla.c
+// Delta-of-delta timestamp and XOR float encoding for telemetry chunks.
+// See gorilla.h for the API. The bit layout follows the Gorilla paper:
+//
+//   timestamp  '0'                      delta-of-delta == 0
+//              '10'   + 7 bits          [-63, 64]
+//              '110'  + 9 bits          [-255, 256]
+//              '1110' + 12 bits         [-2047, 2048]
+//              '1111' + 32 bits         anything else
+//
+//   value      '0'                      same value as before
+//              '10'   + meaningful bits fits in the previous leading/trailing window
+//              '11'   + 5 bits leading zeros + 6 bits length + meaningful bits
+#include <stdlib.h>
+#include <string.h>
+#include "gorilla.h"
+
+#define INITIAL_CAPACITY 64
+#define NO_WINDOW 0xFF
+
+static uint64_t double_bits(double v)
+{
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    return u;
+}
+
+static double bits_double(uint64_t u)
+{
+    double v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+// Makes room for at least nbits more bits in the stream
+static int reserve_bits(gorilla_chunk_t *c, size_t nbits)
+{
+    size_t need = (c->nbits + nbits + 7) / 8;
+    if (need <= c->cap)
+        return 0;
+
+    size_t cap = c->cap ? c->cap : INITIAL_CAPACITY;
+    while (cap < need)
+        cap *= 2;
+
+    uint8_t *p = realloc(c->data, cap);
+    if (!p)
+        return -1;
+    memset(p + c->cap, 0, cap - c->cap);
+    c->data = p;
+    c->cap = cap;
+    return 0;
+}
+
+// Writes the low n bits of value (n <= 64), most significant bit first.
+// The caller must have reserved enough space.
+static void write_bits(gorilla_chunk_t *c, uint64_t value, int n)
+{
+    while (n > 0)
+    {
+        int used = (int)(c->nbits & 7);
+        int room = 8 - used;
+        int take = n < room ? n : room;
+        uint8_t bits = (uint8_t)((value >> (n - take)) & ((1u << take) - 1));
+
+        c->data[c->nbits >> 3] |= (uint8_t)(bits << (room - take));
+        c->nbits += (size_t)take;
+        n -= take;
+    }
+}
+
+static int read_bits(gorilla_iter_t *it, int n, uint64_t *out)
+{
+    if (it->pos + (size_t)n > it->nbits)
+        return -1;
+
+    uint64_t value = 0;
+    while (n > 0)
+    {
+        int used = (int)(it->pos & 7);
+        int room = 8 - used;
+        int take = n < room ? n : room;
+        uint8_t byte = it->data[it->pos >> 3];
+        uint8_t bits = (uint8_t)((byte >> (room - take)) & ((1u << take) - 1));
+
+        value = (value << take) | bits;
+        it->pos += (size_t)take;
+        n -= take;
+    }
+    *out = value;
+    return 0;
+}
+
+static void write_timestamp(gorilla_chunk_t *c, int64_t dod)
+{
+    if (dod == 0)
+    {
+        write_bits(c, 0x0, 1);
+    }
+    else if (dod >= -63 && dod <= 64)
+    {
+        write_bits(c, 0x2, 2);
+        write_bits(c, (uint64_t)(dod + 63), 7);
+    }
+    else if (dod >= -255 && dod <= 256)
+    {
+        write_bits(c, 0x6, 3);
+        write_bits(c, (uint64_t)(dod + 255), 9);
+    }
+    else if (dod >= -2047 && dod <= 2048)
+    {
+        write_bits(c, 0xE, 4);
+        write_bits(c, (uint64_t)(dod + 2047), 12);
+    }
+    else
+    {
+        write_bits(c, 0xF, 4);
+        write_bits(c, (uint64_t)(uint32_t)(int32_t)dod, 32);
+    }
+}
+
+static void write_value(gorilla_chunk_t *c, int i, uint64_t value)
+{
+    uint64_t x = value ^ c->last_val[i];
+    c->last_val[i] = value;
+
+    if (x == 0)
+    {
+        write_bits(c, 0x0, 1);
+        return;
+    }
+
+    int lead = __builtin_clzll(x);
+    int trail = __builtin_ctzll(x);
+    if (lead > 31)
+        lead = 31; // Only 5 bits are available for the leading zero count
+
+    if (c->lead[i] != NO_WINDOW && lead >= c->lead[i] && trail >= c->trail[i])
+    {
+        // Reuse the previous window
+        int sig = 64 - c->lead[i] - c->trail[i];
+        write_bits(c, 0x2, 2);
+        write_bits(c, x >> c->trail[i], sig);
+        return;
+    }
+
+    int sig = 64 - lead - trail;
+    write_bits(c, 0x3, 2);
+    write_bits(c, (uint64_t)lead, 5);
+    write_bits(c, (uint64_t)(sig - 1), 6);
+    write_bits(c, x >> trail, sig);
+    c->lead[i] = (uint8_t)lead;
+    c->trail[i] = (uint8_t)trail;
+}
+
+int gorilla_chunk_init(gorilla_chunk_t *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->lead[0] = c->lead[1] = NO_WINDOW;
+    return reserve_bits(c, INITIAL_CAPACITY * 8);
+}
+
+void gorilla_chunk_free(gorilla_chunk_t *c)
+{
+    free(c->data);
+    c->data = NULL;
+    c->cap = 0;
+    c->nbits = 0;
+    c->count = 0;
+}
+
+int gorilla_chunk_full(const gorilla_chunk_t *c, int64_t ts)
+{
+    if (c->sealed)
+        return 1;
+    if (c->count == 0)
+        return 0;
+    return c->count >= GORILLA_CHUNK_MAX_SAMPLES || ts - c->t_start >= GORILLA_CHUNK_MAX_SPAN_SEC;
+}
+
+int gorilla_chunk_append(gorilla_chunk_t *c, int64_t ts, double temperature, double humidity)
+{
+    if (c->sealed)
+        return -1;
+
+    // Worst case: 4 + 32 timestamp bits, 2 + 5 + 6 + 64 bits per value
+    if (reserve_bits(c, 36 + 2 * 77 + 128) < 0)
+        return -1;
+
+    uint64_t t_bits = double_bits(temperature);
+    uint64_t h_bits = double_bits(humidity);
+
+    if (c->count == 0)
+    {
+        // First sample: timestamp lives in the header, values are stored raw
+        c->t_start = ts;
+        c->t_last = ts;
+        c->last_delta = 0;
+        write_bits(c, t_bits, 64);
+        write_bits(c, h_bits, 64);
+        c->last_val[0] = t_bits;
+        c->last_val[1] = h_bits;
+        c->count = 1;
+        return 0;
+    }
+
+    if (ts < c->t_last)
+        ts = c->t_last; // Wall clock stepped back; keep the stream monotonic
+
+    int64_t delta = ts - c->t_last;
+    int64_t dod = delta - c->last_delta;
+    if (dod > INT32_MAX || dod < INT32_MIN)
+        return -1;
+
+    write_timestamp(c, dod);
+    write_value(c, 0, t_bits);
+    write_value(c, 1, h_bits);
+
+    c->last_delta = delta;
+    c->t_last = ts;
+    c->count++;
+    return 0;
+}
+
+void gorilla_chunk_seal(gorilla_chunk_t *c)
+{
+    if (c->sealed)
+        return;
+    c->sealed = 1;
+
+    size_t used = gorilla_chunk_bytes(c);
+    if (used > 0 && used < c->cap)
+    {
+        uint8_t *p = realloc(c->data, used);
+        if (p)
+        {
+            c->data = p;
+            c->cap = used;
+        }
+    }
+}
+
+size_t gorilla_chunk_bytes(const gorilla_chunk_t *c)
+{
+    return (c->nbits + 7) / 8;
+}
+
+void gorilla_iter_init_raw(gorilla_iter_t *it, const uint8_t *data, size_t nbits,
+                           uint32_t count, int64_t t_start)
+{
+    memset(it, 0, sizeof(*it));
+    it->data = data;
+    it->nbits = nbits;
+    it->count = count;
+    it->t = t_start;
+    it->lead[0] = it->lead[1] = NO_WINDOW;
+}
+
+void gorilla_iter_init(gorilla_iter_t *it, const gorilla_chunk_t *c)
+{
+    gorilla_iter_init_raw(it, c->data, c->nbits, c->count, c->t_start);
+}
+
+static int read_timestamp(gorilla_iter_t *it)
+{
+    uint64_t bit, v;
+    int prefix = 0;
+
+    // Count leading '1' bits of the control prefix (at most 4)
+    while (prefix < 4)
+    {
+        if (read_bits(it, 1, &bit) < 0)
+            return -1;
+        if (!bit)
+            break;
+        prefix++;
+    }
+
+    int64_t dod;
+    switch (prefix)
+    {
+    case 0:
+        dod = 0;
+        break;
+    case 1:
+        if (read_bits(it, 7, &v) < 0)
+            return -1;
+        dod = (int64_t)v - 63;
+        break;
+    case 2:
+        if (read_bits(it, 9, &v) < 0)
+            return -1;
+        dod = (int64_t)v - 255;
+        break;
+    case 3:
+        if (read_bits(it, 12, &v) < 0)
+            return -1;
+        dod = (int64_t)v - 2047;
+        break;
+    default:
+        if (read_bits(it, 32, &v) < 0)
+            return -1;
+        dod = (int32_t)(uint32_t)v;
+        break;
+    }
+
+    it->delta += dod;
+    it->t += it->delta;
+    return 0;
+}
+
+static int read_value(gorilla_iter_t *it, int i)
+{
+    uint64_t bit, v;
+
+    if (read_bits(it, 1, &bit) < 0)
+        return -1;
+    if (!bit)
+        return 0; // Unchanged
+
+    if (read_bits(it, 1, &bit) < 0)
+        return -1;
+
+    if (bit)
+    {
+        uint64_t lead, sig;
+        if (read_bits(it, 5, &lead) < 0 || read_bits(it, 6, &sig) < 0)
+            return -1;
+        sig += 1;
+        if (lead + sig > 64)
+            return -1;
+        it->lead[i] = (uint8_t)lead;
+        it->trail[i] = (uint8_t)(64 - lead - sig);
+    }
+    else if (it->lead[i] == NO_WINDOW)
+    {
+        return -1; // Window reuse before any window was defined
+    }
+
+    int sig = 64 - it->lead[i] - it->trail[i];
+    if (read_bits(it, sig, &v) < 0)
+        return -1;
+    it->val[i] ^= v << it->trail[i];
+    return 0;
+}
+
+int gorilla_iter_next(gorilla_iter_t *it, int64_t *ts, double *temperature, double *humidity)
+{
+    if (it->idx >= it->count)
+        return 0;
+
+    if (it->idx == 0)
+    {
+        if (read_bits(it, 64, &it->val[0]) < 0 || read_bits(it, 64, &it->val[1]) < 0)
+            return -1;
+    }
+    else
+    {
+        if (read_timestamp(it) < 0 || read_value(it, 0) < 0 || read_value(it, 1) < 0)
+            return -1;
+    }
+
+    it->idx++;
+    if (ts)
+        *ts = it->t;
+    if (temperature)
+        *temperature = bits_double(it->val[0]);
+    if (humidity)
+        *humidity = bits_double(it->val[1]);
+    return 1;
+}
@@ -0,0 +1,76 @@
+// gorilla.h
+// Compressed in-memory telemetry chunks (Gorilla / Facebook TSDB encoding).
+//
+// Each chunk stores (timestamp, temperature, humidity) samples as a single bit
+// stream: timestamps use delta-of-delta encoding, values use XOR encoding
+// against the previous value. A DHT reading every 5 seconds compresses from
+// 24 bytes per raw sample to a few bytes.
+#ifndef GORILLA_H
+#define GORILLA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Chunk sealing limits (a chunk is closed for appends once either is reached)
+#define GORILLA_CHUNK_MAX_SAMPLES 720 // One hour at the clients' 5 s cadence
+#define GORILLA_CHUNK_MAX_SPAN_SEC 3600
+
+typedef struct gorilla_chunk
+{
+    uint8_t *data;    // Bit stream (MSB first)
+    size_t cap;       // Allocated bytes in data
+    size_t nbits;     // Bits written so far
+    uint32_t count;   // Number of samples in the chunk
+    int64_t t_start;  // Timestamp of the first sample (seconds)
+    int64_t t_last;   // Timestamp of the last sample
+    int64_t last_delta;
+    uint64_t last_val[2];  // Raw IEEE-754 bits of the previous temperature/humidity
+    uint8_t lead[2];       // Leading zeros of the previous XOR window
+    uint8_t trail[2];      // Trailing zeros of the previous XOR window
+    int sealed;            // 1 once no more samples may be appended
+    struct gorilla_chunk *next; // Used by callers to chain chunks per device
+} gorilla_chunk_t;
+
+// Sequential decoder over a chunk (or over a raw stream read back from disk)
+typedef struct
+{
+    const uint8_t *data;
+    size_t nbits;
+    size_t pos;
+    uint32_t count;
+    uint32_t idx;
+    int64_t t;
+    int64_t delta;
+    uint64_t val[2];
+    uint8_t lead[2];
+    uint8_t trail[2];
+} gorilla_iter_t;
+
+// Initialises an empty chunk. Returns 0 on success, -1 on allocation failure.
+int gorilla_chunk_init(gorilla_chunk_t *c);
+
+// Releases the chunk's buffer (the struct itself is owned by the caller).
+void gorilla_chunk_free(gorilla_chunk_t *c);
+
+// Appends one sample. Timestamps earlier than the previous one are clamped.
+// Returns 0 on success, -1 if the chunk is sealed or memory is exhausted.
+int gorilla_chunk_append(gorilla_chunk_t *c, int64_t ts, double temperature, double humidity);
+
+// Returns 1 if the chunk reached one of its sealing limits for a sample at ts.
+int gorilla_chunk_full(const gorilla_chunk_t *c, int64_t ts);
+
+// Closes the chunk for appends and trims the buffer to its final size.
+void gorilla_chunk_seal(gorilla_chunk_t *c);
+
+// Number of bytes used by the encoded stream
+size_t gorilla_chunk_bytes(const gorilla_chunk_t *c);
+
+void gorilla_iter_init(gorilla_iter_t *it, const gorilla_chunk_t *c);
+void gorilla_iter_init_raw(gorilla_iter_t *it, const uint8_t *data, size_t nbits,
+                           uint32_t count, int64_t t_start);
+
+// Decodes the next sample. Returns 1 if a sample was produced, 0 at the end
+// of the chunk and -1 if the stream is truncated or corrupt.
+int gorilla_iter_next(gorilla_iter_t *it, int64_t *ts, double *temperature, double *humidity);
+
+#endif
@@ -0,0 +1,36 @@
+// heartbeat.c
+// Liveness datagram encoding. See heartbeat.h.
+#include "heartbeat.h"
+
+uint32_t heartbeat_handle(const char *device_id)
+{
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)device_id; *p; ++p)
+    {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void heartbeat_pack(uint32_t handle, uint32_t backlog, uint8_t out[HEARTBEAT_SIZE])
+{
+    if (backlog > 0xFFFF)
+        backlog = 0xFFFF;
+    out[0] = HEARTBEAT_MAGIC;
+    out[1] = HEARTBEAT_VERSION;
+    for (int i = 0; i < 4; ++i)
+        out[2 + i] = (uint8_t)(handle >> (8 * i));
+    out[6] = (uint8_t)backlog;
+    out[7] = (uint8_t)(backlog >> 8);
+}
+
+int heartbeat_parse(const void *buf, size_t len, uint32_t *handle, uint32_t *backlog)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    if (len != HEARTBEAT_SIZE || p[0] != HEARTBEAT_MAGIC || p[1] != HEARTBEAT_VERSION)
+        return -1;
+    *handle = (uint32_t)p[2] | (uint32_t)p[3] << 8 | (uint32_t)p[4] << 16 | (uint32_t)p[5] << 24;
+    *backlog = (uint32_t)p[6] | (uint32_t)p[7] << 8;
+    return 0;
+}
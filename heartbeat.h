@@ -0,0 +1,37 @@
+// heartbeat.h
+// Liveness datagram sent by the clients when they have nothing else to send.
+//
+// 8 little-endian bytes, never valid JSON (first byte is not '{'):
+//   0 magic   uint8   'H'
+//   1 version uint8   1
+//   2 handle  uint32  (heartbeat_handle() of the device id)
+//   6 backlog uint16  (readings waiting on the device, saturated)
+// The handle is computed from the id on both sides, so the server can map a
+// heartbeat to its device without a registration exchange.
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HEARTBEAT_SIZE 8
+#define HEARTBEAT_MAGIC 'H'
+#define HEARTBEAT_VERSION 1
+
+// 32-bit FNV-1a hash of the device id
+uint32_t heartbeat_handle(const char *device_id);
+
+void heartbeat_pack(uint32_t handle, uint32_t backlog, uint8_t out[HEARTBEAT_SIZE]);
+
+// Returns 0, or -1 if buf is not a heartbeat datagram
+int heartbeat_parse(const void *buf, size_t len, uint32_t *handle, uint32_t *backlog);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
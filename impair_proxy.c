@@ -0,0 +1,630 @@
+// impair_proxy.c
+// Userspace UDP impairment proxy between the clients and srv.c.
+//
+// Listens on -l PORT and forwards every datagram to the server (-s, -p),
+// from one upstream socket per client address so the server sees each
+// client apart and its replies find their way back. Both directions go
+// through the same impairments, in order:
+//   -r KBIT    bandwidth cap: datagrams are serialised at this rate behind a
+//              queue of at most -q ms; datagrams that would wait longer are
+//              dropped (tail drop)
+//   -x PCT     loss
+//   -d MS      delay, plus jitter of -j MS drawn from -D uniform|normal|pareto
+//   -o PCT     reordering: held back by an extra -g MS so later ones overtake
+//   -u PCT     duplication: a second copy follows 1 ms later
+// Random draws come from -S SEED, so a scenario is reproducible.
+//
+// The proxy also watches the QoS 1 exchange. Client datagrams are keyed by
+// device id and seq (the first seq of a batch or summary); a key seen again
+// is a retransmission. ACKs are matched to the key: the ACK RTT is measured
+// from the first copy the proxy received from the client to the ACK it
+// passed back to it (both impairments included), and the readings of each
+// key ACKed for the first time (a batch ACK carries "count") count towards
+// goodput. Stops after -t seconds or on SIGINT/SIGTERM and prints the
+// totals; -J FILE also writes them as JSON.
+//
+//   ./impair_proxy -l 5006 -x 5 -d 40 -j 20 -D normal
+//   ./impair_proxy -l 5006 -r 256 -q 200 -t 60 -J result.json
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#define MAX_SESSIONS 4096    // Client addresses (upstream sockets)
+#define DATAGRAM_MAX 9000
+#define TRACK_BITS 18        // Seqs tracked for retransmission/RTT (older ones are overwritten)
+#define TRACK_SIZE (1u << TRACK_BITS)
+#define RTT_BUCKETS 16384    // 1 ms each; the last one collects everything slower
+
+enum
+{
+    JITTER_UNIFORM,
+    JITTER_NORMAL,
+    JITTER_PARETO
+};
+
+typedef struct
+{
+    struct sockaddr_in addr; // Client
+    int fd;                  // Upstream socket towards the server
+} session_t;
+
+typedef struct
+{
+    uint64_t busy_until_us; // Bandwidth cap: when the link finishes the queued datagrams
+    uint64_t datagrams, bytes;
+    uint64_t lost, queue_drops, duplicated, reordered;
+} direction_t;
+
+// A datagram in flight (delay queue)
+typedef struct
+{
+    uint64_t due_us;
+    uint64_t order;
+    int session;
+    int to_client;
+    size_t len;
+    char data[];
+} flight_t;
+
+typedef struct
+{
+    uint64_t key;        // 0 = free
+    uint64_t first_us;   // First copy received from the client
+    uint8_t acked;
+} track_t;
+
+// Scenario
+static double rate_kbit, queue_ms = 100, loss_pct, reorder_pct, dup_pct;
+static double delay_ms, jitter_ms, reorder_gap_ms = 20;
+static int jitter_dist = JITTER_UNIFORM;
+static uint64_t rng = 88172645463325252ull;
+
+static session_t sessions[MAX_SESSIONS];
+static int session_count;
+static direction_t up, down; // Towards the server / towards the clients
+static flight_t **heap;
+static int heap_count, heap_size;
+static uint64_t heap_order;
+static track_t *track;
+static uint32_t rtt_hist[RTT_BUCKETS];
+static uint64_t rtt_count, rtt_sum_us;
+static uint64_t data_datagrams, retransmits, acks, goodput_readings;
+static volatile sig_atomic_t stop;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static uint64_t xorshift64(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double uniform(void)
+{
+    return (xorshift64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int chance(double pct)
+{
+    return pct > 0 && uniform() * 100.0 < pct;
+}
+
+// One-way delay in microseconds
+static uint64_t draw_delay_us(void)
+{
+    double ms = delay_ms;
+    if (jitter_ms > 0)
+    {
+        if (jitter_dist == JITTER_NORMAL)
+        {
+            // Box-Muller; -j is the standard deviation
+            double u1 = uniform(), u2 = uniform();
+            ms += jitter_ms * sqrt(-2.0 * log(u1 > 0 ? u1 : 1e-12)) * cos(2.0 * M_PI * u2);
+        }
+        else if (jitter_dist == JITTER_PARETO)
+        {
+            // Heavy tail (shape 1.5) with mean -j, capped at 20x
+            double u = uniform();
+            double extra = jitter_ms / 3.0 * (pow(u > 0 ? u : 1e-12, -1.0 / 1.5) - 1.0);
+            ms += extra < 20 * jitter_ms ? extra : 20 * jitter_ms;
+        }
+        else
+            ms += jitter_ms * uniform();
+    }
+    return ms > 0 ? (uint64_t)(ms * 1000.0) : 0;
+}
+
+// --- Delay queue: binary min-heap on (due, order) ---
+static int flight_less(const flight_t *a, const flight_t *b)
+{
+    if (a->due_us != b->due_us)
+        return a->due_us < b->due_us;
+    return a->order < b->order;
+}
+
+static void heap_push(flight_t *f)
+{
+    if (heap_count == heap_size)
+    {
+        int size = heap_size ? heap_size * 2 : 1024;
+        flight_t **grown = realloc(heap, (size_t)size * sizeof(*heap));
+        if (!grown)
+        {
+            free(f);
+            return;
+        }
+        heap = grown;
+        heap_size = size;
+    }
+    int i = heap_count++;
+    while (i > 0 && flight_less(f, heap[(i - 1) / 2]))
+    {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = f;
+}
+
+static flight_t *heap_pop(void)
+{
+    flight_t *top = heap[0];
+    flight_t *last = heap[--heap_count];
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= heap_count)
+            break;
+        if (child + 1 < heap_count && flight_less(heap[child + 1], heap[child]))
+            child++;
+        if (!flight_less(heap[child], last))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heap_count > 0)
+        heap[i] = last;
+    return top;
+}
+
+static void schedule(int session, int to_client, const char *buf, size_t len, uint64_t due_us)
+{
+    flight_t *f = malloc(sizeof(*f) + len);
+    if (!f)
+        return;
+    f->due_us = due_us;
+    f->order = heap_order++;
+    f->session = session;
+    f->to_client = to_client;
+    f->len = len;
+    memcpy(f->data, buf, len);
+    heap_push(f);
+}
+
+// Applies the scenario to one datagram and queues what survives
+static void impair(direction_t *dir, int session, int to_client, const char *buf, size_t len)
+{
+    uint64_t now = now_us();
+    uint64_t depart = now;
+
+    dir->datagrams++;
+    dir->bytes += len;
+    if (rate_kbit > 0)
+    {
+        // Serialisation behind the datagrams already queued on the link
+        uint64_t start = dir->busy_until_us > now ? dir->busy_until_us : now;
+        if (start - now > (uint64_t)(queue_ms * 1000.0))
+        {
+            dir->queue_drops++;
+            return;
+        }
+        depart = start + (uint64_t)(len * 8 * 1000.0 / rate_kbit);
+        dir->busy_until_us = depart;
+    }
+    if (chance(loss_pct))
+    {
+        dir->lost++;
+        return;
+    }
+
+    uint64_t due = depart + draw_delay_us();
+    if (chance(reorder_pct))
+    {
+        dir->reordered++;
+        due += (uint64_t)(reorder_gap_ms * 1000.0);
+    }
+    schedule(session, to_client, buf, len, due);
+    if (chance(dup_pct))
+    {
+        dir->duplicated++;
+        schedule(session, to_client, buf, len, due + 1000);
+    }
+}
+
+// --- QoS 1 observation ---
+
+// Copies the string value of "name" into out. Returns 0 if found.
+static int json_string(const char *buf, size_t len, const char *name, char *out, size_t out_len)
+{
+    char pattern[32];
+    int n = snprintf(pattern, sizeof(pattern), "\"%s\":\"", name);
+    const char *p = memmem(buf, len, pattern, (size_t)n);
+    if (!p)
+        return -1;
+    p += n;
+    size_t i = 0;
+    while (p < buf + len && *p != '"' && i + 1 < out_len)
+        out[i++] = *p++;
+    out[i] = '\0';
+    return p < buf + len && *p == '"' ? 0 : -1;
+}
+
+// Number after the first "name": (seq of a reading, or the first reading of a batch)
+static int json_number(const char *buf, size_t len, const char *name, long *value)
+{
+    char pattern[32];
+    int n = snprintf(pattern, sizeof(pattern), "\"%s\":", name);
+    const char *p = memmem(buf, len, pattern, (size_t)n);
+    if (!p || p + n >= buf + len)
+        return -1;
+    char digits[24];
+    size_t i = 0;
+    p += n;
+    while (p < buf + len && i + 1 < sizeof(digits) && ((*p >= '0' && *p <= '9') || *p == '-'))
+        digits[i++] = *p++;
+    digits[i] = '\0';
+    if (i == 0)
+        return -1;
+    *value = strtol(digits, NULL, 10);
+    return 0;
+}
+
+// Key of (device id, seq): FNV-1a of the id, seq in the low bits
+static uint64_t qos_key(const char *id, long seq)
+{
+    uint64_t h = 1469598103934665603ull;
+    for (const char *p = id; *p; ++p)
+        h = (h ^ (uint8_t)*p) * 1099511628211ull;
+    uint64_t key = (h << 32) ^ (uint64_t)(uint32_t)seq;
+    return key ? key : 1;
+}
+
+static track_t *track_slot(uint64_t key)
+{
+    return &track[(key ^ (key >> 29)) & (TRACK_SIZE - 1)];
+}
+
+// Client -> server: QoS 1 readings, batches and summaries
+static void observe_up(const char *buf, size_t len)
+{
+    char id[128];
+    long seq, qos;
+    if (len < 2 || buf[0] != '{' || json_string(buf, len, "id", id, sizeof(id)) != 0 ||
+        json_number(buf, len, "qos", &qos) != 0 || qos != 1 || json_number(buf, len, "seq", &seq) != 0)
+        return;
+
+    data_datagrams++;
+    uint64_t key = qos_key(id, seq);
+    track_t *t = track_slot(key);
+    if (t->key == key)
+    {
+        retransmits++;
+        return;
+    }
+    t->key = key;
+    t->first_us = now_us();
+    t->acked = 0;
+}
+
+// Server -> client, as it is passed to the client
+static void observe_down(const char *buf, size_t len)
+{
+    char id[128], type[16];
+    long seq, count = 1;
+    if (len < 2 || buf[0] != '{' || json_string(buf, len, "type", type, sizeof(type)) != 0 ||
+        strcmp(type, "ACK") != 0 || json_string(buf, len, "id", id, sizeof(id)) != 0 ||
+        json_number(buf, len, "seq", &seq) != 0)
+        return;
+    json_number(buf, len, "count", &count);
+
+    acks++;
+    uint64_t key = qos_key(id, seq);
+    track_t *t = track_slot(key);
+    if (t->key != key || t->acked)
+        return;
+    t->acked = 1;
+
+    uint64_t rtt = now_us() - t->first_us;
+    uint64_t bucket = rtt / 1000;
+    rtt_hist[bucket < RTT_BUCKETS ? bucket : RTT_BUCKETS - 1]++;
+    rtt_count++;
+    rtt_sum_us += rtt;
+    goodput_readings += (uint64_t)(count > 0 ? count : 1);
+}
+
+static double rtt_percentile(double p)
+{
+    uint64_t target = (uint64_t)ceil(rtt_count * p);
+    uint64_t seen = 0;
+    for (int i = 0; i < RTT_BUCKETS; ++i)
+    {
+        seen += rtt_hist[i];
+        if (seen >= target && seen > 0)
+            return i + 0.5;
+    }
+    return 0;
+}
+
+static int find_session(const struct sockaddr_in *addr)
+{
+    for (int i = 0; i < session_count; ++i)
+    {
+        if (sessions[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr && sessions[i].addr.sin_port == addr->sin_port)
+            return i;
+    }
+    return -1;
+}
+
+static void on_signal(int sig)
+{
+    stop = 1;
+}
+
+static void print_direction(FILE *f, const char *name, const direction_t *d, int json)
+{
+    if (json)
+        fprintf(f, "\"%s\":{\"datagrams\":%llu,\"bytes\":%llu,\"lost\":%llu,\"queueDrops\":%llu,"
+                   "\"duplicated\":%llu,\"reordered\":%llu}",
+                name, (unsigned long long)d->datagrams, (unsigned long long)d->bytes, (unsigned long long)d->lost,
+                (unsigned long long)d->queue_drops, (unsigned long long)d->duplicated, (unsigned long long)d->reordered);
+    else
+        fprintf(f, "%s: datagrams=%llu bytes=%llu lost=%llu queue_drops=%llu duplicated=%llu reordered=%llu\n",
+                name, (unsigned long long)d->datagrams, (unsigned long long)d->bytes, (unsigned long long)d->lost,
+                (unsigned long long)d->queue_drops, (unsigned long long)d->duplicated, (unsigned long long)d->reordered);
+}
+
+static void report(FILE *f, double seconds, int json)
+{
+    double retx = data_datagrams ? (double)retransmits / data_datagrams : 0;
+    double mean = rtt_count ? rtt_sum_us / 1000.0 / rtt_count : 0;
+    double goodput = seconds > 0 ? goodput_readings / seconds : 0;
+
+    if (json)
+    {
+        fprintf(f, "{\"seconds\":%.1f,\"sessions\":%d,\"qosDatagrams\":%llu,\"retransmits\":%llu,"
+                   "\"retransmitRatio\":%.4f,\"acks\":%llu,\"ackedKeys\":%llu,\"goodputReadings\":%llu,"
+                   "\"goodputPerSec\":%.1f,\"ackRttMs\":{\"mean\":%.1f,\"p50\":%.1f,\"p99\":%.1f},",
+                seconds, session_count, (unsigned long long)data_datagrams, (unsigned long long)retransmits, retx,
+                (unsigned long long)acks, (unsigned long long)rtt_count, (unsigned long long)goodput_readings, goodput,
+                mean, rtt_percentile(0.5), rtt_percentile(0.99));
+        print_direction(f, "up", &up, 1);
+        fputc(',', f);
+        print_direction(f, "down", &down, 1);
+        fprintf(f, "}\n");
+        return;
+    }
+    fprintf(f, "seconds=%.1f sessions=%d\n", seconds, session_count);
+    print_direction(f, "up", &up, 0);
+    print_direction(f, "down", &down, 0);
+    fprintf(f, "qos: datagrams=%llu retransmits=%llu (ratio %.3f) acks=%llu\n", (unsigned long long)data_datagrams,
+            (unsigned long long)retransmits, retx, (unsigned long long)acks);
+    fprintf(f, "goodput: readings=%llu (%.1f/s)\n", (unsigned long long)goodput_readings, goodput);
+    fprintf(f, "ack_rtt_ms: mean=%.1f p50=%.1f p99=%.1f (samples=%llu)\n", mean, rtt_percentile(0.5),
+            rtt_percentile(0.99), (unsigned long long)rtt_count);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-l listen_port] [-s server_ip] [-p server_port] [-x loss_pct] [-d delay_ms]\n"
+            "          [-j jitter_ms] [-D uniform|normal|pareto] [-o reorder_pct] [-g reorder_gap_ms]\n"
+            "          [-u dup_pct] [-r rate_kbit] [-q queue_ms] [-S seed] [-t seconds] [-J json_file]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    int listen_port = 5006;
+    const char *server_ip = "127.0.0.1";
+    int server_port = 5005;
+    double seconds = 0;
+    const char *json_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:s:p:x:d:j:D:o:g:u:r:q:S:t:J:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l': listen_port = atoi(optarg); break;
+        case 's': server_ip = optarg; break;
+        case 'p': server_port = atoi(optarg); break;
+        case 'x': loss_pct = atof(optarg); break;
+        case 'd': delay_ms = atof(optarg); break;
+        case 'j': jitter_ms = atof(optarg); break;
+        case 'D':
+            if (strcmp(optarg, "uniform") == 0)
+                jitter_dist = JITTER_UNIFORM;
+            else if (strcmp(optarg, "normal") == 0)
+                jitter_dist = JITTER_NORMAL;
+            else if (strcmp(optarg, "pareto") == 0)
+                jitter_dist = JITTER_PARETO;
+            else
+            {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'o': reorder_pct = atof(optarg); break;
+        case 'g': reorder_gap_ms = atof(optarg); break;
+        case 'u': dup_pct = atof(optarg); break;
+        case 'r': rate_kbit = atof(optarg); break;
+        case 'q': queue_ms = atof(optarg); break;
+        case 'S': rng = strtoull(optarg, NULL, 0) | 1; break;
+        case 't': seconds = atof(optarg); break;
+        case 'J': json_path = optarg; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (loss_pct < 0 || loss_pct > 100 || reorder_pct < 0 || reorder_pct > 100 || dup_pct < 0 || dup_pct > 100 ||
+        delay_ms < 0 || jitter_ms < 0 || rate_kbit < 0 || queue_ms < 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    struct sockaddr_in server = {0}, local = {0};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(server_port);
+    if (inet_pton(AF_INET, server_ip, &server.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid server address: %s\n", server_ip);
+        return 2;
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = INADDR_ANY;
+    local.sin_port = htons(listen_port);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&local, sizeof(local)) < 0)
+    {
+        perror("Bind failed");
+        return 1;
+    }
+
+    // One upstream socket per client
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < MAX_SESSIONS + 64)
+    {
+        lim.rlim_cur = lim.rlim_max < MAX_SESSIONS + 64 ? lim.rlim_max : MAX_SESSIONS + 64;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    int ep = epoll_create1(0);
+    track = calloc(TRACK_SIZE, sizeof(*track));
+    if (ep < 0 || !track)
+    {
+        perror("impair_proxy");
+        return 1;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = MAX_SESSIONS}; // MAX_SESSIONS = the listening socket
+    epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    printf("Impairment proxy on port %d -> %s:%d (loss %.1f%%, delay %.1f+%.1f ms, reorder %.1f%%, dup %.1f%%, rate %.0f kbit/s)\n",
+           listen_port, server_ip, server_port, loss_pct, delay_ms, jitter_ms, reorder_pct, dup_pct, rate_kbit);
+    fflush(stdout);
+
+    uint64_t start = now_us();
+    char buf[DATAGRAM_MAX];
+    struct epoll_event events[256];
+
+    while (!stop && (seconds <= 0 || now_us() - start < (uint64_t)(seconds * 1e6)))
+    {
+        // Sleep until the next datagram is due (at most 10 ms)
+        int timeout = 10;
+        if (heap_count > 0)
+        {
+            uint64_t now = now_us();
+            timeout = heap[0]->due_us <= now ? 0 : (int)((heap[0]->due_us - now + 999) / 1000);
+            if (timeout > 10)
+                timeout = 10;
+        }
+        int n = epoll_wait(ep, events, 256, timeout);
+        for (int k = 0; k < n; ++k)
+        {
+            uint32_t which = events[k].data.u32;
+            ssize_t len;
+            if (which == MAX_SESSIONS)
+            {
+                struct sockaddr_in from;
+                socklen_t from_len = sizeof(from);
+                while ((len = recvfrom(listen_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len)) > 0)
+                {
+                    int s = find_session(&from);
+                    if (s < 0)
+                    {
+                        if (session_count == MAX_SESSIONS)
+                            continue;
+                        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+                        if (fd < 0 || connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0)
+                        {
+                            if (fd >= 0)
+                                close(fd);
+                            continue;
+                        }
+                        s = session_count++;
+                        sessions[s].addr = from;
+                        sessions[s].fd = fd;
+                        struct epoll_event sev = {.events = EPOLLIN, .data.u32 = (uint32_t)s};
+                        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &sev);
+                    }
+                    observe_up(buf, (size_t)len);
+                    impair(&up, s, 0, buf, (size_t)len);
+                    from_len = sizeof(from);
+                }
+            }
+            else
+            {
+                while ((len = recv(sessions[which].fd, buf, sizeof(buf), 0)) > 0)
+                    impair(&down, (int)which, 1, buf, (size_t)len);
+            }
+        }
+
+        uint64_t now = now_us();
+        while (heap_count > 0 && heap[0]->due_us <= now)
+        {
+            flight_t *f = heap_pop();
+            session_t *s = &sessions[f->session];
+            if (f->to_client)
+            {
+                observe_down(f->data, f->len);
+                sendto(listen_fd, f->data, f->len, 0, (struct sockaddr *)&s->addr, sizeof(s->addr));
+            }
+            else
+                send(s->fd, f->data, f->len, 0);
+            free(f);
+        }
+    }
+
+    double elapsed = (now_us() - start) / 1e6;
+    report(stdout, elapsed, 0);
+    if (json_path)
+    {
+        FILE *f = fopen(json_path, "w");
+        if (f)
+        {
+            report(f, elapsed, 1);
+            fclose(f);
+        }
+        else
+            perror("Failed to write the JSON report");
+    }
+
+    while (heap_count > 0)
+        free(heap_pop());
+    free(heap);
+    free(track);
+    for (int i = 0; i < session_count; ++i)
+        close(sessions[i].fd);
+    close(listen_fd);
+    close(ep);
+    return 0;
+}
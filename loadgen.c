@@ -0,0 +1,202 @@
+// loadgen.c
+// Fleet load generator for report-by-exception (deadband.c).
+//
+// Simulates -d devices sampling every -I ms for -H hours of device time and
+// counts the datagrams and bytes a fleet sends with and without the clients'
+// deadband filter. The sensor traces are synthetic: a daily temperature and
+// humidity cycle with a per-device phase, plus noise, quantised like a DHT11
+// (0.1 degC, 1 %RH). Between readings each device sends an 8-byte heartbeat
+// datagram after -b seconds of silence (heartbeat.c); a reading is forced
+// every -r seconds. With -s the deadband traffic is also sent to a running
+// server (readings as QoS 0), paced but much faster than real time.
+//
+//   ./loadgen -d 100 -H 24
+//   ./loadgen -d 20 -H 1 -s 127.0.0.1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "deadband.h"
+#include "heartbeat.h"
+#include "telemetry_record.h"
+
+#define DAY_MS 86400000.0
+
+typedef struct
+{
+    char id[32];
+    double base_temp;
+    double base_hum;
+    double phase;
+    uint32_t seq;
+    uint32_t handle;
+    uint32_t boot;    // Boot id sent with each reading
+    uint32_t last_tx; // Device time of the last datagram
+    deadband_t band;
+} sim_device_t;
+
+static double noise(double amplitude)
+{
+    return amplitude * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+static double quantise(double v, double step)
+{
+    return floor(v / step + 0.5) * step;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-d devices] [-H hours] [-I interval_ms] [-t temp_delta] [-u hum_delta]\n"
+            "          [-b heartbeat_s] [-r refresh_s] [-s server_ip] [-p port]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    int device_count = 100;
+    double hours = 24;
+    uint32_t interval_ms = 5000;
+    float temp_delta = 0.5f;
+    float hum_delta = 2.0f;
+    uint32_t heartbeat_s = 60;
+    uint32_t refresh_s = 900;
+    const char *server_ip = NULL;
+    int port = 5005;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:H:I:t:u:b:r:s:p:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': device_count = atoi(optarg); break;
+        case 'H': hours = atof(optarg); break;
+        case 'I': interval_ms = (uint32_t)atoi(optarg); break;
+        case 't': temp_delta = (float)atof(optarg); break;
+        case 'u': hum_delta = (float)atof(optarg); break;
+        case 'b': heartbeat_s = (uint32_t)atoi(optarg); break;
+        case 'r': refresh_s = (uint32_t)atoi(optarg); break;
+        case 's': server_ip = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (device_count < 1 || interval_ms == 0 || hours <= 0 || heartbeat_s == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int sockfd = -1;
+    struct sockaddr_in server = {0};
+    if (server_ip)
+    {
+        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        server.sin_family = AF_INET;
+        server.sin_port = htons(port);
+        if (sockfd < 0 || inet_pton(AF_INET, server_ip, &server.sin_addr) != 1)
+        {
+            fprintf(stderr, "Invalid server address: %s\n", server_ip);
+            return 2;
+        }
+    }
+
+    sim_device_t *devs = calloc((size_t)device_count, sizeof(*devs));
+    if (!devs)
+    {
+        perror("calloc");
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < device_count; ++i)
+    {
+        snprintf(devs[i].id, sizeof(devs[i].id), "Load_Device_%04d", i);
+        devs[i].base_temp = 22.0 + noise(4.0);
+        devs[i].base_hum = 50.0 + noise(15.0);
+        devs[i].phase = noise(M_PI);
+        devs[i].handle = heartbeat_handle(devs[i].id);
+        devs[i].boot = devs[i].handle | 0x80000000u; // Only its length matters here
+        deadband_init(&devs[i].band, temp_delta, hum_delta, refresh_s * 1000);
+    }
+
+    uint64_t samples = 0, periodic_bytes = 0, sent_bytes = 0;
+    uint64_t changes = 0, refreshes = 0, heartbeats = 0, transmitted = 0;
+    uint32_t steps = (uint32_t)(hours * 3600000.0 / interval_ms);
+    char payload[TELEMETRY_JSON_MAX];
+    uint8_t beat[HEARTBEAT_SIZE];
+
+    for (uint32_t step = 0; step < steps; ++step)
+    {
+        uint32_t now = step * interval_ms;
+        for (int i = 0; i < device_count; ++i)
+        {
+            sim_device_t *d = &devs[i];
+            double cycle = sin(2.0 * M_PI * now / DAY_MS + d->phase);
+            float temp = (float)quantise(d->base_temp + 3.0 * cycle + noise(0.15), 0.1);
+            float hum = (float)quantise(d->base_hum - 10.0 * cycle + noise(1.0), 1.0);
+            telemetry_record_t rec;
+            int len;
+
+            // Periodic reporting: every sample, no heartbeat advertised
+            telemetry_record_set(&rec, (uint32_t)samples, now, temp, hum, 0);
+            len = telemetry_record_to_json(&rec, d->id, d->boot, payload, sizeof(payload));
+            periodic_bytes += (uint64_t)len;
+            samples++;
+
+            const void *out;
+            int why = deadband_check(&d->band, temp, hum, now);
+            if (why != DEADBAND_SKIP)
+            {
+                deadband_sent(&d->band, temp, hum, now);
+                if (why == DEADBAND_CHANGE)
+                    changes++;
+                else
+                    refreshes++;
+                telemetry_record_set(&rec, d->seq++, now, temp, hum, 0);
+                rec.heartbeat_s = (uint16_t)heartbeat_s;
+                len = telemetry_record_to_json(&rec, d->id, d->boot, payload, sizeof(payload));
+                out = payload;
+            }
+            else if (now - d->last_tx >= heartbeat_s * 1000)
+            {
+                heartbeat_pack(d->handle, 0, beat);
+                len = HEARTBEAT_SIZE;
+                out = beat;
+                heartbeats++;
+            }
+            else
+                continue;
+
+            d->last_tx = now;
+            sent_bytes += (uint64_t)len;
+            transmitted++;
+            if (sockfd >= 0)
+            {
+                sendto(sockfd, out, (size_t)len, 0, (struct sockaddr *)&server, sizeof(server));
+                if (transmitted % 64 == 0)
+                    usleep(1000); // Stay within the server's socket buffer
+            }
+        }
+    }
+
+    printf("fleet: devices=%d hours=%.1f interval=%ums deadband=%.2fdegC/%.1f%%RH heartbeat=%us refresh=%us\n",
+           device_count, hours, interval_ms, temp_delta, hum_delta, heartbeat_s, refresh_s);
+    printf("periodic: datagrams=%llu bytes=%llu\n",
+           (unsigned long long)samples, (unsigned long long)periodic_bytes);
+    printf("deadband: datagrams=%llu (changes=%llu refreshes=%llu heartbeats=%llu) bytes=%llu\n",
+           (unsigned long long)transmitted, (unsigned long long)changes, (unsigned long long)refreshes,
+           (unsigned long long)heartbeats, (unsigned long long)sent_bytes);
+    printf("reduction: datagrams=%.1f%% bytes=%.1f%% (%.1f datagrams/device/hour instead of %.1f)\n",
+           samples ? 100.0 * (1.0 - (double)transmitted / samples) : 0.0,
+           periodic_bytes ? 100.0 * (1.0 - (double)sent_bytes / periodic_bytes) : 0.0,
+           transmitted / (device_count * hours), samples / (device_count * hours));
+
+    free(devs);
+    if (sockfd >= 0)
+        close(sockfd);
+    return 0;
+}
@@ -0,0 +1,692 @@
+"""
+Local MQTT 3.1.1 broker stand-in for testing the clients and the server
+without the cloud broker.
+
+Supports what the project uses: TLS (self-signed certificate generated on
+start unless --cert/--key are given), CONNECT with username/password and
+clean or persistent sessions, SUBSCRIBE/UNSUBSCRIBE with + and # filters,
+PUBLISH at QoS 0 and 1 with PUBACK, retained messages, PINGREQ and
+DISCONNECT. Persistent sessions keep their subscriptions and queue QoS 1
+messages while the client is offline.
+
+Every connection is logged as one JSON line with the client id, the clean
+session flag, whether the broker still had a session for it and whether
+the TLS session was resumed, so reconnect behaviour can be checked.
+
+Faults can be injected to benchmark a publisher (srv.c's alert path)
+without the cloud broker: a PUBACK delay with jitter, dropped PUBACKs,
+refused connections, a disconnect every N publishes and a connection that
+stops reading (TCP backpressure) after N publishes. SIGUSR1 takes the
+broker down (every connection is closed and new ones are refused) and
+brings it back up again. --stats logs the publish rate periodically.
+
+    python3 mqttBroker.py --port 8883 --tls12
+    python3 mqttBroker.py --plain --port 1883 --puback-delay 50 --puback-jitter 20 --stats 1
+    python3 mqttBroker.py --selftest
+"""
+import argparse
+import json
+import os
+import random
+import signal
+import socket
+import ssl
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+# --- Configuration ---
+DEFAULT_PORT = 8883
+MAX_QUEUED = 1000  # QoS 1 messages kept per offline persistent session
+QUIET = False      # No connection log (self-test)
+
+# --- Packet types ---
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+SUBSCRIBE, SUBACK, UNSUBSCRIBE, UNSUBACK = 8, 9, 10, 11
+PINGREQ, PINGRESP, DISCONNECT = 12, 13, 14
+
+
+def log(event, **fields):
+    if QUIET:
+        return
+    fields["event"] = event
+    fields["time"] = round(time.time(), 3)
+    print(json.dumps(fields), flush=True)
+
+
+# --- Wire helpers ---
+
+def encode_length(n):
+    out = bytearray()
+    while True:
+        byte = n % 128
+        n //= 128
+        out.append(byte | (0x80 if n else 0))
+        if not n:
+            return bytes(out)
+
+
+def encode_string(s):
+    data = s.encode("utf-8") if isinstance(s, str) else s
+    return struct.pack("!H", len(data)) + data
+
+
+def packet(ptype, flags, body):
+    return bytes([(ptype << 4) | flags]) + encode_length(len(body)) + body
+
+
+def read_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        data += chunk
+    return data
+
+
+def read_packet(sock):
+    """Returns (type, flags, body)."""
+    first = read_exact(sock, 1)[0]
+    length, shift = 0, 0
+    while True:
+        byte = read_exact(sock, 1)[0]
+        length |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return first >> 4, first & 0x0F, read_exact(sock, length)
+
+
+def read_string(body, pos):
+    n = struct.unpack_from("!H", body, pos)[0]
+    return body[pos + 2:pos + 2 + n], pos + 2 + n
+
+
+def topic_matches(filt, topic):
+    f, t = filt.split("/"), topic.split("/")
+    for i, part in enumerate(f):
+        if part == "#":
+            return True
+        if i >= len(t) or (part != "+" and part != t[i]):
+            return False
+    return len(f) == len(t)
+
+
+# --- Broker ---
+
+class Session:
+    def __init__(self, client_id):
+        self.client_id = client_id
+        self.subs = {}      # filter -> granted QoS
+        self.queue = []     # (topic, payload, qos) waiting for the client
+        self.conn = None    # Connection while online
+        self.clean = True
+
+
+class Faults:
+    """Injected misbehaviour, shared by all connections."""
+
+    def __init__(self, puback_delay_ms=0, puback_jitter_ms=0, drop_puback_pct=0, refuse_pct=0,
+                 disconnect_after=0, stall_after=0, stall_ms=10000, seed=None):
+        self.puback_delay_ms = puback_delay_ms
+        self.puback_jitter_ms = puback_jitter_ms
+        self.drop_puback_pct = drop_puback_pct
+        self.refuse_pct = refuse_pct
+        self.disconnect_after = disconnect_after  # Publishes per connection (0 = never)
+        self.stall_after = stall_after            # Publishes per connection before it stops reading
+        self.stall_ms = stall_ms
+        self.down = False                         # Toggled by SIGUSR1
+        self.rng = random.Random(seed)
+
+    def puback_delay(self):
+        if not self.puback_delay_ms and not self.puback_jitter_ms:
+            return 0.0
+        return (self.puback_delay_ms + self.rng.uniform(0, self.puback_jitter_ms)) / 1000.0
+
+    def chance(self, pct):
+        return pct > 0 and self.rng.uniform(0, 100) < pct
+
+
+class Broker:
+    def __init__(self, username=None, password=None, faults=None):
+        self.lock = threading.Lock()
+        self.sessions = {}
+        self.retained = {}
+        self.username = username
+        self.password = password
+        self.faults = faults or Faults()
+        self.connections = set()
+        self.stats = {"connects": 0, "resumed": 0, "session_present": 0, "published": 0,
+                      "pubacks": 0, "pubacks_dropped": 0, "refused": 0, "disconnected": 0, "stalls": 0}
+
+    def set_down(self, down):
+        """Takes the broker down (closing every connection) or back up."""
+        self.faults.down = down
+        with self.lock:
+            conns = list(self.connections)
+        for conn in conns:
+            try:
+                conn.sock.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
+        log("down" if down else "up", closed=len(conns))
+
+    def route(self, topic, payload, qos, retain):
+        with self.lock:
+            self.stats["published"] += 1
+            if retain:
+                if payload:
+                    self.retained[topic] = payload
+                else:
+                    self.retained.pop(topic, None)
+            targets = []
+            for s in self.sessions.values():
+                granted = max((q for f, q in s.subs.items() if topic_matches(f, topic)), default=None)
+                if granted is None:
+                    continue
+                out_qos = min(qos, granted)
+                if s.conn:
+                    targets.append((s.conn, out_qos))
+                elif not s.clean and out_qos > 0 and len(s.queue) < MAX_QUEUED:
+                    s.queue.append((topic, payload, out_qos))
+        for conn, out_qos in targets:
+            conn.deliver(topic, payload, out_qos, False)
+
+
+class Connection:
+    def __init__(self, broker, sock, peer, handshake_ms):
+        self.broker = broker
+        self.sock = sock
+        self.peer = peer
+        self.handshake_ms = handshake_ms
+        self.session = None
+        self.send_lock = threading.Lock()
+        self.next_id = 1
+        self.publishes = 0
+
+    def send(self, data):
+        with self.send_lock:
+            self.sock.sendall(data)
+
+    def deliver(self, topic, payload, qos, retain):
+        body = encode_string(topic)
+        if qos:
+            body += struct.pack("!H", self.next_id)
+            self.next_id = self.next_id % 65535 + 1
+        try:
+            self.send(packet(PUBLISH, (qos << 1) | (1 if retain else 0), body + payload))
+        except OSError:
+            pass
+
+    def handle_connect(self, body):
+        _, pos = read_string(body, 0)  # Protocol name
+        level, flags = body[pos], body[pos + 1]
+        keepalive = struct.unpack_from("!H", body, pos + 2)[0]
+        pos += 4
+        client_id, pos = read_string(body, pos)
+        client_id = client_id.decode("utf-8", "replace")
+        if flags & 0x04:  # Will topic and message (accepted, not published)
+            _, pos = read_string(body, pos)
+            _, pos = read_string(body, pos)
+        username = password = None
+        if flags & 0x80:
+            username, pos = read_string(body, pos)
+            username = username.decode("utf-8", "replace")
+        if flags & 0x40:
+            password, pos = read_string(body, pos)
+            password = password.decode("utf-8", "replace")
+        clean = bool(flags & 0x02)
+
+        b = self.broker
+        if b.faults.chance(b.faults.refuse_pct):
+            self.send(packet(CONNACK, 0, bytes([0, 3])))  # Server unavailable
+            with b.lock:
+                b.stats["refused"] += 1
+            log("refused", clientId=client_id, peer=self.peer, reason="injected")
+            return False
+        if b.username is not None and (username != b.username or password != b.password):
+            self.send(packet(CONNACK, 0, bytes([0, 5])))  # Not authorised
+            log("refused", clientId=client_id, peer=self.peer)
+            return False
+        if not client_id:
+            client_id = "anon-%s" % self.peer
+
+        with b.lock:
+            old = b.sessions.get(client_id)
+            if old and old.conn:
+                try:
+                    old.conn.sock.close()  # Session takeover
+                except OSError:
+                    pass
+                old.conn = None
+            present = bool(old) and not clean and not old.clean
+            if not present:
+                old = Session(client_id)
+                b.sessions[client_id] = old
+            old.clean = clean
+            old.conn = self
+            self.session = old
+            queued, old.queue = old.queue, []
+            b.stats["connects"] += 1
+            b.stats["session_present"] += present
+            resumed = bool(getattr(self.sock, "session_reused", False))
+            b.stats["resumed"] += resumed
+
+        self.send(packet(CONNACK, 0, bytes([1 if present else 0, 0])))
+        tls = self.sock.version() if isinstance(self.sock, ssl.SSLSocket) else None
+        log("connect", clientId=client_id, peer=self.peer, protocolLevel=level, cleanSession=clean,
+            sessionPresent=present, keepAlive=keepalive, tls=tls, tlsResumed=resumed,
+            handshakeMs=self.handshake_ms, queuedDelivered=len(queued))
+        for topic, payload, qos in queued:
+            self.deliver(topic, payload, qos, False)
+        return True
+
+    def handle_subscribe(self, body):
+        packet_id = body[:2]
+        pos, granted = 2, []
+        while pos < len(body):
+            filt, pos = read_string(body, pos)
+            qos = min(body[pos] & 0x03, 1)
+            pos += 1
+            filt = filt.decode("utf-8", "replace")
+            with self.broker.lock:
+                self.session.subs[filt] = qos
+                retained = [(t, p) for t, p in self.broker.retained.items() if topic_matches(filt, t)]
+            granted.append(qos)
+            log("subscribe", clientId=self.session.client_id, filter=filt, qos=qos)
+            for topic, payload in retained:
+                self.deliver(topic, payload, qos, True)
+        self.send(packet(SUBACK, 0, packet_id + bytes(granted)))
+
+    def handle_unsubscribe(self, body):
+        pos = 2
+        while pos < len(body):
+            filt, pos = read_string(body, pos)
+            with self.broker.lock:
+                self.session.subs.pop(filt.decode("utf-8", "replace"), None)
+        self.send(packet(UNSUBACK, 0, body[:2]))
+
+    def handle_publish(self, flags, body):
+        b = self.broker
+        f = b.faults
+        qos = (flags >> 1) & 0x03
+        topic, pos = read_string(body, 0)
+        self.publishes += 1
+        if qos:
+            packet_id = body[pos:pos + 2]
+            pos += 2
+            # Sleeping here also stops reading the connection, like a slow broker
+            delay = f.puback_delay()
+            if delay:
+                time.sleep(delay)
+            if f.chance(f.drop_puback_pct):
+                with b.lock:
+                    b.stats["pubacks_dropped"] += 1
+            else:
+                self.send(packet(PUBACK, 0, packet_id))
+                with b.lock:
+                    b.stats["pubacks"] += 1
+        b.route(topic.decode("utf-8", "replace"), body[pos:], min(qos, 1), bool(flags & 0x01))
+
+        if f.stall_after and self.publishes == f.stall_after:
+            # Stop reading: the publisher's socket buffers fill up
+            with b.lock:
+                b.stats["stalls"] += 1
+            log("stall", clientId=self.session.client_id, peer=self.peer, ms=f.stall_ms)
+            time.sleep(f.stall_ms / 1000.0)
+        if f.disconnect_after and self.publishes % f.disconnect_after == 0:
+            with b.lock:
+                b.stats["disconnected"] += 1
+            raise ConnectionError("injected disconnect")
+
+    def run(self):
+        with self.broker.lock:
+            self.broker.connections.add(self)
+        try:
+            ptype, _, body = read_packet(self.sock)
+            if ptype != CONNECT or not self.handle_connect(body):
+                return
+            while True:
+                ptype, flags, body = read_packet(self.sock)
+                if ptype == PUBLISH:
+                    self.handle_publish(flags, body)
+                elif ptype == SUBSCRIBE:
+                    self.handle_subscribe(body)
+                elif ptype == UNSUBSCRIBE:
+                    self.handle_unsubscribe(body)
+                elif ptype == PINGREQ:
+                    self.send(packet(PINGRESP, 0, b""))
+                elif ptype == DISCONNECT:
+                    break
+                # PUBACK from the client: nothing kept in flight
+        except (ConnectionError, OSError, ssl.SSLError, IndexError, struct.error):
+            pass
+        finally:
+            self.close()
+
+    def close(self):
+        b = self.broker
+        s = self.session
+        with b.lock:
+            b.connections.discard(self)
+        if s:
+            with b.lock:
+                if s.conn is self:
+                    s.conn = None
+                    if s.clean:
+                        b.sessions.pop(s.client_id, None)
+            log("disconnect", clientId=s.client_id, peer=self.peer)
+        try:
+            self.sock.close()
+        except OSError:
+            pass
+
+
+def log_stats(broker, interval):
+    last = 0
+    while True:
+        time.sleep(interval)
+        with broker.lock:
+            stats = dict(broker.stats)
+        stats["publishRate"] = round((stats["published"] - last) / interval, 1)
+        last = stats["published"]
+        log("stats", down=broker.faults.down, **stats)
+
+
+def make_self_signed(directory):
+    cert = os.path.join(directory, "broker.crt")
+    key = os.path.join(directory, "broker.key")
+    subprocess.run(["openssl", "req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1",
+                    "-nodes", "-keyout", key, "-out", cert, "-days", "30", "-subj", "/CN=localhost"],
+                   check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def make_server_context(cert, key, tls12):
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    ctx.load_cert_chain(cert, key)
+    if tls12:
+        ctx.maximum_version = ssl.TLSVersion.TLSv1_2  # Like BearSSL on the Pico W
+    return ctx
+
+
+def serve(broker, listener, ctx, stop=None):
+    listener.settimeout(0.2)
+    while not (stop and stop.is_set()):
+        try:
+            raw, addr = listener.accept()
+        except socket.timeout:
+            continue
+        if broker.faults.down:
+            raw.close()  # Connection refused by a broker that is down
+            continue
+        threading.Thread(target=accept_one, args=(broker, raw, addr, ctx), daemon=True).start()
+
+
+def accept_one(broker, raw, addr, ctx):
+    peer = "%s:%d" % addr
+    raw.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    start = time.perf_counter()
+    try:
+        sock = ctx.wrap_socket(raw, server_side=True) if ctx else raw
+    except (ssl.SSLError, OSError) as e:
+        log("tls_error", peer=peer, error=str(e))
+        raw.close()
+        return
+    Connection(broker, sock, peer, round((time.perf_counter() - start) * 1000, 2)).run()
+
+
+# --- Self-test: the clients' reconnect pattern against this broker ---
+
+class TestClient:
+    def __init__(self, port, client_id, clean, ctx=None, session=None, expect_rc=0):
+        raw = socket.create_connection(("127.0.0.1", port), timeout=2)
+        raw.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.sock = ctx.wrap_socket(raw, server_hostname="localhost", session=session) if ctx else raw
+        flags = 0xC0 | (0x02 if clean else 0)
+        body = encode_string("MQTT") + bytes([4, flags]) + struct.pack("!H", 60)
+        body += encode_string(client_id) + encode_string("web_client") + encode_string("Password1")
+        self.sock.sendall(packet(CONNECT, 0, body))
+        ptype, _, ack = read_packet(self.sock)
+        assert ptype == CONNACK and ack[1] == expect_rc, "unexpected CONNACK"
+        self.session_present = bool(ack[0] & 1)
+
+    def subscribe(self, topic, qos):
+        self.sock.sendall(packet(SUBSCRIBE, 2, struct.pack("!H", 1) + encode_string(topic) + bytes([qos])))
+        return read_packet(self.sock)[0] == SUBACK
+
+    def publish(self, topic, payload, qos):
+        body = encode_string(topic) + (struct.pack("!H", 7) if qos else b"") + payload
+        self.sock.sendall(packet(PUBLISH, qos << 1, body))
+        if qos:
+            read_packet(self.sock)
+
+    def publish_timed(self, topic, payload, timeout=1.0):
+        """QoS 1 publish; returns the PUBACK delay in seconds, None if none came."""
+        start = time.perf_counter()
+        self.sock.sendall(packet(PUBLISH, 2, encode_string(topic) + struct.pack("!H", 7) + payload))
+        self.sock.settimeout(timeout)
+        try:
+            ptype, _, _ = read_packet(self.sock)
+        except (socket.timeout, ssl.SSLError, ConnectionError, OSError):
+            return None
+        return time.perf_counter() - start if ptype == PUBACK else None
+
+    def receive(self, timeout=1.0):
+        self.sock.settimeout(timeout)
+        try:
+            ptype, flags, body = read_packet(self.sock)
+        except (socket.timeout, ssl.SSLError, ConnectionError):
+            return None
+        if ptype != PUBLISH:
+            return None
+        topic, pos = read_string(body, 0)
+        return body[pos + (2 if flags & 0x06 else 0):]
+
+    def drop(self):
+        # Like a Wi-Fi blip: no DISCONNECT packet
+        self.sock.close()
+
+
+def selftest(tls12):
+    global QUIET
+    QUIET = True
+    print(f"--- {'TLS 1.2' if tls12 else 'TLS 1.3'} ---")
+    broker = Broker("web_client", "Password1")
+    tmp = tempfile.mkdtemp()
+    cert, key = make_self_signed(tmp)
+    ctx = make_server_context(cert, key, tls12)
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(16)
+    port = listener.getsockname()[1]
+    stop = threading.Event()
+    threading.Thread(target=serve, args=(broker, listener, ctx, stop), daemon=True).start()
+
+    cctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    cctx.check_hostname = False
+    cctx.verify_mode = ssl.CERT_NONE  # The clients use setInsecure()
+    if tls12:
+        cctx.maximum_version = ssl.TLSVersion.TLSv1_2
+    results = []
+
+    def check(name, ok):
+        results.append(ok)
+        print(f"{'✅' if ok else '❌'} {name}")
+
+    device = "g04-PICO_Device_01"
+    topic = "/comcs/g04/commands"
+
+    # 1. First connection: full handshake, no session on the broker
+    c = TestClient(port, device, clean=False, ctx=cctx)
+    check("first connect has no session", not c.session_present)
+    check("command subscription granted", c.subscribe(topic, 1))
+    c.receive(0.2)  # TLS 1.3 session tickets arrive after the handshake
+    tls_session = c.sock.session
+    c.drop()
+    time.sleep(0.1)
+
+    # 2. A command is sent while the device is offline
+    pub = TestClient(port, "operator", clean=True, ctx=cctx)
+    pub.publish(topic, b'{"cmd":"ping"}', 1)
+    pub.drop()
+    time.sleep(0.1)
+
+    # 3. Reconnect after the blip: resumed TLS, same session, queued command
+    c = TestClient(port, device, clean=False, ctx=cctx, session=tls_session)
+    check("reconnect resumed the TLS session", c.sock.session_reused)
+    check("broker kept the persistent session", c.session_present)
+    check("command queued while offline is delivered", c.receive() == b'{"cmd":"ping"}')
+    c.drop()
+    time.sleep(0.1)
+
+    # 4. The previous firmware's pattern: random id, clean session, no TLS cache
+    c = TestClient(port, "ESP32-G04-%x" % (os.getpid() & 0xFFFF), clean=True, ctx=cctx)
+    check("random id with clean session starts from scratch", not c.session_present and not c.sock.session_reused)
+    c.drop()
+
+    # Handshake cost, full vs resumed (host CPU; an MCU is about 100-1000x slower)
+    full, resumed = [], []
+    for _ in range(20):
+        t = time.perf_counter()
+        c = TestClient(port, device, clean=False, ctx=cctx)
+        full.append(time.perf_counter() - t)
+        c.receive(0.05)
+        s = c.sock.session
+        c.drop()
+        t = time.perf_counter()
+        c = TestClient(port, device, clean=False, ctx=cctx, session=s)
+        resumed.append(time.perf_counter() - t)
+        c.drop()
+    full.sort()
+    resumed.sort()
+    print(f"connect+CONNACK median: full handshake {full[10] * 1000:.2f} ms, resumed {resumed[10] * 1000:.2f} ms")
+    print(f"broker stats: {broker.stats}")
+    stop.set()
+    return all(results)
+
+
+def selftest_faults():
+    global QUIET
+    QUIET = True
+    print("--- Injected faults ---")
+    faults = Faults(seed=1)
+    broker = Broker(faults=faults)
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(16)
+    port = listener.getsockname()[1]
+    stop = threading.Event()
+    threading.Thread(target=serve, args=(broker, listener, None, stop), daemon=True).start()
+    results = []
+
+    def check(name, ok):
+        results.append(ok)
+        print(f"{'✅' if ok else '❌'} {name}")
+
+    topic = "/comcs/g04/alerts"
+    c = TestClient(port, "udp_alert_server", clean=True)
+    fast = c.publish_timed(topic, b"{}")
+    faults.puback_delay_ms = 50
+    slow = c.publish_timed(topic, b"{}")
+    faults.puback_delay_ms = 0
+    check("PUBACK delayed by the injected latency", fast is not None and slow is not None and slow >= 0.05 > fast)
+
+    faults.drop_puback_pct = 100
+    check("dropped PUBACK never arrives", c.publish_timed(topic, b"{}", timeout=0.3) is None)
+    faults.drop_puback_pct = 0
+    c.drop()
+
+    faults.refuse_pct = 100
+    try:
+        TestClient(port, "udp_alert_server", clean=True, expect_rc=3).drop()
+        check("connection refused with 'server unavailable'", True)
+    except (AssertionError, OSError):
+        check("connection refused with 'server unavailable'", False)
+    faults.refuse_pct = 0
+
+    faults.disconnect_after = 2
+    c = TestClient(port, "udp_alert_server", clean=True)
+    acked = [c.publish_timed(topic, b"{}", timeout=0.3) for _ in range(3)]
+    check("disconnected after 2 publishes", acked[0] is not None and acked[2] is None)
+    faults.disconnect_after = 0
+    c.drop()
+
+    c = TestClient(port, "udp_alert_server", clean=True)
+    broker.set_down(True)
+    time.sleep(0.1)
+    dropped = c.publish_timed(topic, b"{}", timeout=0.3) is None
+    try:
+        TestClient(port, "operator", clean=True).drop()
+        refused = False
+    except (AssertionError, OSError, ConnectionError):
+        refused = True
+    broker.set_down(False)
+    c = TestClient(port, "udp_alert_server", clean=True)
+    check("down closes connections and refuses new ones, up accepts again",
+          dropped and refused and c.publish_timed(topic, b"{}") is not None)
+    c.drop()
+    print(f"broker stats: {broker.stats}")
+    stop.set()
+    return all(results)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local MQTT broker stand-in")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=DEFAULT_PORT)
+    parser.add_argument("--cert", help="Server certificate (PEM); generated if omitted")
+    parser.add_argument("--key", help="Server private key (PEM)")
+    parser.add_argument("--plain", action="store_true", help="No TLS (plain MQTT)")
+    parser.add_argument("--tls12", action="store_true", help="Cap TLS at 1.2, like BearSSL on the Pico W")
+    parser.add_argument("--username", help="Required username (any if omitted)")
+    parser.add_argument("--password", help="Required password")
+    parser.add_argument("--puback-delay", type=float, default=0, metavar="MS", help="Delay before each PUBACK")
+    parser.add_argument("--puback-jitter", type=float, default=0, metavar="MS", help="Uniform extra PUBACK delay")
+    parser.add_argument("--drop-puback", type=float, default=0, metavar="PCT", help="PUBACKs never sent")
+    parser.add_argument("--refuse", type=float, default=0, metavar="PCT", help="Connections refused (server unavailable)")
+    parser.add_argument("--disconnect-after", type=int, default=0, metavar="N", help="Drop a connection every N publishes")
+    parser.add_argument("--stall-after", type=int, default=0, metavar="N", help="Stop reading a connection after N publishes")
+    parser.add_argument("--stall-ms", type=float, default=10000, help="How long a stalled connection is not read")
+    parser.add_argument("--seed", type=int, help="Seed of the injected faults")
+    parser.add_argument("--stats", type=float, default=0, metavar="SEC", help="Log the publish counters every SEC seconds")
+    parser.add_argument("--selftest", action="store_true",
+                        help="Check session resumption, persistent sessions and the injected faults")
+    args = parser.parse_args()
+
+    if args.selftest:
+        ok = selftest(tls12=False) and selftest(tls12=True) and selftest_faults()
+        sys.exit(0 if ok else 1)
+
+    ctx = None
+    if not args.plain:
+        cert, key = args.cert, args.key
+        if not cert:
+            cert, key = make_self_signed(tempfile.mkdtemp())
+        ctx = make_server_context(cert, key, args.tls12)
+
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind((args.host, args.port))
+    listener.listen(64)
+    faults = Faults(args.puback_delay, args.puback_jitter, args.drop_puback, args.refuse,
+                    args.disconnect_after, args.stall_after, args.stall_ms, args.seed)
+    broker = Broker(args.username, args.password, faults)
+    signal.signal(signal.SIGUSR1, lambda *_: threading.Thread(
+        target=broker.set_down, args=(not faults.down,), daemon=True).start())
+    if args.stats > 0:
+        threading.Thread(target=log_stats, args=(broker, args.stats), daemon=True).start()
+    log("listening", host=args.host, port=args.port, tls=not args.plain)
+    try:
+        serve(broker, listener, ctx)
+    except KeyboardInterrupt:
+        pass
+    log("stats", **broker.stats)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,57 @@
+// mqtt_outbox.c
+// Bounded MQTT outbox and reconnect backoff. See mqtt_outbox.h.
+#include <string.h>
+#include "mqtt_outbox.h"
+
+void mqtt_outbox_init(mqtt_outbox_t *o, uint32_t backoff_min_ms, uint32_t backoff_max_ms)
+{
+    memset(o, 0, sizeof(*o));
+    o->backoff_min_ms = backoff_min_ms;
+    o->backoff_max_ms = backoff_max_ms;
+    o->backoff_ms = backoff_min_ms;
+}
+
+void mqtt_outbox_push(mqtt_outbox_t *o, const telemetry_record_t *rec)
+{
+    if (o->count == MQTT_OUTBOX_SIZE)
+    {
+        mqtt_outbox_pop(o);
+        o->dropped++;
+    }
+    o->items[(o->head + o->count) % MQTT_OUTBOX_SIZE] = *rec;
+    o->count++;
+}
+
+int mqtt_outbox_peek(const mqtt_outbox_t *o, telemetry_record_t *rec)
+{
+    if (o->count == 0)
+        return -1;
+    *rec = o->items[o->head];
+    return 0;
+}
+
+void mqtt_outbox_pop(mqtt_outbox_t *o)
+{
+    if (o->count == 0)
+        return;
+    o->head = (o->head + 1) % MQTT_OUTBOX_SIZE;
+    o->count--;
+}
+
+int mqtt_outbox_reconnect_due(const mqtt_outbox_t *o, uint32_t now_ms)
+{
+    return o->attempts == 0 || (int32_t)(now_ms - o->next_attempt_ms) >= 0;
+}
+
+void mqtt_outbox_connect_failed(mqtt_outbox_t *o, uint32_t now_ms, uint32_t rnd)
+{
+    o->attempts++;
+    o->next_attempt_ms = now_ms + o->backoff_ms + rnd % (o->backoff_ms / 4 + 1);
+    o->backoff_ms = o->backoff_ms > o->backoff_max_ms / 2 ? o->backoff_max_ms : o->backoff_ms * 2;
+}
+
+void mqtt_outbox_connected(mqtt_outbox_t *o)
+{
+    o->attempts = 0;
+    o->backoff_ms = o->backoff_min_ms;
+}
@@ -0,0 +1,59 @@
+// mqtt_outbox.h
+// Bounded RAM outbox for the clients' MQTT publishes, with the reconnect
+// schedule.
+//
+// Readings are queued here instead of being published inline, and the
+// network side publishes them one at a time while the broker is connected.
+// When the outbox is full the oldest reading is dropped: MQTT is the
+// best-effort visibility channel (UDP carries the guaranteed delivery), and
+// the retained topic only keeps the latest value anyway. Reconnect attempts
+// are spaced by an exponential backoff with jitter instead of blocking
+// retries.
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <stdint.h>
+#include "telemetry_record.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MQTT_OUTBOX_SIZE 16 // Readings
+
+typedef struct
+{
+    telemetry_record_t items[MQTT_OUTBOX_SIZE];
+    uint32_t head;  // Index of the oldest reading
+    uint32_t count; // Readings queued
+    uint32_t dropped; // Oldest readings dropped because the outbox was full
+
+    uint32_t backoff_min_ms;
+    uint32_t backoff_max_ms;
+    uint32_t backoff_ms;      // Wait after the next failed attempt
+    uint32_t next_attempt_ms; // millis() of the next reconnect attempt
+    uint32_t attempts;        // Failed attempts since the last connection
+} mqtt_outbox_t;
+
+void mqtt_outbox_init(mqtt_outbox_t *o, uint32_t backoff_min_ms, uint32_t backoff_max_ms);
+
+// Queues a reading, dropping the oldest one if the outbox is full
+void mqtt_outbox_push(mqtt_outbox_t *o, const telemetry_record_t *rec);
+
+// Returns 0 and copies the oldest reading, or -1 if empty. The reading stays
+// queued until mqtt_outbox_pop(), so a failed publish is retried.
+int mqtt_outbox_peek(const mqtt_outbox_t *o, telemetry_record_t *rec);
+void mqtt_outbox_pop(mqtt_outbox_t *o);
+
+// Reconnect schedule: whether an attempt is due, and its outcome. rnd is
+// any random value; up to a quarter of the backoff is added as jitter so a
+// fleet does not reconnect in lockstep.
+int mqtt_outbox_reconnect_due(const mqtt_outbox_t *o, uint32_t now_ms);
+void mqtt_outbox_connect_failed(mqtt_outbox_t *o, uint32_t now_ms, uint32_t rnd);
+void mqtt_outbox_connected(mqtt_outbox_t *o);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,408 @@
+// outage_sim.c
+// Fleet recovery after an outage: server load curve.
+//
+// Simulates -d devices coming back together after a -o second network
+// outage (an access point or uplink restored for the whole site). Each
+// device starts with the readings it stored during the outage (one every -I
+// ms) and drains them in batches through the clients' QoS window
+// (qos_window.c), with the drain logic of cli_esp.c/cli_pico.c, while still
+// sending live readings. The server is a model: it processes -c readings per
+// second from a socket buffer of -q datagrams and drops what does not fit.
+//
+//   -m sync    previous clients: drain at once, RTO doubling, fixed 5 s pause
+//   -m jitter  randomized drain start, decorrelated jitter (qos_window_seed)
+//   -m full    jitter, plus the server's replay admission (replay_sched.c):
+//              batches over -R readings/s are NACKed with a retryAfter slot
+//
+// Time runs in 10 ms ticks. Prints a summary; -f writes the per-second
+// curve as CSV.
+//
+//   ./outage_sim -m sync -f sync.csv
+//   ./outage_sim -m full -d 1000 -o 1800
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "qos_window.h"
+#include "replay_sched.h"
+
+#define TICK_MS 10
+#define LIVE_SEQ 0x80000000u   // Live readings have this bit set, batches carry their ring position
+#define BATCH_MAX 16           // DRAIN_BATCH_MAX in the sketches
+#define BATCHES_PER_STEP 3     // DRAIN_BYTE_BUDGET in the sketches
+#define WINDOW 8               // QOS_WINDOW_SIZE
+#define ACK_TIMEOUT_MS 800
+#define MAX_RETRIES 5
+#define DRAIN_RETRY_MS 5000
+#define DRAIN_RETRY_MAX_MS 60000
+#define DRAIN_START_SPREAD_MS 10000
+#define STORED_MAX 2048        // BACKLOG_CAPACITY
+
+enum
+{
+    MODE_SYNC,
+    MODE_JITTER,
+    MODE_FULL
+};
+
+typedef struct
+{
+    uint32_t pos; // Ring counter of the first record
+    uint32_t n;
+    uint8_t pending;
+    uint8_t acked;
+} sim_batch_t;
+
+typedef struct
+{
+    qos_window_t w;
+    uint32_t head, tail;  // Backlog ring counters
+    uint32_t drain_next;
+    sim_batch_t batches[QOS_WINDOW_MAX];
+    int first, count, inflight;
+    int failed;
+    uint32_t failed_at, pause_ms, backoff_ms;
+    uint32_t next_sample;
+    uint32_t live_seq;
+
+    // Server side
+    uint64_t slot_us;     // Replay reservation
+    uint8_t *seen;        // Backlog records processed, by ring position (STORED_MAX)
+} sim_device_t;
+
+typedef struct
+{
+    int dev;
+    uint32_t seq;
+    uint32_t n;
+} datagram_t;
+
+typedef struct
+{
+    uint64_t offered, dropped, readings, duplicates, acks, nacks;
+} counters_t;
+
+static sim_device_t *devs;
+static datagram_t *queue;
+static int queue_cap, queue_head, queue_len;
+static uint32_t nack_retry_after;
+static counters_t sec, total;
+static int mode = MODE_SYNC;
+
+static int queue_push(const datagram_t *d)
+{
+    if (queue_len == queue_cap)
+        return -1;
+    queue[(queue_head + queue_len) % queue_cap] = *d;
+    queue_len++;
+    return 0;
+}
+
+// The "buffer" is the datagram header; the QoS window only stores and resends it
+static int sim_send(void *ctx, const char *buf, size_t len)
+{
+    datagram_t d;
+    d.dev = (int)((sim_device_t *)ctx - devs);
+    memcpy(&d.seq, buf, sizeof(d.seq));
+    memcpy(&d.n, buf + sizeof(d.seq), sizeof(d.n));
+    sec.offered++;
+    if (queue_push(&d) != 0)
+        sec.dropped++;
+    return 0;
+}
+
+static void pause_drain(sim_device_t *d, uint32_t now, uint32_t ms)
+{
+    d->failed = 1;
+    d->failed_at = now;
+    d->pause_ms = ms;
+}
+
+static uint32_t sim_now;
+
+// onQoSDone()/markDrained() in the sketches
+static void sim_done(void *ctx, uint32_t seq, int delivered, const char *buf, size_t len)
+{
+    sim_device_t *d = ctx;
+    if (seq & LIVE_SEQ)
+    {
+        if (!delivered)
+            d->tail++;
+        return;
+    }
+    for (int k = 0; k < d->count; ++k)
+    {
+        sim_batch_t *b = &d->batches[(d->first + k) % QOS_WINDOW_MAX];
+        if (b->pending && b->pos == seq)
+        {
+            b->pending = 0;
+            b->acked = (uint8_t)delivered;
+            if (delivered)
+                d->backoff_ms = DRAIN_RETRY_MS;
+            else if (nack_retry_after)
+                pause_drain(d, sim_now, nack_retry_after);
+            else if (mode == MODE_SYNC)
+                pause_drain(d, sim_now, DRAIN_RETRY_MS);
+            else
+            {
+                d->backoff_ms = qos_window_backoff(&d->w, DRAIN_RETRY_MS, d->backoff_ms, DRAIN_RETRY_MAX_MS);
+                pause_drain(d, sim_now, d->backoff_ms);
+            }
+            d->inflight--;
+            return;
+        }
+    }
+}
+
+static void send_datagram(sim_device_t *d, uint32_t seq, uint32_t n, uint32_t now)
+{
+    char buf[2 * sizeof(uint32_t)];
+    memcpy(buf, &seq, sizeof(seq));
+    memcpy(buf + sizeof(seq), &n, sizeof(n));
+    qos_window_send(&d->w, seq, buf, sizeof(buf), now);
+}
+
+// advanceBacklog() + transmitStoredData()
+static void drain(sim_device_t *d, uint32_t now)
+{
+    while (d->count > 0)
+    {
+        sim_batch_t *b = &d->batches[d->first];
+        if (b->pending || !b->acked)
+            break;
+        d->head = b->pos + b->n;
+        d->first = (d->first + 1) % QOS_WINDOW_MAX;
+        d->count--;
+    }
+    if (d->head == d->tail)
+        return;
+
+    if (d->failed)
+    {
+        if (d->inflight > 0 || now - d->failed_at < d->pause_ms)
+            return;
+        d->failed = 0;
+        d->drain_next = d->head;
+        d->count = 0;
+    }
+    if (d->drain_next < d->head)
+        d->drain_next = d->head;
+
+    for (int i = 0; i < BATCHES_PER_STEP && d->drain_next != d->tail && d->count < QOS_WINDOW_MAX &&
+                    d->w.inflight < WINDOW - 1;
+         ++i)
+    {
+        uint32_t n = d->tail - d->drain_next < BATCH_MAX ? d->tail - d->drain_next : BATCH_MAX;
+        sim_batch_t *b = &d->batches[(d->first + d->count) % QOS_WINDOW_MAX];
+        b->pos = d->drain_next;
+        b->n = n;
+        b->pending = 1;
+        b->acked = 0;
+        d->count++;
+        d->inflight++;
+        d->drain_next += n;
+        send_datagram(d, b->pos, n, now);
+    }
+}
+
+// Processes queued datagrams while *budget (in thousandths of a reading) lasts
+static void serve(replay_sched_t *rs, uint64_t *budget, uint32_t now)
+{
+    while (queue_len > 0)
+    {
+        datagram_t *q = &queue[queue_head];
+        sim_device_t *d = &devs[q->dev];
+        int live = (q->seq & LIVE_SEQ) != 0;
+        uint32_t fresh = live ? 1 : 0;
+        uint32_t retry_after = 0;
+
+        if (q->n * 1000ull > *budget)
+            break;
+        for (uint32_t k = 0; !live && k < q->n; ++k)
+            fresh += !d->seen[(q->seq + k) % STORED_MAX];
+        if (mode == MODE_FULL && !live && fresh > 0)
+            retry_after = replay_sched_admit(rs, &d->slot_us, now, q->n);
+        *budget -= (retry_after ? 1 : q->n) * 1000ull; // A NACK costs about one reading
+        queue_head = (queue_head + 1) % queue_cap;
+        queue_len--;
+
+        if (retry_after)
+        {
+            sec.nacks++;
+            nack_retry_after = retry_after;
+            qos_window_on_nack(&d->w, q->seq);
+            nack_retry_after = 0;
+            continue;
+        }
+        sec.readings += fresh;
+        sec.duplicates += q->n - fresh;
+        for (uint32_t k = 0; !live && k < q->n; ++k)
+            d->seen[(q->seq + k) % STORED_MAX] = 1;
+        sec.acks++;
+        qos_window_on_ack(&d->w, q->seq, now);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-m sync|jitter|full] [-d devices] [-o outage_s] [-I interval_ms]\n"
+            "          [-c readings_per_s] [-q queue_datagrams] [-R replay_per_s] [-T max_s] [-f csv]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    int device_count = 1000;
+    uint32_t outage_s = 1800;
+    uint32_t interval_ms = 15000;
+    uint32_t capacity = 4000;
+    uint32_t replay_rate = 2000;
+    uint32_t max_s = 900;
+    const char *csv_path = NULL;
+    int opt;
+
+    queue_cap = 256;
+    while ((opt = getopt(argc, argv, "m:d:o:I:c:q:R:T:f:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            mode = !strcmp(optarg, "full") ? MODE_FULL : !strcmp(optarg, "jitter") ? MODE_JITTER : MODE_SYNC;
+            break;
+        case 'd': device_count = atoi(optarg); break;
+        case 'o': outage_s = (uint32_t)atoi(optarg); break;
+        case 'I': interval_ms = (uint32_t)atoi(optarg); break;
+        case 'c': capacity = (uint32_t)atoi(optarg); break;
+        case 'q': queue_cap = atoi(optarg); break;
+        case 'R': replay_rate = (uint32_t)atoi(optarg); break;
+        case 'T': max_s = (uint32_t)atoi(optarg); break;
+        case 'f': csv_path = optarg; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (device_count < 1 || interval_ms == 0 || capacity < 100 || queue_cap < 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FILE *csv = NULL;
+    if (csv_path && !(csv = fopen(csv_path, "w")))
+    {
+        perror(csv_path);
+        return 1;
+    }
+
+    devs = calloc((size_t)device_count, sizeof(*devs));
+    queue = calloc((size_t)queue_cap, sizeof(*queue));
+    uint8_t *seen = calloc((size_t)device_count, STORED_MAX);
+    if (!devs || !queue || !seen)
+    {
+        perror("calloc");
+        return 1;
+    }
+
+    replay_sched_t rs;
+    replay_sched_init(&rs, replay_rate, 1000);
+    srand(1);
+    uint64_t stored = 0;
+    for (int i = 0; i < device_count; ++i)
+    {
+        sim_device_t *d = &devs[i];
+        qos_window_init(&d->w, WINDOW, ACK_TIMEOUT_MS, MAX_RETRIES, sim_send, sim_done, d);
+        d->backoff_ms = DRAIN_RETRY_MS;
+        d->seen = seen + (size_t)i * STORED_MAX;
+        // Readings taken during the outage, depending on each device's sampling phase
+        uint32_t phase = (uint32_t)rand() % interval_ms;
+        d->tail = (outage_s * 1000 + phase) / interval_ms;
+        d->next_sample = interval_ms - phase;
+        d->drain_next = 0;
+        stored += d->tail;
+        if (mode != MODE_SYNC)
+        {
+            qos_window_seed(&d->w, (uint32_t)i * 2654435761u ^ (uint32_t)rand());
+            pause_drain(d, 0, (uint32_t)rand() % DRAIN_START_SPREAD_MS);
+        }
+    }
+
+    if (csv)
+        fprintf(csv, "t,offered,dropped,readings,duplicates,acks,nacks,backlog\n");
+
+    uint64_t peak_offered = 0, peak_readings = 0, budget = 0;
+    uint32_t drained_at = 0;
+    for (uint32_t now = 0; now < max_s * 1000; now += TICK_MS)
+    {
+        sim_now = now;
+        budget += (uint64_t)capacity * TICK_MS;
+        serve(&rs, &budget, now);
+        if (queue_len == 0 && budget > (uint64_t)capacity * TICK_MS)
+            budget = (uint64_t)capacity * TICK_MS; // An idle server saves nothing up
+
+        uint64_t backlog = 0;
+        int idle = 1;
+        for (int i = 0; i < device_count; ++i)
+        {
+            sim_device_t *d = &devs[i];
+            qos_window_poll(&d->w, now);
+            if (now >= d->next_sample)
+            {
+                d->next_sample += interval_ms;
+                if (qos_window_can_send(&d->w))
+                    send_datagram(d, LIVE_SEQ | d->live_seq++, 1, now);
+                else
+                    d->tail++;
+            }
+            drain(d, now);
+            backlog += d->tail - d->head;
+            if (d->head != d->tail || d->inflight > 0)
+                idle = 0;
+        }
+
+        if ((now + TICK_MS) % 1000 == 0)
+        {
+            if (csv)
+                fprintf(csv, "%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n", (now + TICK_MS) / 1000,
+                        (unsigned long long)sec.offered, (unsigned long long)sec.dropped,
+                        (unsigned long long)sec.readings, (unsigned long long)sec.duplicates,
+                        (unsigned long long)sec.acks, (unsigned long long)sec.nacks, (unsigned long long)backlog);
+            if (sec.offered > peak_offered)
+                peak_offered = sec.offered;
+            if (sec.readings + sec.duplicates > peak_readings)
+                peak_readings = sec.readings + sec.duplicates;
+            total.offered += sec.offered;
+            total.dropped += sec.dropped;
+            total.readings += sec.readings;
+            total.duplicates += sec.duplicates;
+            total.acks += sec.acks;
+            total.nacks += sec.nacks;
+            memset(&sec, 0, sizeof(sec));
+        }
+        if (idle && !drained_at)
+        {
+            drained_at = now + TICK_MS;
+            break;
+        }
+    }
+
+    static const char *names[] = {"sync", "jitter", "full"};
+    printf("fleet: mode=%s devices=%d outage=%us interval=%ums stored=%llu capacity=%u/s queue=%d%s\n",
+           names[mode], device_count, outage_s, interval_ms, (unsigned long long)stored, capacity, queue_cap,
+           mode == MODE_FULL ? "" : " (no admission)");
+    printf("load: peak_datagrams=%llu/s peak_readings=%llu/s datagrams=%llu dropped=%llu (%.1f%%)\n",
+           (unsigned long long)peak_offered, (unsigned long long)peak_readings, (unsigned long long)total.offered,
+           (unsigned long long)total.dropped, total.offered ? 100.0 * total.dropped / total.offered : 0.0);
+    printf("work: readings=%llu duplicates=%llu acks=%llu nacks=%llu\n", (unsigned long long)total.readings,
+           (unsigned long long)total.duplicates, (unsigned long long)total.acks, (unsigned long long)total.nacks);
+    if (drained_at)
+        printf("drained: %.1fs (at full capacity: %.1fs)\n", drained_at / 1000.0, (double)stored / capacity);
+    else
+        printf("drained: not within %us\n", max_s);
+
+    if (csv)
+        fclose(csv);
+    free(devs);
+    free(queue);
+    free(seen);
+    return 0;
+}
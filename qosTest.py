@@ -1,14 +1,24 @@
-import socket
+import argparse
 import json
+import multiprocessing
+import random
+import select
+import socket
+import sys
 import time
+import urllib.request
+from collections import Counter
 
 # --- Configuration ---
 SERVER_IP = '127.0.0.1'  # Server's IP address
 SERVER_PORT = 5005       # Server's UDP port
+METRICS_PORT = 9100      # Server's metrics/admin endpoint
 TIMEOUT = 1.0            # Socket timeout for receiving ACK
 
 # --- Test Payload Structure ---
 TEST_ID = "TestDev-QoS1"
+RESTART_ID = "TestDev-Restart"  # Device that reboots between two runs of seqs
+BACKLOG_ID = "TestDev-Backlog"  # Device that replays its backlog after a reboot
 BASE_PAYLOAD = {
     "id": TEST_ID,
     "temperature": 25.5,
@@ -80,6 +90,415 @@ def validate_ack(ack_data, expected_seq):
         
     return is_valid
 
+# --- Performance Suite ---
+#
+# Each scenario drives the server from PERF_WORKERS processes (one socket
+# each) at a paced, open-loop datagram rate and measures the time from
+# sending a datagram to the first ACK/NACK for it. A scenario passes when it
+# stays within its budgets:
+#   p99_ms      99th percentile of that response time
+#   throughput  ACKed readings per second (the offered rate for live readings)
+#   max_loss    share of live readings that never got a response
+# --scale multiplies every rate (and throughput budget), so the same suite
+# runs on a laptop and on the target host.
+
+PERF_WORKERS = 2
+PERF_SECONDS = 5.0
+PERF_DEVICES = 8         # Devices per worker (the server tracks at most MAX_DEVICES)
+PERF_SETTLE = 1.0        # Seconds to wait for late responses
+HIST_US = 10             # Latency histogram resolution
+HIST_MAX = 2000000 // HIST_US  # Responses slower than 2 s share the last bucket
+BATCH_SIZE = 16          # Readings per replay batch (the clients' CLIENT_DRAIN_BATCH_MAX)
+BATCH_WINDOW = 4         # Unacknowledged batches per replaying device (the clients' QoS window)
+REPLAY_READINGS_PER_SEC = 2000  # srv.c's replay budget
+
+PERF_SCENARIOS = [
+    {"name": "steady_state", "rate": 5000,
+     "desc": "Live QoS 1 readings from every device",
+     "budget": {"p99_ms": 5.0, "throughput": 4950, "max_loss": 0.001}},
+    {"name": "duplicate_storm", "rate": 5000, "copies": 4,
+     "desc": "Every reading sent 4 times back to back; each copy must be ACKed again",
+     "budget": {"p99_ms": 5.0, "throughput": 1240, "max_loss": 0.001}},
+    {"name": "replay_burst", "rate": 2000, "batch_share": 0.25,
+     "desc": "Backlog batches far over the replay budget next to live readings; NACKed batches are resent after retryAfter",
+     "budget": {"p99_ms": 5.0, "throughput": 1480, "max_loss": 0.001,
+                "max_replay_rate": REPLAY_READINGS_PER_SEC * 1.25}},
+    {"name": "invalid_json_flood", "rate": 5000, "invalid_share": 0.5,
+     "desc": "Half of the datagrams are malformed JSON",
+     "budget": {"p99_ms": 5.0, "throughput": 2475, "max_loss": 0.001}},
+    {"name": "mqtt_broker_down", "rate": 2000, "alert_share": 0.005,
+     "desc": "Range alerts (and their differential alerts) while the server's MQTT broker is unreachable or faulty",
+     "budget": {"p99_ms": 5.0, "throughput": 1980, "max_loss": 0.001}},
+]
+
+
+def reading_payload(device, seq, temperature):
+    return json.dumps({"id": device, "type": "WeatherObserved", "temperature": temperature,
+                       "relativeHumidity": 55.0, "dateObserved": time.strftime("%Y-%m-%dT%H:%M:%S"),
+                       "qos": 1, "seq": seq}, separators=(",", ":")).encode()
+
+
+def batch_payload(device, first_seq):
+    readings = [{"seq": first_seq + i, "temperature": 24.0, "relativeHumidity": 50.0,
+                 "dateObserved": time.strftime("%Y-%m-%dT%H:%M:%S")} for i in range(BATCH_SIZE)]
+    return json.dumps({"id": device, "type": "WeatherObservedBatch", "status": "OPERATIONAL", "qos": 1,
+                       "readings": readings}, separators=(",", ":")).encode()
+
+
+def next_seqs():
+    """Next seq of every device the server knows, so a rerun neither repeats
+    seqs (duplicates) nor leaves gaps."""
+    try:
+        with urllib.request.urlopen(f"http://{SERVER_IP}:{METRICS_PORT}/devices", timeout=2) as r:
+            return {d["id"]: d["maxSeq"] + 1 for d in json.load(r) if d.get("maxSeq", -1) >= 0}
+    except (OSError, ValueError):
+        return {}
+
+
+def mqtt_counters():
+    """The server's alert publishing counters (empty if /metrics is unreachable)."""
+    try:
+        with urllib.request.urlopen(f"http://{SERVER_IP}:{METRICS_PORT}/metrics", timeout=2) as r:
+            text = r.read().decode()
+    except OSError:
+        return {}
+    names = {"comcs_mqtt_connected": "connected", 'comcs_mqtt_alerts_total{outcome="published"}': "published",
+             'comcs_mqtt_alerts_total{outcome="failed"}': "failed", "comcs_mqtt_publish_seconds_total": "publishSeconds"}
+    values = {}
+    for line in text.splitlines():
+        name, _, value = line.rpartition(" ")
+        if name in names:
+            values[names[name]] = float(value)
+    return values
+
+
+def perf_worker(scenario, worker, rate, seconds, start_at, first_seqs, results):
+    """Sends one worker's share of a scenario and reports its counters."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    sock.setblocking(False)
+    name = scenario["name"]
+    live = [f"Perf-{name}-{worker:02d}-{d:02d}" for d in range(PERF_DEVICES)]
+    replay = [f"Perf-{name}-{worker:02d}-R{d:02d}" for d in range(PERF_DEVICES)]
+    seqs = Counter({d: first_seqs.get(d, 0) for d in live + replay})
+    copies = scenario.get("copies", 1)
+
+    stats = Counter()
+    hist = {"live": Counter(), "batch": Counter()}
+    sent_at = {}     # (id, seq) -> (first send time, class)
+    batches = {}     # (id, first seq) -> payload, until ACKed
+    inflight = Counter()  # Unacknowledged batches per replay device
+    retries = []     # (due, key) of NACKed batches
+    repeat = []      # Sent before the next new reading: copies (duplicate storm), alert follow-ups
+    interval = 1.0 / rate
+    n = 0
+
+    def send(payload, key=None, kind="live"):
+        try:
+            sock.sendto(payload, (SERVER_IP, SERVER_PORT))
+        except BlockingIOError:
+            stats["send_blocked"] += 1
+            return
+        stats["datagrams"] += 1
+        if key is not None and key not in sent_at:
+            sent_at[key] = (time.perf_counter(), kind)
+            stats["expected_" + kind] += 1
+
+    def next_datagram():
+        nonlocal n
+        n += 1
+        if repeat:
+            send(*repeat.pop())
+            return
+        if "invalid_share" in scenario and (n * scenario["invalid_share"]) % 1 >= 1 - scenario["invalid_share"]:
+            send(b'{"id":"Perf-invalid","temperature":' + str(n).encode())
+            stats["invalid"] += 1
+            return
+        if "batch_share" in scenario and (n * scenario["batch_share"]) % 1 >= 1 - scenario["batch_share"]:
+            stats["batch_slots"] += 1
+            device = replay[stats["batch_slots"] % len(replay)]
+            if inflight[device] < BATCH_WINDOW:
+                first = seqs[device]
+                seqs[device] += BATCH_SIZE
+                key = (device, first)
+                batches[key] = batch_payload(device, first)
+                inflight[device] += 1
+                send(batches[key], key, "batch")
+                stats["batches"] += 1
+                return
+            # Its window is full: the slot goes to a live reading
+        device = live[stats["readings"] % len(live)]
+        seq = seqs[device]
+        seqs[device] += 1
+        alert = "alert_share" in scenario and (n * scenario["alert_share"]) % 1 >= 1 - scenario["alert_share"]
+        payload = reading_payload(device, seq, 60.0 if alert else 24.0)
+        send(payload, (device, seq))
+        stats["readings"] += 1
+        repeat.extend([(payload,)] * (copies - 1))
+        if alert:
+            # The server compares every reading with the last one of all other
+            # devices, so a device must not stay out of range
+            stats["alerts"] += 1
+            seqs[device] += 1
+            repeat.append((reading_payload(device, seq + 1, 24.0), (device, seq + 1)))
+
+    def receive():
+        while True:
+            try:
+                data = sock.recv(2048)
+            except BlockingIOError:
+                return
+            now = time.perf_counter()
+            try:
+                msg = json.loads(data)
+            except ValueError:
+                stats["bad_responses"] += 1
+                continue
+            stats["responses"] += 1
+            key = (msg.get("id"), msg.get("seq"))
+            first = sent_at.pop(key, None)
+            if first is not None:
+                hist[first[1]][min(int((now - first[0]) * 1e6) // HIST_US, HIST_MAX)] += 1
+            if msg.get("type") == "NACK":
+                stats["nacks"] += 1
+                if key in batches:
+                    retries.append((now + msg.get("retryAfter", 100) / 1000.0, key))
+            elif msg.get("type") == "ACK":
+                stats["acks"] += 1
+                if key in batches:
+                    del batches[key]
+                    inflight[key[0]] -= 1
+                    stats["replayed"] += msg.get("count", BATCH_SIZE)
+                elif first is not None:
+                    stats["acked_readings"] += 1
+
+    while time.time() < start_at:
+        time.sleep(0.001)
+    start = time.perf_counter()
+    end = start + seconds
+    next_send = start
+    while True:
+        now = time.perf_counter()
+        if now >= end:
+            break
+        sends = 0
+        while next_send <= now and sends < 64:
+            next_datagram()
+            next_send += interval
+            sends += 1
+        if now - next_send > 0.1:
+            stats["behind"] += int((now - next_send) / interval)
+            next_send = now
+        if retries:
+            retries.sort()
+            while retries and retries[0][0] <= now:
+                key = retries.pop(0)[1]
+                if key in batches:
+                    send(batches[key], key, "batch")
+                    stats["resent"] += 1
+        receive()
+        wait = next_send - time.perf_counter()
+        if wait > 0:
+            select.select([sock], [], [], wait)
+
+    while repeat:
+        send(*repeat.pop())
+    settle = time.perf_counter() + PERF_SETTLE
+    while time.perf_counter() < settle:
+        select.select([sock], [], [], 0.01)
+        receive()
+    stats["unanswered"] = sum(1 for _, kind in sent_at.values() if kind == "live")
+    sock.close()
+    results.put({"stats": dict(stats), "hist": {k: dict(v) for k, v in hist.items()}})
+
+
+def percentile_ms(hist, p):
+    total = sum(hist.values())
+    if total == 0:
+        return None
+    target = total * p
+    seen = 0
+    for bucket in sorted(hist):
+        seen += hist[bucket]
+        if seen >= target:
+            return round((bucket + 1) * HIST_US / 1000.0, 3)
+    return None
+
+
+def run_perf_scenario(scenario, scale, workers, seconds):
+    rate = scenario["rate"] * scale
+    results = multiprocessing.Queue()
+    first_seqs = next_seqs()
+    mqtt_before = mqtt_counters() if "alert_share" in scenario else {}
+    start_at = time.time() + 0.5
+    procs = [multiprocessing.Process(target=perf_worker,
+                                     args=(scenario, w, rate / workers, seconds, start_at, first_seqs, results))
+             for w in range(workers)]
+    for p in procs:
+        p.start()
+    parts = [results.get() for _ in procs]
+    for p in procs:
+        p.join()
+
+    mqtt_after = mqtt_counters() if mqtt_before else {}
+    stats = Counter()
+    hist = {"live": Counter(), "batch": Counter()}
+    for part in parts:
+        stats.update(part["stats"])
+        for kind in hist:
+            hist[kind].update({int(k): v for k, v in part["hist"][kind].items()})
+
+    budget = {k: (v * scale if k in ("throughput", "max_replay_rate") else v)
+              for k, v in scenario["budget"].items()}
+    live_p99 = percentile_ms(hist["live"], 0.99)
+    result = {
+        "scenario": scenario["name"],
+        "description": scenario["desc"],
+        "offeredRate": rate,
+        "seconds": seconds,
+        "datagrams": stats["datagrams"],
+        "sentRate": round(stats["datagrams"] / seconds, 1),
+        "responses": stats["responses"],
+        "acks": stats["acks"],
+        "nacks": stats["nacks"],
+        "invalid": stats["invalid"],
+        "alerts": stats["alerts"],
+        "behind": stats["behind"] + stats["send_blocked"],
+        "throughput": round(stats["acked_readings"] / seconds, 1),
+        "loss": round(stats["unanswered"] / stats["expected_live"], 5) if stats["expected_live"] else 0.0,
+        "latencyMs": {"p50": percentile_ms(hist["live"], 0.5), "p99": live_p99,
+                      "max": percentile_ms(hist["live"], 1.0)},
+        "budget": budget,
+    }
+    if stats["batches"]:
+        result["replayRate"] = round(stats["replayed"] / seconds, 1)
+        result["batchLatencyMs"] = {"p50": percentile_ms(hist["batch"], 0.5),
+                                    "p99": percentile_ms(hist["batch"], 0.99)}
+
+    if mqtt_after:
+        # Whether the broker was really down, and what publishing cost the alert path
+        result["mqtt"] = {k: round(v - mqtt_before.get(k, 0), 6) if k != "connected" else int(v)
+                          for k, v in mqtt_after.items()}
+
+    failures = []
+    if live_p99 is None or live_p99 > budget["p99_ms"]:
+        failures.append(f"p99 {live_p99} ms > {budget['p99_ms']} ms")
+    if result["throughput"] < budget["throughput"]:
+        failures.append(f"throughput {result['throughput']}/s < {budget['throughput']}/s")
+    if result["loss"] > budget["max_loss"]:
+        failures.append(f"loss {result['loss']} > {budget['max_loss']}")
+    if "max_replay_rate" in budget and result.get("replayRate", 0) > budget["max_replay_rate"]:
+        failures.append(f"replay {result['replayRate']}/s > {budget['max_replay_rate']}/s")
+    if result["behind"]:
+        failures.append(f"load generator fell {result['behind']} datagrams behind (lower --scale)")
+    result["passed"] = not failures
+    result["failures"] = failures
+    return result
+
+
+def run_perf_suite(args):
+    scenarios = PERF_SCENARIOS
+    if args.only:
+        wanted = args.only.split(",")
+        unknown = set(wanted) - {s["name"] for s in PERF_SCENARIOS}
+        if unknown:
+            sys.exit(f"Unknown scenario(s): {', '.join(sorted(unknown))}")
+        scenarios = [s for s in PERF_SCENARIOS if s["name"] in wanted]
+
+    results = []
+    for scenario in scenarios:
+        print(f"\n--- {scenario['name']}: {scenario['desc']} ({scenario['rate'] * args.scale:.0f} datagrams/s) ---")
+        r = run_perf_scenario(scenario, args.scale, args.workers, args.seconds)
+        results.append(r)
+        print(f"  sent {r['sentRate']}/s, ACKed {r['throughput']} readings/s, loss {r['loss']}, "
+              f"ACK p50 {r['latencyMs']['p50']} ms p99 {r['latencyMs']['p99']} ms")
+        if "mqtt" in r:
+            print(f"  server MQTT: connected={r['mqtt'].get('connected')} published={r['mqtt'].get('published')} "
+                  f"failed={r['mqtt'].get('failed')} publishing {r['mqtt'].get('publishSeconds')} s")
+        if "replayRate" in r:
+            print(f"  replay {r['replayRate']} readings/s, {r['nacks']} NACKs, "
+                  f"batch p99 {r['batchLatencyMs']['p99']} ms")
+        if r["passed"]:
+            print("  ✅ Within budget.")
+        else:
+            print(f"  ❌ Over budget: {'; '.join(r['failures'])}")
+
+    report = {"suite": "qos-perf", "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S"),
+              "server": f"{SERVER_IP}:{SERVER_PORT}", "scale": args.scale, "workers": args.workers,
+              "passed": all(r["passed"] for r in results), "scenarios": results}
+    if args.json:
+        # One line per run, so the file is a trend log
+        with open(args.json, "a") as f:
+            f.write(json.dumps(report) + "\n")
+    print(f"\n--- Performance Suite {'Passed' if report['passed'] else 'Failed'} ---")
+    return 0 if report["passed"] else 1
+
+def device_counters(device):
+    """/devices entry of one device (empty if unknown or unreachable)."""
+    try:
+        with urllib.request.urlopen(f"http://{SERVER_IP}:{METRICS_PORT}/devices", timeout=2) as r:
+            return next((d for d in json.load(r) if d["id"] == device), {})
+    except (OSError, ValueError):
+        return {}
+
+
+def validate_restart(sock):
+    """Sends seqs 0-4, then 0-4 again under a new boot id, as a rebooted
+    client does. Every reading must be ACKed and none taken as a duplicate."""
+    before = device_counters(RESTART_ID)
+    acked = 0
+    for boot in random.sample(range(1, 2**31), 2):
+        for seq in range(5):
+            payload = json.loads(reading_payload(RESTART_ID, seq, 25.0))
+            payload["boot"] = boot
+            sock.sendto(json.dumps(payload).encode(), (SERVER_IP, SERVER_PORT))
+            try:
+                ack = json.loads(sock.recvfrom(8192)[0])
+                acked += ack.get("type") == "ACK" and ack.get("seq") == seq
+            except (socket.timeout, ValueError):
+                pass
+    after = device_counters(RESTART_ID)
+    duplicates = after.get("duplicates", 0) - before.get("duplicates", 0)
+    restarts = after.get("restarts", 0) - before.get("restarts", 0)
+    print(f"[CLIENT] ACKed {acked}/10, duplicates {duplicates}, restarts {restarts}")
+    if acked == 10 and after and duplicates == 0 and restarts >= 1:
+        print("  ✅ Validation Successful: the restarted device's readings were processed.")
+        return True
+    print("  ❌ Test Failed: readings after the restart were dropped as duplicates.")
+    return False
+
+def validate_backlog_after_restart(sock):
+    """Sends seqs 0-50, reboots, sends live seq 61 and then the stored seqs
+    51-60 as one batch, as a client draining its backlog after a reboot does.
+    The batch must be ACKed and every reading in it stored."""
+    boots = random.sample(range(1, 2**31), 2)
+    before = device_counters(BACKLOG_ID)
+
+    def send(payload, boot):
+        payload = json.loads(payload)
+        payload["boot"] = boot
+        sock.sendto(json.dumps(payload).encode(), (SERVER_IP, SERVER_PORT))
+        try:
+            return json.loads(sock.recvfrom(8192)[0])
+        except (socket.timeout, ValueError):
+            return {}
+
+    for seq in range(51):
+        send(reading_payload(BACKLOG_ID, seq, 25.0), boots[0])
+    send(reading_payload(BACKLOG_ID, 61, 25.0), boots[1])
+    batch = json.loads(batch_payload(BACKLOG_ID, 51))
+    batch["readings"] = batch["readings"][:10]
+    ack = send(json.dumps(batch), boots[1])
+    after = device_counters(BACKLOG_ID)
+    duplicates = after.get("duplicates", 0) - before.get("duplicates", 0)
+    stored = after.get("readings", 0) - before.get("readings", 0)
+    print(f"[CLIENT] Batch ACK {ack}, stored {stored}/62, duplicates {duplicates}")
+    if ack.get("type") == "ACK" and ack.get("count") == 10 and stored == 62 and duplicates == 0:
+        print("  ✅ Validation Successful: the backlog replayed after the restart was stored.")
+        return True
+    print("  ❌ Test Failed: backlog readings were ACKed but not stored.")
+    return False
+
 # --- Main Test Execution ---
 
 def run_qos_tests():
@@ -111,8 +530,28 @@ def run_qos_tests():
     ack_3 = send_and_wait_for_ack(sock, seq_3)
     validate_ack(ack_3, seq_3)
 
+    # --- SCENARIO 4: Device Restart (seqs start over under a new boot id) ---
+    print("\n\n--- SCENARIO 4: Device Restart (SEQ 0-4, reboot, SEQ 0-4 again) ---")
+    print("Goal: Server should process both runs: a new boot id is not a duplicate.")
+    validate_restart(sock)
+
+    # --- SCENARIO 5: Backlog Replay After a Restart (live reading first) ---
+    print("\n\n--- SCENARIO 5: Backlog After Restart (SEQ 0-50, reboot, SEQ 61, batch 51-60) ---")
+    print("Goal: Server should store the batch: its seqs were never received in this boot.")
+    validate_backlog_after_restart(sock)
+
     sock.close()
     print("\n--- QoS Tests Complete ---")
 
 if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="QoS tests against a running server")
+    parser.add_argument("--perf", action="store_true", help="run the performance suite instead")
+    parser.add_argument("--only", help="comma-separated performance scenarios")
+    parser.add_argument("--scale", type=float, default=1.0, help="multiplies the rates and throughput budgets")
+    parser.add_argument("--seconds", type=float, default=PERF_SECONDS, help="duration of each scenario")
+    parser.add_argument("--workers", type=int, default=PERF_WORKERS, help="sending processes")
+    parser.add_argument("--json", help="append the results as one JSON line to this file")
+    args = parser.parse_args()
+    if args.perf:
+        sys.exit(run_perf_suite(args))
     run_qos_tests()
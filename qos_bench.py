@@ -0,0 +1,187 @@
+"""
+Reproducible QoS benchmark: runs fleet_sim through impair_proxy against a
+running server, once per network scenario, and reports for each one the
+goodput (readings the server stored per second, from its /devices
+counters), the readings ACKed as seen by the proxy, the ACK round trip
+(p50/p99, measured at the proxy) and the retransmission ratio. A reading
+that was ACKed but not stored shows up as the difference of the two.
+
+Every scenario uses the same fleet, duration and seeds, so two runs on the
+same machine differ only by scheduling noise. Each scenario's fleet has its
+own device-id prefix, so no scenario inherits another's seq state; the
+server needs room for devices x scenarios devices. Build the tools first:
+
+    make server fleet_sim impair_proxy
+    ./server -s max_devices=2048 &
+    python3 qos_bench.py
+    python3 qos_bench.py --devices 500 --seconds 60 --only loss5,bw --out results.json
+"""
+import argparse
+import json
+import os
+import re
+import signal
+import subprocess
+import sys
+import time
+import urllib.request
+
+# --- Configuration ---
+SERVER_PORT = 5005
+PROXY_PORT = 5006
+METRICS_URL = "http://127.0.0.1:9100"
+SETTLE = 3.0  # Seconds the proxy keeps running after the fleet, for the last ACKs
+# The proxy counts a batch's readings under its first seq, so a reading ACKed
+# live and again in a replayed batch is counted twice. Differences up to
+# this share of the ACKed readings are not reported as unstored.
+UNSTORED_TOLERANCE = 0.005
+
+# name -> impair_proxy options (applied in both directions)
+SCENARIOS = [
+    ("clean", []),
+    ("loss5", ["-x", "5"]),
+    ("loss20", ["-x", "20"]),
+    ("delay_normal", ["-d", "40", "-j", "10", "-D", "normal"]),
+    ("delay_pareto", ["-d", "40", "-j", "20", "-D", "pareto"]),
+    ("reorder", ["-d", "5", "-o", "10", "-g", "30"]),
+    ("duplicate", ["-u", "10"]),
+    ("bw", ["-r", "256", "-q", "200"]),
+    ("mixed", ["-x", "5", "-d", "40", "-j", "20", "-D", "normal", "-o", "2", "-u", "1", "-r", "2048"]),
+]
+
+FLEET_LINE = re.compile(r"readings=(\d+) transmissions=(\d+) \(retransmits=(\d+).*acked=(\d+) failed=(\d+)")
+BACKLOG_LINE = re.compile(r"backlog: stored=(\d+) peak=(\d+) left=(\d+)")
+
+
+def server_get(args, path):
+    with urllib.request.urlopen(args.metrics_url + path, timeout=5) as r:
+        return r.read().decode()
+
+
+def server_stored(args, prefix):
+    """Readings the server stored for the devices named prefix*."""
+    devices = json.loads(server_get(args, "/devices"))
+    return sum(d["readings"] + d["summarizedReadings"] for d in devices if d["id"].startswith(prefix))
+
+
+def check_device_room(args, scenarios):
+    """Exits unless the server can register every scenario's fleet."""
+    try:
+        known = len(json.loads(server_get(args, "/devices")))
+        config = server_get(args, "/config")
+    except (OSError, ValueError) as e:
+        sys.exit(f"Server metrics at {args.metrics_url} unreachable: {e}")
+    m = re.search(r"^max_devices = (\d+)", config, re.M)
+    need = args.devices * len(scenarios)
+    if m and known + need > int(m.group(1)):
+        sys.exit(f"The server has room for {int(m.group(1)) - known} more devices, the scenarios need {need}: "
+                 f"restart it with -s max_devices={known + need}")
+
+
+def run_scenario(name, impair, args, here, prefix):
+    """Runs one scenario and returns its results."""
+    report = os.path.join(args.workdir, f"qos_bench_{name}.json")
+    if os.path.exists(report):
+        os.remove(report)
+    proxy = subprocess.Popen(
+        [os.path.join(here, "impair_proxy"), "-l", str(args.proxy_port), "-p", str(args.server_port),
+         "-S", str(args.seed), "-J", report] + impair,
+        stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    time.sleep(0.3)
+    if proxy.poll() is not None:
+        sys.exit(f"impair_proxy failed: {proxy.stderr.read().strip()}")
+
+    fleet = subprocess.run(
+        [os.path.join(here, "fleet_sim"), "-d", str(args.devices), "-t", str(args.seconds),
+         "-p", str(args.proxy_port), "-I", str(args.interval), "-D", "-S", str(args.seed), "-P", prefix],
+        capture_output=True, text=True)
+    time.sleep(SETTLE)
+    proxy.send_signal(signal.SIGINT)
+    proxy.wait()
+    if fleet.returncode != 0:
+        sys.exit(f"fleet_sim failed: {fleet.stderr.strip()}")
+
+    with open(report) as f:
+        result = json.load(f)
+    os.remove(report)
+    result["scenario"] = name
+    result["impairment"] = " ".join(impair) or "none"
+    m = FLEET_LINE.search(fleet.stdout)
+    if m:
+        result["fleet"] = dict(zip(("readings", "transmissions", "retransmits", "acked", "failed"),
+                                   map(int, m.groups())))
+    m = BACKLOG_LINE.search(fleet.stdout)
+    if m:
+        result["fleet"]["backlogStored"], result["fleet"]["backlogLeft"] = int(m.group(1)), int(m.group(3))
+    # Goodput over the fleet's run, not the proxy's settle time. The proxy's
+    # count is what the fleet was told; the server's is what it stored.
+    result["devicePrefix"] = prefix
+    result["ackedReadings"] = result["goodputReadings"]
+    result["storedReadings"] = server_stored(args, prefix)
+    result["ackedNotStored"] = max(0, result["ackedReadings"] - result["storedReadings"])
+    result["ackedPerSec"] = round(result["ackedReadings"] / args.seconds, 1)
+    result["goodputPerSec"] = round(result["storedReadings"] / args.seconds, 1)
+    return result
+
+
+def print_table(results):
+    print(f"{'scenario':<14}{'goodput/s':>10}{'acked/s':>9}{'unstored':>9}{'rtt p50':>9}{'rtt p99':>9}{'retx':>8}"
+          f"{'lost':>7}{'qdrop':>7}{'backlog':>8}{'failed':>8}")
+    for r in results:
+        fleet = r.get("fleet", {})
+        print(f"{r['scenario']:<14}{r['goodputPerSec']:>10.1f}{r['ackedPerSec']:>9.1f}{r['ackedNotStored']:>9}"
+              f"{r['ackRttMs']['p50']:>9.1f}"
+              f"{r['ackRttMs']['p99']:>9.1f}{r['retransmitRatio'] * 100:>7.1f}%"
+              f"{r['up']['lost'] + r['down']['lost']:>7}{r['up']['queueDrops'] + r['down']['queueDrops']:>7}"
+              f"{fleet.get('backlogStored', 0):>8}{fleet.get('failed', 0):>8}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--devices", type=int, default=200)
+    parser.add_argument("--seconds", type=int, default=20)
+    parser.add_argument("--interval", type=int, default=1000, help="sampling period in ms")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--server-port", type=int, default=SERVER_PORT)
+    parser.add_argument("--proxy-port", type=int, default=PROXY_PORT)
+    parser.add_argument("--metrics-url", default=METRICS_URL, help="the server's /devices and /config")
+    parser.add_argument("--only", help="comma-separated scenario names")
+    parser.add_argument("--list", action="store_true", help="list the scenarios")
+    parser.add_argument("--out", help="write all results to this JSON file")
+    parser.add_argument("--workdir", default=".", help="where the proxy writes its reports")
+    args = parser.parse_args()
+
+    if args.list:
+        for name, impair in SCENARIOS:
+            print(f"{name:<14}{' '.join(impair) or 'none'}")
+        return
+    scenarios = SCENARIOS
+    if args.only:
+        wanted = args.only.split(",")
+        unknown = set(wanted) - {name for name, _ in SCENARIOS}
+        if unknown:
+            sys.exit(f"Unknown scenario(s): {', '.join(sorted(unknown))}")
+        scenarios = [s for s in SCENARIOS if s[0] in wanted]
+
+    check_device_room(args, scenarios)
+    here = os.path.dirname(os.path.abspath(__file__))
+    run = f"{int(time.time()) % 4096:03x}"  # Keeps reruns apart as well
+    results = []
+    for i, (name, impair) in enumerate(scenarios):
+        print(f"--- {name}: {' '.join(impair) or 'no impairment'}", flush=True)
+        results.append(run_scenario(name, impair, args, here, f"QB{run}_{i}_"))
+    print()
+    print_table(results)
+    unstored = [r["scenario"] for r in results if r["ackedNotStored"] > UNSTORED_TOLERANCE * r["ackedReadings"]]
+    if unstored:
+        print(f"\nACKed readings the server did not store: {', '.join(unstored)}")
+
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump({"devices": args.devices, "seconds": args.seconds, "intervalMs": args.interval,
+                       "seed": args.seed, "results": results}, f, indent=2)
+    return 1 if unstored else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,216 @@
+// qos_harness.c
+// Host test harness for the sliding-window QoS sender (qos_window.c).
+//
+// Plays a device draining a backlog: sends -n readings to a running server
+// with up to -w seqs in flight, optionally dropping a share of the datagrams
+// in each direction (-l) to exercise per-seq retransmission, and reports delivery
+// counts and throughput. With -b, up to that many readings are packed into
+// each datagram as the clients do when draining their backlog. Exits non-zero
+// if any reading was not acknowledged.
+//
+//   ./qos_harness -n 500 -w 8          # window of 8
+//   ./qos_harness -n 500 -w 1          # stop-and-wait, for comparison
+//   ./qos_harness -n 500 -w 8 -b 16    # batched drain
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "qos_window.h"
+#include "telemetry_record.h"
+
+typedef struct
+{
+    int sockfd;
+    struct sockaddr_in server;
+    const char *device_id;
+    uint32_t boot; // New on every run, like a rebooted device
+    int loss_pct;
+    uint32_t dropped;
+    uint32_t readings_acked;
+    uint32_t readings_failed;
+} harness_t;
+
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// Window slots hold packed records; one record goes out as a single
+// reading, several as a batch, as on the clients
+static int harness_send(void *ctx, const char *buf, size_t len)
+{
+    harness_t *h = ctx;
+    telemetry_record_t recs[QOS_PAYLOAD_MAX / TELEMETRY_RECORD_SIZE];
+    char payload[TELEMETRY_BATCH_JSON_MAX];
+    int n = (int)(len / TELEMETRY_RECORD_SIZE);
+    int used = 0;
+    int plen;
+
+    for (int i = 0; i < n; ++i)
+        telemetry_record_unpack((const uint8_t *)buf + i * TELEMETRY_RECORD_SIZE, &recs[i]);
+    if (n == 1)
+        plen = telemetry_record_to_json(&recs[0], h->device_id, h->boot, payload, sizeof(payload));
+    else
+        plen = telemetry_batch_to_json(recs, n, h->device_id, h->boot, payload, sizeof(payload), &used);
+    if (plen < 0)
+        return -1;
+
+    if (h->loss_pct > 0 && rand() % 100 < h->loss_pct)
+    {
+        h->dropped++;
+        return 0; // Lost on the "link"
+    }
+    return sendto(h->sockfd, payload, (size_t)plen, 0, (struct sockaddr *)&h->server, sizeof(h->server)) < 0 ? -1 : 0;
+}
+
+static void harness_done(void *ctx, uint32_t seq, int delivered, const char *buf, size_t len)
+{
+    harness_t *h = ctx;
+    if (delivered)
+    {
+        h->readings_acked += (uint32_t)(len / TELEMETRY_RECORD_SIZE);
+        return;
+    }
+    h->readings_failed += (uint32_t)(len / TELEMETRY_RECORD_SIZE);
+    fprintf(stderr, "seq %u: no ACK after max retries\n", seq);
+}
+
+// Number of records starting at recs that fit in one batch datagram
+static int batch_fit(const telemetry_record_t *recs, int n, const char *device_id, uint32_t boot)
+{
+    char payload[TELEMETRY_BATCH_JSON_MAX];
+    int used = 0;
+    if (n <= 1 || telemetry_batch_to_json(recs, n, device_id, boot, payload, sizeof(payload), &used) < 0)
+        return 1;
+    return used;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-s server_ip] [-p port] [-i device_id] [-n readings] [-w window]\n"
+            "          [-t initial_rto_ms] [-r max_tries] [-l loss_percent] [-b batch]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *server_ip = "127.0.0.1";
+    const char *device_id = "Harness_Device_01";
+    int port = 5005;
+    int count = 500;
+    int window = 8;
+    int initial_rto = 800;
+    int max_tries = 5;
+    int batch = 1;
+    harness_t h = {0};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:p:i:n:w:t:r:l:b:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': server_ip = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'i': device_id = optarg; break;
+        case 'n': count = atoi(optarg); break;
+        case 'w': window = atoi(optarg); break;
+        case 't': initial_rto = atoi(optarg); break;
+        case 'r': max_tries = atoi(optarg); break;
+        case 'l': h.loss_pct = atoi(optarg); break;
+        case 'b': batch = atoi(optarg); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+
+    h.sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (h.sockfd < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+    h.server.sin_family = AF_INET;
+    h.server.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &h.server.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid server address: %s\n", server_ip);
+        return 2;
+    }
+    if (batch < 1 || batch > QOS_PAYLOAD_MAX / TELEMETRY_RECORD_SIZE)
+    {
+        fprintf(stderr, "Batch must be 1..%d readings\n", QOS_PAYLOAD_MAX / TELEMETRY_RECORD_SIZE);
+        return 2;
+    }
+    h.device_id = device_id;
+    srand((unsigned)time(NULL) ^ (unsigned)getpid());
+    h.boot = 1 + (uint32_t)rand();
+
+    qos_window_t w;
+    qos_window_init(&w, window, initial_rto, max_tries, harness_send, harness_done, &h);
+
+    uint32_t start = now_ms();
+    int next = 0;
+    char incoming[512];
+    char probe[TELEMETRY_JSON_MAX];
+    telemetry_record_t first;
+
+    telemetry_record_set(&first, 0, 0, 0.0f, 0.0f, 1);
+    if (telemetry_record_to_json(&first, device_id, h.boot, probe, sizeof(probe)) < 0)
+    {
+        fprintf(stderr, "Device id too long\n");
+        return 2;
+    }
+
+    while (next < count || w.inflight > 0)
+    {
+        while (next < count && qos_window_can_send(&w))
+        {
+            telemetry_record_t recs[QOS_PAYLOAD_MAX / TELEMETRY_RECORD_SIZE];
+            uint8_t packed[QOS_PAYLOAD_MAX];
+            int k = count - next < batch ? count - next : batch;
+
+            for (int i = 0; i < k; ++i)
+                telemetry_record_set(&recs[i], (uint32_t)(next + i), now_ms(),
+                                     20.0f + ((next + i) % 10) * 0.1f, 50.0f, 1);
+            k = batch_fit(recs, k, device_id, h.boot);
+            for (int i = 0; i < k; ++i)
+                telemetry_record_pack(&recs[i], packed + i * TELEMETRY_RECORD_SIZE);
+
+            qos_window_send(&w, (uint32_t)next, (const char *)packed, (size_t)k * TELEMETRY_RECORD_SIZE, now_ms());
+            next += k;
+        }
+
+        struct pollfd pfd = {h.sockfd, POLLIN, 0};
+        if (poll(&pfd, 1, 10) > 0)
+        {
+            ssize_t n;
+            while ((n = recv(h.sockfd, incoming, sizeof(incoming), MSG_DONTWAIT)) > 0)
+            {
+                uint32_t seq;
+                if (h.loss_pct > 0 && rand() % 100 < h.loss_pct)
+                {
+                    h.dropped++;
+                    continue; // ACK lost on the "link"
+                }
+                if (qos_parse_ack(incoming, (size_t)n, device_id, &seq))
+                    qos_window_on_ack(&w, seq, now_ms());
+            }
+        }
+        qos_window_poll(&w, now_ms());
+    }
+
+    double secs = (now_ms() - start) / 1000.0;
+    printf("window=%d batch=%d readings=%d acked=%u failed=%u datagrams=%u retransmits=%u dropped=%u\n",
+           window, batch, count, h.readings_acked, h.readings_failed, w.sent, w.retransmits, h.dropped);
+    printf("elapsed=%.2fs throughput=%.1f readings/s srtt=%ums rttvar=%ums rto=%ums\n",
+           secs, secs > 0 ? count / secs : 0.0, w.srtt_ms, w.rttvar_ms, w.rto_ms);
+
+    close(h.sockfd);
+    return h.readings_failed == 0 ? 0 : 1;
+}
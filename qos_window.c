@@ -0,0 +1,251 @@
+// qos_window.c
+// Sliding-window QoS 1 sender. See qos_window.h.
+#include <string.h>
+#include "qos_window.h"
+
+// Wrap-safe "a is at or after b" for millisecond clocks
+static int time_reached(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) >= 0;
+}
+
+static void transmit(qos_window_t *w, qos_slot_t *s, uint32_t now_ms)
+{
+    w->send(w->ctx, s->buf, s->len);
+    if (s->tries > 0)
+        w->retransmits++;
+    w->sent++;
+    s->tries++;
+    s->sent_ms = now_ms;
+}
+
+static uint32_t next_random(qos_window_t *w)
+{
+    uint32_t x = w->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return w->rng = x;
+}
+
+static void release(qos_window_t *w, qos_slot_t *s, int delivered)
+{
+    s->in_use = 0;
+    w->inflight--;
+    if (delivered)
+        w->acked++;
+    else
+        w->failed++;
+    if (w->done)
+        w->done(w->ctx, s->seq, delivered, s->buf, s->len);
+}
+
+static uint32_t clamp_rto(uint32_t rto)
+{
+    if (rto < QOS_MIN_RTO_MS)
+        return QOS_MIN_RTO_MS;
+    if (rto > QOS_MAX_RTO_MS)
+        return QOS_MAX_RTO_MS;
+    return rto;
+}
+
+// Jacobson/Karels estimator (RFC 6298, section 2)
+static void rtt_sample(qos_window_t *w, uint32_t r)
+{
+    if (!w->has_rtt)
+    {
+        w->srtt_ms = r;
+        w->rttvar_ms = r / 2;
+        w->has_rtt = 1;
+    }
+    else
+    {
+        uint32_t err = w->srtt_ms > r ? w->srtt_ms - r : r - w->srtt_ms;
+        w->rttvar_ms = (3 * w->rttvar_ms + err) / 4;
+        w->srtt_ms = (7 * w->srtt_ms + r) / 8;
+    }
+
+    uint32_t var = 4 * w->rttvar_ms;
+    w->rto_ms = clamp_rto(w->srtt_ms + (var > QOS_CLOCK_GRANULARITY_MS ? var : QOS_CLOCK_GRANULARITY_MS));
+}
+
+void qos_window_init(qos_window_t *w, int window, uint32_t initial_rto_ms, int max_tries,
+                     qos_send_fn send, qos_done_fn done, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    if (window < 1)
+        window = 1;
+    if (window > QOS_WINDOW_MAX)
+        window = QOS_WINDOW_MAX;
+    w->window = window;
+    w->rto_ms = clamp_rto(initial_rto_ms);
+    w->max_tries = max_tries;
+    w->send = send;
+    w->done = done;
+    w->ctx = ctx;
+}
+
+void qos_window_seed(qos_window_t *w, uint32_t seed)
+{
+    w->rng = seed ? seed : 0x9E3779B9u;
+}
+
+uint32_t qos_window_backoff(qos_window_t *w, uint32_t base, uint32_t prev, uint32_t cap)
+{
+    uint32_t next;
+    if (!w->rng)
+        next = prev > cap / 2 ? cap : prev * 2;
+    else
+    {
+        uint32_t hi = prev > cap / 3 ? cap : prev * 3;
+        next = hi > base ? base + next_random(w) % (hi - base + 1) : base;
+    }
+    return next < cap ? next : cap;
+}
+
+int qos_window_can_send(const qos_window_t *w)
+{
+    return w->inflight < w->window;
+}
+
+int qos_window_send(qos_window_t *w, uint32_t seq, const char *buf, size_t len, uint32_t now_ms)
+{
+    if (!qos_window_can_send(w) || len > QOS_PAYLOAD_MAX)
+        return -1;
+
+    for (int i = 0; i < w->window; ++i)
+    {
+        qos_slot_t *s = &w->slots[i];
+        if (s->in_use)
+            continue;
+
+        s->in_use = 1;
+        s->tries = 0;
+        s->seq = seq;
+        s->len = (uint16_t)len;
+        s->timeout_ms = w->rto_ms;
+        memcpy(s->buf, buf, len);
+        w->inflight++;
+        transmit(w, s, now_ms);
+        return 0;
+    }
+    return -1;
+}
+
+int qos_window_on_ack(qos_window_t *w, uint32_t seq, uint32_t now_ms)
+{
+    for (int i = 0; i < w->window; ++i)
+    {
+        qos_slot_t *s = &w->slots[i];
+        if (s->in_use && s->seq == seq)
+        {
+            // Karn's rule: the ACK of a retransmitted seq may belong to any copy
+            if (s->tries == 1)
+                rtt_sample(w, now_ms - s->sent_ms);
+            release(w, s, 1);
+            return 1;
+        }
+    }
+    return 0; // Late ACK of a seq already given up on, or a duplicate ACK
+}
+
+int qos_window_on_nack(qos_window_t *w, uint32_t seq)
+{
+    for (int i = 0; i < w->window; ++i)
+    {
+        qos_slot_t *s = &w->slots[i];
+        if (s->in_use && s->seq == seq)
+        {
+            w->nacked++;
+            release(w, s, 0);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void qos_window_poll(qos_window_t *w, uint32_t now_ms)
+{
+    for (int i = 0; i < w->window; ++i)
+    {
+        qos_slot_t *s = &w->slots[i];
+        if (!s->in_use || !time_reached(now_ms, s->sent_ms + s->timeout_ms))
+            continue;
+
+        if (s->tries >= w->max_tries)
+        {
+            release(w, s, 0);
+            continue;
+        }
+
+        // Back off this seq, and the RTO for new seqs until a fresh sample
+        // arrives (once per timeout of a seq sent with the current RTO)
+        if (s->timeout_ms >= w->rto_ms)
+            w->rto_ms = clamp_rto(w->rto_ms * 2);
+        s->timeout_ms = clamp_rto(qos_window_backoff(w, w->rto_ms, s->timeout_ms, QOS_MAX_RTO_MS));
+        transmit(w, s, now_ms);
+    }
+}
+
+// Returns a pointer to the value of "key" (after the colon), or NULL
+static const char *find_value(const char *buf, size_t len, const char *key)
+{
+    size_t klen = strlen(key);
+    for (size_t i = 0; i + klen + 2 < len; ++i)
+    {
+        if (buf[i] != '"' || memcmp(buf + i + 1, key, klen) != 0 || buf[i + 1 + klen] != '"')
+            continue;
+
+        const char *p = buf + i + klen + 2;
+        const char *end = buf + len;
+        while (p < end && (*p == ' ' || *p == ':'))
+            p++;
+        return p < end ? p : NULL;
+    }
+    return NULL;
+}
+
+static int string_equals(const char *p, const char *end, const char *s)
+{
+    size_t n = strlen(s);
+    return p < end && *p == '"' && (size_t)(end - p) > n + 1 && memcmp(p + 1, s, n) == 0 && p[n + 1] == '"';
+}
+
+// Parses an unsigned number. Returns 0 if p does not start with a digit.
+static int parse_number(const char *p, const char *end, uint32_t *out)
+{
+    if (!p || p >= end || *p < '0' || *p > '9')
+        return 0;
+
+    uint32_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        v = v * 10 + (uint32_t)(*p++ - '0');
+    *out = v;
+    return 1;
+}
+
+// Checks "type" and "id" and reads "seq"
+static int parse_reply(const char *buf, size_t len, const char *type_name, const char *id, uint32_t *seq)
+{
+    const char *end = buf + len;
+    const char *type = find_value(buf, len, "type");
+    const char *dev = find_value(buf, len, "id");
+
+    if (!type || !dev || !string_equals(type, end, type_name) || !string_equals(dev, end, id))
+        return 0;
+    return parse_number(find_value(buf, len, "seq"), end, seq);
+}
+
+int qos_parse_ack(const char *buf, size_t len, const char *id, uint32_t *seq)
+{
+    return parse_reply(buf, len, "ACK", id, seq);
+}
+
+int qos_parse_nack(const char *buf, size_t len, const char *id, uint32_t *seq, uint32_t *retry_after_ms)
+{
+    if (!parse_reply(buf, len, "NACK", id, seq))
+        return 0;
+    if (!parse_number(find_value(buf, len, "retryAfter"), buf + len, retry_after_ms))
+        *retry_after_ms = 0;
+    return 1;
+}
@@ -0,0 +1,111 @@
+// qos_window.h
+// Platform-independent sliding-window sender for the QoS 1 telemetry protocol.
+//
+// Keeps up to `window` unacknowledged datagrams in flight, matches ACKs to the
+// outstanding seqs and retransmits each one on its own timeout. The timeout
+// (RTO) follows the measured ACK round trip (Jacobson/Karels, RFC 6298): only
+// first transmissions are sampled (Karn's rule), and a timeout doubles the RTO
+// until a fresh sample arrives. Once seeded (qos_window_seed), each seq's own
+// retransmission timeout grows with decorrelated jitter instead of doubling,
+// so devices that lost the same server do not retry in lockstep. The server
+// may also refuse a datagram with a NACK naming a retry delay. The platform
+// supplies the transmit function and the clock (milliseconds, may wrap), so
+// the same code runs on the ESP32/Pico clients and in the host harness.
+// Copy qos_window.h/.c next to the sketch when building with the Arduino IDE.
+#ifndef QOS_WINDOW_H
+#define QOS_WINDOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define QOS_WINDOW_MAX 16     // Upper bound for the window size
+#define QOS_PAYLOAD_MAX 256   // Largest datagram kept for retransmission
+#define QOS_MIN_RTO_MS 200
+#define QOS_MAX_RTO_MS 5000
+#define QOS_CLOCK_GRANULARITY_MS 10
+
+// Transmits one datagram. Returns 0 on success.
+typedef int (*qos_send_fn)(void *ctx, const char *buf, size_t len);
+
+// Reports the outcome of a seq: delivered (ACKed) or given up after max_tries
+typedef void (*qos_done_fn)(void *ctx, uint32_t seq, int delivered, const char *buf, size_t len);
+
+typedef struct
+{
+    uint8_t in_use;
+    uint8_t tries;       // Transmissions so far
+    uint16_t len;
+    uint32_t seq;
+    uint32_t sent_ms;    // Time of the last transmission
+    uint32_t timeout_ms; // Current ACK wait for this seq (RTO at send, backed off per retry)
+    char buf[QOS_PAYLOAD_MAX];
+} qos_slot_t;
+
+typedef struct
+{
+    qos_slot_t slots[QOS_WINDOW_MAX];
+    int window;
+    int inflight;
+    int has_rtt;        // Set after the first valid RTT sample
+    uint32_t srtt_ms;   // Smoothed ACK round trip
+    uint32_t rttvar_ms; // Round-trip variation
+    uint32_t rto_ms;    // Timeout given to new transmissions
+    int max_tries;
+    qos_send_fn send;
+    qos_done_fn done;
+    void *ctx;
+    uint32_t rng;       // xorshift32 state; 0 = no jitter (plain doubling)
+
+    // Counters for logs and the harness
+    uint32_t sent;
+    uint32_t retransmits;
+    uint32_t acked;
+    uint32_t failed;
+    uint32_t nacked;    // Of those failed, refused by the server (NACK)
+} qos_window_t;
+
+// initial_rto_ms is used until the first ACK is timed
+void qos_window_init(qos_window_t *w, int window, uint32_t initial_rto_ms, int max_tries,
+                     qos_send_fn send, qos_done_fn done, void *ctx);
+
+// Enables jittered backoff. Use a per-device seed (e.g. id hash ^ boot time).
+void qos_window_seed(qos_window_t *w, uint32_t seed);
+
+// Decorrelated jitter: a random wait between base and 3 * prev, at most cap.
+// Without a seed it doubles prev (at most cap).
+uint32_t qos_window_backoff(qos_window_t *w, uint32_t base, uint32_t prev, uint32_t cap);
+
+// Non-zero if another seq may be submitted
+int qos_window_can_send(const qos_window_t *w);
+
+// Transmits buf and tracks it until ACKed or given up. Returns -1 if the
+// window is full or the datagram is too large.
+int qos_window_send(qos_window_t *w, uint32_t seq, const char *buf, size_t len, uint32_t now_ms);
+
+// Matches an ACK to the outstanding set. Returns 1 if seq was in flight.
+int qos_window_on_ack(qos_window_t *w, uint32_t seq, uint32_t now_ms);
+
+// Gives up on seq now because the server refused it (reported as not
+// delivered). Returns 1 if seq was in flight.
+int qos_window_on_nack(qos_window_t *w, uint32_t seq);
+
+// Retransmits timed-out seqs and gives up on those out of tries
+void qos_window_poll(qos_window_t *w, uint32_t now_ms);
+
+// Parses an ACK datagram ({"type":"ACK","id":...,"seq":N}) addressed to id.
+// Returns 1 and sets *seq on success.
+int qos_parse_ack(const char *buf, size_t len, const char *id, uint32_t *seq);
+
+// Parses a NACK datagram ({"type":"NACK","id":...,"seq":N,"retryAfter":ms}).
+// Returns 1 and sets *seq and *retry_after_ms (0 if absent) on success.
+int qos_parse_nack(const char *buf, size_t len, const char *id, uint32_t *seq, uint32_t *retry_after_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+// replay_sched.c
+// Server-side replay admission. See replay_sched.h.
+#include <string.h>
+#include "replay_sched.h"
+
+void replay_sched_init(replay_sched_t *r, uint32_t readings_per_sec, uint32_t burst_ms)
+{
+    memset(r, 0, sizeof(*r));
+    r->cost_us = 1000000ull / (readings_per_sec ? readings_per_sec : 1);
+    r->burst_us = (uint64_t)burst_ms * 1000;
+}
+
+void replay_sched_set_rate(replay_sched_t *r, uint32_t readings_per_sec, uint32_t burst_ms)
+{
+    r->cost_us = 1000000ull / (readings_per_sec ? readings_per_sec : 1);
+    r->burst_us = (uint64_t)burst_ms * 1000;
+}
+
+uint32_t replay_sched_admit(replay_sched_t *r, uint64_t *slot_us, uint64_t now_ms, uint32_t count)
+{
+    uint64_t now_us = now_ms * 1000;
+
+    // Coming back for a reserved slot: its capacity is already accounted for
+    if (*slot_us)
+    {
+        if (now_us + REPLAY_SLOT_EARLY_MS * 1000 >= *slot_us)
+        {
+            *slot_us = 0;
+            r->admitted++;
+            return 0;
+        }
+        r->deferred++;
+        return (uint32_t)((*slot_us - now_us + 999) / 1000);
+    }
+
+    // Idle capacity is saved up to the burst allowance
+    if (r->next_us + r->burst_us < now_us)
+        r->next_us = now_us - r->burst_us;
+
+    if (r->next_us <= now_us)
+    {
+        r->next_us += count * r->cost_us;
+        r->admitted++;
+        return 0;
+    }
+
+    // Reserve the next free slot
+    *slot_us = r->next_us;
+    r->next_us += count * r->cost_us;
+    r->deferred++;
+    return (uint32_t)((*slot_us - now_us + 999) / 1000);
+}
+
+uint32_t replay_sched_wait_ms(const replay_sched_t *r, uint64_t now_ms)
+{
+    uint64_t now_us = now_ms * 1000;
+    return r->next_us > now_us ? (uint32_t)((r->next_us - now_us) / 1000) : 0;
+}
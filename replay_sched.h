@@ -0,0 +1,40 @@
+// replay_sched.h
+// Admission of backlog replay (batch datagrams) on the server.
+//
+// Replayed readings are admitted at up to `rate` per second, with a burst
+// allowance. A batch that arrives when the budget is used up is not
+// processed: the device is given the next free slot, and the server NACKs
+// it with a retryAfter pointing at that slot. The slot is reserved, so the
+// device is admitted when it comes back, and the slots of deferred devices
+// follow one another, which spreads a fleet's post-outage replay evenly
+// instead of having it retried in lockstep.
+#ifndef REPLAY_SCHED_H
+#define REPLAY_SCHED_H
+
+#include <stdint.h>
+
+#define REPLAY_SLOT_EARLY_MS 50 // A device may come back this much before its slot
+
+typedef struct
+{
+    uint64_t cost_us;  // Replay capacity taken by one reading
+    uint64_t burst_us; // Unused capacity that may be saved up
+    uint64_t next_us;  // Capacity is used or reserved up to this time
+    uint32_t admitted; // Batches processed
+    uint32_t deferred; // Batches NACKed with a slot
+} replay_sched_t;
+
+void replay_sched_init(replay_sched_t *r, uint32_t readings_per_sec, uint32_t burst_ms);
+
+// Changes the rate, keeping the reservations and counters
+void replay_sched_set_rate(replay_sched_t *r, uint32_t readings_per_sec, uint32_t burst_ms);
+
+// Decides on a batch of count readings at now_ms. *slot_us is the device's
+// reservation (0 = none), kept by the caller. Returns 0 if the batch may be
+// processed now, or the retryAfter in ms.
+uint32_t replay_sched_admit(replay_sched_t *r, uint64_t *slot_us, uint64_t now_ms, uint32_t count);
+
+// Time until the replay budget is free again (0 = free now)
+uint32_t replay_sched_wait_ms(const replay_sched_t *r, uint64_t now_ms);
+
+#endif
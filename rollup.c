@@ -0,0 +1,542 @@
+// rollup.c
+// Retention and downsampling of stored telemetry segments. See rollup.h.
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "gorilla.h"
+#include "rollup.h"
+#include "segment.h"
+
+#define DAY_SEC 86400
+// A raw day file also holds the tail of chunks that started before midnight
+// (chunks span at most GORILLA_CHUNK_MAX_SPAN_SEC), so buckets cover 25 hours.
+#define MINUTE_BUCKETS (25 * 60)
+#define HOUR_BUCKETS 25
+
+typedef struct
+{
+    uint32_t count;
+    double tmin, tmax, tsum;
+    double hmin, hmax, hsum;
+} bucket_t;
+
+// Receives the buckets of one device after a raw day file was aggregated
+typedef int (*bucket_sink)(const char *id, const bucket_t *minute, const bucket_t *hour,
+                           int64_t day, void *ctx);
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Sleeps as needed to keep the average I/O rate under the throttle's limit
+static void throttle_account(rollup_throttle_t *t, size_t bytes)
+{
+    if (!t || t->bytes_per_sec <= 0)
+        return;
+
+    double now = now_sec();
+    if (t->start == 0)
+        t->start = now;
+    t->bytes += (double)bytes;
+
+    double ahead = t->bytes / t->bytes_per_sec - (now - t->start);
+    if (ahead > 0)
+        usleep((useconds_t)(ahead * 1e6));
+}
+
+// Parses <prefix>-YYYYMMDD.seg into the UTC start of that day
+static int parse_day(const char *name, const char *prefix, int64_t *day)
+{
+    size_t plen = strlen(prefix);
+    if (strncmp(name, prefix, plen) != 0 || name[plen] != '-' ||
+        strlen(name) != plen + 13 || strcmp(name + plen + 9, ".seg") != 0)
+        return -1;
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(name + plen + 1, "%Y%m%d", &tm);
+    if (!end || *end != '.')
+        return -1;
+    *day = timegm(&tm);
+    return 0;
+}
+
+typedef struct
+{
+    char name[64];
+    int64_t day;
+} day_file_t;
+
+static int compare_day_files(const void *a, const void *b)
+{
+    int64_t da = ((const day_file_t *)a)->day, db = ((const day_file_t *)b)->day;
+    return (da > db) - (da < db);
+}
+
+// Lists <prefix>-YYYYMMDD.seg files sorted by day. Caller frees *out.
+static int list_day_files(const char *dir, const char *prefix, day_file_t **out, int *count)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+        return -1;
+
+    day_file_t *files = NULL;
+    int n = 0, cap = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL)
+    {
+        int64_t day;
+        if (parse_day(e->d_name, prefix, &day) < 0)
+            continue;
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 32;
+            day_file_t *nf = realloc(files, (size_t)cap * sizeof(*files));
+            if (!nf)
+                break;
+            files = nf;
+        }
+        snprintf(files[n].name, sizeof(files[n].name), "%s", e->d_name);
+        files[n].day = day;
+        n++;
+    }
+    closedir(d);
+
+    if (n > 1)
+        qsort(files, (size_t)n, sizeof(*files), compare_day_files);
+    *out = files;
+    *count = n;
+    return 0;
+}
+
+static int id_equals(const segment_record_t *r, const char *id)
+{
+    return strlen(id) == r->hdr->id_len && memcmp(r->id, id, r->hdr->id_len) == 0;
+}
+
+static void bucket_add(bucket_t *b, double temp, double hum)
+{
+    if (b->count == 0)
+    {
+        b->tmin = b->tmax = temp;
+        b->hmin = b->hmax = hum;
+    }
+    if (temp < b->tmin)
+        b->tmin = temp;
+    if (temp > b->tmax)
+        b->tmax = temp;
+    if (hum < b->hmin)
+        b->hmin = hum;
+    if (hum > b->hmax)
+        b->hmax = hum;
+    b->tsum += temp;
+    b->hsum += hum;
+    b->count++;
+}
+
+static int compare_records(const void *a, const void *b)
+{
+    const segment_record_t *ra = a, *rb = b;
+    size_t n = ra->hdr->id_len < rb->hdr->id_len ? ra->hdr->id_len : rb->hdr->id_len;
+    int c = memcmp(ra->id, rb->id, n);
+    if (c == 0)
+        c = (int)ra->hdr->id_len - (int)rb->hdr->id_len;
+    if (c == 0)
+        c = (ra->hdr->t_start > rb->hdr->t_start) - (ra->hdr->t_start < rb->hdr->t_start);
+    return c;
+}
+
+// Aggregates a mapped raw day file device by device (only `device` if not
+// NULL). Records are validated once, indexed and grouped by device; memory
+// use is the index plus one day of buckets.
+static int aggregate_raw(const segment_map_t *m, int64_t day, const char *device,
+                         rollup_throttle_t *throttle, bucket_sink sink, void *ctx)
+{
+    segment_record_t *recs = NULL;
+    int n = 0, cap = 0;
+    size_t off = 0;
+    segment_record_t r;
+    while (segment_next(m, &off, &r) == 1)
+    {
+        if (r.hdr->kind != SEGMENT_KIND_RAW || (device && !id_equals(&r, device)))
+            continue;
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 256;
+            segment_record_t *nr = realloc(recs, (size_t)cap * sizeof(*recs));
+            if (!nr)
+            {
+                free(recs);
+                return -1;
+            }
+            recs = nr;
+        }
+        recs[n++] = r;
+    }
+    if (n > 1)
+        qsort(recs, (size_t)n, sizeof(*recs), compare_records);
+
+    bucket_t *minute = malloc(MINUTE_BUCKETS * sizeof(*minute));
+    bucket_t *hour = malloc(HOUR_BUCKETS * sizeof(*hour));
+    int rc = (minute && hour) ? 0 : -1;
+
+    for (int i = 0; rc == 0 && i < n;)
+    {
+        char id[256];
+        snprintf(id, sizeof(id), "%.*s", (int)recs[i].hdr->id_len, recs[i].id);
+        memset(minute, 0, MINUTE_BUCKETS * sizeof(*minute));
+        memset(hour, 0, HOUR_BUCKETS * sizeof(*hour));
+
+        for (; i < n && id_equals(&recs[i], id); ++i)
+        {
+            const segment_hdr_t *h = recs[i].hdr;
+            gorilla_iter_t it;
+            int64_t ts;
+            double temp, hum;
+            gorilla_iter_init_raw(&it, recs[i].payload, h->nbits, h->count, h->t_start);
+            while (gorilla_iter_next(&it, &ts, &temp, &hum) == 1)
+            {
+                int64_t rel = ts - day;
+                if (rel < 0 || rel >= MINUTE_BUCKETS * 60)
+                    continue;
+                bucket_add(&minute[rel / 60], temp, hum);
+                bucket_add(&hour[rel / 3600], temp, hum);
+            }
+            throttle_account(throttle, sizeof(*h) + h->id_len + h->payload_len);
+        }
+
+        rc = sink(id, minute, hour, day, ctx);
+    }
+
+    free(minute);
+    free(hour);
+    free(recs);
+    return rc;
+}
+
+static void bucket_to_rollup(const bucket_t *b, int64_t t, segment_rollup_t *out)
+{
+    out->t = t;
+    out->count = b->count;
+    out->temp_min = (float)b->tmin;
+    out->temp_max = (float)b->tmax;
+    out->temp_mean = (float)(b->tsum / b->count);
+    out->hum_min = (float)b->hmin;
+    out->hum_max = (float)b->hmax;
+    out->hum_mean = (float)(b->hsum / b->count);
+}
+
+// --- Compaction ---
+
+typedef struct
+{
+    const char *path_1m;
+    const char *path_1h;
+    rollup_throttle_t *throttle;
+    segment_rollup_t *scratch; // MINUTE_BUCKETS entries
+} compact_ctx_t;
+
+static int write_rollups(const char *path, uint16_t kind, const char *id, const bucket_t *b,
+                         int nbuckets, int width, int64_t day, segment_rollup_t *scratch,
+                         rollup_throttle_t *throttle)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < nbuckets; ++i)
+    {
+        if (b[i].count)
+            bucket_to_rollup(&b[i], day + (int64_t)i * width, &scratch[n++]);
+    }
+    if (n == 0)
+        return 0;
+
+    uint32_t len = n * (uint32_t)sizeof(*scratch);
+    throttle_account(throttle, len);
+    return segment_append_record(path, kind, id, n, 0, scratch[0].t, scratch[n - 1].t + width - 1,
+                                 scratch, len);
+}
+
+static int compact_sink(const char *id, const bucket_t *minute, const bucket_t *hour,
+                        int64_t day, void *arg)
+{
+    compact_ctx_t *c = arg;
+    if (write_rollups(c->path_1m, SEGMENT_KIND_ROLLUP_1M, id, minute, MINUTE_BUCKETS,
+                      ROLLUP_MINUTE, day, c->scratch, c->throttle) < 0)
+        return -1;
+    return write_rollups(c->path_1h, SEGMENT_KIND_ROLLUP_1H, id, hour, HOUR_BUCKETS,
+                         ROLLUP_HOUR, day, c->scratch, c->throttle);
+}
+
+static int sync_file(const char *path)
+{
+    int fd = open(path, O_WRONLY);
+    if (fd < 0)
+        return -1;
+    int rc = fdatasync(fd);
+    close(fd);
+    return rc;
+}
+
+// Rolls one raw day file into its 1m/1h files, then deletes it. The rollups
+// are built in temporary files and renamed into place, so a crash at any
+// point leaves either the raw file or complete rollups (re-running the
+// compaction on a day overwrites its rollups).
+static int compact_raw_day(const char *dir, const day_file_t *f, rollup_throttle_t *throttle)
+{
+    char raw[512], final_1m[512], final_1h[512], tmp_1m[520], tmp_1h[520];
+    snprintf(raw, sizeof(raw), "%s/%s", dir, f->name);
+    segment_path(final_1m, sizeof(final_1m), dir, "1m", f->day);
+    segment_path(final_1h, sizeof(final_1h), dir, "1h", f->day);
+    snprintf(tmp_1m, sizeof(tmp_1m), "%s.tmp", final_1m);
+    snprintf(tmp_1h, sizeof(tmp_1h), "%s.tmp", final_1h);
+    unlink(tmp_1m);
+    unlink(tmp_1h);
+
+    segment_map_t m;
+    if (segment_map(raw, &m) < 0)
+        return -1;
+
+    segment_rollup_t *scratch = malloc(MINUTE_BUCKETS * sizeof(*scratch));
+    compact_ctx_t ctx = {tmp_1m, tmp_1h, throttle, scratch};
+    int rc = scratch ? aggregate_raw(&m, f->day, NULL, throttle, compact_sink, &ctx) : -1;
+    free(scratch);
+    segment_unmap(&m);
+
+    if (rc == 0)
+    {
+        // Days without any readings still get (empty) rollup files
+        close(open(tmp_1m, O_WRONLY | O_CREAT, 0644));
+        close(open(tmp_1h, O_WRONLY | O_CREAT, 0644));
+        rc = (sync_file(tmp_1m) == 0 && sync_file(tmp_1h) == 0 &&
+              rename(tmp_1m, final_1m) == 0 && rename(tmp_1h, final_1h) == 0)
+                 ? 0
+                 : -1;
+    }
+    if (rc == 0)
+        rc = unlink(raw);
+    else
+    {
+        unlink(tmp_1m);
+        unlink(tmp_1h);
+    }
+    return rc;
+}
+
+// Deletes <prefix> day files that ended before the retention window
+static int expire_files(const char *dir, const char *prefix, int days, int64_t now)
+{
+    if (days <= 0)
+        return 0;
+
+    day_file_t *files;
+    int n, removed = 0;
+    if (list_day_files(dir, prefix, &files, &n) < 0)
+        return -1;
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (files[i].day + DAY_SEC > now - (int64_t)days * DAY_SEC)
+            break; // Sorted by day
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+        if (unlink(path) == 0)
+            removed++;
+    }
+    free(files);
+    return removed;
+}
+
+int rollup_compact(const char *dir, const rollup_policy_t *policy, int64_t now,
+                   rollup_throttle_t *throttle)
+{
+    int processed = 0;
+
+    if (policy->raw_days > 0)
+    {
+        day_file_t *files;
+        int n;
+        if (list_day_files(dir, "raw", &files, &n) < 0)
+            return -1;
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (files[i].day + DAY_SEC > now - (int64_t)policy->raw_days * DAY_SEC)
+                break;
+            if (compact_raw_day(dir, &files[i], throttle) == 0)
+                processed++;
+            else
+                perror("Failed to compact raw segment");
+        }
+        free(files);
+    }
+
+    int removed = expire_files(dir, "1m", policy->minute_days, now);
+    if (removed > 0)
+        processed += removed;
+    removed = expire_files(dir, "1h", policy->hour_days, now);
+    if (removed > 0)
+        processed += removed;
+    return processed;
+}
+
+int rollup_resolution(const rollup_policy_t *policy, int64_t now, int64_t from)
+{
+    if (policy->raw_days <= 0 || from >= now - (int64_t)policy->raw_days * DAY_SEC)
+        return ROLLUP_RAW;
+    if (policy->minute_days <= 0 || from >= now - (int64_t)policy->minute_days * DAY_SEC)
+        return ROLLUP_MINUTE;
+    return ROLLUP_HOUR;
+}
+
+// --- Queries ---
+
+typedef struct
+{
+    int64_t from, to;
+    int resolution;
+    rollup_cb cb;
+    void *ctx;
+    int stopped;
+} query_ctx_t;
+
+static int emit_rollup(query_ctx_t *q, const char *id, size_t id_len, const segment_rollup_t *e)
+{
+    rollup_point_t p = {e->t, e->count, e->temp_min, e->temp_max, e->temp_mean,
+                        e->hum_min, e->hum_max, e->hum_mean};
+    if (p.t < q->from || p.t >= q->to)
+        return 0;
+    if (q->cb(id, id_len, &p, q->ctx))
+        q->stopped = 1;
+    return q->stopped;
+}
+
+// Sink for raw days that were not compacted yet: aggregate on the fly
+static int query_sink(const char *id, const bucket_t *minute, const bucket_t *hour,
+                      int64_t day, void *arg)
+{
+    query_ctx_t *q = arg;
+    const bucket_t *b = q->resolution == ROLLUP_HOUR ? hour : minute;
+    int n = q->resolution == ROLLUP_HOUR ? HOUR_BUCKETS : MINUTE_BUCKETS;
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (!b[i].count)
+            continue;
+        segment_rollup_t e;
+        bucket_to_rollup(&b[i], day + (int64_t)i * q->resolution, &e);
+        if (emit_rollup(q, id, strlen(id), &e))
+            return 1;
+    }
+    return 0;
+}
+
+static void query_raw_file(query_ctx_t *q, const segment_map_t *m, const char *device)
+{
+    size_t off = 0;
+    segment_record_t r;
+    while (!q->stopped && segment_next(m, &off, &r) == 1)
+    {
+        if (r.hdr->kind != SEGMENT_KIND_RAW || r.hdr->t_end < q->from || r.hdr->t_start >= q->to)
+            continue;
+        if (device && !id_equals(&r, device))
+            continue;
+
+        gorilla_iter_t it;
+        rollup_point_t p = {0};
+        double temp, hum;
+        gorilla_iter_init_raw(&it, r.payload, r.hdr->nbits, r.hdr->count, r.hdr->t_start);
+        while (gorilla_iter_next(&it, &p.t, &temp, &hum) == 1)
+        {
+            if (p.t < q->from || p.t >= q->to)
+                continue;
+            p.count = 1;
+            p.temp_min = p.temp_max = p.temp_mean = temp;
+            p.hum_min = p.hum_max = p.hum_mean = hum;
+            if (q->cb(r.id, r.hdr->id_len, &p, q->ctx))
+            {
+                q->stopped = 1;
+                break;
+            }
+        }
+    }
+}
+
+static void query_rollup_file(query_ctx_t *q, const segment_map_t *m, const char *device)
+{
+    size_t off = 0;
+    segment_record_t r;
+    while (!q->stopped && segment_next(m, &off, &r) == 1)
+    {
+        if (r.hdr->kind == SEGMENT_KIND_RAW || r.hdr->t_end < q->from || r.hdr->t_start >= q->to)
+            continue;
+        if (device && !id_equals(&r, device))
+            continue;
+
+        const segment_rollup_t *e = (const segment_rollup_t *)r.payload;
+        for (uint32_t i = 0; i < r.hdr->count && !q->stopped; ++i)
+            emit_rollup(q, r.id, r.hdr->id_len, &e[i]);
+    }
+}
+
+static int day_in_query(int64_t day, int64_t from, int64_t to)
+{
+    // Include the previous day: its chunks may run past midnight
+    return day + 2 * DAY_SEC > from && day < to;
+}
+
+int rollup_query(const char *dir, const char *device, int64_t from, int64_t to,
+                 int resolution, rollup_cb cb, void *ctx)
+{
+    query_ctx_t q = {from, to, resolution, cb, ctx, 0};
+    day_file_t *raw, *rolled = NULL;
+    int nraw, nrolled = 0;
+
+    if (list_day_files(dir, "raw", &raw, &nraw) < 0)
+        return -1;
+    if (resolution != ROLLUP_RAW &&
+        list_day_files(dir, resolution == ROLLUP_HOUR ? "1h" : "1m", &rolled, &nrolled) < 0)
+    {
+        free(raw);
+        return -1;
+    }
+
+    // Rolled-up days first (older), then raw days, both in day order
+    char path[512];
+    segment_map_t m;
+    for (int i = 0; i < nrolled && !q.stopped; ++i)
+    {
+        if (!day_in_query(rolled[i].day, from, to))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, rolled[i].name);
+        if (segment_map(path, &m) == 0)
+        {
+            query_rollup_file(&q, &m, device);
+            segment_unmap(&m);
+        }
+    }
+
+    for (int i = 0; i < nraw && !q.stopped; ++i)
+    {
+        if (!day_in_query(raw[i].day, from, to))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, raw[i].name);
+        if (segment_map(path, &m) < 0)
+            continue;
+        if (resolution == ROLLUP_RAW)
+            query_raw_file(&q, &m, device);
+        else
+            aggregate_raw(&m, raw[i].day, device, NULL, query_sink, &q);
+        segment_unmap(&m);
+    }
+
+    free(raw);
+    free(rolled);
+    return 0;
+}
@@ -0,0 +1,66 @@
+// rollup.h
+// Retention and downsampling of stored telemetry segments.
+//
+// Raw day files (raw-YYYYMMDD.seg) older than the raw retention are rolled
+// up into 1-minute (1m-YYYYMMDD.seg) and 1-hour (1h-YYYYMMDD.seg) aggregates
+// with min/max/mean/count per device and bucket, then deleted. Rollup files
+// are deleted in turn once they leave their own retention window.
+// rollup_query() picks the finest resolution still available for a range.
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default retention policy (days; 0 keeps the resolution forever)
+#define ROLLUP_RAW_RETENTION_DAYS 7
+#define ROLLUP_MINUTE_RETENTION_DAYS 90
+#define ROLLUP_HOUR_RETENTION_DAYS 730
+
+#define ROLLUP_RAW 0
+#define ROLLUP_MINUTE 60
+#define ROLLUP_HOUR 3600
+
+typedef struct
+{
+    int raw_days;
+    int minute_days;
+    int hour_days;
+} rollup_policy_t;
+
+// Token bucket limiting the compaction's disk traffic
+typedef struct
+{
+    double bytes_per_sec;
+    double start;
+    double bytes;
+} rollup_throttle_t;
+
+// A point returned by rollup_query(). Raw samples have count 1 and
+// min == max == mean.
+typedef struct
+{
+    int64_t t;
+    uint32_t count;
+    double temp_min, temp_max, temp_mean;
+    double hum_min, hum_max, hum_mean;
+} rollup_point_t;
+
+// Called for every point; return non-zero to stop the query
+typedef int (*rollup_cb)(const char *device, size_t device_len, const rollup_point_t *p, void *ctx);
+
+// Compacts every raw day file that left the raw retention window and deletes
+// expired rollup files. Returns the number of files processed or -1.
+int rollup_compact(const char *dir, const rollup_policy_t *policy, int64_t now,
+                   rollup_throttle_t *throttle);
+
+// Finest resolution that still covers data starting at from
+int rollup_resolution(const rollup_policy_t *policy, int64_t now, int64_t from);
+
+// Streams points of device (NULL = all devices) in [from, to) at the given
+// resolution. Buckets split across two day files are reported twice with
+// their partial aggregates. Returns 0, or -1 if the directory is unreadable.
+int rollup_query(const char *dir, const char *device, int64_t from, int64_t to,
+                 int resolution, rollup_cb cb, void *ctx);
+
+#endif
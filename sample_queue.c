@@ -0,0 +1,52 @@
+// sample_queue.c
+// Lock-free SPSC queue of readings. See sample_queue.h.
+#include <string.h>
+#include "sample_queue.h"
+
+#if (SAMPLE_QUEUE_SIZE & (SAMPLE_QUEUE_SIZE - 1)) != 0
+#error "SAMPLE_QUEUE_SIZE must be a power of two"
+#endif
+
+void sample_queue_init(sample_queue_t *q)
+{
+    memset(q, 0, sizeof(*q));
+}
+
+int sample_queue_push(sample_queue_t *q, const telemetry_record_t *rec)
+{
+    uint32_t tail = q->tail; // Only this side writes it
+    uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+    if (tail - head == SAMPLE_QUEUE_SIZE)
+    {
+        __atomic_store_n(&q->overflows, q->overflows + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    q->items[tail & (SAMPLE_QUEUE_SIZE - 1)] = *rec;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int sample_queue_pop(sample_queue_t *q, telemetry_record_t *rec)
+{
+    uint32_t head = q->head; // Only this side writes it
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+    if (tail == head)
+        return -1;
+    *rec = q->items[head & (SAMPLE_QUEUE_SIZE - 1)];
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+uint32_t sample_queue_count(const sample_queue_t *q)
+{
+    // head first: it can only catch up with a tail read after it
+    uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) - head;
+}
+
+uint32_t sample_queue_overflows(const sample_queue_t *q)
+{
+    return __atomic_load_n(&q->overflows, __ATOMIC_RELAXED);
+}
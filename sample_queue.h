@@ -0,0 +1,46 @@
+// sample_queue.h
+// Lock-free single-producer/single-consumer queue of readings, handing
+// samples from the sampler (one core) to the network task (the other core).
+//
+// tail is only written by the producer and head only by the consumer. Each
+// side fills or empties the slot first and then publishes its index with a
+// release store, and reads the other side's index with an acquire load, so
+// no lock or interrupt masking is needed. Uses the GCC __atomic builtins
+// (ESP32 and RP2040 toolchains, and the host).
+#ifndef SAMPLE_QUEUE_H
+#define SAMPLE_QUEUE_H
+
+#include <stdint.h>
+#include "telemetry_record.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SAMPLE_QUEUE_SIZE 64 // Readings; must be a power of two
+
+typedef struct
+{
+    telemetry_record_t items[SAMPLE_QUEUE_SIZE];
+    uint32_t head;      // Counter of the next reading to pop (consumer)
+    uint32_t tail;      // Counter of the next free slot (producer)
+    uint32_t overflows; // Readings refused because the queue was full (producer)
+} sample_queue_t;
+
+void sample_queue_init(sample_queue_t *q);
+
+// Producer side. Returns 0, or -1 (and counts an overflow) if full.
+int sample_queue_push(sample_queue_t *q, const telemetry_record_t *rec);
+
+// Consumer side. Returns 0, or -1 if empty.
+int sample_queue_pop(sample_queue_t *q, telemetry_record_t *rec);
+
+// Safe to call from either side
+uint32_t sample_queue_count(const sample_queue_t *q);
+uint32_t sample_queue_overflows(const sample_queue_t *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
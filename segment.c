@@ -0,0 +1,173 @@
+// segment.c
+// Append-only segment files for sealed telemetry chunks. See segment.h.
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "segment.h"
+
+uint32_t segment_crc32(uint32_t crc, const void *data, size_t len)
+{
+    static uint32_t table[256];
+    static int table_ready = 0;
+
+    if (!table_ready)
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        table_ready = 1;
+    }
+
+    const uint8_t *p = data;
+    crc = ~crc;
+    while (len--)
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void segment_path(char *buf, size_t len, const char *dir, const char *prefix, int64_t t)
+{
+    time_t tt = (time_t)t;
+    struct tm tm_utc;
+    gmtime_r(&tt, &tm_utc);
+
+    char day[16];
+    strftime(day, sizeof(day), "%Y%m%d", &tm_utc);
+    snprintf(buf, len, "%s/%s-%s.seg", dir, prefix, day);
+}
+
+int segment_append_record(const char *path, uint16_t kind, const char *device_id,
+                          uint32_t count, uint64_t nbits, int64_t t_start, int64_t t_end,
+                          const void *payload, uint32_t payload_len)
+{
+    size_t id_len = strlen(device_id);
+    if (id_len > UINT16_MAX)
+        return -1;
+
+    segment_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SEGMENT_MAGIC;
+    hdr.kind = kind;
+    hdr.id_len = (uint16_t)id_len;
+    hdr.count = count;
+    hdr.payload_len = payload_len;
+    hdr.nbits = nbits;
+    hdr.t_start = t_start;
+    hdr.t_end = t_end;
+    hdr.crc = segment_crc32(segment_crc32(0, device_id, id_len), payload, payload_len);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        return -1;
+
+    // One writev per record so concurrent appenders never interleave records
+    struct iovec iov[3] = {
+        {&hdr, sizeof(hdr)},
+        {(void *)device_id, id_len},
+        {(void *)payload, payload_len},
+    };
+    ssize_t expected = (ssize_t)(sizeof(hdr) + id_len + payload_len);
+    ssize_t written = writev(fd, iov, 3);
+
+    int saved = errno;
+    close(fd);
+    if (written != expected)
+    {
+        errno = written < 0 ? saved : EIO;
+        return -1;
+    }
+    return 0;
+}
+
+int segment_append_chunk(const char *dir, const char *device_id, const gorilla_chunk_t *c)
+{
+    char path[512];
+    segment_path(path, sizeof(path), dir, "raw", c->t_start);
+    return segment_append_record(path, SEGMENT_KIND_RAW, device_id, c->count, c->nbits,
+                                 c->t_start, c->t_last, c->data,
+                                 (uint32_t)gorilla_chunk_bytes(c));
+}
+
+int segment_map(const char *path, segment_map_t *m)
+{
+    memset(m, 0, sizeof(*m));
+    m->fd = open(path, O_RDONLY);
+    if (m->fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(m->fd, &st) < 0)
+    {
+        close(m->fd);
+        m->fd = -1;
+        return -1;
+    }
+
+    m->size = (size_t)st.st_size;
+    if (m->size == 0)
+        return 0; // Empty file: nothing to map
+
+    void *p = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, m->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        close(m->fd);
+        m->fd = -1;
+        return -1;
+    }
+    m->base = p;
+    madvise(p, m->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void segment_unmap(segment_map_t *m)
+{
+    if (m->base)
+        munmap((void *)m->base, m->size);
+    if (m->fd >= 0)
+        close(m->fd);
+    m->base = NULL;
+    m->size = 0;
+    m->fd = -1;
+}
+
+int segment_next(const segment_map_t *m, size_t *off, segment_record_t *rec)
+{
+    if (*off >= m->size)
+        return 0;
+    if (m->size - *off < sizeof(segment_hdr_t))
+        return -1;
+
+    const segment_hdr_t *hdr = (const segment_hdr_t *)(m->base + *off);
+    if (hdr->magic != SEGMENT_MAGIC)
+        return -1;
+
+    size_t body = (size_t)hdr->id_len + hdr->payload_len;
+    if (m->size - *off - sizeof(*hdr) < body)
+        return -1;
+
+    const uint8_t *id = m->base + *off + sizeof(*hdr);
+    const uint8_t *payload = id + hdr->id_len;
+    uint32_t crc = segment_crc32(segment_crc32(0, id, hdr->id_len), payload, hdr->payload_len);
+    if (crc != hdr->crc)
+        return -1;
+    if (hdr->kind == SEGMENT_KIND_RAW && hdr->nbits > (uint64_t)hdr->payload_len * 8)
+        return -1;
+    if (hdr->kind != SEGMENT_KIND_RAW && (uint64_t)hdr->count * sizeof(segment_rollup_t) != hdr->payload_len)
+        return -1;
+
+    rec->hdr = hdr;
+    rec->id = (const char *)id;
+    rec->payload = payload;
+    *off += sizeof(*hdr) + body;
+    return 1;
+}
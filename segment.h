@@ -0,0 +1,80 @@
+// segment.h
+// Append-only on-disk segment files for sealed telemetry chunks.
+//
+// The server appends every sealed gorilla chunk to a per-day segment file
+// (<dir>/raw-YYYYMMDD.seg). Each record carries its own header and CRC so a
+// torn write at the end of a file is detected and skipped by readers. Readers
+// map whole segment files with mmap and walk the records in place.
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gorilla.h"
+
+#define SEGMENT_MAGIC 0x31484347u // "GCH1" in little-endian
+#define SEGMENT_KIND_RAW 1        // Payload is a gorilla chunk bit stream
+#define SEGMENT_KIND_ROLLUP_1M 2  // Payload is an array of 1-minute segment_rollup_t
+#define SEGMENT_KIND_ROLLUP_1H 3  // Payload is an array of 1-hour segment_rollup_t
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t kind;
+    uint16_t id_len;      // Length of the device id that follows the header
+    uint32_t count;       // Samples in the record
+    uint32_t payload_len; // Bytes of payload after the id
+    uint64_t nbits;       // Valid bits in the payload (raw chunks)
+    int64_t t_start;
+    int64_t t_end;
+    uint32_t crc;         // CRC-32 of id + payload
+} segment_hdr_t;
+
+// One downsampled bucket (written by the compaction job, see rollup.h)
+typedef struct __attribute__((packed))
+{
+    int64_t t;      // Bucket start
+    uint32_t count; // Raw samples aggregated
+    float temp_min, temp_max, temp_mean;
+    float hum_min, hum_max, hum_mean;
+} segment_rollup_t;
+
+// Read-only mapping of one segment file
+typedef struct
+{
+    const uint8_t *base;
+    size_t size;
+    int fd;
+} segment_map_t;
+
+// A record decoded in place from a mapping
+typedef struct
+{
+    const segment_hdr_t *hdr;
+    const char *id; // Not NUL-terminated, see hdr->id_len
+    const uint8_t *payload;
+} segment_record_t;
+
+uint32_t segment_crc32(uint32_t crc, const void *data, size_t len);
+
+// Formats <dir>/<prefix>-YYYYMMDD.seg for the UTC day containing t
+void segment_path(char *buf, size_t len, const char *dir, const char *prefix, int64_t t);
+
+// Appends a sealed chunk to the raw segment of the chunk's start day.
+// Returns 0 on success, -1 on I/O failure (errno is preserved).
+int segment_append_chunk(const char *dir, const char *device_id, const gorilla_chunk_t *c);
+
+// Appends a generic record to the given file (used by writers of other kinds)
+int segment_append_record(const char *path, uint16_t kind, const char *device_id,
+                          uint32_t count, uint64_t nbits, int64_t t_start, int64_t t_end,
+                          const void *payload, uint32_t payload_len);
+
+int segment_map(const char *path, segment_map_t *m);
+void segment_unmap(segment_map_t *m);
+
+// Iterates records starting at *off. Returns 1 and advances *off when a valid
+// record was read, 0 at the end of the mapping and -1 on a corrupt or torn
+// record (the rest of the file is then unreadable).
+int segment_next(const segment_map_t *m, size_t *off, segment_record_t *rec);
+
+#endif
@@ -13,11 +13,32 @@
 #include <errno.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <stddef.h>      // For offsetof (metrics table)
 #include <math.h>        // For fabs() function used in differential calculation
 #include <cjson/cJSON.h> // For JSON parsing (Smartdata model)
 #include <MQTTClient.h>  // Paho MQTT C client
 #include <pthread.h>     // For creating monitoring thread
 #include <unistd.h>      // For usleep
+#include <sys/stat.h>    // For mkdir (history segment directory)
+#include <sys/resource.h> // For setpriority (low-priority compaction thread)
+#include <sys/syscall.h> // For gettid / ioprio_set
+#include "gapset.h"      // Per-device missing sequence ranges
+#include "gorilla.h"     // Compressed per-device telemetry history
+#include "rollup.h"      // Retention and downsampling of stored segments
+#include "segment.h"     // On-disk segments for sealed history chunks
+#include "heartbeat.h"   // Binary liveness datagrams from the clients
+#include "replay_sched.h" // Admission of post-outage backlog replay
+#include "tenant.h"      // Per-tenant devices, thresholds, topics and quotas
+#include "config.h"      // Configuration file, overrides and reload
+#include <poll.h>        // One ingest loop over the shared and per-tenant sockets
+#include <signal.h>
+#include <sys/signalfd.h> // SIGHUP (configuration reload) handled in the ingest loop
+
+// The values below are the compiled-in defaults. The configuration file
+// (-c FILE, see config.h) and -s key=value override them at startup, and
+// the performance knobs are reloaded on SIGHUP:
+//   ./server -c comcs.conf -s ingest_batch=32
+//   kill -HUP <pid>
 
 // Network Configuration (Req 2a)
 #define PORT 5005
@@ -39,41 +60,165 @@
 #define INACTIVITY_TIMEOUT_SEC 10 // Client is considered dead after 60 seconds of no reports
 #define MONITOR_INTERVAL_SEC 5   // Check every 10 seconds
 
-// MQTT Configuration
+// Telemetry history (compressed in-memory chunks, see gorilla.h)
+#define HISTORY_RAM_RETENTION_SEC (90 * 24 * 3600) // Sealed chunks older than this are dropped from RAM
+#define HISTORY_FLUSH_ENABLED 1                    // Append sealed chunks to on-disk segments
+#define HISTORY_DATA_DIR "data"                    // Directory holding the raw-YYYYMMDD.seg files
+
+// Storage compaction: raw segments -> 1-minute / 1-hour rollups (see rollup.h)
+#define COMPACTION_INTERVAL_SEC 600
+#define COMPACTION_IO_BYTES_PER_SEC (4 * 1024 * 1024) // Disk read+write budget of the compaction
+
+// Metrics / admin HTTP endpoint (Prometheus text on /metrics, JSON on /devices)
+#define METRICS_PORT 9100
+#define LINK_RTT_EWMA_SHIFT 3 // Smoothing of the retransmission interval (1/8 per sample)
+
+// --- Sequence Gap Tracking ---
+#define GAP_GRACE_SEC 900      // Time a gap may still be filled by backlog replay before it counts as lost
+#define GAP_ALERTS_ENABLED 1   // Raise a DATA_LOSS alert when gaps expire unrecovered
+#define DEDUP_WINDOW 256       // Seqs below the highest one checked against the received ones
+
+// --- Backlog Replay Admission ---
+#define REPLAY_ADMISSION_ENABLED 1  // NACK batches over the budget with a retryAfter slot
+#define REPLAY_READINGS_PER_SEC 2000 // Replayed readings processed per second, per tenant
+#define REPLAY_BURST_MS 1000        // Idle replay capacity that may be used at once
+
+// --- Tenants ---
+// Without [tenant NAME] sections in the configuration file, every device
+// belongs to one tenant with the values above (see tenant.h)
+#define TENANT_DEFAULT_NAME "g04"
+#define TENANT_TOPIC_PREFIX "/comcs/g04/" // Alerts go to <prefix>alerts
+#define TENANT_INGEST_BURST_MS 1000       // Unused ingest quota that may be saved up
+#define INGEST_BATCH 16                   // Datagrams read from a socket before the next one's turn
+#define SOCKET_RCVBUF 0                   // SO_RCVBUF of the UDP sockets (0 = system default)
+
+// MQTT Configuration. The address and TLS mode can also be overridden
+// with COMCS_MQTT_ADDRESS and COMCS_MQTT_TLS (verify, insecure or off), and
+// COMCS_MQTT_TRUSTSTORE names a CA file; e.g. for mqttBroker.py:
+//   COMCS_MQTT_ADDRESS=tcp://127.0.0.1:1883 COMCS_MQTT_TLS=off ./server
 #define MQTT_ADDRESS "ssl://4979254f05ea480283d67c6f0d9f7525.s1.eu.hivemq.cloud:8883"
+#define MQTT_TLS "verify"              // Check the broker certificate against the system CAs
+#define MQTT_PUBLISH_TIMEOUT_MS 1000   // Wait for an alert's PUBACK (blocks the caller)
 #define MQTT_CLIENT_ID "udp_alert_server"
-#define MQTT_ALERT_TOPIC "/comcs/g04/alerts"
+#define MQTT_CONNECT_TIMEOUT_S 5       // Bound on one connection attempt
+#define MQTT_RECONNECT_MIN_MS 1000     // First pause before reconnecting to a lost broker
+#define MQTT_RECONNECT_MAX_MS 60000    // The pause doubles per failed attempt up to this
 
 // HiveMQ Credentials
 #define MQTT_USERNAME "web_client"
 #define MQTT_PASSWORD "Password1"
 
 MQTTClient client;
+static server_config_t server_cfg;     // Running configuration (reloadable keys change on SIGHUP)
+static const char *config_path = NULL; // -c FILE
+static const char *config_overrides[64]; // -s key=value, in order
+static int config_override_count = 0;
+static uint32_t config_reloads = 0, config_reload_failures = 0;
+static uint32_t mqtt_published = 0;    // Alerts acknowledged by the broker
+static uint32_t mqtt_failed = 0;       // Alerts not published or not acknowledged in time
+static uint64_t mqtt_wait_us = 0;      // Time spent publishing alerts, PUBACK wait included
+static uint32_t mqtt_connects = 0;     // Reconnections after a lost or failed connection
+static uint32_t mqtt_connect_failures = 0; // Reconnection attempts that failed
+
+// Per-device link quality counters, updated on the ingest path
+typedef struct
+{
+    uint32_t packets;        // Valid datagrams received from the device
+    uint32_t readings;       // Readings stored, QoS 0 included (duplicates excluded)
+    uint32_t batches;        // Of those, batch datagrams (readings array)
+    uint32_t duplicates;     // QoS 1 packets whose seq was already processed
+    uint32_t ack_resends;    // ACKs sent again because of duplicates
+    uint32_t missing;        // Seqs skipped over by forward jumps
+    uint32_t replayed;       // Late seqs below the highest one seen (backlog replay)
+    uint32_t addr_changes;   // Times the source address/port changed
+    uint32_t retx_ms;        // Smoothed first receipt -> retransmission interval (client RTT + ACK wait)
+    uint32_t recovered;      // Missing seqs later filled by retransmissions
+    uint32_t lost;           // Missing seqs never received within gap_grace_sec (or evicted)
+    uint32_t pending;        // Missing seqs still within the grace period
+    uint32_t heartbeats;     // Heartbeat datagrams received (no reading, no ACK)
+    uint32_t backlog;        // Readings waiting on the device, from its last heartbeat
+    uint32_t deferred;       // Batches NACKed with a retryAfter (replay over budget)
+    uint32_t summaries;      // Summary datagrams received (readings folded on the device)
+    uint32_t summarized;     // Readings those summaries stand in for
+    uint32_t restarts;       // Times the device restarted its seqs (new boot id)
+    time_t addr_changed_at;  // When the source address last changed
+} link_stats_t;
 
 // Structure to track the state of each sending device (Req 2c)
 typedef struct
 {
     char id[128];
+    int tenant;         // Index into tenants[]
+    uint32_t handle;    // heartbeat_handle(id), names the device in heartbeat datagrams
     double temperature; // Last reported temperature
     double humidity;    // Last reported humidity
     char dateObserved[64];
     struct sockaddr_in addr; // Client's network address
     int has_seq;             // Flag: 1 if we have processed a sequence number before
     long last_seq;           // Last sequence number processed (for Guaranteed Delivery check)
+    uint32_t boot;           // Boot id the seqs belong to (0 = the client sends none)
     time_t last_seen;        // Last time a packet was successfully received
+    int heartbeat_s;         // Max silence advertised by a report-by-exception client (0 = none)
+    long max_seq;            // Highest sequence number processed
+    long summary_seq;        // First seq of the last summary processed (-1 = none)
+    uint64_t seen[DEDUP_WINDOW_MAX / 64]; // Seqs received in (max_seq - DEDUP_WINDOW_MAX, max_seq]
+    uint64_t last_seq_rx_ms; // Monotonic time the last seq was first received
+    uint64_t replay_slot_us; // Replay slot reserved by a NACK (0 = none)
+    link_stats_t link;       // Link quality counters (see /metrics and /devices)
+    gapset_t gaps;           // Missing seq ranges awaiting retransmission
+    long lost_lo, lost_hi;   // Span of the ranges lost since the last DATA_LOSS alert
+    uint32_t lost_unreported; // Seqs lost since the last DATA_LOSS alert
+    gorilla_chunk_t *history;      // Sealed history chunks, oldest first
+    gorilla_chunk_t *history_last; // Tail of the sealed list
+    gorilla_chunk_t *history_open; // Chunk currently receiving samples
 } device_t;
 
 // Global storage for tracking connected devices (Req 2c)
-static device_t devices[MAX_DEVICES];
+static device_t *devices;             // server_cfg.max_devices entries
 static int device_count = 0;
 static FILE *alert_log = NULL;
+static uint32_t unknown_heartbeats = 0; // Heartbeats whose handle matches no device
+static uint32_t unmatched_datagrams = 0; // Datagrams from device ids no tenant matches
+
+// A tenant's configuration, devices and quota state
+typedef struct
+{
+    tenant_config_t *cfg;      // Entry of server_cfg.tenants (reloaded in place)
+    char alert_topic[128];
+    int *device_idx;           // Into devices[], in registration order
+    int device_count;
+    tenant_bucket_t ingest;    // readings_per_sec (main loop only)
+    tenant_bucket_t alerts;    // alerts_per_sec (under alert_quota_lock)
+    replay_sched_t replay;     // Replay budget (main loop only)
+    uint32_t readings;         // Readings admitted by the ingest quota
+    uint32_t throttled;        // Datagrams refused by the ingest quota
+    uint32_t devices_rejected; // Datagrams from new devices over max_devices
+    uint32_t alerts_sent;      // Alerts logged and handed to the MQTT publisher
+    uint32_t alerts_suppressed; // Alerts dropped over alerts_per_sec
+    uint32_t alerts_unreported; // Of those, not yet summed up in the log
+} tenant_t;
+
+static tenant_t tenants[TENANT_MAX];
+static int tenant_count = 0;
+
+// Protects the tenants' alert quotas (alerts come from the main loop and the monitor)
+static pthread_mutex_t alert_quota_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Protects the history chunks (appended by the main loop, sealed by the monitor)
+static pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Protects the gap sets (opened/filled by the main loop, expired by the monitor)
+static pthread_mutex_t gap_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Helper function definitions
 static void log_alert(const char *message); 
 
-static device_t *find_device_by_id(const char *id);
-static device_t *add_or_get_device(const char *id, struct sockaddr_in *addr);
-static void send_ack(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *id, long seq);
+static device_t *find_device_by_id(const tenant_t *t, const char *id);
+static device_t *add_or_get_device(tenant_t *t, const char *id, struct sockaddr_in *addr);
+static void send_ack(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *id, long seq, int count);
+static void send_nack(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *id, long seq, uint32_t retry_after_ms);
+static uint64_t monotonic_ms(void);
+static uint64_t monotonic_us(void);
 
 
 // FIX: Restoring the definition of log_alert() which was missing.
@@ -96,29 +241,96 @@ static void log_alert(const char *message)
 }
 
 
+// Sleeps for ms milliseconds (usleep is only specified below one second).
+static void sleep_ms(uint32_t ms)
+{
+    struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
 // Function running in a separate thread to keep the MQTT connection alive.
+// A broker that was down at startup or dropped the connection later is
+// reconnected here, after a pause that starts at MQTT_RECONNECT_MIN_MS and
+// doubles per failed attempt up to MQTT_RECONNECT_MAX_MS, plus up to 25%
+// random jitter. Alerts raised meanwhile fail without waiting and are
+// counted as failed. arg is the connect options used at startup.
 void *mqtt_thread_func(void *arg)
 {
+    MQTTClient_connectOptions *conn_opts = arg;
+    unsigned int seed = (unsigned int)time(NULL) ^ ((unsigned int)getpid() << 16);
+    uint32_t backoff_ms = MQTT_RECONNECT_MIN_MS;
+    int connected = MQTTClient_isConnected(client);
+
     while (1)
     {
-        // Keep MQTT alive
-        MQTTClient_yield();
-        usleep(100 * 1000); // 100 ms sleep to avoid busy loop
+        if (MQTTClient_isConnected(client))
+        {
+            connected = 1;
+            backoff_ms = MQTT_RECONNECT_MIN_MS;
+            // Keep MQTT alive
+            MQTTClient_yield();
+            usleep(100 * 1000); // 100 ms sleep to avoid busy loop
+            continue;
+        }
+        if (connected)
+        {
+            printf("Lost the MQTT connection to %s, reconnecting\n", server_cfg.mqtt_address);
+            connected = 0;
+        }
+
+        uint32_t pause_ms = backoff_ms + (uint32_t)rand_r(&seed) % (backoff_ms / 4 + 1);
+        sleep_ms(pause_ms);
+        int rc = MQTTClient_connect(client, conn_opts);
+        if (rc == MQTTCLIENT_SUCCESS)
+        {
+            printf("Reconnected to MQTT broker at %s\n", server_cfg.mqtt_address);
+            mqtt_connects++;
+            continue;
+        }
+        mqtt_connect_failures++;
+        backoff_ms = backoff_ms * 2 > MQTT_RECONNECT_MAX_MS ? MQTT_RECONNECT_MAX_MS : backoff_ms * 2;
+        printf("MQTT reconnect failed, return code %d; next attempt in about %u s\n", rc, backoff_ms / 1000);
     }
     return NULL;
 }
 
 // Function to log alerts to stdout and a file (Req 2d)
-// and send alert via MQTT (Req 2f)
-static void log_alert_dual(const char *device,
+// and send alert via MQTT (Req 2f) on the device's tenant topic
+static void log_alert_dual(const device_t *dev,
                            const char *alert_type,
                            const char *message)
 {
+    tenant_t *t = &tenants[dev->tenant];
+
+    // Alerts over the tenant's quota are only counted (and summed up by the
+    // monitor): logging flushes a shared file and publishing waits for the
+    // PUBACK on the shared connection, so one tenant's alert storm would
+    // hold up everyone else's ingest and alerts
+    pthread_mutex_lock(&alert_quota_lock);
+    int over_quota = tenant_bucket_take(&t->alerts, monotonic_us(), 1) != 0;
+    if (over_quota)
+    {
+        t->alerts_suppressed++;
+        t->alerts_unreported++;
+    }
+    else
+        t->alerts_sent++;
+    pthread_mutex_unlock(&alert_quota_lock);
+    if (over_quota)
+        return;
+
     /* --------- 1) PRINT & SAVE LOG ENTRY --------- */
+    // With several tenants, device ids may repeat: name them tenant/id
     char formatted[512]; // Increased size for complex messages
-    snprintf(formatted, sizeof(formatted),
-             "%s: device=%s: %s",
-             alert_type, device, message);
+    if (tenant_count > 1)
+        snprintf(formatted, sizeof(formatted),
+                 "%s: device=%s/%s: %s",
+                 alert_type, t->cfg->name, dev->id, message);
+    else
+        snprintf(formatted, sizeof(formatted),
+                 "%s: device=%s: %s",
+                 alert_type, dev->id, message);
 
     log_alert(formatted); // Now calls the standalone log_alert function
 
@@ -135,7 +347,8 @@ static void log_alert_dual(const char *device,
     strftime(timebuf, sizeof(timebuf), "%Y-%m-%dT%H:%M:%S", &tm_now);
     cJSON_AddStringToObject(root, "timestamp", timebuf);
     
-    cJSON_AddStringToObject(root, "device", device);
+    cJSON_AddStringToObject(root, "tenant", t->cfg->name);
+    cJSON_AddStringToObject(root, "device", dev->id);
     cJSON_AddStringToObject(root, "alertType", alert_type);
     cJSON_AddStringToObject(root, "message", message);
 
@@ -155,31 +368,284 @@ static void log_alert_dual(const char *device,
     msg.qos = 1; // Guaranteed delivery via MQTT
     msg.retained = 0;
 
-    int rc = MQTTClient_publishMessage(client, MQTT_ALERT_TOPIC, &msg, &token);
+    uint64_t start = monotonic_us();
+    int rc = MQTTClient_publishMessage(client, t->alert_topic, &msg, &token);
     if (rc == MQTTCLIENT_SUCCESS)
     {
         // Wait briefly for confirmation
-        MQTTClient_waitForCompletion(client, token, 1000); 
+        rc = MQTTClient_waitForCompletion(client, token, server_cfg.mqtt_publish_timeout_ms);
     }
+    // Failures stay silent to avoid log spam, as they might be transient
+    if (rc == MQTTCLIENT_SUCCESS)
+        mqtt_published++;
     else
+        mqtt_failed++;
+    mqtt_wait_us += monotonic_us() - start;
+
+    free(json_str);
+}
+
+
+// Seals the device's open history chunk, flushes it to disk and drops sealed
+// chunks that fell out of the RAM retention window. Caller holds history_lock.
+static void history_seal_open(device_t *dev, time_t now)
+{
+    gorilla_chunk_t *c = dev->history_open;
+    dev->history_open = NULL;
+    if (c && c->count == 0)
+    {
+        gorilla_chunk_free(c);
+        free(c);
+    }
+    else if (c)
     {
-        // Keep silent to avoid log spam, as the failure might be transient.
+        gorilla_chunk_seal(c);
+
+        if (HISTORY_FLUSH_ENABLED && segment_append_chunk(tenants[dev->tenant].cfg->data_dir, dev->id, c) < 0)
+        {
+            perror("Failed to flush history chunk");
+        }
+
+        if (dev->history_last)
+            dev->history_last->next = c;
+        else
+            dev->history = c;
+        dev->history_last = c;
     }
 
-    free(json_str);
+    while (dev->history && dev->history->t_last < now - HISTORY_RAM_RETENTION_SEC)
+    {
+        gorilla_chunk_t *old = dev->history;
+        dev->history = old->next;
+        if (!dev->history)
+            dev->history_last = NULL;
+        gorilla_chunk_free(old);
+        free(old);
+    }
+}
+
+// Records a reading in the device's compressed history
+static void history_append(device_t *dev, time_t ts, double temp, double hum)
+{
+    pthread_mutex_lock(&history_lock);
+
+    if (dev->history_open && gorilla_chunk_full(dev->history_open, ts))
+        history_seal_open(dev, ts);
+
+    if (!dev->history_open)
+    {
+        gorilla_chunk_t *c = malloc(sizeof(*c));
+        if (!c || gorilla_chunk_init(c) < 0)
+        {
+            free(c);
+            pthread_mutex_unlock(&history_lock);
+            return;
+        }
+        dev->history_open = c;
+    }
+
+    if (gorilla_chunk_append(dev->history_open, ts, temp, hum) < 0)
+    {
+        // Out of memory: keep what is already encoded and drop this sample
+        history_seal_open(dev, ts);
+    }
+
+    pthread_mutex_unlock(&history_lock);
+}
+
+// Accumulates a lost gap range for the next DATA_LOSS alert. Called with gap_lock held.
+static void gap_lost(const gap_range_t *r, void *ctx)
+{
+    device_t *dev = ctx;
+    long n = r->hi - r->lo + 1;
+
+    if (dev->lost_unreported == 0 || r->lo < dev->lost_lo)
+        dev->lost_lo = r->lo;
+    if (dev->lost_unreported == 0 || r->hi > dev->lost_hi)
+        dev->lost_hi = r->hi;
+    dev->lost_unreported += (uint32_t)n;
+    dev->link.lost += (uint32_t)n;
+}
+
+// Updates the gap set for a new (non-duplicate) QoS 1 seq
+static void gap_track(device_t *dev, long seq, time_t now)
+{
+    pthread_mutex_lock(&gap_lock);
+    if (dev->max_seq >= 0 && seq > dev->max_seq + 1)
+    {
+        dev->link.missing += (uint32_t)(seq - dev->max_seq - 1);
+        gapset_open(&dev->gaps, dev->max_seq + 1, seq - 1, now, gap_lost, dev);
+    }
+    else if (seq < dev->max_seq)
+    {
+        dev->link.replayed++;
+        if (gapset_fill(&dev->gaps, seq, NULL, gap_lost, dev))
+            dev->link.recovered++;
+    }
+    dev->link.pending = (uint32_t)gapset_pending(&dev->gaps);
+    pthread_mutex_unlock(&gap_lock);
 }
 
+// Bit of seq in dev->seen
+#define SEEN_WORD(seq) (((unsigned long)(seq) % DEDUP_WINDOW_MAX) / 64)
+#define SEEN_BIT(seq) (1ull << ((unsigned long)(seq) % 64))
+
+// Records seq as received and raises max_seq to it. Seqs that push max_seq
+// up clear the bits they take over from seqs that fell out of the window.
+static void seq_seen(device_t *dev, long seq)
+{
+    if (seq > dev->max_seq)
+    {
+        if (seq - dev->max_seq >= DEDUP_WINDOW_MAX)
+            memset(dev->seen, 0, sizeof(dev->seen));
+        else
+            for (long s = dev->max_seq + 1; s <= seq; ++s)
+                dev->seen[SEEN_WORD(s)] &= ~SEEN_BIT(s);
+        dev->max_seq = seq;
+    }
+    else if (dev->max_seq - seq >= DEDUP_WINDOW_MAX)
+    {
+        return;
+    }
+    dev->seen[SEEN_WORD(seq)] |= SEEN_BIT(seq);
+}
+
+// Windowed clients retransmit out of order, so a seq just below the highest
+// one is a duplicate if it was received before. One that was not is new: a
+// gap being filled, or a backlog record stored before the client (or this
+// server) restarted and replayed after a newer live reading. Seqs further
+// back are processed as before.
+static int is_duplicate_seq(device_t *dev, long seq)
+{
+    if (!dev->has_seq)
+        return 0;
+    if (seq == dev->last_seq)
+        return 1;
+    if (seq > dev->max_seq || dev->max_seq - seq >= (long)server_cfg.dedup_window)
+        return 0;
+    return (dev->seen[SEEN_WORD(seq)] & SEEN_BIT(seq)) != 0;
+}
+
+// A client starts its seqs again after a reboot, and the old highest seq
+// would make the new ones look like duplicates. Its datagrams carry a random
+// "boot" id per run: a new one starts the device's seq tracking over. For
+// clients that send none, a seq beyond the dedup window below the highest
+// one while no gap is open is taken as a restart.
+static void seq_restart_check(device_t *dev, uint32_t boot, long seq)
+{
+    char log_message[256];
+    int restart;
+
+    if (!dev->has_seq)
+    {
+        dev->boot = boot;
+        return;
+    }
+    pthread_mutex_lock(&gap_lock);
+    if (boot)
+        restart = boot != dev->boot;
+    else
+        restart = dev->boot == 0 && seq >= 0 && dev->max_seq - seq > (long)server_cfg.dedup_window &&
+                  gapset_pending(&dev->gaps) == 0;
+    if (restart)
+    {
+        gapset_init(&dev->gaps);
+        dev->link.pending = 0;
+    }
+    pthread_mutex_unlock(&gap_lock);
+    if (!restart)
+        return;
+
+    snprintf(log_message, sizeof(log_message), "Device %s restarted its seqs at %ld (last run reached %ld)",
+             dev->id, seq, dev->max_seq);
+    log_alert(log_message);
+    dev->boot = boot;
+    dev->has_seq = 0;
+    dev->last_seq = -1;
+    dev->max_seq = -1;
+    dev->summary_seq = -1;
+    memset(dev->seen, 0, sizeof(dev->seen));
+    dev->link.restarts++;
+}
+
+// "boot" of a datagram (0 = absent)
+static uint32_t parse_boot(const cJSON *root)
+{
+    const cJSON *j = cJSON_GetObjectItemCaseSensitive(root, "boot");
+    if (!cJSON_IsNumber(j) || j->valuedouble < 1 || j->valuedouble > UINT32_MAX)
+        return 0;
+    return (uint32_t)j->valuedouble;
+}
+
+// Expires gaps past the grace period and reports data loss per device
+static void gap_expire_all(time_t now)
+{
+    for (int i = 0; i < device_count; ++i)
+    {
+        device_t *dev = &devices[i];
+        char message[256];
+        uint32_t lost;
+        long lo, hi;
+
+        pthread_mutex_lock(&gap_lock);
+        gapset_expire(&dev->gaps, now - (time_t)server_cfg.gap_grace_sec, gap_lost, dev);
+        dev->link.pending = (uint32_t)gapset_pending(&dev->gaps);
+        lost = dev->lost_unreported;
+        lo = dev->lost_lo;
+        hi = dev->lost_hi;
+        dev->lost_unreported = 0;
+        pthread_mutex_unlock(&gap_lock);
+
+        // Alert outside the lock: publishing may block on the broker
+        if (server_cfg.gap_alerts && lost > 0)
+        {
+            snprintf(message, sizeof(message),
+                     "%u reading(s) never received between seq %ld and %ld.", lost, lo, hi);
+            log_alert_dual(dev, "DATA_LOSS", message);
+        }
+    }
+}
+
+// Logs how many alerts each tenant had over its quota since the last call
+static void report_suppressed_alerts(void)
+{
+    char message[256];
+
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        pthread_mutex_lock(&alert_quota_lock);
+        uint32_t n = tenants[i].alerts_unreported;
+        tenants[i].alerts_unreported = 0;
+        pthread_mutex_unlock(&alert_quota_lock);
+
+        if (n > 0)
+        {
+            snprintf(message, sizeof(message), "Tenant %s: %u alert(s) over alerts_per_sec (%u/s) suppressed",
+                     tenants[i].cfg->name, n, tenants[i].cfg->alerts_per_sec);
+            log_alert(message);
+        }
+    }
+}
+
+// Silence allowed before a device is considered dead. Report-by-exception
+// clients advertise their heartbeat interval; the tenant's timeout
+// (INACTIVITY_TIMEOUT_SEC by default) is added as slack for the sampling
+// period and delivery.
+static int inactivity_timeout(const device_t *dev)
+{
+    return dev->heartbeat_s + tenants[dev->tenant].cfg->inactivity_timeout_sec;
+}
 
 // Function running in a separate thread to check for client inactivity (NEW REQUIREMENT)
 void *monitor_device_status(void *arg)
 {
-    printf("Device monitoring thread started. Timeout: %d sec.\n", INACTIVITY_TIMEOUT_SEC);
+    printf("Device monitoring thread started. Checking every %u sec.\n", server_cfg.monitor_interval_sec);
     time_t current_time;
     char message[256];
 
     while (1)
     {
-        sleep(MONITOR_INTERVAL_SEC); // Check devices periodically
+        sleep(server_cfg.monitor_interval_sec); // Check devices periodically
 
         current_time = time(NULL);
 
@@ -188,32 +654,470 @@ void *monitor_device_status(void *arg)
             device_t *dev = &devices[i];
             double inactivity_duration = difftime(current_time, dev->last_seen);
 
-            if (inactivity_duration > INACTIVITY_TIMEOUT_SEC)
+            if (inactivity_duration > inactivity_timeout(dev))
             {
                 // Trigger an alert for client inactivity
                 snprintf(message, sizeof(message), 
                          "Client has not reported in %.0f seconds. Suspected failure.", 
                          inactivity_duration);
                 
-                log_alert_dual(dev->id, "CLIENT_INACTIVITY", message);
+                log_alert_dual(dev, "CLIENT_INACTIVITY", message);
                 
                 // Optional: To prevent immediate spamming of the same alert, 
                 // you might want to increase dev->last_seen temporarily or 
                 // use a separate flag. For simplicity, we just log the alert.
             }
         }
+
+        gap_expire_all(current_time);
+        report_suppressed_alerts();
+
+        // Periodically seal history chunks, including those of idle devices
+        pthread_mutex_lock(&history_lock);
+        for (int i = 0; i < device_count; ++i)
+        {
+            device_t *dev = &devices[i];
+            if (dev->history_open && gorilla_chunk_full(dev->history_open, current_time))
+                history_seal_open(dev, current_time);
+        }
+        pthread_mutex_unlock(&history_lock);
     }
     return NULL;
 }
 
 
-// Looks up a device based on its unique ID
-static device_t *find_device_by_id(const char *id)
+// Background compaction of the history segments. Runs at the lowest CPU and
+// I/O priority with its own byte budget, so the ingest path is unaffected.
+void *compaction_thread_func(void *arg)
 {
-    for (int i = 0; i < device_count; ++i)
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, (id_t)tid, 19);
+#ifdef SYS_ioprio_set
+    // IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3 (<linux/ioprio.h>)
+    syscall(SYS_ioprio_set, 1, tid, 3 << 13);
+#endif
+
+    rollup_policy_t policy = {ROLLUP_RAW_RETENTION_DAYS, ROLLUP_MINUTE_RETENTION_DAYS,
+                              ROLLUP_HOUR_RETENTION_DAYS};
+    char message[256];
+
+    while (1)
     {
-        if (strcmp(devices[i].id, id) == 0)
-            return &devices[i];
+        rollup_throttle_t throttle = {server_cfg.compaction_io_bytes_per_sec, 0, 0};
+        int processed = 0;
+        for (int i = 0; i < tenant_count; ++i)
+        {
+            // Tenants may share a directory: compact each one once
+            int seen = 0;
+            for (int j = 0; j < i && !seen; ++j)
+                seen = strcmp(tenants[j].cfg->data_dir, tenants[i].cfg->data_dir) == 0;
+            int n = seen ? 0 : rollup_compact(tenants[i].cfg->data_dir, &policy, time(NULL), &throttle);
+            if (n > 0)
+                processed += n;
+        }
+        if (processed > 0)
+        {
+            snprintf(message, sizeof(message), "Compaction: %d segment files rolled up or expired", processed);
+            log_alert(message);
+        }
+        sleep(server_cfg.compaction_interval_sec);
+    }
+    return NULL;
+}
+
+// --- Metrics / admin endpoint ---
+
+// Per-device counters exported on /metrics
+static const struct
+{
+    const char *name;
+    const char *type;
+    const char *help;
+    size_t offset; // Into link_stats_t
+} link_metrics[] = {
+    {"comcs_device_packets_total", "counter", "Valid datagrams received", offsetof(link_stats_t, packets)},
+    {"comcs_device_readings_total", "counter", "Readings stored, QoS 0 included and duplicates excluded", offsetof(link_stats_t, readings)},
+    {"comcs_device_batches_total", "counter", "Batch datagrams received", offsetof(link_stats_t, batches)},
+    {"comcs_device_duplicates_total", "counter", "QoS 1 duplicates received", offsetof(link_stats_t, duplicates)},
+    {"comcs_device_ack_resends_total", "counter", "ACKs resent for duplicates", offsetof(link_stats_t, ack_resends)},
+    {"comcs_device_missing_seqs_total", "counter", "Sequence numbers skipped by forward jumps", offsetof(link_stats_t, missing)},
+    {"comcs_device_replayed_total", "counter", "Late (backlog replay) packets received", offsetof(link_stats_t, replayed)},
+    {"comcs_device_recovered_seqs_total", "counter", "Missing seqs filled by late retransmissions", offsetof(link_stats_t, recovered)},
+    {"comcs_device_lost_seqs_total", "counter", "Missing seqs never received within the grace period", offsetof(link_stats_t, lost)},
+    {"comcs_device_pending_seqs", "gauge", "Missing seqs still within the grace period", offsetof(link_stats_t, pending)},
+    {"comcs_device_heartbeats_total", "counter", "Heartbeat datagrams received", offsetof(link_stats_t, heartbeats)},
+    {"comcs_device_backlog", "gauge", "Readings waiting on the device (last heartbeat)", offsetof(link_stats_t, backlog)},
+    {"comcs_device_summaries_total", "counter", "Summary datagrams received", offsetof(link_stats_t, summaries)},
+    {"comcs_device_summarized_readings_total", "counter", "Readings received only as part of a summary", offsetof(link_stats_t, summarized)},
+    {"comcs_device_deferred_batches_total", "counter", "Replay batches NACKed with a retryAfter", offsetof(link_stats_t, deferred)},
+    {"comcs_device_restarts_total", "counter", "Seq restarts (device reboots)", offsetof(link_stats_t, restarts)},
+    {"comcs_device_addr_changes_total", "counter", "Source address changes", offsetof(link_stats_t, addr_changes)},
+    {"comcs_device_retransmit_interval_ms", "gauge", "Smoothed interval between a seq and its retransmission", offsetof(link_stats_t, retx_ms)},
+};
+
+// Writes a device id as a quoted Prometheus label value
+static void write_label(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if (*s == '\n')
+            fputs("\\n", f);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// Per-tenant quotas and usage. Tenant names need no escaping (see tenant.h).
+static void write_tenant_metrics(FILE *f)
+{
+    uint64_t now_ms = monotonic_ms();
+
+    fprintf(f, "# HELP comcs_tenant_devices Devices registered by the tenant\n");
+    fprintf(f, "# TYPE comcs_tenant_devices gauge\n");
+    for (int i = 0; i < tenant_count; ++i)
+        fprintf(f, "comcs_tenant_devices{tenant=\"%s\"} %d\n", tenants[i].cfg->name, tenants[i].device_count);
+    fprintf(f, "# HELP comcs_tenant_readings_total Readings admitted by the tenant's ingest quota\n");
+    fprintf(f, "# TYPE comcs_tenant_readings_total counter\n");
+    for (int i = 0; i < tenant_count; ++i)
+        fprintf(f, "comcs_tenant_readings_total{tenant=\"%s\"} %u\n", tenants[i].cfg->name, tenants[i].readings);
+    fprintf(f, "# HELP comcs_tenant_throttled_total Datagrams refused (NACKed) over the tenant's ingest quota\n");
+    fprintf(f, "# TYPE comcs_tenant_throttled_total counter\n");
+    for (int i = 0; i < tenant_count; ++i)
+        fprintf(f, "comcs_tenant_throttled_total{tenant=\"%s\"} %u\n", tenants[i].cfg->name, tenants[i].throttled);
+    fprintf(f, "# HELP comcs_tenant_devices_rejected_total Datagrams from new devices over the tenant's max_devices\n");
+    fprintf(f, "# TYPE comcs_tenant_devices_rejected_total counter\n");
+    for (int i = 0; i < tenant_count; ++i)
+        fprintf(f, "comcs_tenant_devices_rejected_total{tenant=\"%s\"} %u\n", tenants[i].cfg->name,
+                tenants[i].devices_rejected);
+    fprintf(f, "# HELP comcs_tenant_alerts_total Alerts by outcome of the tenant's alert quota\n");
+    fprintf(f, "# TYPE comcs_tenant_alerts_total counter\n");
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        fprintf(f, "comcs_tenant_alerts_total{tenant=\"%s\",outcome=\"sent\"} %u\n", tenants[i].cfg->name,
+                tenants[i].alerts_sent);
+        fprintf(f, "comcs_tenant_alerts_total{tenant=\"%s\",outcome=\"suppressed\"} %u\n", tenants[i].cfg->name,
+                tenants[i].alerts_suppressed);
+    }
+    fprintf(f, "# HELP comcs_replay_wait_ms Time until the tenant's replay budget is free again\n");
+    fprintf(f, "# TYPE comcs_replay_wait_ms gauge\n");
+    for (int i = 0; i < tenant_count; ++i)
+        fprintf(f, "comcs_replay_wait_ms{tenant=\"%s\"} %u\n", tenants[i].cfg->name,
+                replay_sched_wait_ms(&tenants[i].replay, now_ms));
+    fprintf(f, "# HELP comcs_replay_batches_total Replay batches by admission outcome\n");
+    fprintf(f, "# TYPE comcs_replay_batches_total counter\n");
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        fprintf(f, "comcs_replay_batches_total{tenant=\"%s\",outcome=\"admitted\"} %u\n", tenants[i].cfg->name,
+                tenants[i].replay.admitted);
+        fprintf(f, "comcs_replay_batches_total{tenant=\"%s\",outcome=\"deferred\"} %u\n", tenants[i].cfg->name,
+                tenants[i].replay.deferred);
+    }
+}
+
+static void write_metrics(FILE *f)
+{
+    int count = device_count;
+
+    fprintf(f, "# HELP comcs_devices Devices tracked by the server\n");
+    fprintf(f, "# TYPE comcs_devices gauge\ncomcs_devices %d\n", count);
+
+    // Fleet congestion view: how much data is still waiting on the devices
+    uint64_t fleet_backlog = 0;
+    int backlogged = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        fleet_backlog += devices[i].link.backlog;
+        backlogged += devices[i].link.backlog > 0;
+    }
+    fprintf(f, "# HELP comcs_fleet_backlog Readings waiting on all devices (last heartbeats)\n");
+    fprintf(f, "# TYPE comcs_fleet_backlog gauge\ncomcs_fleet_backlog %llu\n", (unsigned long long)fleet_backlog);
+    fprintf(f, "# HELP comcs_devices_backlogged Devices reporting a non-empty backlog\n");
+    fprintf(f, "# TYPE comcs_devices_backlogged gauge\ncomcs_devices_backlogged %d\n", backlogged);
+    write_tenant_metrics(f);
+    fprintf(f, "# HELP comcs_heartbeats_unknown_total Heartbeats from devices not known to the server\n");
+    fprintf(f, "# TYPE comcs_heartbeats_unknown_total counter\ncomcs_heartbeats_unknown_total %u\n", unknown_heartbeats);
+    fprintf(f, "# HELP comcs_config_reloads_total Configuration reloads (SIGHUP) by outcome\n");
+    fprintf(f, "# TYPE comcs_config_reloads_total counter\n");
+    fprintf(f, "comcs_config_reloads_total{outcome=\"applied\"} %u\n", config_reloads);
+    fprintf(f, "comcs_config_reloads_total{outcome=\"failed\"} %u\n", config_reload_failures);
+    fprintf(f, "# HELP comcs_datagrams_unmatched_total Datagrams from device ids that match no tenant\n");
+    fprintf(f, "# TYPE comcs_datagrams_unmatched_total counter\ncomcs_datagrams_unmatched_total %u\n", unmatched_datagrams);
+    fprintf(f, "# HELP comcs_mqtt_connected Whether the alert MQTT connection is up\n");
+    fprintf(f, "# TYPE comcs_mqtt_connected gauge\ncomcs_mqtt_connected %d\n", MQTTClient_isConnected(client) ? 1 : 0);
+    fprintf(f, "# HELP comcs_mqtt_reconnects_total Reconnection attempts after a lost or failed connection\n");
+    fprintf(f, "# TYPE comcs_mqtt_reconnects_total counter\n");
+    fprintf(f, "comcs_mqtt_reconnects_total{outcome=\"connected\"} %u\n", mqtt_connects);
+    fprintf(f, "comcs_mqtt_reconnects_total{outcome=\"failed\"} %u\n", mqtt_connect_failures);
+    fprintf(f, "# HELP comcs_mqtt_alerts_total Alerts published over MQTT by outcome\n");
+    fprintf(f, "# TYPE comcs_mqtt_alerts_total counter\n");
+    fprintf(f, "comcs_mqtt_alerts_total{outcome=\"published\"} %u\n", mqtt_published);
+    fprintf(f, "comcs_mqtt_alerts_total{outcome=\"failed\"} %u\n", mqtt_failed);
+    fprintf(f, "# HELP comcs_mqtt_publish_seconds_total Time the alert path spent publishing, PUBACK wait included\n");
+    fprintf(f, "# TYPE comcs_mqtt_publish_seconds_total counter\ncomcs_mqtt_publish_seconds_total %.6f\n", mqtt_wait_us / 1e6);
+
+    for (size_t m = 0; m < sizeof(link_metrics) / sizeof(link_metrics[0]); ++m)
+    {
+        fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", link_metrics[m].name, link_metrics[m].help,
+                link_metrics[m].name, link_metrics[m].type);
+        for (int i = 0; i < count; ++i)
+        {
+            uint32_t value;
+            memcpy(&value, (const char *)&devices[i].link + link_metrics[m].offset, sizeof(value));
+            fprintf(f, "%s{tenant=\"%s\",device=", link_metrics[m].name, tenants[devices[i].tenant].cfg->name);
+            write_label(f, devices[i].id);
+            fprintf(f, "} %u\n", value);
+        }
+    }
+
+    fprintf(f, "# HELP comcs_device_last_seen_seconds Unix time of the last packet\n");
+    fprintf(f, "# TYPE comcs_device_last_seen_seconds gauge\n");
+    for (int i = 0; i < count; ++i)
+    {
+        fprintf(f, "comcs_device_last_seen_seconds{tenant=\"%s\",device=", tenants[devices[i].tenant].cfg->name);
+        write_label(f, devices[i].id);
+        fprintf(f, "} %ld\n", (long)devices[i].last_seen);
+    }
+}
+
+static int compare_retry_cost(const void *a, const void *b)
+{
+    const device_t *da = *(device_t *const *)a, *db = *(device_t *const *)b;
+    uint32_t ca = da->link.duplicates + da->link.missing;
+    uint32_t cb = db->link.duplicates + db->link.missing;
+    return (cb > ca) - (cb < ca);
+}
+
+// Admin view: every device with its link statistics, worst links first
+static void write_devices_json(FILE *f)
+{
+    int count = device_count;
+    device_t **sorted = malloc((size_t)(count ? count : 1) * sizeof(*sorted));
+    cJSON *root = cJSON_CreateArray();
+    if (!sorted || !root)
+    {
+        free(sorted);
+        cJSON_Delete(root);
+        return;
+    }
+
+    for (int i = 0; i < count; ++i)
+        sorted[i] = &devices[i];
+    qsort(sorted, (size_t)count, sizeof(*sorted), compare_retry_cost);
+
+    char addr[INET_ADDRSTRLEN];
+    for (int i = 0; i < count; ++i)
+    {
+        const device_t *d = sorted[i];
+        cJSON *o = cJSON_CreateObject();
+        if (!o)
+            break;
+        cJSON_AddItemToArray(root, o);
+
+        if (!inet_ntop(AF_INET, &d->addr.sin_addr, addr, sizeof(addr)))
+            strcpy(addr, "UNKNOWN_IP");
+        cJSON_AddStringToObject(o, "id", d->id);
+        cJSON_AddStringToObject(o, "tenant", tenants[d->tenant].cfg->name);
+        cJSON_AddStringToObject(o, "address", addr);
+        cJSON_AddNumberToObject(o, "port", ntohs(d->addr.sin_port));
+        cJSON_AddNumberToObject(o, "lastSeen", (double)d->last_seen);
+        cJSON_AddNumberToObject(o, "heartbeatSec", d->heartbeat_s);
+        cJSON_AddNumberToObject(o, "inactivityTimeoutSec", inactivity_timeout(d));
+        cJSON_AddNumberToObject(o, "lastSeq", (double)d->last_seq);
+        cJSON_AddNumberToObject(o, "maxSeq", (double)d->max_seq);
+        cJSON_AddNumberToObject(o, "packets", d->link.packets);
+        cJSON_AddNumberToObject(o, "readings", d->link.readings);
+        cJSON_AddNumberToObject(o, "batches", d->link.batches);
+        cJSON_AddNumberToObject(o, "duplicates", d->link.duplicates);
+        cJSON_AddNumberToObject(o, "ackResends", d->link.ack_resends);
+        cJSON_AddNumberToObject(o, "missingSeqs", d->link.missing);
+        cJSON_AddNumberToObject(o, "replayed", d->link.replayed);
+        cJSON_AddNumberToObject(o, "recoveredSeqs", d->link.recovered);
+        cJSON_AddNumberToObject(o, "lostSeqs", d->link.lost);
+        cJSON_AddNumberToObject(o, "pendingSeqs", d->link.pending);
+        cJSON_AddNumberToObject(o, "heartbeats", d->link.heartbeats);
+        cJSON_AddNumberToObject(o, "backlog", d->link.backlog);
+        cJSON_AddNumberToObject(o, "deferredBatches", d->link.deferred);
+        cJSON_AddNumberToObject(o, "summaries", d->link.summaries);
+        cJSON_AddNumberToObject(o, "summarizedReadings", d->link.summarized);
+        cJSON_AddNumberToObject(o, "restarts", d->link.restarts);
+        cJSON_AddNumberToObject(o, "retransmitIntervalMs", d->link.retx_ms);
+        cJSON_AddNumberToObject(o, "addrChanges", d->link.addr_changes);
+        cJSON_AddNumberToObject(o, "addrChangedAt", (double)d->link.addr_changed_at);
+    }
+
+    char *out = cJSON_PrintUnformatted(root);
+    if (out)
+    {
+        fputs(out, f);
+        free(out);
+    }
+    cJSON_Delete(root);
+    free(sorted);
+}
+
+// Admin view: every tenant with its configuration and usage
+static void write_tenants_json(FILE *f)
+{
+    cJSON *root = cJSON_CreateArray();
+    char addr[INET_ADDRSTRLEN];
+    char net[INET_ADDRSTRLEN + 3]; // a.b.c.d/len
+    if (!root)
+        return;
+
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        const tenant_t *t = &tenants[i];
+        cJSON *o = cJSON_CreateObject();
+        if (!o)
+            break;
+        cJSON_AddItemToArray(root, o);
+
+        struct in_addr in = {htonl(t->cfg->net)};
+        int len = 0;
+        for (uint32_t m = t->cfg->netmask; m; m <<= 1)
+            len++;
+        if (!inet_ntop(AF_INET, &in, addr, sizeof(addr)))
+            strcpy(addr, "0.0.0.0");
+        snprintf(net, sizeof(net), "%s/%d", addr, len);
+
+        cJSON_AddStringToObject(o, "name", t->cfg->name);
+        cJSON_AddStringToObject(o, "match", t->cfg->match);
+        cJSON_AddStringToObject(o, "network", net);
+        cJSON_AddNumberToObject(o, "port", t->cfg->port ? (int)t->cfg->port : (int)server_cfg.port);
+        cJSON_AddStringToObject(o, "alertTopic", t->alert_topic);
+        cJSON_AddStringToObject(o, "dataDir", t->cfg->data_dir);
+        cJSON_AddNumberToObject(o, "tempMin", t->cfg->temp_min);
+        cJSON_AddNumberToObject(o, "tempMax", t->cfg->temp_max);
+        cJSON_AddNumberToObject(o, "humMin", t->cfg->hum_min);
+        cJSON_AddNumberToObject(o, "humMax", t->cfg->hum_max);
+        cJSON_AddNumberToObject(o, "tempDiff", t->cfg->temp_diff);
+        cJSON_AddNumberToObject(o, "humDiff", t->cfg->hum_diff);
+        cJSON_AddNumberToObject(o, "inactivityTimeoutSec", t->cfg->inactivity_timeout_sec);
+        cJSON_AddNumberToObject(o, "maxDevices", t->cfg->max_devices);
+        cJSON_AddNumberToObject(o, "readingsPerSec", t->cfg->readings_per_sec);
+        cJSON_AddNumberToObject(o, "alertsPerSec", t->cfg->alerts_per_sec);
+        cJSON_AddNumberToObject(o, "replayReadingsPerSec", t->cfg->replay_readings_per_sec);
+        cJSON_AddNumberToObject(o, "devices", t->device_count);
+        cJSON_AddNumberToObject(o, "readings", t->readings);
+        cJSON_AddNumberToObject(o, "throttled", t->throttled);
+        cJSON_AddNumberToObject(o, "devicesRejected", t->devices_rejected);
+        cJSON_AddNumberToObject(o, "alertsSent", t->alerts_sent);
+        cJSON_AddNumberToObject(o, "alertsSuppressed", t->alerts_suppressed);
+    }
+
+    char *out = cJSON_PrintUnformatted(root);
+    if (out)
+    {
+        fputs(out, f);
+        free(out);
+    }
+    cJSON_Delete(root);
+}
+
+// Minimal HTTP server for the metrics scraper and operators (one request
+// per connection). Counters are read without locking; a scrape may see a
+// device mid-update, which is fine for monitoring.
+void *metrics_thread_func(void *arg)
+{
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0)
+    {
+        perror("Failed to create metrics socket");
+        return NULL;
+    }
+
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(server_cfg.metrics_port);
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 16) < 0)
+    {
+        perror("Failed to bind metrics endpoint");
+        close(lfd);
+        return NULL;
+    }
+    printf("Metrics endpoint on http://0.0.0.0:%u/metrics (admin: /devices, /tenants, /config)\n", server_cfg.metrics_port);
+
+    while (1)
+    {
+        int cfd = accept(lfd, NULL, NULL);
+        if (cfd < 0)
+            continue;
+
+        struct timeval tv = {2, 0};
+        setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        char req[1024];
+        ssize_t n = recv(cfd, req, sizeof(req) - 1, 0);
+        if (n <= 0)
+        {
+            close(cfd);
+            continue;
+        }
+        req[n] = '\0';
+
+        char *body = NULL;
+        size_t body_len = 0;
+        FILE *f = open_memstream(&body, &body_len);
+        const char *status = "200 OK";
+        const char *ctype = "text/plain; version=0.0.4";
+
+        if (f && strncmp(req, "GET /metrics", 12) == 0)
+        {
+            write_metrics(f);
+        }
+        else if (f && strncmp(req, "GET /devices", 12) == 0)
+        {
+            write_devices_json(f);
+            ctype = "application/json";
+        }
+        else if (f && strncmp(req, "GET /tenants", 12) == 0)
+        {
+            write_tenants_json(f);
+            ctype = "application/json";
+        }
+        else if (f && strncmp(req, "GET /config", 11) == 0)
+        {
+            config_write(f, &server_cfg);
+            ctype = "text/plain";
+        }
+        else if (f)
+        {
+            status = "404 Not Found";
+            fputs("Not found\n", f);
+        }
+        if (f)
+            fclose(f);
+
+        char header[256];
+        int hlen = snprintf(header, sizeof(header),
+                            "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                            status, ctype, body_len);
+        send(cfd, header, (size_t)hlen, MSG_NOSIGNAL);
+        if (body)
+            send(cfd, body, body_len, MSG_NOSIGNAL);
+        free(body);
+        close(cfd);
+    }
+    return NULL;
+}
+
+// Looks up a device based on its ID, unique within its tenant
+static device_t *find_device_by_id(const tenant_t *t, const char *id)
+{
+    for (int i = 0; i < t->device_count; ++i)
+    {
+        device_t *d = &devices[t->device_idx[i]];
+        if (strcmp(d->id, id) == 0)
+            return d;
     }
     return NULL;
 }
@@ -230,38 +1134,109 @@ static device_t *find_device_by_addr(struct sockaddr_in *addr)
     return NULL;
 }
 
-// Adds a new device or retrieves an existing one (Req 2c)
-static device_t *add_or_get_device(const char *id, struct sockaddr_in *addr)
+// Looks up a device by the handle carried in its heartbeats, among the
+// devices of the tenant that owns the socket (tenant < 0: the tenants on
+// the shared port). Tenants may reuse ids, so a device last seen at the
+// heartbeat's source address is preferred.
+static device_t *find_device_by_handle(int tenant, uint32_t handle, const struct sockaddr_in *addr)
+{
+    device_t *found = NULL;
+    for (int i = 0; i < device_count; ++i)
+    {
+        device_t *d = &devices[i];
+        if (d->handle != handle || (tenant >= 0 ? d->tenant != tenant : tenants[d->tenant].cfg->port != 0))
+            continue;
+        if (d->addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+            return d;
+        if (!found)
+            found = d;
+    }
+    return found;
+}
+
+// Records the source address of a packet from a known device
+static void update_device_addr(device_t *d, struct sockaddr_in *addr)
+{
+    if (d->addr.sin_addr.s_addr != addr->sin_addr.s_addr || d->addr.sin_port != addr->sin_port)
+    {
+        d->link.addr_changes++;
+        d->link.addr_changed_at = time(NULL);
+    }
+    d->addr = *addr;
+}
+
+static uint64_t monotonic_ms(void)
 {
-    device_t *d = find_device_by_id(id);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Adds a new device or retrieves an existing one (Req 2c), within the
+// tenant's max_devices. The tenants' maximums fit in the table together
+// (config_check), so a tenant cannot take the slots of another.
+static device_t *add_or_get_device(tenant_t *t, const char *id, struct sockaddr_in *addr)
+{
+    device_t *d = find_device_by_id(t, id);
     if (d)
     {
         // If device exists, update its network address and last seen time
-        d->addr = *addr;
+        update_device_addr(d, addr);
         d->last_seen = time(NULL);
         return d;
     }
 
     // Add new device if space is available
-    if (device_count >= MAX_DEVICES)
+    if (device_count >= (int)server_cfg.max_devices || t->device_count >= (int)t->cfg->max_devices)
+    {
+        t->devices_rejected++;
         return NULL;
-    d = &devices[device_count++];
+    }
+    d = &devices[device_count];
 
     // Initialize new device struct
     strncpy(d->id, id, sizeof(d->id) - 1);
     d->id[sizeof(d->id) - 1] = '\0';
+    d->tenant = (int)(t - tenants);
+    d->handle = heartbeat_handle(d->id);
     d->temperature = 0;
     d->humidity = 0;
     d->dateObserved[0] = '\0';
     d->addr = *addr;
     d->has_seq = 0;
+    memset(d->seen, 0, sizeof(d->seen));
+    d->boot = 0;
     d->last_seq = -1;
+    d->max_seq = -1;
+    d->summary_seq = -1;
+    d->last_seq_rx_ms = 0;
+    d->replay_slot_us = 0;
+    memset(&d->link, 0, sizeof(d->link));
+    gapset_init(&d->gaps);
+    d->lost_lo = d->lost_hi = 0;
+    d->lost_unreported = 0;
     d->last_seen = time(NULL);
+    d->history = NULL;
+    d->history_last = NULL;
+    d->history_open = NULL;
+
+    // Publish the entry only once it is initialised (read by other threads)
+    t->device_idx[t->device_count] = device_count;
+    t->device_count++;
+    device_count++;
     return d;
 }
 
 // Sends an ACK message back to the client for QoS=1 (Guaranteed Delivery) (Req 2b)
-static void send_ack(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *id, long seq)
+// count > 0 acknowledges a batch of that many readings, named by its first seq
+static void send_ack(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *id, long seq, int count)
 {
     if (!id)
         return;
@@ -277,6 +1252,8 @@ static void send_ack(int sockfd, struct sockaddr_in *client_addr, socklen_t addr
     cJSON_AddStringToObject(ack, "type", "ACK");
     cJSON_AddStringToObject(ack, "id", id);
     cJSON_AddNumberToObject(ack, "seq", (double)seq); // Sequence number must match the received one
+    if (count > 0)
+        cJSON_AddNumberToObject(ack, "count", count);
 
     char *out = cJSON_PrintUnformatted(ack); // Print compact JSON string
     if (out)
@@ -296,258 +1273,972 @@ static void send_ack(int sockfd, struct sockaddr_in *client_addr, socklen_t addr
     cJSON_Delete(ack); // Free cJSON object
 }
 
-int main()
+// Refuses a batch for now: the client drops it from its window and sends it
+// again after retry_after_ms (its reserved replay slot)
+static void send_nack(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *id, long seq, uint32_t retry_after_ms)
 {
-    int sockfd;
-    struct sockaddr_in server_addr, client_addr;
-    char buffer[BUFFER_SIZE];
-    char client_ip_str[INET_ADDRSTRLEN];
-    char log_message[BUFFER_SIZE + 256];
-    pthread_t mqtt_thread;
-    pthread_t monitor_thread; // NEW: Monitoring thread ID
-    int mqtt_thread_created = 0;
-    int monitor_thread_created = 0;
+    cJSON *nack = cJSON_CreateObject();
+    if (!nack)
+        return;
 
-    // Open the alert log file for appending
-    alert_log = fopen(ALERT_LOGFILE, "a");
-    if (!alert_log)
+    cJSON_AddStringToObject(nack, "type", "NACK");
+    cJSON_AddStringToObject(nack, "id", id);
+    cJSON_AddNumberToObject(nack, "seq", (double)seq);
+    cJSON_AddNumberToObject(nack, "retryAfter", retry_after_ms);
+
+    char *out = cJSON_PrintUnformatted(nack);
+    if (out)
     {
-        perror("Failed to open alert log file");
+        if (sendto(sockfd, out, strlen(out), 0, (struct sockaddr *)client_addr, addrlen) < 0)
+            perror("sendto (NACK) failed");
+        free(out);
     }
+    cJSON_Delete(nack);
+}
 
-    // Create UDP socket (AF_INET for IPv4, SOCK_DGRAM for UDP)
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+// Dedup, store, ACK and alert path for one reading (Req 2b-2e). Batch
+// members pass ack = 0: the caller acknowledges the whole batch instead.
+// Returns 1 if the reading was processed, 0 for a duplicate, -1 if rejected.
+static int process_reading(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *peer,
+                           device_t *dev, double temp, double hum, const char *dateObserved,
+                           int qos, long seq, int ack)
+{
+    const char *id = dev->id;
+    const tenant_t *t = &tenants[dev->tenant];
+    const tenant_config_t *cfg = t->cfg;
+    char log_message[512];
+
+    // --- QoS CHECK & ACK LOGIC (Req 2b) ---
+    if (qos == 1)
     {
-        perror("Failed to create socket");
-        exit(EXIT_FAILURE);
+        if (seq == -1)
+        {
+            // Ignore QoS 1 packets without a sequence number
+            snprintf(log_message, sizeof(log_message), "QoS 1 packet missing 'seq' field from device %s", id);
+            log_alert(log_message);
+            return -1;
+        }
+        if (is_duplicate_seq(dev, seq))
+        {
+            // DUPLICATE PACKET: Resend ACK and ignore data to prevent duplicate processing
+            snprintf(log_message, sizeof(log_message), "Duplicate seq %ld from device %s%s",
+                         seq, id, ack ? " - resending ACK" : "");
+            log_alert(log_message);
+            if (ack)
+            {
+                send_ack(sockfd, client_addr, addrlen, id, seq, 0);
+                dev->link.ack_resends++;
+            }
+
+            // The client retransmits after its ACK wait expires, so the
+            // interval since the first copy tracks its RTT + timeout
+            if (seq == dev->last_seq)
+            {
+                uint32_t interval = (uint32_t)(monotonic_ms() - dev->last_seq_rx_ms);
+                if (dev->link.retx_ms == 0)
+                    dev->link.retx_ms = interval;
+                else
+                    dev->link.retx_ms += (uint32_t)(((int64_t)interval - dev->link.retx_ms) >> LINK_RTT_EWMA_SHIFT);
+            }
+            dev->link.duplicates++;
+            return 0; // Skip data processing for duplicates
+        }
+    }
+    // --- END QoS CHECK ---
+
+    // Store reading (only if not a duplicate). This updates dev->last_seen.
+    dev->temperature = temp;
+    dev->humidity = hum;
+    strncpy(dev->dateObserved, dateObserved, sizeof(dev->dateObserved) - 1);
+    dev->dateObserved[sizeof(dev->dateObserved) - 1] = '\0';
+    dev->last_seen = time(NULL); // CRITICAL: Updates the timestamp used by the monitor thread
+    history_append(dev, dev->last_seen, temp, hum);
+    dev->link.readings++;
+
+    if (qos == 1)
+    {
+        gap_track(dev, seq, dev->last_seen);
+        seq_seen(dev, seq);
+
+        dev->has_seq = 1;
+        dev->last_seq = seq;
+        dev->last_seq_rx_ms = monotonic_ms();
+        // Send ACK for successful receipt and processing
+        if (ack)
+            send_ack(sockfd, client_addr, addrlen, id, seq, 0);
     }
 
-    // Configure server address structure
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY; // Listen on all interfaces
-    server_addr.sin_port = htons(PORT);       // Convert port to network byte order
+    // Print received reading (Req 2d)
+    printf("Received from %s -> id=%s temp=%.2f hum=%.2f qos=%d seq=%ld\n",
+           peer, id, temp, hum, qos, seq);
 
-    // Bind server socket to the address and port (Req 2a)
-    if (bind(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    // --- ALERTING: Range Validation (the tenant's ranges) ---
+    if (temp < cfg->temp_min || temp > cfg->temp_max)
     {
-        perror("Bind failed");
-        close(sockfd);
-        exit(EXIT_FAILURE);
+        snprintf(log_message, sizeof(log_message), "Temperature %.2f outside of range [%.1f,%.1f]", temp, cfg->temp_min, cfg->temp_max);
+        log_alert_dual(dev, "TEMPERATURE_OUT_OF_RANGE", log_message);
+    }
+    if (hum < cfg->hum_min || hum > cfg->hum_max)
+    {
+        snprintf(log_message, sizeof(log_message), "Humidity %.2f outside of range [%.1f,%.1f]", hum, cfg->hum_min, cfg->hum_max);
+        log_alert_dual(dev, "HUMIDITY_OUT_OF_RANGE", log_message);
     }
 
-    printf("Alert UDP server running on port %d...\n", PORT);
+    // --- ALERTING: Differential Calculation (Req 2e), within the tenant ---
+    for (int i = 0; i < t->device_count; ++i)
+    {
+        device_t *other = &devices[t->device_idx[i]];
+        if (other == dev)
+            continue; // Skip comparing device to itself
 
-    // --- MQTT Initialization ---
-    MQTTClient_create(&client, MQTT_ADDRESS, MQTT_CLIENT_ID, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+        // Calculate absolute difference using fabs() from <math.h>
+        double temp_diff = fabs(dev->temperature - other->temperature);
+        double hum_diff = fabs(dev->humidity - other->humidity);
 
-    MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
-    MQTTClient_SSLOptions ssl_opts = MQTTClient_SSLOptions_initializer;
-    // NOTE: For HiveMQ/public brokers, often trustStore is not needed if running on a modern OS with root certificates.
-    // However, including the option is necessary for secure connection setup.
-    ssl_opts.enableServerCertAuth = 1; 
-    // ssl_opts.trustStore = "./cert.pem"; // Commented out, but required if cert file is used.
+        // Check if either differential exceeds its threshold
+        if (temp_diff >= cfg->temp_diff || hum_diff >= cfg->hum_diff)
+        {
+            snprintf(log_message, sizeof(log_message), "Compared with %s, temperature differs by %+0.2f°C and humidity by %+0.2f%% (thresholds: %+0.2f°C / %+0.2f%%, respectively).",
+                         other->id, temp_diff, hum_diff, cfg->temp_diff, cfg->hum_diff);
+            log_alert_dual(dev, "DIFFERENTIAL_ALERT", log_message); // Log and Publish
+        }
+    }
+    return 1;
+}
 
-    conn_opts.keepAliveInterval = 20;
-    conn_opts.cleansession = 1;
-    conn_opts.username = MQTT_USERNAME;
-    conn_opts.password = MQTT_PASSWORD;
-    conn_opts.ssl = &ssl_opts;
+// Sequence number of a reading, or -1 if absent
+static long parse_seq(const cJSON *jseq)
+{
+    if (cJSON_IsNumber(jseq) && cJSON_GetNumberValue(jseq) >= 0)
+        return (long)cJSON_GetNumberValue(jseq);
+    return -1;
+}
 
-    int rc;
-    if ((rc = MQTTClient_connect(client, &conn_opts)) != MQTTCLIENT_SUCCESS)
+// Handles a WeatherObservedBatch datagram (backlog drain): every reading in
+// "readings" goes through process_reading(), then one ACK naming the first
+// seq and the count confirms the batch, duplicates included.
+static void handle_batch(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *peer,
+                         tenant_t *t, const char *id, cJSON *root)
+{
+    cJSON *jqos = cJSON_GetObjectItemCaseSensitive(root, "qos");
+    cJSON *jreadings = cJSON_GetObjectItemCaseSensitive(root, "readings");
+    int qos = cJSON_IsNumber(jqos) ? jqos->valueint : 0;
+    int count = cJSON_GetArraySize(jreadings);
+    char log_message[512];
+
+    if (count == 0)
+        return;
+
+    device_t *dev = add_or_get_device(t, id, client_addr);
+    if (!dev)
     {
-        printf("Failed to connect to MQTT, return code %d\n", rc);
-        // Do not exit, continue to serve UDP telemetry
+        snprintf(log_message, sizeof(log_message), "Device list of tenant %s full, cannot record device %s", t->cfg->name, id);
+        log_alert(log_message);
+        return;
     }
-    else
+    dev->link.packets++;
+    dev->link.batches++;
+
+    long first_seq = parse_seq(cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(jreadings, 0), "seq"));
+    if (qos == 1)
+        seq_restart_check(dev, parse_boot(root), first_seq);
+
+    // Replay over budget: NACK with a reserved slot instead of processing.
+    // A retransmitted batch (first seq already seen) is just ACKed again.
+    // The ingest quota taken for the batch is given back: the client sends
+    // it again after retryAfter and is charged then.
+    if (server_cfg.replay_admission && qos == 1 && first_seq >= 0 && !is_duplicate_seq(dev, first_seq))
     {
-        printf("Connected to MQTT broker at %s\n", MQTT_ADDRESS);
-        // Start the thread to keep the MQTT connection alive
-        if (pthread_create(&mqtt_thread, NULL, mqtt_thread_func, NULL) != 0)
+        uint32_t retry_after = replay_sched_admit(&t->replay, &dev->replay_slot_us, monotonic_ms(), (uint32_t)count);
+        if (retry_after)
         {
-            perror("Failed to create MQTT thread");
+            tenant_bucket_refund(&t->ingest, (uint32_t)count);
+            t->readings -= (uint32_t)count;
+            dev->link.deferred++;
+            send_nack(sockfd, client_addr, addrlen, id, first_seq, retry_after);
+            return;
         }
-        else
+    }
+    cJSON *item;
+    cJSON_ArrayForEach(item, jreadings)
+    {
+        cJSON *jtemp = cJSON_GetObjectItemCaseSensitive(item, "temperature");
+        cJSON *jhum = cJSON_GetObjectItemCaseSensitive(item, "relativeHumidity");
+        cJSON *jdate = cJSON_GetObjectItemCaseSensitive(item, "dateObserved");
+
+        // A malformed reading cannot become valid on retry: skip it, ACK the rest
+        if (!cJSON_IsNumber(jtemp) || !cJSON_IsNumber(jhum))
         {
-            mqtt_thread_created = 1;
+            snprintf(log_message, sizeof(log_message), "Missing mandatory fields in batch reading from %s", peer);
+            log_alert(log_message);
+            continue;
         }
+        process_reading(sockfd, client_addr, addrlen, peer, dev, jtemp->valuedouble, jhum->valuedouble,
+                        cJSON_IsString(jdate) ? jdate->valuestring : "", qos,
+                        parse_seq(cJSON_GetObjectItemCaseSensitive(item, "seq")), 0);
     }
-    
-    // --- Device Monitoring Initialization ---
-    if (pthread_create(&monitor_thread, NULL, monitor_device_status, NULL) != 0)
+
+    if (qos == 1 && first_seq >= 0)
+        send_ack(sockfd, client_addr, addrlen, id, first_seq, count);
+}
+
+// Numeric member of a summary statistic object ("temperature": {"min", ...})
+static int summary_stat(const cJSON *jstat, const char *name, double *value)
+{
+    const cJSON *j = cJSON_GetObjectItemCaseSensitive(jstat, name);
+    if (!cJSON_IsNumber(j))
+        return -1;
+    *value = j->valuedouble;
+    return 0;
+}
+
+// Handles a WeatherObservedSummary datagram: a device whose backlog filled up
+// folded the readings seq..lastSeq into min/max/mean/count. The range counts
+// as delivered (its gaps are filled), the mean goes into the history at
+// arrival time like any reading, and min/max are range-checked. No
+// differential alerts: the values are not current. One ACK names seq.
+static void handle_summary(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, const char *peer,
+                           tenant_t *t, const char *id, cJSON *root)
+{
+    cJSON *jtemp = cJSON_GetObjectItemCaseSensitive(root, "temperature");
+    cJSON *jhum = cJSON_GetObjectItemCaseSensitive(root, "relativeHumidity");
+    cJSON *jcount = cJSON_GetObjectItemCaseSensitive(root, "count");
+    long first_seq = parse_seq(cJSON_GetObjectItemCaseSensitive(root, "seq"));
+    long last_seq = parse_seq(cJSON_GetObjectItemCaseSensitive(root, "lastSeq"));
+    double t_min, t_max, t_mean, h_min, h_max, h_mean;
+    char log_message[512];
+
+    if (first_seq < 0 || last_seq < first_seq || !cJSON_IsNumber(jcount) || jcount->valuedouble < 1 ||
+        summary_stat(jtemp, "min", &t_min) || summary_stat(jtemp, "max", &t_max) || summary_stat(jtemp, "mean", &t_mean) ||
+        summary_stat(jhum, "min", &h_min) || summary_stat(jhum, "max", &h_max) || summary_stat(jhum, "mean", &h_mean))
     {
-        perror("Failed to create device monitor thread");
+        snprintf(log_message, sizeof(log_message), "Malformed summary from %s", peer);
+        log_alert(log_message);
+        return;
     }
-    else
+
+    device_t *dev = add_or_get_device(t, id, client_addr);
+    if (!dev)
     {
-        monitor_thread_created = 1;
+        snprintf(log_message, sizeof(log_message), "Device list of tenant %s full, cannot record device %s", t->cfg->name, id);
+        log_alert(log_message);
+        return;
     }
+    dev->link.packets++;
+    seq_restart_check(dev, parse_boot(root), first_seq);
 
+    // Retransmission (the ACK was lost): ACK again, do not count it twice
+    if (first_seq == dev->summary_seq)
+    {
+        send_ack(sockfd, client_addr, addrlen, id, first_seq, 0);
+        dev->link.duplicates++;
+        dev->link.ack_resends++;
+        return;
+    }
 
-    // Main server loop (Req 2c)
-    while (1)
+    uint32_t count = (uint32_t)jcount->valuedouble;
+    time_t now = time(NULL);
+    dev->summary_seq = first_seq;
+    dev->link.summaries++;
+    dev->link.summarized += count;
+    dev->last_seen = now;
+    history_append(dev, now, t_mean, h_mean);
+
+    pthread_mutex_lock(&gap_lock);
+    if (dev->max_seq >= 0 && first_seq > dev->max_seq + 1)
     {
-        socklen_t len = sizeof(client_addr);
+        dev->link.missing += (uint32_t)(first_seq - dev->max_seq - 1);
+        gapset_open(&dev->gaps, dev->max_seq + 1, first_seq - 1, now, gap_lost, dev);
+    }
+    else if (first_seq <= dev->max_seq)
+    {
+        dev->link.replayed += count;
+        dev->link.recovered += (uint32_t)gapset_fill_range(&dev->gaps, first_seq, last_seq, NULL, gap_lost, dev);
+    }
+    dev->link.pending = (uint32_t)gapset_pending(&dev->gaps);
+    pthread_mutex_unlock(&gap_lock);
+    for (long s = last_seq - first_seq >= DEDUP_WINDOW_MAX ? last_seq - DEDUP_WINDOW_MAX + 1 : first_seq; s <= last_seq; ++s)
+        seq_seen(dev, s);
+    dev->has_seq = 1;
 
-        // Receive data from any client. Blocks until a packet is received.
-        ssize_t n = recvfrom(sockfd, buffer, BUFFER_SIZE - 1, 0,
-                             (struct sockaddr *)&client_addr, &len);
+    send_ack(sockfd, client_addr, addrlen, id, first_seq, 0);
 
-        if (n < 0)
-        {
-            if (errno == EINTR)
-                continue; // Handle interrupted system calls
-            perror("Error receiving data");
-            continue;
-        }
+    printf("Received from %s -> id=%s summary of %u readings seq=%ld..%ld temp=%.2f..%.2f hum=%.2f..%.2f\n",
+           peer, id, count, first_seq, last_seq, t_min, t_max, h_min, h_max);
 
-        buffer[n] = '\0'; // Null-terminate the received data
+    if (t_min < t->cfg->temp_min || t_max > t->cfg->temp_max)
+    {
+        snprintf(log_message, sizeof(log_message), "Temperature %.2f..%.2f (summary of seq %ld..%ld) outside of range [%.1f,%.1f]",
+                 t_min, t_max, first_seq, last_seq, t->cfg->temp_min, t->cfg->temp_max);
+        log_alert_dual(dev, "TEMPERATURE_OUT_OF_RANGE", log_message);
+    }
+    if (h_min < t->cfg->hum_min || h_max > t->cfg->hum_max)
+    {
+        snprintf(log_message, sizeof(log_message), "Humidity %.2f..%.2f (summary of seq %ld..%ld) outside of range [%.1f,%.1f]",
+                 h_min, h_max, first_seq, last_seq, t->cfg->hum_min, t->cfg->hum_max);
+        log_alert_dual(dev, "HUMIDITY_OUT_OF_RANGE", log_message);
+    }
+}
 
-        // Convert client's IP address to a readable string
-        if (inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip_str, INET_ADDRSTRLEN) == NULL)
-        {
-            strcpy(client_ip_str, "UNKNOWN_IP");
-        }
+// Handles a heartbeat datagram: liveness and backlog depth only. No JSON,
+// no ACK, no alerts or storage. Devices are registered by their readings;
+// a heartbeat from an unknown handle (e.g. after a server restart) is only
+// counted.
+static void handle_heartbeat(int tenant, struct sockaddr_in *client_addr, uint32_t handle, uint32_t backlog)
+{
+    device_t *dev = find_device_by_handle(tenant, handle, client_addr);
+    if (!dev)
+    {
+        unknown_heartbeats++;
+        return;
+    }
+    update_device_addr(dev, client_addr);
+    dev->last_seen = time(NULL);
+    dev->link.heartbeats++;
+    dev->link.backlog = backlog;
+}
 
-        // Parse incoming JSON payload (Req 2g: Smartdata model)
-        cJSON *root = cJSON_Parse(buffer);
-        if (!root)
-        {
-            snprintf(log_message, sizeof(log_message), "Received invalid JSON from %s:%d -> %s",
-                     client_ip_str, ntohs(client_addr.sin_port), buffer);
-            log_alert(log_message);
-            cJSON_Delete(root);
+// The compiled-in configuration: the values above, one tenant for every device
+static void server_config_defaults(server_config_t *c)
+{
+    tenant_config_t *t = &c->tenant_defaults;
+
+    memset(c, 0, sizeof(*c));
+    c->port = PORT;
+    c->metrics_port = METRICS_PORT;
+    c->max_devices = MAX_DEVICES;
+    strcpy(c->alert_log, ALERT_LOGFILE);
+    strcpy(c->mqtt_address, MQTT_ADDRESS);
+    strcpy(c->mqtt_tls, MQTT_TLS);
+    strcpy(c->mqtt_client_id, MQTT_CLIENT_ID);
+    strcpy(c->mqtt_username, MQTT_USERNAME);
+    strcpy(c->mqtt_password, MQTT_PASSWORD);
+    c->buffer_size = BUFFER_SIZE;
+    c->ingest_batch = INGEST_BATCH;
+    c->socket_rcvbuf = SOCKET_RCVBUF;
+    c->mqtt_publish_timeout_ms = MQTT_PUBLISH_TIMEOUT_MS;
+    c->monitor_interval_sec = MONITOR_INTERVAL_SEC;
+    c->dedup_window = DEDUP_WINDOW;
+    c->gap_grace_sec = GAP_GRACE_SEC;
+    c->gap_alerts = GAP_ALERTS_ENABLED;
+    c->replay_admission = REPLAY_ADMISSION_ENABLED;
+    c->replay_burst_ms = REPLAY_BURST_MS;
+    c->compaction_interval_sec = COMPACTION_INTERVAL_SEC;
+    c->compaction_io_bytes_per_sec = COMPACTION_IO_BYTES_PER_SEC;
+
+    strcpy(t->name, TENANT_DEFAULT_NAME);
+    strcpy(t->topic_prefix, TENANT_TOPIC_PREFIX);
+    strcpy(t->data_dir, HISTORY_DATA_DIR);
+    t->temp_min = TEMP_MIN;
+    t->temp_max = TEMP_MAX;
+    t->hum_min = HUM_MIN;
+    t->hum_max = HUM_MAX;
+    t->temp_diff = TEMP_DIFF_THRESHOLD;
+    t->hum_diff = HUM_DIFF_THRESHOLD;
+    t->inactivity_timeout_sec = INACTIVITY_TIMEOUT_SEC;
+    t->max_devices = 0; // An equal share of max_devices (config_share_devices)
+    t->burst_ms = TENANT_INGEST_BURST_MS;
+    t->replay_readings_per_sec = REPLAY_READINGS_PER_SEC;
+}
+
+// Builds the configuration: defaults, the file, the COMCS_MQTT_* variables,
+// then the -s overrides in order. Used at startup and on SIGHUP.
+static int load_config(server_config_t *c, char *err, size_t errlen)
+{
+    static const char *env_keys[][2] = {{"COMCS_MQTT_ADDRESS", "mqtt_address"},
+                                        {"COMCS_MQTT_TLS", "mqtt_tls"},
+                                        {"COMCS_MQTT_TRUSTSTORE", "mqtt_truststore"}};
+    char assignment[512];
+
+    server_config_defaults(c);
+    if (config_path && config_load(config_path, c, err, errlen) < 0)
+        return -1;
+    config_finish(c);
+
+    for (size_t i = 0; i < sizeof(env_keys) / sizeof(env_keys[0]); ++i)
+    {
+        const char *value = getenv(env_keys[i][0]);
+        if (!value)
             continue;
-        }
+        snprintf(assignment, sizeof(assignment), "%s=%s", env_keys[i][1], value);
+        if (config_override(c, assignment, err, errlen) < 0)
+            return -1;
+    }
+    for (int i = 0; i < config_override_count; ++i)
+    {
+        if (config_override(c, config_overrides[i], err, errlen) < 0)
+            return -1;
+    }
+    config_share_devices(c);
+    return config_check(c, err, errlen);
+}
 
-        // Extract key fields (Req 2g)
-        cJSON *jid = cJSON_GetObjectItemCaseSensitive(root, "id");
-        cJSON *jtemp = cJSON_GetObjectItemCaseSensitive(root, "temperature");
-        cJSON *jhum = cJSON_GetObjectItemCaseSensitive(root, "relativeHumidity");
-        cJSON *jdate = cJSON_GetObjectItemCaseSensitive(root, "dateObserved");
-        cJSON *jseq = cJSON_GetObjectItemCaseSensitive(root, "seq");
-        cJSON *jqos = cJSON_GetObjectItemCaseSensitive(root, "qos");
+static int tenant_init(tenant_t *t, tenant_config_t *cfg)
+{
+    uint32_t slots = cfg->max_devices < server_cfg.max_devices ? cfg->max_devices : server_cfg.max_devices;
+
+    memset(t, 0, sizeof(*t));
+    t->cfg = cfg;
+    snprintf(t->alert_topic, sizeof(t->alert_topic), "%salerts", cfg->topic_prefix);
+    t->device_idx = calloc(slots, sizeof(*t->device_idx));
+    if (!t->device_idx)
+        return -1;
+    tenant_bucket_init(&t->ingest, cfg->readings_per_sec, cfg->burst_ms);
+    tenant_bucket_init(&t->alerts, cfg->alerts_per_sec, cfg->burst_ms);
+    replay_sched_init(&t->replay, cfg->replay_readings_per_sec, server_cfg.replay_burst_ms);
+    return 0;
+}
 
-        // Basic validation for mandatory fields (Req 2d)
-        if (!cJSON_IsString(jid) || !cJSON_IsNumber(jtemp) || !cJSON_IsNumber(jhum))
-        {
-            snprintf(log_message, sizeof(log_message), "Missing mandatory fields in JSON from %s:%d -> %s",
-                     client_ip_str, ntohs(client_addr.sin_port), buffer);
-            log_alert(log_message);
-            cJSON_Delete(root);
+// Creates a directory and its missing parents (data/g05)
+static int make_dirs(const char *path)
+{
+    char buf[sizeof(((tenant_config_t *)0)->data_dir)];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char *p = buf + 1; *p; ++p)
+    {
+        if (*p != '/')
             continue;
-        }
+        *p = '\0';
+        if (mkdir(buf, 0755) < 0 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    return mkdir(buf, 0755) < 0 && errno != EEXIST ? -1 : 0;
+}
+
+// Binds a UDP socket on all interfaces (Req 2a)
+static int open_udp_socket(int port)
+{
+    struct sockaddr_in server_addr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        perror("Failed to create socket");
+        return -1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY; // Listen on all interfaces
+    server_addr.sin_port = htons(port);       // Convert port to network byte order
+    if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-        // Safely extract values
-        const char *id = jid->valuestring;
-        double temp = jtemp->valuedouble;
-        double hum = jhum->valuedouble;
-        const char *dateObserved = cJSON_IsString(jdate) ? jdate->valuestring : "";
-        long seq = -1;
-        int qos = 0;
+// Applies socket_rcvbuf to the UDP sockets (0 leaves them as they are).
+// The kernel doubles the value and caps it at net.core.rmem_max.
+static void set_socket_buffers(const struct pollfd *fds, const int *fd_tenant, int nfds)
+{
+    int size = (int)server_cfg.socket_rcvbuf;
+    int actual = 0;
+    socklen_t len = sizeof(actual);
+
+    for (int i = 0; size && i < nfds; ++i)
+    {
+        if (fd_tenant[i] < -1)
+            continue; // Not a UDP socket
+        if (setsockopt(fds[i].fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+            perror("Failed to set the socket receive buffer");
+        else if (i == 0 && getsockopt(fds[i].fd, SOL_SOCKET, SO_RCVBUF, &actual, &len) == 0)
+            printf("UDP receive buffers: %d bytes (socket_rcvbuf = %d)\n", actual, size);
+    }
+}
+
+// SIGHUP: reads the configuration again and applies the reloadable keys in
+// place. Devices, counters and the startup-only settings are kept, and an
+// invalid configuration leaves the running one as it was.
+static void reload_config(const struct pollfd *fds, const int *fd_tenant, int nfds, char **buffer)
+{
+    static server_config_t next; // Large: keep it off the stack
+    char err[512], changed[512], message[1280];
+
+    if (load_config(&next, err, sizeof(err)) < 0)
+    {
+        config_reload_failures++;
+        snprintf(message, sizeof(message), "Configuration reload failed, keeping the running configuration: %s", err);
+        log_alert(message);
+        return;
+    }
+
+    uint32_t buffer_size = server_cfg.buffer_size;
+    config_apply_reloadable(&server_cfg, &next);
+
+    if (server_cfg.buffer_size != buffer_size)
+    {
+        char *b = realloc(*buffer, server_cfg.buffer_size);
+        if (b)
+            *buffer = b;
+        else
+            server_cfg.buffer_size = buffer_size;
+    }
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        tenant_t *t = &tenants[i];
+        tenant_bucket_set_rate(&t->ingest, t->cfg->readings_per_sec, t->cfg->burst_ms);
+        replay_sched_set_rate(&t->replay, t->cfg->replay_readings_per_sec, server_cfg.replay_burst_ms);
+        pthread_mutex_lock(&alert_quota_lock);
+        tenant_bucket_set_rate(&t->alerts, t->cfg->alerts_per_sec, t->cfg->burst_ms);
+        pthread_mutex_unlock(&alert_quota_lock);
+    }
+    set_socket_buffers(fds, fd_tenant, nfds);
+    config_reloads++;
+
+    int n = config_startup_changes(&server_cfg, &next, changed, sizeof(changed));
+    snprintf(message, sizeof(message), "Configuration reloaded from %s%s%s", config_path ? config_path : "the defaults",
+             n ? "; restart to apply: " : "", n ? changed : "");
+    log_alert(message);
+}
+
+// Tenant of a datagram: the one owning the socket it arrived on, or on the
+// shared port the one whose device id prefix and network match best
+static tenant_t *tenant_for(int sock_tenant, const char *id, const struct sockaddr_in *addr)
+{
+    tenant_t *best = NULL;
+    int best_len = -1;
+    uint32_t a = ntohl(addr->sin_addr.s_addr);
 
-        if (cJSON_IsNumber(jseq))
+    if (sock_tenant >= 0)
+        return &tenants[sock_tenant];
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        int len = tenant_match(tenants[i].cfg, id, a);
+        if (len > best_len)
         {
-            double seq_val = cJSON_GetNumberValue(jseq);
-            if (seq_val >= 0)
-            {
-                seq = (long)seq_val;
-            }
+            best = &tenants[i];
+            best_len = len;
         }
-        if (cJSON_IsNumber(jqos))
-            qos = jqos->valueint;
+    }
+    return best;
+}
+
+// Ingest quota of the tenant, checked before any per-device work. A
+// datagram over the quota is not processed: QoS 1 readings, batches and
+// summaries are NACKed with a retryAfter (the clients keep them in their
+// backlog, or pause the drain), QoS 0 readings are dropped. A batch takes
+// one unit per reading, a summary one. Returns 1 if it may be processed.
+static int ingest_admit(int sockfd, struct sockaddr_in *client_addr, socklen_t addrlen, tenant_t *t,
+                        const char *id, cJSON *root, cJSON *jreadings, int summary)
+{
+    uint32_t count = jreadings ? (uint32_t)cJSON_GetArraySize(jreadings) : 1;
+    uint32_t retry_after = tenant_bucket_take(&t->ingest, monotonic_us(), count);
+    if (!retry_after)
+    {
+        t->readings += count;
+        return 1;
+    }
+
+    t->throttled++;
+    cJSON *jqos = cJSON_GetObjectItemCaseSensitive(root, "qos");
+    cJSON *first = jreadings ? cJSON_GetArrayItem(jreadings, 0) : root;
+    long seq = parse_seq(cJSON_GetObjectItemCaseSensitive(first, "seq"));
+    if (seq >= 0 && (summary || (cJSON_IsNumber(jqos) && jqos->valueint == 1)))
+        send_nack(sockfd, client_addr, addrlen, id, seq, retry_after);
+    return 0;
+}
+
+// One datagram from the socket of tenant sock_tenant (-1 = the shared port)
+static void handle_datagram(int sockfd, int sock_tenant, char *buffer, ssize_t n,
+                            struct sockaddr_in *client_addr, socklen_t len)
+{
+    char client_ip_str[INET_ADDRSTRLEN];
+    char peer[INET_ADDRSTRLEN + 8]; // "ip:port"
+    char log_message[BUFFER_SIZE + 256];
+
+    // Heartbeats are binary and skip everything below
+    uint32_t hb_handle, hb_backlog;
+    if (heartbeat_parse(buffer, (size_t)n, &hb_handle, &hb_backlog) == 0)
+    {
+        handle_heartbeat(sock_tenant, client_addr, hb_handle, hb_backlog);
+        return;
+    }
 
-        // Add or retrieve device state (Req 2c)
-        device_t *dev = add_or_get_device(id, &client_addr);
-        if (!dev)
+    buffer[n] = '\0'; // Null-terminate the received data
+
+    // Convert client's IP address to a readable string
+    if (inet_ntop(AF_INET, &(client_addr->sin_addr), client_ip_str, INET_ADDRSTRLEN) == NULL)
+    {
+        strcpy(client_ip_str, "UNKNOWN_IP");
+    }
+
+    // Parse incoming JSON payload (Req 2g: Smartdata model)
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root)
+    {
+        snprintf(log_message, sizeof(log_message), "Received invalid JSON from %s:%d -> %s",
+                 client_ip_str, ntohs(client_addr->sin_port), buffer);
+        log_alert(log_message);
+        cJSON_Delete(root);
+        return;
+    }
+
+    snprintf(peer, sizeof(peer), "%s:%d", client_ip_str, ntohs(client_addr->sin_port));
+
+    // Extract key fields (Req 2g)
+    cJSON *jid = cJSON_GetObjectItemCaseSensitive(root, "id");
+    cJSON *jreadings = cJSON_GetObjectItemCaseSensitive(root, "readings");
+    cJSON *jtype = cJSON_GetObjectItemCaseSensitive(root, "type");
+    int is_batch = cJSON_IsString(jid) && cJSON_IsArray(jreadings);
+    int is_summary = cJSON_IsString(jid) && cJSON_IsString(jtype) &&
+                     strcmp(jtype->valuestring, "WeatherObservedSummary") == 0;
+
+    // Tenant and its ingest quota
+    tenant_t *t = NULL;
+    if (cJSON_IsString(jid))
+    {
+        t = tenant_for(sock_tenant, jid->valuestring, client_addr);
+        if (!t)
         {
-            snprintf(log_message, sizeof(log_message), "Device list full, cannot record device %s", id);
+            unmatched_datagrams++;
+            snprintf(log_message, sizeof(log_message), "No tenant for device %s from %s", jid->valuestring, peer);
             log_alert(log_message);
             cJSON_Delete(root);
-            continue;
+            return;
         }
+        if (!ingest_admit(sockfd, client_addr, len, t, jid->valuestring, root, is_batch ? jreadings : NULL,
+                          is_summary))
+        {
+            cJSON_Delete(root);
+            return;
+        }
+    }
+
+    // Batch of stored readings: one datagram, one ACK
+    if (is_batch)
+    {
+        handle_batch(sockfd, client_addr, len, peer, t, jid->valuestring, root);
+        cJSON_Delete(root);
+        return;
+    }
+
+    // Summary of readings the device folded when its backlog was full
+    if (is_summary)
+    {
+        handle_summary(sockfd, client_addr, len, peer, t, jid->valuestring, root);
+        cJSON_Delete(root);
+        return;
+    }
+    cJSON *jtemp = cJSON_GetObjectItemCaseSensitive(root, "temperature");
+    cJSON *jhum = cJSON_GetObjectItemCaseSensitive(root, "relativeHumidity");
+    cJSON *jdate = cJSON_GetObjectItemCaseSensitive(root, "dateObserved");
+    cJSON *jseq = cJSON_GetObjectItemCaseSensitive(root, "seq");
+    cJSON *jqos = cJSON_GetObjectItemCaseSensitive(root, "qos");
+    cJSON *jhb = cJSON_GetObjectItemCaseSensitive(root, "heartbeat");
+
+    // Basic validation for mandatory fields (Req 2d)
+    if (!cJSON_IsString(jid) || !cJSON_IsNumber(jtemp) || !cJSON_IsNumber(jhum))
+    {
+        snprintf(log_message, sizeof(log_message), "Missing mandatory fields in JSON from %s:%d -> %s",
+                 client_ip_str, ntohs(client_addr->sin_port), buffer);
+        log_alert(log_message);
+        cJSON_Delete(root);
+        return;
+    }
+
+    // Safely extract values
+    const char *id = jid->valuestring;
+    double temp = jtemp->valuedouble;
+    double hum = jhum->valuedouble;
+    const char *dateObserved = cJSON_IsString(jdate) ? jdate->valuestring : "";
+    long seq = parse_seq(jseq);
+    int qos = 0;
 
-        // --- QoS CHECK & ACK LOGIC (Req 2b) ---
-        if (qos == 1)
+    if (cJSON_IsNumber(jqos))
+        qos = jqos->valueint;
+
+    // Add or retrieve device state (Req 2c)
+    device_t *dev = add_or_get_device(t, id, client_addr);
+    if (!dev)
+    {
+        snprintf(log_message, sizeof(log_message), "Device list of tenant %s full, cannot record device %s", t->cfg->name, id);
+        log_alert(log_message);
+        cJSON_Delete(root);
+        return;
+    }
+
+    dev->link.packets++;
+    if (cJSON_IsNumber(jhb) && jhb->valueint >= 0)
+        dev->heartbeat_s = jhb->valueint;
+    if (qos == 1 && seq >= 0)
+        seq_restart_check(dev, parse_boot(root), seq);
+    process_reading(sockfd, client_addr, len, peer, dev, temp, hum, dateObserved, qos, seq, 1);
+
+    cJSON_Delete(root); // Clean up JSON object
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-c FILE] [-s key=value]... [-t]\n"
+            "  -c FILE       configuration file (default: $COMCS_CONFIG, else the compiled-in values)\n"
+            "  -s key=value  override a key after the file; NAME.key=value for tenant NAME\n"
+            "  -t            check the configuration, print it and exit\n"
+            "SIGHUP reloads the file and applies the reloadable keys (see config.h).\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in client_addr;
+    char *buffer;
+    struct pollfd fds[TENANT_MAX + 2]; // The shared port, the tenants' own, then SIGHUP
+    int fd_tenant[TENANT_MAX + 2];     // Tenant owning each socket (-1 = shared, -2 = signals)
+    int nfds = 0;
+    pthread_t mqtt_thread;
+    pthread_t monitor_thread; // NEW: Monitoring thread ID
+    pthread_t compaction_thread;
+    pthread_t metrics_thread;
+    int mqtt_thread_created = 0;
+    int monitor_thread_created = 0;
+    int compaction_thread_created = 0;
+    int metrics_thread_created = 0;
+    int check_only = 0;
+    int opt;
+
+    // --- Configuration ---
+    config_path = getenv("COMCS_CONFIG");
+    while ((opt = getopt(argc, argv, "c:s:th")) != -1)
+    {
+        switch (opt)
         {
-            if (seq == -1)
-            {
-                // Ignore QoS 1 packets without a sequence number
-                snprintf(log_message, sizeof(log_message), "QoS 1 packet missing 'seq' field from device %s", id);
-                log_alert(log_message);
-                cJSON_Delete(root);
-                continue;
-            }
-            if (dev->has_seq && seq == dev->last_seq)
+        case 'c':
+            config_path = optarg;
+            break;
+        case 's':
+            if (config_override_count == (int)(sizeof(config_overrides) / sizeof(config_overrides[0])))
             {
-                // DUPLICATE PACKET: Resend ACK and ignore data to prevent duplicate processing
-                snprintf(log_message, sizeof(log_message), "Duplicate seq %ld from device %s - resending ACK",
-                             seq, id);
-                log_alert(log_message);
-                send_ack(sockfd, &client_addr, len, id, seq);
-                cJSON_Delete(root);
-                continue; // Skip data processing for duplicates
+                fprintf(stderr, "Too many -s overrides\n");
+                exit(EXIT_FAILURE);
             }
+            config_overrides[config_override_count++] = optarg;
+            break;
+        case 't':
+            check_only = 1;
+            break;
+        default:
+            usage(argv[0]);
+            exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
         }
-        // --- END QoS CHECK ---
+    }
+    if (optind < argc)
+    {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    char err[512];
+    if (load_config(&server_cfg, err, sizeof(err)) < 0)
+    {
+        fprintf(stderr, "Invalid configuration: %s\n", err);
+        exit(EXIT_FAILURE);
+    }
+    if (check_only)
+    {
+        config_write(stdout, &server_cfg);
+        fprintf(stderr, "Configuration OK\n");
+        return 0;
+    }
+
+    // SIGHUP is read from a signalfd by the ingest loop; the threads
+    // created below inherit the blocked mask
+    sigset_t sigmask;
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &sigmask, NULL);
 
-        // Store reading (only if not a duplicate). This updates dev->last_seen.
-        dev->temperature = temp;
-        dev->humidity = hum;
-        strncpy(dev->dateObserved, dateObserved, sizeof(dev->dateObserved) - 1);
-        dev->dateObserved[sizeof(dev->dateObserved) - 1] = '\0';
-        dev->last_seen = time(NULL); // CRITICAL: Updates the timestamp used by the monitor thread
+    devices = calloc(server_cfg.max_devices, sizeof(*devices));
+    buffer = malloc(server_cfg.buffer_size);
+    if (!devices || !buffer)
+    {
+        perror("Failed to allocate the device table");
+        exit(EXIT_FAILURE);
+    }
 
-        if (qos == 1)
+    // --- Tenants ---
+    tenant_count = server_cfg.tenant_count;
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        if (tenant_init(&tenants[i], &server_cfg.tenants[i]) < 0)
         {
-            dev->has_seq = 1;
-            dev->last_seq = seq;
-            // Send ACK for successful receipt and processing
-            send_ack(sockfd, &client_addr, len, id, seq);
+            perror("Failed to allocate tenant");
+            exit(EXIT_FAILURE);
         }
+    }
+
+    // Open the alert log file for appending
+    alert_log = fopen(server_cfg.alert_log, "a");
+    if (!alert_log)
+    {
+        perror("Failed to open alert log file");
+    }
 
-        // Print received reading (Req 2d)
-        printf("Received from %s:%d -> id=%s temp=%.2f hum=%.2f qos=%d seq=%ld\n",
-               client_ip_str, ntohs(client_addr.sin_port),
-               id, temp, hum, qos, seq);
+    // Make sure the history segment directories exist
+    for (int i = 0; HISTORY_FLUSH_ENABLED && i < tenant_count; ++i)
+    {
+        if (make_dirs(tenants[i].cfg->data_dir) < 0)
+            perror("Failed to create history data directory");
+    }
 
-        // --- ALERTING: Range Validation ---
-        if (temp < TEMP_MIN || temp > TEMP_MAX)
+    // UDP sockets: the shared port, and the tenants that have their own
+    fds[nfds].fd = open_udp_socket((int)server_cfg.port);
+    fd_tenant[nfds++] = -1;
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        if (tenants[i].cfg->port)
         {
-            snprintf(log_message, sizeof(log_message), "Temperature %.2f outside of range [%.1f,%.1f]", temp, TEMP_MIN, TEMP_MAX);
-            log_alert_dual(id, "TEMPERATURE_OUT_OF_RANGE", log_message);
+            fds[nfds].fd = open_udp_socket(tenants[i].cfg->port);
+            fd_tenant[nfds++] = i;
         }
-        if (hum < HUM_MIN || hum > HUM_MAX)
+    }
+    fds[nfds].fd = signalfd(-1, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+    fd_tenant[nfds++] = -2;
+    for (int i = 0; i < nfds; ++i)
+    {
+        if (fds[i].fd < 0)
         {
-            snprintf(log_message, sizeof(log_message), "Humidity %.2f outside of range [%.1f,%.1f]", hum, HUM_MIN, HUM_MAX);
-            log_alert_dual(id, "HUMIDITY_OUT_OF_RANGE", log_message);
+            if (fd_tenant[i] == -2)
+                perror("Failed to create signalfd");
+            exit(EXIT_FAILURE);
         }
+        fds[i].events = POLLIN;
+    }
+    set_socket_buffers(fds, fd_tenant, nfds);
 
-        // --- ALERTING: Differential Calculation (Req 2e) ---
-        for (int i = 0; i < device_count; ++i)
-        {
-            device_t *other = &devices[i];
-            if (strcmp(other->id, dev->id) == 0)
-                continue; // Skip comparing device to itself
+    printf("Alert UDP server running on port %u...\n", server_cfg.port);
+    printf("Configuration: %s\n", config_path ? config_path : "compiled-in defaults");
+    for (int i = 0; i < tenant_count; ++i)
+    {
+        const tenant_config_t *c = tenants[i].cfg;
+        char source[96];
+        if (c->port)
+            snprintf(source, sizeof(source), "port %d", c->port);
+        else
+            snprintf(source, sizeof(source), "ids \"%s*\"", c->match);
+        printf("Tenant %s: %s, alerts on %s, up to %u devices, %u readings/s (0 = unlimited)\n", c->name,
+               source, tenants[i].alert_topic, c->max_devices, c->readings_per_sec);
+    }
+
+    // --- MQTT Initialization (address and TLS mode checked by config_check) ---
+    const char *mqtt_tls = server_cfg.mqtt_tls;
+    int tls_off = strcmp(mqtt_tls, "off") == 0;
+    MQTTClient_create(&client, server_cfg.mqtt_address, server_cfg.mqtt_client_id, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+
+    MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
+    MQTTClient_SSLOptions ssl_opts = MQTTClient_SSLOptions_initializer;
+    // NOTE: For HiveMQ/public brokers, often trustStore is not needed if running on a modern OS with root certificates.
+    // A self-signed test broker needs its certificate in mqtt_truststore, or "insecure".
+    ssl_opts.enableServerCertAuth = strcmp(mqtt_tls, "verify") == 0;
+    ssl_opts.trustStore = server_cfg.mqtt_truststore[0] ? server_cfg.mqtt_truststore : NULL;
+
+    conn_opts.keepAliveInterval = 20;
+    conn_opts.connectTimeout = MQTT_CONNECT_TIMEOUT_S;
+    conn_opts.cleansession = 1;
+    conn_opts.username = server_cfg.mqtt_username;
+    conn_opts.password = server_cfg.mqtt_password;
+    conn_opts.ssl = tls_off ? NULL : &ssl_opts;
+
+    int rc;
+    if ((rc = MQTTClient_connect(client, &conn_opts)) != MQTTCLIENT_SUCCESS)
+    {
+        printf("Failed to connect to MQTT, return code %d; retrying in the background\n", rc);
+        // Do not exit, continue to serve UDP telemetry
+    }
+    else
+    {
+        printf("Connected to MQTT broker at %s\n", server_cfg.mqtt_address);
+    }
+    // Start the thread to keep the MQTT connection alive (and reconnect it).
+    // conn_opts stays valid: main only returns after joining the thread.
+    if (pthread_create(&mqtt_thread, NULL, mqtt_thread_func, &conn_opts) != 0)
+    {
+        perror("Failed to create MQTT thread");
+    }
+    else
+    {
+        mqtt_thread_created = 1;
+    }
+    
+    // --- Device Monitoring Initialization ---
+    if (pthread_create(&monitor_thread, NULL, monitor_device_status, NULL) != 0)
+    {
+        perror("Failed to create device monitor thread");
+    }
+    else
+    {
+        monitor_thread_created = 1;
+    }
 
-            // Calculate absolute difference using fabs() from <math.h>
-            double temp_diff = fabs(dev->temperature - other->temperature);
-            double hum_diff = fabs(dev->humidity - other->humidity);
+    // --- Metrics / Admin Endpoint Initialization ---
+    if (pthread_create(&metrics_thread, NULL, metrics_thread_func, NULL) != 0)
+        perror("Failed to create metrics thread");
+    else
+        metrics_thread_created = 1;
 
-            // Check if either differential exceeds its threshold
-            if (temp_diff >= TEMP_DIFF_THRESHOLD || hum_diff >= HUM_DIFF_THRESHOLD)
+    // --- Storage Compaction Initialization ---
+    if (HISTORY_FLUSH_ENABLED)
+    {
+        if (pthread_create(&compaction_thread, NULL, compaction_thread_func, NULL) != 0)
+            perror("Failed to create compaction thread");
+        else
+            compaction_thread_created = 1;
+    }
+
+
+    // Main server loop (Req 2c). Each ready socket gets up to ingest_batch
+    // datagrams per round, so a flooded tenant port cannot keep the others
+    // waiting.
+    while (1)
+    {
+        if (poll(fds, (nfds_t)nfds, -1) < 0)
+        {
+            if (errno != EINTR) // Handle interrupted system calls
+                perror("Error polling sockets");
+            continue;
+        }
+
+        for (int i = 0; i < nfds; ++i)
+        {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+            if (fd_tenant[i] == -2)
             {
-                snprintf(log_message, sizeof(log_message), "Compared with %s, temperature differs by %+0.2f°C and humidity by %+0.2f%% (thresholds: %+0.2f°C / %+0.2f%%, respectively).",
-                             other->id, temp_diff, hum_diff, TEMP_DIFF_THRESHOLD, HUM_DIFF_THRESHOLD);
-                log_alert_dual(id, "DIFFERENTIAL_ALERT", log_message); // Log and Publish
+                struct signalfd_siginfo si;
+                while (read(fds[i].fd, &si, sizeof(si)) == sizeof(si))
+                    ;
+                reload_config(fds, fd_tenant, nfds, &buffer);
+                continue;
+            }
+            for (uint32_t k = 0; k < server_cfg.ingest_batch; ++k)
+            {
+                socklen_t len = sizeof(client_addr);
+                ssize_t n = recvfrom(fds[i].fd, buffer, server_cfg.buffer_size - 1, MSG_DONTWAIT,
+                                     (struct sockaddr *)&client_addr, &len);
+                if (n < 0)
+                {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                        perror("Error receiving data");
+                    break;
+                }
+                handle_datagram(fds[i].fd, fd_tenant[i], buffer, n, &client_addr, len);
             }
         }
-
-        cJSON_Delete(root); // Clean up JSON object
     }
 
     // --- Cleanup and Exit ---
+    if (metrics_thread_created)
+    {
+        pthread_cancel(metrics_thread);
+        pthread_join(metrics_thread, NULL);
+    }
+    if (compaction_thread_created)
+    {
+        pthread_cancel(compaction_thread);
+        pthread_join(compaction_thread, NULL);
+    }
     if (monitor_thread_created)
     {
         pthread_cancel(monitor_thread);
@@ -565,6 +2256,11 @@ int main()
 
     if (alert_log)
         fclose(alert_log);
-    close(sockfd);
+    for (int i = 0; i < nfds; ++i)
+        close(fds[i].fd);
+    for (int i = 0; i < tenant_count; ++i)
+        free(tenants[i].device_idx);
+    free(devices);
+    free(buffer);
     return 0;
 }
@@ -0,0 +1,279 @@
+// telemetry_record.c
+// Compact fixed-width telemetry record. See telemetry_record.h.
+#include <stdio.h>
+#include <string.h>
+#include "telemetry_record.h"
+
+static uint16_t crc16_ccitt(const uint8_t *p, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    while (len--)
+    {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (int k = 0; k < 8; ++k)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static int32_t to_c100(float v, int32_t lo, int32_t hi)
+{
+    float scaled = v * 100.0f;
+    int32_t r = (int32_t)(scaled + (scaled >= 0 ? 0.5f : -0.5f));
+    if (r < lo)
+        return lo;
+    if (r > hi)
+        return hi;
+    return r;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+void telemetry_record_set(telemetry_record_t *rec, uint32_t seq, uint32_t observed,
+                          float temp, float hum, uint8_t qos)
+{
+    rec->seq = seq;
+    rec->observed = observed;
+    rec->temp_c100 = (int16_t)to_c100(temp, INT16_MIN, INT16_MAX);
+    rec->hum_c100 = (uint16_t)to_c100(hum, 0, UINT16_MAX);
+    rec->qos = qos;
+    rec->heartbeat_s = 0;
+}
+
+void telemetry_record_pack(const telemetry_record_t *rec, uint8_t out[TELEMETRY_RECORD_SIZE])
+{
+    put_u32(out, rec->seq);
+    put_u32(out + 4, rec->observed);
+    put_u16(out + 8, (uint16_t)rec->temp_c100);
+    put_u16(out + 10, rec->hum_c100);
+    out[12] = rec->qos;
+    out[13] = (uint8_t)(rec->heartbeat_s / 10 > 255 ? 255 : rec->heartbeat_s / 10);
+    put_u16(out + 14, crc16_ccitt(out, 14));
+}
+
+int telemetry_record_unpack(const uint8_t in[TELEMETRY_RECORD_SIZE], telemetry_record_t *rec)
+{
+    if (get_u16(in + 14) != crc16_ccitt(in, 14))
+        return -1;
+
+    rec->seq = get_u32(in);
+    rec->observed = get_u32(in + 4);
+    rec->temp_c100 = (int16_t)get_u16(in + 8);
+    rec->hum_c100 = get_u16(in + 10);
+    rec->qos = in[12];
+    rec->heartbeat_s = (uint16_t)(in[13] * 10);
+    return 0;
+}
+
+// Fixed-point formatting: no float printf on the devices
+static int c100_to_str(int32_t v, char *buf, size_t len)
+{
+    const char *sign = v < 0 ? "-" : "";
+    if (v < 0)
+        v = -v;
+    return snprintf(buf, len, "%s%ld.%02ld", sign, (long)(v / 100), (long)(v % 100));
+}
+
+// ",\"boot\":N", or "" for boot 0
+static void boot_to_json(uint32_t boot, char *buf, size_t len)
+{
+    if (boot)
+        snprintf(buf, len, ",\"boot\":%lu", (unsigned long)boot);
+    else
+        buf[0] = '\0';
+}
+
+// Writes the measurement fields shared by single and batch payloads
+static int measurements_to_json(const telemetry_record_t *rec, char *buf, size_t len)
+{
+    char t[16], h[16];
+    c100_to_str(rec->temp_c100, t, sizeof(t));
+    c100_to_str(rec->hum_c100, h, sizeof(h));
+    return snprintf(buf, len, "\"temperature\":%s,\"relativeHumidity\":%s,\"dateObserved\":%lu",
+                    t, h, (unsigned long)rec->observed);
+}
+
+int telemetry_record_to_json(const telemetry_record_t *rec, const char *device_id, uint32_t boot,
+                             char *buf, size_t len)
+{
+    char fields[96];
+    char heartbeat[24] = "";
+    char jboot[24];
+    measurements_to_json(rec, fields, sizeof(fields));
+    boot_to_json(boot, jboot, sizeof(jboot));
+    if (rec->heartbeat_s > 0)
+        snprintf(heartbeat, sizeof(heartbeat), ",\"heartbeat\":%u", (unsigned)rec->heartbeat_s);
+
+    int n = snprintf(buf, len,
+                     "{\"id\":\"%s\",\"type\":\"WeatherObserved\",%s,\"status\":\"OPERATIONAL\","
+                     "\"qos\":%u,\"seq\":%lu%s%s}",
+                     device_id, fields, (unsigned)rec->qos, (unsigned long)rec->seq, jboot, heartbeat);
+    if (n < 0 || (size_t)n >= len)
+        return -1;
+    return n;
+}
+
+int telemetry_batch_to_json(const telemetry_record_t *recs, int n, const char *device_id, uint32_t boot,
+                            char *buf, size_t len, int *used)
+{
+    char jboot[24];
+    *used = 0;
+    if (n < 1)
+        return -1;
+
+    boot_to_json(boot, jboot, sizeof(jboot));
+    int pos = snprintf(buf, len,
+                       "{\"id\":\"%s\",\"type\":\"WeatherObservedBatch\",\"status\":\"OPERATIONAL\","
+                       "\"qos\":%u%s,\"readings\":[",
+                       device_id, (unsigned)recs[0].qos, jboot);
+    if (pos < 0 || (size_t)pos >= len)
+        return -1;
+
+    for (int i = 0; i < n; ++i)
+    {
+        char fields[96];
+        char item[128];
+        measurements_to_json(&recs[i], fields, sizeof(fields));
+        int k = snprintf(item, sizeof(item), "%s{\"seq\":%lu,%s}",
+                         i > 0 ? "," : "", (unsigned long)recs[i].seq, fields);
+
+        // Keep room for the closing "]}" and the terminator
+        if (k < 0 || (size_t)(pos + k + 3) > len)
+            break;
+        memcpy(buf + pos, item, (size_t)k);
+        pos += k;
+        (*used)++;
+    }
+    if (*used == 0)
+        return -1;
+
+    memcpy(buf + pos, "]}", 3);
+    return pos + 2;
+}
+
+void telemetry_summary_init(telemetry_summary_t *s, const telemetry_record_t *rec)
+{
+    s->first_seq = s->last_seq = rec->seq;
+    s->first_observed = s->last_observed = rec->observed;
+    s->count = 1;
+    s->qos = rec->qos;
+    s->temp_min_c100 = s->temp_max_c100 = s->temp_mean_c100 = rec->temp_c100;
+    s->hum_min_c100 = s->hum_max_c100 = s->hum_mean_c100 = rec->hum_c100;
+}
+
+void telemetry_summary_add(telemetry_summary_t *s, const telemetry_record_t *rec)
+{
+    telemetry_summary_t one;
+    telemetry_summary_init(&one, rec);
+    telemetry_summary_merge(s, &one);
+}
+
+// Count-weighted mean, rounded
+static int32_t merge_mean(int32_t a, uint32_t na, int32_t b, uint32_t nb)
+{
+    int64_t sum = (int64_t)a * na + (int64_t)b * nb;
+    int64_t n = (int64_t)na + nb;
+    return (int32_t)((sum + (sum >= 0 ? n / 2 : -n / 2)) / n);
+}
+
+void telemetry_summary_merge(telemetry_summary_t *s, const telemetry_summary_t *next)
+{
+    s->temp_mean_c100 = (int16_t)merge_mean(s->temp_mean_c100, s->count, next->temp_mean_c100, next->count);
+    s->hum_mean_c100 = (uint16_t)merge_mean(s->hum_mean_c100, s->count, next->hum_mean_c100, next->count);
+    if (next->temp_min_c100 < s->temp_min_c100)
+        s->temp_min_c100 = next->temp_min_c100;
+    if (next->temp_max_c100 > s->temp_max_c100)
+        s->temp_max_c100 = next->temp_max_c100;
+    if (next->hum_min_c100 < s->hum_min_c100)
+        s->hum_min_c100 = next->hum_min_c100;
+    if (next->hum_max_c100 > s->hum_max_c100)
+        s->hum_max_c100 = next->hum_max_c100;
+    s->last_seq = next->last_seq;
+    s->last_observed = next->last_observed;
+    s->count = s->count + next->count < s->count ? UINT32_MAX : s->count + next->count;
+}
+
+void telemetry_summary_pack(const telemetry_summary_t *s, uint8_t out[TELEMETRY_SUMMARY_SIZE])
+{
+    put_u32(out, s->first_seq);
+    put_u32(out + 4, s->last_seq);
+    put_u32(out + 8, s->first_observed);
+    out[12] = TELEMETRY_SUMMARY_KIND;
+    out[13] = s->qos;
+    put_u16(out + 14, (uint16_t)s->temp_mean_c100);
+    put_u32(out + 16, s->last_observed);
+    put_u32(out + 20, s->count);
+    put_u16(out + 24, (uint16_t)s->temp_min_c100);
+    put_u16(out + 26, (uint16_t)s->temp_max_c100);
+    put_u16(out + 28, s->hum_min_c100);
+    put_u16(out + 30, s->hum_max_c100);
+    put_u16(out + 32, s->hum_mean_c100);
+    put_u16(out + 34, crc16_ccitt(out, 34));
+}
+
+int telemetry_summary_unpack(const uint8_t *in, size_t len, telemetry_summary_t *s)
+{
+    if (len != TELEMETRY_SUMMARY_SIZE || in[12] != TELEMETRY_SUMMARY_KIND || get_u16(in + 34) != crc16_ccitt(in, 34))
+        return -1;
+
+    s->first_seq = get_u32(in);
+    s->last_seq = get_u32(in + 4);
+    s->first_observed = get_u32(in + 8);
+    s->qos = in[13];
+    s->temp_mean_c100 = (int16_t)get_u16(in + 14);
+    s->last_observed = get_u32(in + 16);
+    s->count = get_u32(in + 20);
+    s->temp_min_c100 = (int16_t)get_u16(in + 24);
+    s->temp_max_c100 = (int16_t)get_u16(in + 26);
+    s->hum_min_c100 = get_u16(in + 28);
+    s->hum_max_c100 = get_u16(in + 30);
+    s->hum_mean_c100 = get_u16(in + 32);
+    return s->count > 0 ? 0 : -1;
+}
+
+int telemetry_summary_to_json(const telemetry_summary_t *s, const char *device_id, uint32_t boot,
+                              char *buf, size_t len)
+{
+    char v[6][16];
+    char jboot[24];
+    boot_to_json(boot, jboot, sizeof(jboot));
+    c100_to_str(s->temp_min_c100, v[0], sizeof(v[0]));
+    c100_to_str(s->temp_max_c100, v[1], sizeof(v[1]));
+    c100_to_str(s->temp_mean_c100, v[2], sizeof(v[2]));
+    c100_to_str(s->hum_min_c100, v[3], sizeof(v[3]));
+    c100_to_str(s->hum_max_c100, v[4], sizeof(v[4]));
+    c100_to_str(s->hum_mean_c100, v[5], sizeof(v[5]));
+
+    int n = snprintf(buf, len,
+                     "{\"id\":\"%s\",\"type\":\"WeatherObservedSummary\",\"status\":\"OPERATIONAL\","
+                     "\"qos\":%u%s,\"seq\":%lu,\"lastSeq\":%lu,\"count\":%lu,"
+                     "\"dateObserved\":%lu,\"dateObservedEnd\":%lu,"
+                     "\"temperature\":{\"min\":%s,\"max\":%s,\"mean\":%s},"
+                     "\"relativeHumidity\":{\"min\":%s,\"max\":%s,\"mean\":%s}}",
+                     device_id, (unsigned)s->qos, jboot, (unsigned long)s->first_seq, (unsigned long)s->last_seq,
+                     (unsigned long)s->count, (unsigned long)s->first_observed, (unsigned long)s->last_observed,
+                     v[0], v[1], v[2], v[3], v[4], v[5]);
+    if (n < 0 || (size_t)n >= len)
+        return -1;
+    return n;
+}
@@ -0,0 +1,120 @@
+// telemetry_record.h
+// Compact fixed-width telemetry record for the client backlog.
+//
+// A reading is stored as 16 little-endian bytes:
+//   0  seq       uint32
+//   4  observed  uint32  (dateObserved: device millis at sampling)
+//   8  temp      int16   (0.01 degC)
+//   10 hum       uint16  (0.01 %RH)
+//   12 qos       uint8
+//   13 heartbeat uint8   (advertised max silence, 10 s units; 0 = none)
+//   14 crc       uint16  (CRC-16/CCITT-FALSE over bytes 0..13)
+// and turned into the JSON wire format only when it is sent.
+//
+// When the backlog runs out of room, the oldest readings are folded into
+// summaries of 36 bytes:
+//   0  first_seq       uint32
+//   4  last_seq        uint32
+//   8  first_observed  uint32
+//   12 kind            uint8   (TELEMETRY_SUMMARY_KIND; a reading has its qos here)
+//   13 qos             uint8
+//   14 temp_mean       int16   (0.01 degC)
+//   16 last_observed   uint32
+//   20 count           uint32  (readings folded in)
+//   24 temp_min        int16
+//   26 temp_max        int16
+//   28 hum_min         uint16  (0.01 %RH)
+//   30 hum_max         uint16
+//   32 hum_mean        uint16
+//   34 crc             uint16  (CRC-16/CCITT-FALSE over bytes 0..33)
+#ifndef TELEMETRY_RECORD_H
+#define TELEMETRY_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_RECORD_SIZE 16
+#define TELEMETRY_JSON_MAX 256 // Wire payload incl. a device id of up to 48 chars and the boot id
+#define TELEMETRY_BATCH_JSON_MAX 1400 // Batch payload: one datagram within a 1500-byte MTU
+#define TELEMETRY_SUMMARY_SIZE 36
+#define TELEMETRY_SUMMARY_KIND 0x80
+#define TELEMETRY_SUMMARY_JSON_MAX 400
+
+typedef struct
+{
+    uint32_t seq;
+    uint32_t observed;
+    int16_t temp_c100;
+    uint16_t hum_c100;
+    uint8_t qos;
+    uint16_t heartbeat_s; // Max silence advertised to the server (0 = none)
+} telemetry_record_t;
+
+// Aggregate of consecutive readings (min/max/mean over count readings)
+typedef struct
+{
+    uint32_t first_seq;
+    uint32_t last_seq;
+    uint32_t first_observed;
+    uint32_t last_observed;
+    uint32_t count;
+    uint8_t qos;
+    int16_t temp_min_c100;
+    int16_t temp_max_c100;
+    int16_t temp_mean_c100;
+    uint16_t hum_min_c100;
+    uint16_t hum_max_c100;
+    uint16_t hum_mean_c100;
+} telemetry_summary_t;
+
+// Fills a record from sensor values (rounded to 0.01, clamped to the field
+// range), with no heartbeat advertised
+void telemetry_record_set(telemetry_record_t *rec, uint32_t seq, uint32_t observed,
+                          float temp, float hum, uint8_t qos);
+
+void telemetry_record_pack(const telemetry_record_t *rec, uint8_t out[TELEMETRY_RECORD_SIZE]);
+
+// Returns 0, or -1 if the CRC does not match
+int telemetry_record_unpack(const uint8_t in[TELEMETRY_RECORD_SIZE], telemetry_record_t *rec);
+
+// Writes the WeatherObserved JSON payload. boot is the sender's boot id,
+// sent as "boot" so the server can tell a reboot that restarted the seqs
+// from duplicates (0 = not sent). Returns its length, or -1 if buf is too
+// small.
+int telemetry_record_to_json(const telemetry_record_t *rec, const char *device_id, uint32_t boot,
+                             char *buf, size_t len);
+
+// Writes a WeatherObservedBatch payload holding as many of the n records as
+// fit in len bytes, in order, under a "readings" array. Sets *used to the
+// number included and returns the payload length, or -1 if none fits.
+int telemetry_batch_to_json(const telemetry_record_t *recs, int n, const char *device_id, uint32_t boot,
+                            char *buf, size_t len, int *used);
+
+// Starts a summary holding one reading
+void telemetry_summary_init(telemetry_summary_t *s, const telemetry_record_t *rec);
+
+// Folds the next (newer) reading into s
+void telemetry_summary_add(telemetry_summary_t *s, const telemetry_record_t *rec);
+
+// Folds the next (newer) summary into s
+void telemetry_summary_merge(telemetry_summary_t *s, const telemetry_summary_t *next);
+
+void telemetry_summary_pack(const telemetry_summary_t *s, uint8_t out[TELEMETRY_SUMMARY_SIZE]);
+
+// Returns 0, or -1 if in is not a valid summary
+int telemetry_summary_unpack(const uint8_t *in, size_t len, telemetry_summary_t *s);
+
+// Writes the WeatherObservedSummary JSON payload. Returns its length, or -1
+// if buf is too small.
+int telemetry_summary_to_json(const telemetry_summary_t *s, const char *device_id, uint32_t boot,
+                              char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,228 @@
+// tenant.c
+// Tenant configuration, matching and quotas. See tenant.h.
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tenant.h"
+
+void tenant_bucket_init(tenant_bucket_t *b, uint32_t per_sec, uint32_t burst_ms)
+{
+    b->cost_us = per_sec ? 1000000ull / per_sec : 0;
+    b->burst_us = (uint64_t)burst_ms * 1000;
+    b->next_us = 0;
+}
+
+void tenant_bucket_set_rate(tenant_bucket_t *b, uint32_t per_sec, uint32_t burst_ms)
+{
+    b->cost_us = per_sec ? 1000000ull / per_sec : 0;
+    b->burst_us = (uint64_t)burst_ms * 1000;
+}
+
+uint32_t tenant_bucket_take(tenant_bucket_t *b, uint64_t now_us, uint32_t n)
+{
+    if (b->cost_us == 0)
+        return 0;
+
+    // Idle capacity is saved up to the burst allowance
+    if (b->next_us + b->burst_us < now_us)
+        b->next_us = now_us - b->burst_us;
+
+    if (b->next_us > now_us)
+        return (uint32_t)((b->next_us - now_us + 999) / 1000);
+    b->next_us += n * b->cost_us;
+    return 0;
+}
+
+void tenant_bucket_refund(tenant_bucket_t *b, uint32_t n)
+{
+    uint64_t refund = n * b->cost_us;
+    b->next_us = b->next_us > refund ? b->next_us - refund : 0;
+}
+
+static int parse_double(const char *s, double *out)
+{
+    char *end;
+    errno = 0;
+    double v = strtod(s, &end);
+    if (end == s || *end || errno)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_u32(const char *s, uint32_t *out)
+{
+    char *end;
+    errno = 0;
+    unsigned long v = strtoul(s, &end, 10);
+    if (end == s || *end || errno || v > UINT32_MAX || *s == '-')
+        return -1;
+    *out = (uint32_t)v;
+    return 0;
+}
+
+static int set_string(char *dst, size_t size, const char *value)
+{
+    if (strlen(value) >= size)
+        return -1;
+    strcpy(dst, value);
+    return 0;
+}
+
+// "a.b.c.d/len"
+static int parse_network(const char *s, uint32_t *net, uint32_t *mask)
+{
+    char addr[INET_ADDRSTRLEN];
+    const char *slash = strchr(s, '/');
+    uint32_t len = 32;
+    struct in_addr in;
+
+    if (slash)
+    {
+        if ((size_t)(slash - s) >= sizeof(addr) || parse_u32(slash + 1, &len) < 0 || len > 32)
+            return -1;
+        memcpy(addr, s, (size_t)(slash - s));
+        addr[slash - s] = '\0';
+    }
+    else if (set_string(addr, sizeof(addr), s) < 0)
+        return -1;
+
+    if (inet_pton(AF_INET, addr, &in) != 1)
+        return -1;
+    *mask = len ? 0xFFFFFFFFu << (32 - len) : 0;
+    *net = ntohl(in.s_addr) & *mask;
+    return 0;
+}
+
+int tenant_config_set(tenant_config_t *c, const char *key, const char *value)
+{
+    uint32_t u;
+
+    if (strcmp(key, "match") == 0)
+        return set_string(c->match, sizeof(c->match), value);
+    if (strcmp(key, "network") == 0)
+        return parse_network(value, &c->net, &c->netmask);
+    if (strcmp(key, "port") == 0)
+    {
+        if (parse_u32(value, &u) < 0 || u > 65535)
+            return -1;
+        c->port = (int)u;
+        return 0;
+    }
+    if (strcmp(key, "topic_prefix") == 0)
+        return set_string(c->topic_prefix, sizeof(c->topic_prefix), value);
+    if (strcmp(key, "data_dir") == 0)
+        return set_string(c->data_dir, sizeof(c->data_dir), value);
+    if (strcmp(key, "temp_min") == 0)
+        return parse_double(value, &c->temp_min);
+    if (strcmp(key, "temp_max") == 0)
+        return parse_double(value, &c->temp_max);
+    if (strcmp(key, "hum_min") == 0)
+        return parse_double(value, &c->hum_min);
+    if (strcmp(key, "hum_max") == 0)
+        return parse_double(value, &c->hum_max);
+    if (strcmp(key, "temp_diff") == 0)
+        return parse_double(value, &c->temp_diff);
+    if (strcmp(key, "hum_diff") == 0)
+        return parse_double(value, &c->hum_diff);
+    if (strcmp(key, "inactivity_timeout_sec") == 0)
+    {
+        if (parse_u32(value, &u) < 0 || u > 86400)
+            return -1;
+        c->inactivity_timeout_sec = (int)u;
+        return 0;
+    }
+    if (strcmp(key, "max_devices") == 0)
+        return parse_u32(value, &c->max_devices);
+    if (strcmp(key, "readings_per_sec") == 0)
+        return parse_u32(value, &c->readings_per_sec);
+    if (strcmp(key, "burst_ms") == 0)
+        return parse_u32(value, &c->burst_ms);
+    if (strcmp(key, "alerts_per_sec") == 0)
+        return parse_u32(value, &c->alerts_per_sec);
+    if (strcmp(key, "replay_readings_per_sec") == 0)
+        return parse_u32(value, &c->replay_readings_per_sec);
+    return -1;
+}
+
+int tenant_config_check(const tenant_config_t *c, char *err, size_t errlen)
+{
+    const char *p;
+
+    // The name ends up in metric labels, topics and alert log lines
+    if (!c->name[0])
+    {
+        snprintf(err, errlen, "tenant name is empty");
+        return -1;
+    }
+    for (p = c->name; *p; ++p)
+    {
+        if (!isalnum((unsigned char)*p) && *p != '_' && *p != '-')
+        {
+            snprintf(err, errlen, "tenant name %s may only contain letters, digits, _ and -", c->name);
+            return -1;
+        }
+    }
+
+    size_t tlen = strlen(c->topic_prefix);
+    if (tlen == 0 || c->topic_prefix[tlen - 1] != '/' || strpbrk(c->topic_prefix, "#+"))
+        snprintf(err, errlen, "tenant %s: topic_prefix must end in / and contain no wildcards", c->name);
+    else if (!c->data_dir[0])
+        snprintf(err, errlen, "tenant %s: data_dir is empty", c->name);
+    else if (c->temp_min >= c->temp_max)
+        snprintf(err, errlen, "tenant %s: temp_min must be below temp_max", c->name);
+    else if (c->hum_min >= c->hum_max)
+        snprintf(err, errlen, "tenant %s: hum_min must be below hum_max", c->name);
+    else if (c->temp_diff <= 0 || c->hum_diff <= 0)
+        snprintf(err, errlen, "tenant %s: temp_diff and hum_diff must be positive", c->name);
+    else if (c->inactivity_timeout_sec <= 0)
+        snprintf(err, errlen, "tenant %s: inactivity_timeout_sec must be positive", c->name);
+    else if (c->max_devices == 0)
+        snprintf(err, errlen, "tenant %s: no device slots left (the other tenants' max_devices take all of max_devices)", c->name);
+    else if (c->readings_per_sec > 1000000 || c->alerts_per_sec > 1000000)
+        snprintf(err, errlen, "tenant %s: readings_per_sec and alerts_per_sec are at most 1000000", c->name);
+    else if (c->replay_readings_per_sec == 0 || c->replay_readings_per_sec > 1000000)
+        snprintf(err, errlen, "tenant %s: replay_readings_per_sec must be 1..1000000", c->name);
+    else
+        return 0;
+    return -1;
+}
+
+void tenant_config_write(FILE *f, const tenant_config_t *c)
+{
+    struct in_addr in = {htonl(c->net)};
+    char net[INET_ADDRSTRLEN];
+    int len = 0;
+
+    for (uint32_t m = c->netmask; m; m <<= 1)
+        len++;
+    if (!inet_ntop(AF_INET, &in, net, sizeof(net)))
+        strcpy(net, "0.0.0.0");
+
+    fprintf(f, "[tenant %s]\n", c->name);
+    fprintf(f, "match = %s\n", c->match);
+    fprintf(f, "network = %s/%d\n", net, len);
+    fprintf(f, "port = %d\n", c->port);
+    fprintf(f, "topic_prefix = %s\n", c->topic_prefix);
+    fprintf(f, "data_dir = %s\n", c->data_dir);
+    fprintf(f, "temp_min = %.10g\ntemp_max = %.10g\n", c->temp_min, c->temp_max);
+    fprintf(f, "hum_min = %.10g\nhum_max = %.10g\n", c->hum_min, c->hum_max);
+    fprintf(f, "temp_diff = %.10g\nhum_diff = %.10g\n", c->temp_diff, c->hum_diff);
+    fprintf(f, "inactivity_timeout_sec = %d\n", c->inactivity_timeout_sec);
+    fprintf(f, "max_devices = %u\n", c->max_devices);
+    fprintf(f, "readings_per_sec = %u\n", c->readings_per_sec);
+    fprintf(f, "burst_ms = %u\n", c->burst_ms);
+    fprintf(f, "alerts_per_sec = %u\n", c->alerts_per_sec);
+    fprintf(f, "replay_readings_per_sec = %u\n", c->replay_readings_per_sec);
+}
+
+int tenant_match(const tenant_config_t *t, const char *id, uint32_t addr)
+{
+    size_t len = strlen(t->match);
+    if (t->port || strncmp(id, t->match, len) != 0 || (addr & t->netmask) != t->net)
+        return -1;
+    return (int)len;
+}
@@ -0,0 +1,85 @@
+// tenant.h
+// Tenant-scoped configuration for one server shared by several groups/sites.
+//
+// A tenant owns a set of devices, its alert topic, its thresholds and its
+// quotas. Datagrams are assigned to a tenant by the UDP port they arrive on
+// (a tenant may have its own port) or, on the shared port, by the longest
+// device id prefix and source network that match. Tenants share the ingest
+// loop, the MQTT connection and the metrics endpoint; the quotas keep one
+// tenant's traffic from using up what the others need.
+//
+// Tenants are [tenant NAME] sections of the server's configuration file
+// (see config.h):
+//
+//   [tenant g05]
+//   match = G05_            # device id prefix ("" or absent = any)
+//   network = 10.5.0.0/16   # source network (absent = any)
+//   port = 5015             # own UDP port (absent = the shared one)
+//   topic_prefix = /comcs/g05/
+//   temp_max = 45
+//   readings_per_sec = 500
+#ifndef TENANT_H
+#define TENANT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TENANT_MAX 16
+#define TENANT_NAME_LEN 32
+
+typedef struct
+{
+    char name[TENANT_NAME_LEN];
+    char match[64];          // Device id prefix ("" = any)
+    uint32_t net, netmask;   // Source network, host byte order (netmask 0 = any)
+    int port;                // Own UDP port (0 = the shared port)
+    char topic_prefix[96];   // MQTT topics; alerts go to <topic_prefix>alerts
+    char data_dir[128];      // History segments (tenants reusing device ids need their own)
+    double temp_min, temp_max;
+    double hum_min, hum_max;
+    double temp_diff, hum_diff;      // Differential alert thresholds
+    int inactivity_timeout_sec;      // Added to the device's heartbeat interval
+    uint32_t max_devices;            // Devices the tenant may register (0 = a share, see config.h)
+    uint32_t readings_per_sec;       // Ingest quota (0 = unlimited)
+    uint32_t burst_ms;               // Unused ingest quota that may be saved up
+    uint32_t alerts_per_sec;         // Alerts published over MQTT (0 = unlimited)
+    uint32_t replay_readings_per_sec; // Backlog replay admitted (see replay_sched.h)
+} tenant_config_t;
+
+// Rate limiter for the quotas: a count of n takes n / per_sec seconds of
+// capacity, and up to burst_ms of unused capacity is saved up
+typedef struct
+{
+    uint64_t cost_us;  // Capacity taken by one unit (0 = unlimited)
+    uint64_t burst_us;
+    uint64_t next_us;  // Capacity is used up to this time
+} tenant_bucket_t;
+
+void tenant_bucket_init(tenant_bucket_t *b, uint32_t per_sec, uint32_t burst_ms);
+
+// Changes the rate, keeping the capacity already used
+void tenant_bucket_set_rate(tenant_bucket_t *b, uint32_t per_sec, uint32_t burst_ms);
+
+// Takes n units at now_us. Returns 0 if they fit, or the ms until they would.
+uint32_t tenant_bucket_take(tenant_bucket_t *b, uint64_t now_us, uint32_t n);
+
+// Gives back n units taken for work that was not done after all
+void tenant_bucket_refund(tenant_bucket_t *b, uint32_t n);
+
+// Sets one key from its text value. Returns 0, or -1 for an unknown key or
+// a value that does not parse.
+int tenant_config_set(tenant_config_t *c, const char *key, const char *value);
+
+// Checks a tenant's values. Returns 0, or -1 with a message in err.
+int tenant_config_check(const tenant_config_t *c, char *err, size_t errlen);
+
+// Writes the tenant as a [tenant NAME] section
+void tenant_config_write(FILE *f, const tenant_config_t *c);
+
+// Whether a datagram from device id at addr (host byte order) on the shared
+// port belongs to the tenant. Returns the length of the matched id prefix
+// (the longest one wins), or -1. Tenants with their own port never match.
+int tenant_match(const tenant_config_t *t, const char *id, uint32_t addr);
+
+#endif